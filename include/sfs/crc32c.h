@@ -0,0 +1,17 @@
+/* crc32c.h: CRC32C校验和 */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* 校验和函数 */
+
+uint32_t    crc32c(uint32_t crc, const void *data, size_t length);
+bool        crc32c_hardware(void);
+
+#endif
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,59 @@
+/* delta.h: SimpleFS 增量映像发送和接收 */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "sfs/disk.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* 增量常量 */
+
+#define DELTA_MAGIC         (0x44534653)        /* 增量文件魔数（"SFSD"） */
+#define DELTA_VERSION       (1)                 /* 增量文件格式版本 */
+#define DELTA_RUN_BLOCKS    (64)                /* 一个区间最多包含的块数（一次disk_submit） */
+
+/* 增量结构
+ *
+ * 增量文件由一个DeltaHeader、若干个DeltaRun（每个之后紧跟count个块的数据）
+ * 和一个count为0的结束标记组成（均为小端序）。结束标记的block是文件中的总块数，
+ * 用于发现被截断的文件。
+ */
+
+typedef struct DeltaHeader DeltaHeader;
+struct DeltaHeader {
+    uint32_t    magic;                          /* DELTA_MAGIC */
+    uint32_t    version;                        /* DELTA_VERSION */
+    uint32_t    block_size;                     /* 发送时的块大小 */
+    uint32_t    since;                          /* 发送的是这个检查点之后写入的块 */
+    uint32_t    until;                          /* 发送时建立的检查点（下一次增量的since） */
+    uint32_t    reserved;                       /* 保留（为0） */
+    uint64_t    blocks;                         /* 源映像的块数 */
+};
+
+typedef struct DeltaRun DeltaRun;
+struct DeltaRun {
+    uint64_t    block;                          /* 区间的第一个块（结束标记中为总块数） */
+    uint32_t    count;                          /* 区间的块数（0表示结束） */
+    uint32_t    checksum;                       /* 区间数据的CRC32C（以block为初值） */
+};
+
+typedef struct DeltaStats DeltaStats;
+struct DeltaStats {
+    uint32_t    since;                          /* 增量的起始检查点 */
+    uint32_t    until;                          /* 增量的结束检查点 */
+    size_t      runs;                           /* 区间数 */
+    size_t      blocks;                         /* 块数 */
+    size_t      bytes;                          /* 增量文件的字节数 */
+};
+
+/* 增量函数 */
+
+bool    delta_send(Disk *disk, uint32_t since, int fd, DeltaStats *stats);
+bool    delta_receive(Disk *disk, int fd, DeltaStats *stats);
+
+#endif
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,75 @@
+/* dir.h: SimpleFS 目录 */
+
+#ifndef DIR_H
+#define DIR_H
+
+#include "sfs/fs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* 目录常量 */
+
+#define FS_NAME_MAX         (255)               /* 目录项名称的最大长度 */
+
+#define DIR_MAX_DEPTH       (10)                /* 哈希表的最大全局深度（最多1<<10个桶） */
+#define DIR_TABLE_SLOTS     ((BLOCK_SIZE - 4 * sizeof(uint32_t)) / sizeof(uint16_t))
+#define DIR_BUCKET_BYTES    (BLOCK_SIZE - 2 * sizeof(uint32_t))
+
+#define DIR_TYPE_FILE       (1)                 /* 目录项指向普通文件 */
+#define DIR_TYPE_DIRECTORY  (2)                 /* 目录项指向目录 */
+
+/* 目录结构
+ *
+ * 目录是设置了INODE_DIRECTORY的inode，其内容是一个可扩展哈希表：逻辑块0是
+ * DirHeader，逻辑块1及之后是DirBucket。按名称的哈希值低depth位在表中找到桶，
+ * 因此无论目录有多少项，查找都只需读取头块和一个桶块。
+ */
+
+typedef struct DirHeader DirHeader;
+struct DirHeader {
+    uint32_t    depth;                          /* 全局深度：表中有1<<depth个槽 */
+    uint32_t    buckets;                        /* 桶的个数（桶n位于逻辑块n） */
+    uint32_t    entries;                        /* 目录项个数 */
+    uint32_t    parent;                         /* 父目录的inode编号（根目录指向自身） */
+    uint16_t    table[DIR_TABLE_SLOTS];         /* 槽 -> 桶所在的逻辑块 */
+};
+
+typedef struct DirBucket DirBucket;
+struct DirBucket {
+    uint32_t    depth;                          /* 局部深度 */
+    uint32_t    used;                           /* records中已使用的字节数 */
+    uint8_t     records[DIR_BUCKET_BYTES];      /* 紧密排列的DirRecord */
+};
+
+typedef struct DirRecord DirRecord;
+struct __attribute__((packed)) DirRecord {
+    uint32_t    inode_number;                   /* 目录项指向的inode */
+    uint8_t     type;                           /* 目录项类型（DIR_TYPE_*） */
+    uint8_t     length;                         /* 名称长度（不含结尾的NUL） */
+    char        name[];                         /* 名称 */
+};
+
+typedef struct DirEntry DirEntry;
+struct DirEntry {
+    uint32_t    inode_number;                   /* 目录项指向的inode */
+    uint8_t     type;                           /* 目录项类型（DIR_TYPE_*） */
+    char        name[FS_NAME_MAX + 1];          /* 以NUL结尾的名称 */
+};
+
+/* 目录函数 */
+
+ssize_t fs_root(FileSystem *fs);
+ssize_t fs_lookup(FileSystem *fs, size_t dir, const char *name);
+ssize_t fs_mkdir(FileSystem *fs, size_t dir, const char *name);
+bool    fs_link(FileSystem *fs, size_t dir, const char *name, size_t inode_number);
+bool    fs_unlink(FileSystem *fs, size_t dir, const char *name);
+int     fs_readdir(FileSystem *fs, size_t dir, size_t *cookie, DirEntry *entry);
+
+ssize_t fs_resolve(FileSystem *fs, const char *path);
+ssize_t fs_resolve_parent(FileSystem *fs, const char *path, char *name);
+
+#endif
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -3,16 +3,45 @@
 #ifndef DISK_H
 #define DISK_H
 
+#include "sfs/model.h"
+#include "sfs/stats.h"
+#include "sfs/trace.h"
+
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 /* 磁盘常量 */
 
 #define BLOCK_SIZE      (1<<12)
 #define DISK_FAILURE    (-1)
+#define DISK_QUEUE_MERGE (64)   /* 一次向量I/O最多合并的相邻块数 */
+#define DISK_STRIPE_DEFAULT (16) /* 默认的条带单元（块数） */
 
 /* 磁盘结构 */
 
+typedef struct DiskOptions DiskOptions;
+
+struct DiskOptions {
+    bool    checksums;  /* 是否维护并校验每个块的CRC32C校验和 */
+    const char *trace;  /* 记录每次disk_read/disk_write的跟踪文件（NULL表示不记录） */
+    ModelOptions model; /* 模拟的延迟模型（默认不模拟） */
+    size_t  stripe;     /* 多个映像组成条带磁盘时的条带单元（块数，0表示DISK_STRIPE_DEFAULT） */
+    bool    mirror;     /* 多个映像组成镜像磁盘而不是条带磁盘 */
+    bool    discard;    /* 文件系统释放块时在映像中打洞（见disk_discard） */
+    bool    track;      /* 记录每个块最后一次被写入时的代数（见disk_checkpoint） */
+};
+
+typedef struct DiskRequest DiskRequest;
+
+struct DiskRequest {
+    size_t  block;      /* 块编号 */
+    bool    write;      /* 是否是写入 */
+    char   *data;       /* 数据缓冲区（BLOCK_SIZE字节） */
+    ssize_t result;     /* 完成后设置：BLOCK_SIZE或DISK_FAILURE */
+};
+
 typedef struct Disk Disk;
 
 struct Disk {
@@ -20,15 +49,53 @@ struct Disk {
     size_t  blocks;     /* 磁盘映像中的块数 */
     size_t  reads;      /* 从磁盘映像中读取的次数	*/
     size_t  writes;     /*  写入磁盘映像的次数	*/
+
+    uint32_t   *checksums;          /* 每个块的校验和（未启用时为NULL） */
+    int         checksum_fd;        /* 校验和文件（<path>.crc）的文件描述符 */
+    size_t      checksum_errors;    /* 读取时校验失败的次数 */
+
+    Stats       stats;              /* disk_read/disk_write的调用次数、字节数和延迟 */
+    Trace      *trace;              /* 块I/O跟踪（未启用时为NULL） */
+    Model      *model;              /* 延迟模型（未启用时为NULL） */
+    uint64_t    simulated;          /* 延迟模型模拟的总耗时（纳秒） */
+    size_t      inflight;           /* 正在进行的disk_read/disk_write数（延迟模型的队列深度） */
+    size_t      head;               /* 上次访问的块之后的块（请求队列的电梯起点） */
+    uint64_t    seek_distance;      /* 相邻两次访问之间的块距离之和 */
+
+    Disk      **members;            /* 条带或镜像的成员磁盘（单个映像时为NULL） */
+    size_t      member_count;       /* 成员磁盘数 */
+    size_t      stripe;             /* 条带单元（块数） */
+    bool        mirrored;           /* 成员是彼此的副本（镜像磁盘） */
+    bool        stale;              /* 作为镜像副本时：写入失败而落后于其他副本，需要disk_resync */
+
+    bool        discard;            /* 文件系统是否应该对释放的块调用disk_discard */
+    size_t      discards;           /* disk_discard释放的块数 */
+
+    uint32_t   *generations;        /* 每个块最后一次被写入时的代数（未跟踪时为NULL） */
+    uint32_t    generation;         /* 当前代数：之后写入的块记录为这个代数 */
+    int         generation_fd;      /* 代数文件（<path>.gen）的文件描述符 */
 }; 
 
 /* 磁盘函数 */
 
 Disk *	disk_open(const char *path, size_t blocks);
+Disk *	disk_open_with(const char *path, size_t blocks, const DiskOptions *options);
+Disk *	disk_open_striped(const char *const *paths, size_t count, size_t blocks, const DiskOptions *options);
+Disk *	disk_open_mirrored(const char *const *paths, size_t count, size_t blocks, const DiskOptions *options);
+Disk *	disk_open_list(const char *list, size_t blocks, const DiskOptions *options);
 void	disk_close(Disk *disk);
 
 ssize_t	disk_read(Disk *disk, size_t block, char *data);
 ssize_t	disk_write(Disk *disk, size_t block, char *data);
+ssize_t	disk_submit(Disk *disk, DiskRequest *requests, size_t count);
+
+ssize_t	disk_copy_out(Disk *disk, size_t block, size_t count, int fd, off_t offset);
+ssize_t	disk_copy_in(Disk *disk, size_t block, size_t count, int fd, off_t offset);
+ssize_t	disk_discard(Disk *disk, size_t block, size_t count);
+ssize_t	disk_checkpoint(Disk *disk);
+
+ssize_t	disk_verify(Disk *disk, size_t threads);
+ssize_t	disk_resync(Disk *disk, size_t replica);
 
 #endif
 
@@ -5,16 +5,47 @@
 
 #include "sfs/disk.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 
 /* 文件系统常量 */
 
 #define MAGIC_NUMBER        (0xf0f03410)
-#define INODES_PER_BLOCK    (128)               /* TODO: 每个块中的inode数 */
-#define POINTERS_PER_INODE  (5)                 /* TODO:  每个inode的直接指针数  */
-#define POINTERS_PER_BLOCK  (1024)              /* TODO: 每个块中的指针数 */
+#define INODES_PER_BLOCK    (128)               /* 默认几何（4K块、32字节inode）下每个块中的inode数 */
+#define POINTERS_PER_INODE  (5)                 /* 每个inode的直接指针数 */
+#define POINTERS_PER_BLOCK  (1024)              /* 默认几何下每个块中的指针数 */
+
+#define FS_BLOCK_SIZE_MIN   (BLOCK_SIZE)        /* 文件系统块大小的下限（一个磁盘块） */
+#define FS_BLOCK_SIZE_MAX   (1<<16)             /* 文件系统块大小的上限 */
+#define FS_INODE_SIZE_MIN   (32)                /* inode大小的下限（sizeof(Inode)） */
+#define FS_INODE_SIZE_MAX   (1024)              /* inode大小的上限（超出Inode的部分保留） */
+#define FS_LARGE_INODE_SIZE (64)                /* FS_LARGE文件系统的最小（默认）inode大小 */
+#define FS_MAP_CACHE        (8)                 /* 二级和三级间接树的指针块缓存项数 */
+#define FS_GROUP_BLOCKS     (1<<15)             /* 默认每个分配组的块数 */
+#define FS_INODE_CHUNKS     (1000)              /* inode块映射的项数（超级块必须放进一个磁盘块） */
+#define FS_VIEW_PAGES       (64)                /* 读取视图缓存的页数（每页一个文件系统块），也是一个视图最多覆盖的块数 */
+#define FS_DISCARD_BATCH    (1024)              /* 打洞模式下积累多少个已释放块后合并成区间一起打洞 */
+
+#define FS_COMPRESS         (1<<0)              /* 超级块标志：新建文件默认压缩 */
+#define FS_DEDUP            (1<<1)              /* 超级块标志：按内容去重数据块 */
+#define FS_NAMESPACE        (1<<2)              /* 超级块标志：已创建根目录（root有效） */
+#define FS_LARGE            (1<<3)              /* 超级块标志：inode带有扩展字段（64位文件大小、二级和三级间接块） */
+#define FS_GROUPS           (1<<4)              /* 超级块标志：磁盘划分为分配组，每组有自己的inode片段和数据区 */
+#define FS_INODE_MAP        (1<<5)              /* 超级块标志：inode表按需分块增长，各块的位置记录在inode块映射中 */
+#define FS_FEATURES         (FS_COMPRESS | FS_DEDUP | FS_NAMESPACE | FS_LARGE | FS_GROUPS | FS_INODE_MAP)  /* 本版本能够挂载的全部标志 */
+
+#define INODE_COMPRESSED    (1<<0)              /* inode标志：文件数据按组压缩存储 */
+#define INODE_DIRECTORY     (1<<1)              /* inode标志：inode是目录（见dir.h） */
+
+#define INSPECT_MAGIC       (0x49534653)        /* 二进制检查记录流的魔数（"SFSI"） */
+#define INSPECT_VERSION     (1)                 /* 二进制检查记录流的格式版本 */
+
+#define COMPRESS_GROUP      (4)                 /* 每个压缩组包含的逻辑块数 */
+#define COMPRESSED_MARK     (0x80000000)        /* 压缩组最后一个指针槽：标记 | 压缩后字节数 */
 
 /* 文件系统结构 */
 
@@ -22,37 +53,238 @@ typedef struct SuperBlock SuperBlock;
 struct SuperBlock {
     uint32_t    magic_number;                   /* 文件系统魔数 */
     uint32_t    blocks;                         /* 文件系统中的块数 */
-    uint32_t    inode_blocks;                   /* 用于存储inode的保留块数 */
+    uint32_t    inode_blocks;                   /* 用于存储inode的块数（设置FS_INODE_MAP时随inode表增长） */
     uint32_t    inodes;                         /* 文件系统中的inode的个数 */
+    uint32_t    flags;                          /* 文件系统标志（FS_*） */
+    uint32_t    dedup_blocks;                   /* 用于存储内容哈希的块数（在inode表之后；分组时在超级块之后） */
+    uint32_t    root;                           /* 根目录的inode编号（设置FS_NAMESPACE时有效） */
+    uint32_t    block_size;                     /* 文件系统块大小（0表示BLOCK_SIZE） */
+    uint32_t    inode_size;                     /* inode表中每个inode占用的字节数（0表示32） */
+    uint32_t    group_blocks;                   /* 每个分配组的块数（设置FS_GROUPS时有效，最后一组可能更长） */
+    uint32_t    group_inode_blocks;             /* 每个分配组开头的inode块数（设置FS_GROUPS时有效，设置FS_INODE_MAP时为0） */
+    uint32_t    inode_chunks;                   /* 已分配的inode块组数（设置FS_INODE_MAP时有效） */
+    uint32_t    chunk_blocks;                   /* 每个inode块组包含的连续inode块数（设置FS_INODE_MAP时有效） */
+    uint32_t    inode_map[FS_INODE_CHUNKS];     /* 每个inode块组的第一个块（设置FS_INODE_MAP时有效） */
+    uint32_t    free_block_count;               /* 上次修改后卸载时的空闲数据块数（0表示未记录） */
+    uint32_t    free_inode_count;               /* 上次修改后卸载时的空闲inode数 */
 };
 
 typedef struct Inode      Inode;
 struct Inode {
-    uint32_t    valid;                          /* inode是否有效 */
+    uint8_t     valid;                          /* inode是否有效 */
+    uint8_t     flags;                          /* inode标志（INODE_*） */
+    uint16_t    links;                          /* 引用该inode的目录项数 */
     uint32_t    size;                           /* 文件大小 */
     uint32_t    direct[POINTERS_PER_INODE];     /* 直接指针 */
     uint32_t    indirect;                       /* 间接指针 */
 };
 
-typedef union  Block      Block;
+typedef struct InodeExtension InodeExtension;
+struct InodeExtension {                         /* FS_LARGE文件系统中紧跟在Inode之后 */
+    uint32_t    size_high;                      /* 文件大小的高32位 */
+    uint32_t    double_indirect;                /* 二级间接指针 */
+    uint32_t    triple_indirect;                /* 三级间接指针 */
+    uint32_t    reserved[5];                    /* 保留 */
+};
+
+typedef union  Block      Block;               /* 按最大块大小定义，只使用前block_size字节 */
 union Block {
     SuperBlock  super;                          /* 将块视为超级块 */
-    Inode       inodes[INODES_PER_BLOCK];       /* 将块视为inode表 */
-    uint32_t    pointers[POINTERS_PER_BLOCK];   /* 将块视为指针 */
-    char        data[BLOCK_SIZE];               /* 将块视为数据 */
+    Inode       inodes[FS_BLOCK_SIZE_MAX / FS_INODE_SIZE_MIN];      /* 将块视为inode表（inode_size为32时） */
+    uint32_t    pointers[FS_BLOCK_SIZE_MAX / sizeof(uint32_t)];     /* 将块视为指针 */
+    char        data[FS_BLOCK_SIZE_MAX];                            /* 将块视为数据 */
+};
+
+typedef struct GroupCache GroupCache;
+struct GroupCache {
+    bool        valid;                          /* 缓存是否有效 */
+    uint32_t    inode_number;                   /* 缓存的压缩组所属的inode */
+    uint32_t    group;                          /* 缓存的压缩组序号 */
+    char       *data;                           /* 解压后的压缩组数据（挂载时按块大小分配） */
+    char       *packed;                         /* 压缩数据的缓冲区（与data同时分配） */
+};
+
+typedef struct MapCache MapCache;
+struct MapCache {
+    uint32_t    blocks[FS_MAP_CACHE];           /* 缓存的指针块号（0表示空闲） */
+    bool        touched[FS_MAP_CACHE];          /* 是否为修改而访问过（需要写回） */
+    uint64_t    used[FS_MAP_CACHE];             /* 最近一次访问的时间（按LRU替换） */
+    uint64_t    clock;                          /* 访问计数 */
+    char       *data;                           /* FS_MAP_CACHE个块的数据（挂载FS_LARGE文件系统时分配） */
+};
+
+typedef struct AllocGroup AllocGroup;
+struct AllocGroup {
+    size_t          data;                       /* 组内第一个数据块（inode片段之后） */
+    size_t          end;                        /* 组的最后一个块之后的块 */
+    size_t          free;                       /* 组内空闲的数据块数 */
+    size_t          extent;                     /* 组内最长的空闲区间（块数，extent_stale时需要重新扫描） */
+    bool            extent_stale;               /* 上次扫描之后组内是否分配或释放过块 */
+    pthread_mutex_t lock;                       /* 保护组内的空闲块位图、计数和最长空闲区间 */
+};
+
+typedef struct DiscardQueue DiscardQueue;
+struct DiscardQueue {
+    size_t         *blocks;                     /* 已释放、等待打洞后才变为空闲的块（未启用打洞时为NULL） */
+    size_t          count;                      /* blocks中的块数（不超过FS_DISCARD_BATCH） */
+    pthread_mutex_t lock;                       /* 保护blocks和count（先于分配组的锁获取） */
+};
+
+typedef struct ViewPage ViewPage;
+struct ViewPage {
+    bool        valid;                          /* 页的内容是否仍是(inode_number, index)的当前数据（失效的页不再被查找到） */
+    uint32_t    inode_number;                   /* 页所属的inode */
+    uint64_t    index;                          /* 页对应的文件逻辑块号 */
+    uint32_t    refs;                           /* 引用该页的视图数（大于0时不会被替换） */
+    uint64_t    used;                           /* 最近一次被视图引用的时间（按LRU替换） */
+    char       *data;                           /* 块数据（第一次使用时按块大小分配） */
+};
+
+typedef struct ViewCache ViewCache;
+struct ViewCache {
+    ViewPage        pages[FS_VIEW_PAGES];       /* 缓存页 */
+    uint64_t        clock;                      /* 引用计数 */
+    pthread_mutex_t lock;                       /* 保护缓存页的查找、替换和引用计数 */
+};
+
+typedef struct FsView FsView;
+struct FsView {
+    struct iovec    iov[FS_VIEW_PAGES];         /* 按文件顺序指向缓存页中数据的只读区间 */
+    size_t          count;                      /* iov的项数 */
+    size_t          length;                     /* 视图覆盖的字节数 */
+    ViewPage       *pages[FS_VIEW_PAGES];       /* 视图固定的缓存页（与iov一一对应） */
+};
+
+typedef struct DedupIndex DedupIndex;
+struct DedupIndex {
+    uint32_t    *hashes;                        /* 每个块的内容哈希（0表示未索引），持久化在哈希块中 */
+    uint32_t    *refcounts;                     /* 每个块的引用计数（挂载时根据块指针重新计算） */
+    uint32_t    *buckets;                       /* 哈希桶：桶中的第一个块 */
+    uint32_t    *next;                          /* 同一个哈希桶中的下一个块 */
+    size_t       mask;                          /* 哈希桶数减一 */
+    bool        *dirty;                         /* 需要写回的哈希块 */
+};
+
+typedef struct DedupStats DedupStats;
+struct DedupStats {
+    size_t      logical_blocks;                 /* 文件引用的数据块总数 */
+    size_t      physical_blocks;                /* 实际占用的数据块数 */
+    size_t      shared_blocks;                  /* 被多次引用的数据块数 */
+};
+
+typedef struct SpaceStats SpaceStats;
+struct SpaceStats {
+    size_t      block_size;                     /* 文件系统块大小（字节） */
+    size_t      total_blocks;                   /* 文件系统中的块数 */
+    size_t      data_blocks;                    /* 可以分配给文件的块数 */
+    size_t      free_blocks;                    /* 空闲的数据块数 */
+    size_t      largest_extent;                 /* 最长的连续空闲块数（区间不跨越分配组，与fs_fallocate相同） */
+    size_t      total_inodes;                   /* inode表中的inode数（inode表按需增长时为当前大小） */
+    size_t      free_inodes;                    /* inode表中空闲的inode数 */
+};
+
+typedef struct InspectOptions InspectOptions;
+struct InspectOptions {
+    size_t      threads;                        /* 扫描inode表的线程数（0表示1，超过要扫描的批数时减少） */
+    size_t      first_inode;                    /* 只报告编号不小于它的inode */
+    size_t      end_inode;                      /* 只报告编号小于它的inode（0表示不限） */
+    size_t      min_size;                       /* 只报告不小于它的文件（字节） */
+    size_t      end_size;                       /* 只报告小于它的文件（0表示不限） */
+    bool        extents;                        /* 是否输出每个文件的块区间列表 */
+    bool        binary;                         /* 输出二进制记录而不是JSON行 */
+};
+
+/* 二进制检查记录流由一个InspectHeader和之后的若干个InspectRecord组成（均为小端序），
+ * 每个InspectRecord之后紧跟listed个InspectExtent。 */
+
+typedef struct InspectHeader InspectHeader;
+struct InspectHeader {
+    uint32_t    magic;                          /* INSPECT_MAGIC */
+    uint32_t    version;                        /* INSPECT_VERSION */
+    uint32_t    block_size;                     /* 文件系统块大小 */
+    uint32_t    reserved;                       /* 保留（为0） */
+    uint64_t    inodes;                         /* inode表中的inode数 */
+};
+
+typedef struct InspectRecord InspectRecord;
+struct InspectRecord {
+    uint64_t    inode;                          /* inode编号 */
+    uint64_t    size;                           /* 文件大小 */
+    uint32_t    flags;                          /* inode标志（INODE_*） */
+    uint32_t    links;                          /* 引用该inode的目录项数 */
+    uint64_t    blocks;                         /* 数据块数 */
+    uint64_t    indirect_blocks;                /* 间接块数 */
+    uint64_t    extents;                        /* 数据块按文件顺序组成的连续区间数 */
+    uint64_t    listed;                         /* 之后紧跟的InspectExtent数（未请求区间列表时为0） */
+};
+
+typedef struct InspectExtent InspectExtent;
+struct InspectExtent {
+    uint64_t    start;                          /* 区间的第一个块 */
+    uint64_t    length;                         /* 区间的块数 */
 };
 
+typedef struct FsRequest FsRequest;
+typedef void (*FsCallback)(FsRequest *request);
+struct FsRequest {                              /* 异步读写请求（由调用者分配，完成之前不能修改或释放） */
+    size_t      inode_number;                   /* 要读写的inode */
+    char       *data;                           /* 数据缓冲区 */
+    size_t      length;                         /* 要读写的字节数 */
+    size_t      offset;                         /* 读写的字节偏移 */
+    FsCallback  callback;                       /* 完成时在I/O引擎线程中调用，可以释放或重新提交请求（NULL表示放入完成队列，由fs_async_reap取回） */
+    void       *context;                        /* 调用者的数据 */
+    bool        write;                          /* 是否是写入（由fs_read_async/fs_write_async设置） */
+    ssize_t     result;                         /* 完成后设置：与fs_read/fs_write的返回值相同 */
+    uint64_t    submitted;                      /* 提交的时间（统计从提交到完成的延迟） */
+    FsRequest  *next;                           /* 所在队列中的下一个请求 */
+};
+
+typedef struct FsEngine FsEngine;               /* 执行异步请求的I/O引擎线程（见fs.c） */
+
 typedef struct FileSystem FileSystem;
 struct FileSystem {
     Disk        *disk;                          /* 挂载文件系统的磁盘 */
-    bool        *free_blocks;                   /* 空闲块位图  */
+    bool        *free_blocks;                   /* 空闲块位图（按分配组划分，每组的部分由组的锁保护） */
+    AllocGroup  *groups;                        /* 分配组（未分组的文件系统视为一组） */
+    size_t       group_count;                   /* 分配组数 */
     SuperBlock   meta_data;                     /* 文件系统元数据 */
+    size_t       block_size;                    /* 文件系统块大小（字节） */
+    size_t       block_shift;                   /* log2(block_size) */
+    size_t       sectors;                       /* 每个文件系统块占用的磁盘块数 */
+    size_t       inode_size;                    /* 每个inode占用的字节数 */
+    size_t       inodes_per_block;              /* 每个inode块中的inode数 */
+    size_t       inode_shift;                   /* log2(inodes_per_block) */
+    size_t       pointers_per_block;            /* 每个间接块中的指针数 */
+    GroupCache   cache;                         /* 最近访问的解压缩组 */
+    MapCache     map_cache;                     /* 当前操作的文件的二级和三级间接块 */
+    ViewCache    views;                         /* fs_read_view返回的缓存页 */
+    DedupIndex   dedup;                         /* 去重索引（未启用时全部为NULL） */
+    DiscardQueue discards;                      /* 等待打洞的已释放块（磁盘以discard选项打开时启用） */
+    size_t       inode_hint;                    /* 编号小于它的inode都已被使用 */
+    size_t       free_inodes;                   /* inode表中空闲的inode数（随创建、删除和增长更新） */
+    Stats        stats;                         /* 文件系统各入口函数的统计（不受挂载影响） */
+    StatsDumper *dumper;                        /* 定期输出指标文件的线程（未启用时为NULL） */
+    FsEngine    *engine;                        /* 异步I/O引擎（第一次提交异步请求时启动，未启动时为NULL） */
+};
+
+typedef struct FormatOptions FormatOptions;
+struct FormatOptions {
+    bool        compress;                       /* 新建文件是否默认压缩 */
+    bool        dedup;                          /* 是否按内容去重数据块 */
+    size_t      block_size;                     /* 文件系统块大小：BLOCK_SIZE的2的幂倍，不超过64K（0表示BLOCK_SIZE） */
+    size_t      inode_size;                     /* inode大小：32到1024之间的2的幂（0表示32，large时为64） */
+    bool        large;                          /* 是否支持64位文件大小和多级间接块 */
+    size_t      group_blocks;                   /* 每个分配组的块数（0表示FS_GROUP_BLOCKS） */
+    bool        fixed_inodes;                   /* 是否在每个分配组开头预留inode表（否则inode表按需增长） */
 };
 
 /* 文件系统函数 */
 
 void    fs_debug(Disk *disk);
+ssize_t fs_inspect(Disk *disk, const InspectOptions *options, FILE *stream);
+bool    fs_inspect_parse(const char *spec, InspectOptions *options);
 bool    fs_format(FileSystem *fs, Disk *disk);
+bool    fs_format_with(FileSystem *fs, Disk *disk, const FormatOptions *options);
 
 bool    fs_mount(FileSystem *fs, Disk *disk);
 void    fs_unmount(FileSystem *fs);
@@ -61,9 +293,36 @@ ssize_t fs_create(FileSystem *fs);
 bool    fs_remove(FileSystem *fs, size_t inode_number);
 ssize_t fs_stat(FileSystem *fs, size_t inode_number);
 
+ssize_t fs_create_many(FileSystem *fs, size_t *inodes, size_t count);
+ssize_t fs_remove_many(FileSystem *fs, const size_t *inodes, size_t count);
+
 ssize_t fs_read(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset);
 ssize_t fs_write(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset);
 
+ssize_t fs_read_view(FileSystem *fs, size_t inode_number, FsView *view, size_t length, size_t offset);
+void    fs_release_view(FileSystem *fs, FsView *view);
+
+bool    fs_read_async(FileSystem *fs, FsRequest *request);
+bool    fs_write_async(FileSystem *fs, FsRequest *request);
+FsRequest *fs_async_reap(FileSystem *fs, bool wait);
+
+bool    fs_truncate(FileSystem *fs, size_t inode_number, size_t size);
+bool    fs_fallocate(FileSystem *fs, size_t inode_number, size_t offset, size_t length);
+bool    fs_set_compression(FileSystem *fs, size_t inode_number, bool enabled);
+bool    fs_dedup_stats(FileSystem *fs, DedupStats *stats);
+bool    fs_statfs(FileSystem *fs, SpaceStats *stats);
+ssize_t fs_trim(FileSystem *fs);
+
+ssize_t fs_copyin(FileSystem *fs, size_t inode_number, int fd);
+ssize_t fs_copyout(FileSystem *fs, size_t inode_number, int fd);
+
+/* 统计函数（stats.c） */
+
+void    fs_stats(FileSystem *fs, Stats *stats);
+void    fs_stats_reset(FileSystem *fs);
+bool    fs_stats_start(FileSystem *fs, const char *path, unsigned int interval);
+void    fs_stats_stop(FileSystem *fs);
+
 #endif
 
 /* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
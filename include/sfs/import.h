@@ -0,0 +1,39 @@
+/* import.h: SimpleFS 批量导入 */
+
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include "sfs/fs.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* 导入常量 */
+
+#define IMPORT_CHUNK_SIZE   (1<<20)             /* 读取线程每次读取、文件系统每次写入的最大字节数 */
+#define IMPORT_QUEUE_DEPTH  (4)                 /* 每个读取线程在队列中最多积压的数据块数 */
+
+/* 导入结构 */
+
+typedef struct ImportOptions ImportOptions;
+struct ImportOptions {
+    size_t      threads;                        /* 读取线程数（0表示使用CPU个数） */
+    FILE       *manifest;                       /* 输出"inode<TAB>路径"清单（NULL表示不输出） */
+};
+
+typedef struct ImportStats ImportStats;
+struct ImportStats {
+    size_t      files;                          /* 导入的文件数 */
+    size_t      directories;                    /* 创建的目录数 */
+    size_t      bytes;                          /* 写入的字节数 */
+    size_t      skipped;                        /* 跳过的非普通文件数 */
+    size_t      errors;                         /* 失败的文件或目录数 */
+};
+
+/* 导入函数 */
+
+bool    fs_import(FileSystem *fs, const char *host_path, size_t dir, const ImportOptions *options, ImportStats *stats);
+
+#endif
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
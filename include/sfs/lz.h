@@ -0,0 +1,21 @@
+/* lz.h: LZ压缩编解码器 */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+/* 编解码器常量 */
+
+#define LZ_MIN_MATCH    (4)                     /* 最短匹配长度 */
+#define LZ_MAX_OFFSET   (65535)                 /* 最大回溯距离 */
+
+/* 编解码器函数 */
+
+size_t  lz_compress(const char *src, size_t length, char *dst, size_t capacity);
+ssize_t lz_decompress(const char *src, size_t length, char *dst, size_t capacity);
+
+#endif
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
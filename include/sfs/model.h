@@ -0,0 +1,53 @@
+/* model.h: SimpleFS 磁盘延迟模型 */
+
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* 模型常量 */
+
+#define MODEL_HDD_RPM           (7200)          /* HDD：默认转速 */
+#define MODEL_HDD_SEEK_MIN      (500000)        /* HDD：相邻磁道寻道时间（纳秒） */
+#define MODEL_HDD_SEEK_MAX      (15000000)      /* HDD：全行程寻道时间（纳秒） */
+#define MODEL_HDD_TRANSFER      (150)           /* HDD：传输速率（MB/s） */
+#define MODEL_HDD_TRACK_BLOCKS  (256)           /* HDD：每个磁道的块数 */
+
+#define MODEL_SSD_READ          (80000)         /* SSD：读取一页的时间（纳秒） */
+#define MODEL_SSD_WRITE         (30000)         /* SSD：写入一页的时间（纳秒） */
+#define MODEL_SSD_ERASE         (2000000)       /* SSD：擦除一个擦除块的时间（纳秒） */
+#define MODEL_SSD_ERASE_BLOCKS  (256)           /* SSD：每个擦除块的页数 */
+#define MODEL_SSD_CHANNELS      (8)             /* SSD：默认并行通道数 */
+
+#define MODEL_CONSTANT          (100)           /* 常量模型：默认每次操作的微秒数 */
+
+/* 模型结构 */
+
+typedef enum {
+    MODEL_NONE,                                 /* 不模拟延迟 */
+    MODEL_CONSTANT_LATENCY,                     /* 每次操作固定延迟 */
+    MODEL_HDD,                                  /* 机械硬盘：寻道、旋转和传输 */
+    MODEL_SSD,                                  /* 固态硬盘：队列深度和擦除块 */
+} ModelType;
+
+typedef struct ModelOptions ModelOptions;
+struct ModelOptions {
+    ModelType   type;                           /* 模型类型 */
+    uint32_t    parameter;                      /* 常量：微秒；HDD：转速；SSD：通道数（0表示默认值） */
+    bool        sleep;                          /* 是否真正睡眠模拟的时间（否则只计入时钟） */
+};
+
+typedef struct Model Model;                     /* 模型状态（见model.c） */
+
+/* 模型函数 */
+
+bool        model_parse(const char *spec, ModelOptions *options);
+Model *     model_open(const ModelOptions *options, size_t blocks);
+uint64_t    model_access(Model *model, bool write, size_t block, size_t depth);
+void        model_close(Model *model);
+
+#endif
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
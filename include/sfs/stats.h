@@ -0,0 +1,80 @@
+/* stats.h: SimpleFS 运行统计 */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* 统计常量 */
+
+#define STATS_BUCKETS       (40)                /* 延迟直方图的桶数：桶i统计[2^(i-1), 2^i)纳秒 */
+
+/* 统计结构 */
+
+typedef enum {
+    STATS_DISK_READ,
+    STATS_DISK_WRITE,
+    STATS_FS_FORMAT,
+    STATS_FS_MOUNT,
+    STATS_FS_CREATE,
+    STATS_FS_REMOVE,
+    STATS_FS_CREATE_MANY,
+    STATS_FS_REMOVE_MANY,
+    STATS_FS_TRIM,
+    STATS_FS_STATFS,
+    STATS_FS_STAT,
+    STATS_FS_READ,
+    STATS_FS_READ_VIEW,
+    STATS_FS_READ_ASYNC,
+    STATS_FS_WRITE_ASYNC,
+    STATS_FS_WRITE,
+    STATS_FS_TRUNCATE,
+    STATS_FS_FALLOCATE,
+    STATS_FS_SET_COMPRESSION,
+    STATS_FS_COPYIN,
+    STATS_FS_COPYOUT,
+    STATS_FS_LOOKUP,
+    STATS_FS_MKDIR,
+    STATS_FS_LINK,
+    STATS_FS_UNLINK,
+    STATS_FS_READDIR,
+    STATS_FS_RESOLVE,
+    STATS_FS_IMPORT,
+    STATS_OPERATIONS,
+} StatsOperation;
+
+typedef struct StatsCounter StatsCounter;
+struct StatsCounter {
+    uint64_t    calls;                          /* 调用次数 */
+    uint64_t    errors;                         /* 失败次数 */
+    uint64_t    bytes;                          /* 读写的字节数 */
+    uint64_t    nanoseconds;                    /* 总耗时 */
+    uint64_t    histogram[STATS_BUCKETS];       /* 按2的幂分桶的延迟直方图 */
+};
+
+typedef struct Stats Stats;
+struct Stats {
+    StatsCounter counters[STATS_OPERATIONS];    /* 每种操作的计数器 */
+};
+
+typedef struct StatsDumper StatsDumper;         /* 定期输出指标文件的线程（见stats.c） */
+
+/* 统计函数 */
+
+uint64_t    stats_now(void);
+void        stats_advance(uint64_t nanoseconds);
+void        stats_record(Stats *stats, StatsOperation operation, uint64_t start, bool success, size_t bytes);
+void        stats_snapshot(const Stats *stats, Stats *snapshot);
+void        stats_merge(Stats *target, const Stats *source);
+void        stats_reset(Stats *stats);
+const char *stats_name(StatsOperation operation);
+uint64_t    stats_percentile(const StatsCounter *counter, double percentile);
+void        stats_print(const Stats *stats, FILE *stream);
+void        stats_write_metrics(const Stats *stats, FILE *stream);
+
+#endif
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
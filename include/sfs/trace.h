@@ -0,0 +1,56 @@
+/* trace.h: SimpleFS 块I/O跟踪 */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* 跟踪常量 */
+
+#define TRACE_MAGIC         (0x52544653)        /* 跟踪文件魔数（"SFTR"） */
+#define TRACE_VERSION       (1)                 /* 跟踪文件格式版本 */
+#define TRACE_BUFFER        (4096)              /* 写入文件前在内存中缓冲的记录数 */
+
+#define TRACE_READ          (0)                 /* 记录类型：disk_read */
+#define TRACE_WRITE         (1)                 /* 记录类型：disk_write */
+
+/* 跟踪结构
+ *
+ * 跟踪文件由一个TraceHeader和之后紧密排列的TraceRecord组成（均为小端序）。
+ */
+
+typedef struct TraceHeader TraceHeader;
+struct TraceHeader {
+    uint32_t    magic;                          /* TRACE_MAGIC */
+    uint32_t    version;                        /* TRACE_VERSION */
+    uint32_t    block_size;                     /* 记录时的块大小 */
+    uint32_t    reserved;                       /* 保留（为0） */
+    uint64_t    blocks;                         /* 记录时磁盘的块数 */
+};
+
+typedef struct TraceRecord TraceRecord;
+struct __attribute__((packed)) TraceRecord {
+    uint64_t    timestamp;                      /* 操作开始的时间（相对于跟踪开始的纳秒） */
+    uint32_t    block;                          /* 块编号 */
+    uint32_t    latency;                        /* 操作耗时（纳秒，超过UINT32_MAX时取UINT32_MAX） */
+    uint8_t     operation;                      /* TRACE_READ或TRACE_WRITE */
+    uint8_t     status;                         /* 0表示成功，1表示失败 */
+};
+
+typedef struct Trace Trace;                     /* 正在记录的跟踪文件（见trace.c） */
+
+/* 跟踪函数 */
+
+Trace * trace_open(const char *path, size_t blocks);
+void    trace_record(Trace *trace, uint8_t operation, size_t block, uint64_t start, bool success);
+bool    trace_close(Trace *trace);
+
+bool    trace_read_header(FILE *stream, TraceHeader *header);
+bool    trace_read(FILE *stream, TraceRecord *record);
+
+#endif
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,133 @@
+/* crc32c.c: CRC32C校验和 */
+
+#include "sfs/crc32c.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/* 内部常量 */
+
+#define CRC32C_POLY     (0x82f63b78)            /* Castagnoli多项式（反射形式） */
+
+/* 内部属性 */
+
+static uint32_t         crc32c_table[8][256];   /* 软件实现的slice-by-8查找表 */
+static uint32_t       (*crc32c_impl)(uint32_t, const unsigned char *, size_t);
+static pthread_once_t   crc32c_once = PTHREAD_ONCE_INIT;
+
+/* 内部函数 */
+
+void        crc32c_init(void);
+uint32_t    crc32c_update_software(uint32_t crc, const unsigned char *p, size_t length);
+uint32_t    crc32c_update_hardware(uint32_t crc, const unsigned char *p, size_t length);
+
+/* 外部函数 */
+
+/**
+ * 计算数据的CRC32C校验和。支持SSE4.2的x86-64处理器使用crc32指令，否则使用
+ * slice-by-8查表的软件实现；两者结果完全相同。
+ *
+ * @param       crc         之前的校验和（第一次调用时为0），用于分段计算。
+ * @param       data        数据缓冲区。
+ * @param       length      数据的字节数。
+ * @return      更新后的校验和。
+ **/
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) {
+    pthread_once(&crc32c_once, crc32c_init);
+    return ~crc32c_impl(~crc, data, length);
+}
+
+/**
+ * 返回是否使用了硬件CRC32C指令。
+ **/
+bool crc32c_hardware(void) {
+    pthread_once(&crc32c_once, crc32c_init);
+    return crc32c_impl == crc32c_update_hardware;
+}
+
+/* 内部函数 */
+
+/**
+ * 生成软件查找表并选择实现（只执行一次）。
+ **/
+void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t crc = crc32c_table[t - 1][i];
+            crc32c_table[t][i] = (crc >> 8) ^ crc32c_table[0][crc & 0xff];
+        }
+    }
+
+    crc32c_impl = crc32c_update_software;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_impl = crc32c_update_hardware;
+    }
+#endif
+}
+
+/**
+ * 软件实现：每次处理8个字节（slice-by-8）。
+ **/
+uint32_t crc32c_update_software(uint32_t crc, const unsigned char *p, size_t length) {
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, p, 4);
+        memcpy(&high, p + 4, 4);
+        low ^= crc;
+
+        crc = crc32c_table[7][low & 0xff]          ^ crc32c_table[6][(low >> 8) & 0xff]  ^
+              crc32c_table[5][(low >> 16) & 0xff]  ^ crc32c_table[4][low >> 24]          ^
+              crc32c_table[3][high & 0xff]         ^ crc32c_table[2][(high >> 8) & 0xff] ^
+              crc32c_table[1][(high >> 16) & 0xff] ^ crc32c_table[0][high >> 24];
+
+        p      += 8;
+        length -= 8;
+    }
+
+    while (length--) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xff];
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * 硬件实现：使用SSE4.2的crc32指令，每次处理8个字节。
+ **/
+__attribute__((target("sse4.2")))
+uint32_t crc32c_update_hardware(uint32_t crc, const unsigned char *p, size_t length) {
+    uint64_t crc64 = crc;
+
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64   = __builtin_ia32_crc32di(crc64, word);
+        p      += 8;
+        length -= 8;
+    }
+
+    crc = crc64;
+    while (length--) {
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+    }
+
+    return crc;
+}
+#else
+uint32_t crc32c_update_hardware(uint32_t crc, const unsigned char *p, size_t length) {
+    return crc32c_update_software(crc, p, length);
+}
+#endif
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
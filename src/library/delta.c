@@ -0,0 +1,230 @@
+/* delta.c: SimpleFS 增量映像发送和接收 */
+
+#include "sfs/crc32c.h"
+#include "sfs/delta.h"
+#include "sfs/logging.h"
+
+#include <string.h>
+#include <unistd.h>
+
+/* 内部函数 */
+
+bool    delta_write(int fd, const void *data, size_t length, DeltaStats *stats);
+bool    delta_read(int fd, void *data, size_t length, DeltaStats *stats);
+
+/* 外部函数 */
+
+/**
+ * 把检查点since之后写入的块以增量格式（见delta.h）写入fd，执行以下操作：
+ *
+ *  1. 建立新的检查点（见disk_checkpoint），记录在文件头中作为下一次增量的since。
+ *
+ *  2. 按块号顺序把代数大于since的连续块合并成区间（最多DELTA_RUN_BLOCKS块），
+ *     每个区间用一次disk_submit读取，连同校验和写入fd。
+ *
+ *  3. 写入结束标记。
+ *
+ * 注意：since为0时发送整个映像。发送失败时检查点已经前进，但代数大于since的块不会减少，
+ * 因此可以用同一个since重新发送。fd可以是管道。
+ *
+ * @param       disk        源磁盘（必须是启用了变更跟踪的单个映像）。
+ * @param       since       起始检查点。
+ * @param       fd          输出的文件描述符。
+ * @param       stats       返回发送的区间数、块数和字节数（可以为NULL）。
+ *
+ * @return      是否成功。
+ **/
+bool delta_send(Disk *disk, uint32_t since, int fd, DeltaStats *stats) {
+    DeltaStats local;
+    stats = stats ? stats : &local;
+    memset(stats, 0, sizeof(DeltaStats));
+
+    ssize_t until = disk ? disk_checkpoint(disk) : DISK_FAILURE;
+    if (until == DISK_FAILURE) {
+        error("Unable to create a checkpoint (change tracking is not enabled)");
+        return false;
+    }
+
+    DeltaHeader header = {
+        .magic      = DELTA_MAGIC,
+        .version    = DELTA_VERSION,
+        .block_size = BLOCK_SIZE,
+        .since      = since,
+        .until      = until,
+        .blocks     = disk->blocks,
+    };
+    stats->since = since;
+    stats->until = until;
+
+    char        *buffer = (char *)malloc(DELTA_RUN_BLOCKS * BLOCK_SIZE);
+    DiskRequest  requests[DELTA_RUN_BLOCKS];
+    bool         success = buffer != NULL && delta_write(fd, &header, sizeof(header), stats);
+
+    for (size_t block = 0; success && block < disk->blocks; ) {
+        if (disk->generations[block] <= since) {
+            block++;
+            continue;
+        }
+
+        size_t count = 0;
+        while (count < DELTA_RUN_BLOCKS && block + count < disk->blocks && disk->generations[block + count] > since) {
+            requests[count] = (DiskRequest){.block = block + count, .write = false, .data = buffer + count * BLOCK_SIZE};
+            count++;
+        }
+
+        if (disk_submit(disk, requests, count) != (ssize_t)count) {
+            error("Unable to read blocks %zu-%zu", block, block + count - 1);
+            success = false;
+            break;
+        }
+
+        DeltaRun run = {.block = block, .count = count, .checksum = crc32c(block, buffer, count * BLOCK_SIZE)};
+        success = delta_write(fd, &run, sizeof(run), stats) && delta_write(fd, buffer, count * BLOCK_SIZE, stats);
+        stats->runs++;
+        stats->blocks += count;
+        block += count;
+    }
+
+    DeltaRun end = {.block = stats->blocks};
+    success = success && delta_write(fd, &end, sizeof(end), stats);
+
+    free(buffer);
+    return success;
+}
+
+/**
+ * 从fd读取增量并应用到磁盘，执行以下操作：
+ *
+ *  1. 检查文件头：魔数、版本、块大小和块数必须与磁盘相符。
+ *
+ *  2. 依次读取每个区间，校验数据后用一次disk_submit写入。
+ *
+ *  3. 检查结束标记中的总块数，发现被截断的增量。
+ *
+ * 注意：区间在校验之后才写入，因此损坏的区间不会被应用；但出错之前的区间已经写入，
+ * 映像处于两个检查点之间的状态，需要重新接收同一个增量（或完整发送）。
+ *
+ * @param       disk        目标磁盘。
+ * @param       fd          输入的文件描述符（可以是管道）。
+ * @param       stats       返回接收的检查点、区间数、块数和字节数（可以为NULL）。
+ *
+ * @return      是否成功应用了完整的增量。
+ **/
+bool delta_receive(Disk *disk, int fd, DeltaStats *stats) {
+    DeltaStats local;
+    stats = stats ? stats : &local;
+    memset(stats, 0, sizeof(DeltaStats));
+
+    DeltaHeader header;
+    if (disk == NULL || !delta_read(fd, &header, sizeof(header), stats) ||
+        header.magic != DELTA_MAGIC || header.version != DELTA_VERSION || header.block_size != BLOCK_SIZE) {
+        error("Not a delta for %d byte blocks", BLOCK_SIZE);
+        return false;
+    }
+
+    if (header.blocks != disk->blocks) {
+        error("Delta is for %llu blocks but the disk holds %zu", (unsigned long long)header.blocks, disk->blocks);
+        return false;
+    }
+    stats->since = header.since;
+    stats->until = header.until;
+
+    char        *buffer = (char *)malloc(DELTA_RUN_BLOCKS * BLOCK_SIZE);
+    DiskRequest  requests[DELTA_RUN_BLOCKS];
+    bool         success = buffer != NULL;
+
+    while (success) {
+        DeltaRun run;
+        if (!delta_read(fd, &run, sizeof(run), stats)) {
+            error("Truncated delta after %zu blocks", stats->blocks);
+            success = false;
+            break;
+        }
+
+        if (run.count == 0) {
+            if (run.block != stats->blocks) {
+                error("Delta holds %zu blocks but should hold %llu", stats->blocks, (unsigned long long)run.block);
+                success = false;
+            }
+            break;
+        }
+
+        if (run.count > DELTA_RUN_BLOCKS || run.block >= disk->blocks || run.count > disk->blocks - run.block) {
+            error("Bad run of %u blocks at block %llu", run.count, (unsigned long long)run.block);
+            success = false;
+            break;
+        }
+
+        if (!delta_read(fd, buffer, run.count * BLOCK_SIZE, stats)) {
+            error("Truncated delta in run at block %llu", (unsigned long long)run.block);
+            success = false;
+            break;
+        }
+
+        if (crc32c(run.block, buffer, run.count * BLOCK_SIZE) != run.checksum) {
+            error("Checksum mismatch in run at block %llu", (unsigned long long)run.block);
+            success = false;
+            break;
+        }
+
+        for (size_t i = 0; i < run.count; i++) {
+            requests[i] = (DiskRequest){.block = run.block + i, .write = true, .data = buffer + i * BLOCK_SIZE};
+        }
+        if (disk_submit(disk, requests, run.count) != (ssize_t)run.count) {
+            error("Unable to write blocks %llu-%llu", (unsigned long long)run.block, (unsigned long long)run.block + run.count - 1);
+            success = false;
+            break;
+        }
+
+        stats->runs++;
+        stats->blocks += run.count;
+    }
+
+    free(buffer);
+    return success;
+}
+
+/* 内部函数 */
+
+/**
+ * 把length字节全部写入fd（处理部分写入），并计入stats->bytes。
+ **/
+bool delta_write(int fd, const void *data, size_t length, DeltaStats *stats) {
+    for (size_t done = 0; done < length; ) {
+        ssize_t result = write(fd, (const char *)data + done, length - done);
+        if (result <= 0) {
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            error("Unable to write delta: %s", strerror(errno));
+            return false;
+        }
+        done += result;
+    }
+
+    stats->bytes += length;
+    return true;
+}
+
+/**
+ * 从fd读取恰好length字节（处理部分读取），并计入stats->bytes。
+ *
+ * @return      是否读到了length字节（文件提前结束时为false）。
+ **/
+bool delta_read(int fd, void *data, size_t length, DeltaStats *stats) {
+    for (size_t done = 0; done < length; ) {
+        ssize_t result = read(fd, (char *)data + done, length - done);
+        if (result <= 0) {
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += result;
+    }
+
+    stats->bytes += length;
+    return true;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
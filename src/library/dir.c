@@ -0,0 +1,703 @@
+/* dir.c: SimpleFS 目录 */
+
+#include "sfs/crc32c.h"
+#include "sfs/dir.h"
+#include "sfs/logging.h"
+#include "sfs/utils.h"
+
+#include <string.h>
+
+/* 内部函数 */
+
+ssize_t     fs_lookup_untimed(FileSystem *fs, size_t dir, const char *name);
+ssize_t     fs_mkdir_untimed(FileSystem *fs, size_t dir, const char *name);
+bool        fs_link_untimed(FileSystem *fs, size_t dir, const char *name, size_t inode_number);
+bool        fs_unlink_untimed(FileSystem *fs, size_t dir, const char *name);
+int         fs_readdir_untimed(FileSystem *fs, size_t dir, size_t *cookie, DirEntry *entry);
+ssize_t     fs_resolve_untimed(FileSystem *fs, const char *path);
+ssize_t     dir_root(FileSystem *fs, bool create);
+bool        dir_init(FileSystem *fs, size_t inode_number, size_t parent);
+bool        dir_destroy(FileSystem *fs, size_t inode_number);
+bool        dir_read_header(FileSystem *fs, size_t dir, DirHeader *header);
+bool        dir_read_block(FileSystem *fs, size_t dir, size_t index, void *block);
+bool        dir_write_block(FileSystem *fs, size_t dir, size_t index, const void *block);
+bool        dir_valid_name(const char *name, size_t length);
+uint32_t    dir_hash(const char *name, size_t length);
+DirRecord * dir_find(DirBucket *bucket, const char *name, size_t length);
+void        dir_append(DirBucket *bucket, uint32_t inode_number, uint8_t type, const char *name, size_t length);
+bool        dir_insert(FileSystem *fs, size_t dir, const char *name, size_t inode_number, uint8_t type);
+bool        dir_split(FileSystem *fs, size_t dir, DirHeader *header, size_t index, DirBucket *bucket);
+ssize_t     dir_adjust_links(FileSystem *fs, size_t inode_number, int delta);
+ssize_t     dir_walk(FileSystem *fs, size_t dir, const char *path, size_t length);
+
+/* fs.c中的内部函数 */
+
+bool        fs_load_inode(FileSystem *fs, size_t inode_number, Block *inode_block, Inode **inode);
+bool        fs_save_inode(FileSystem *fs, size_t inode_number, Block *inode_block);
+ssize_t     fs_read_untimed(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset);
+ssize_t     fs_write_untimed(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset);
+
+/* 外部函数 */
+
+/**
+ * 返回根目录的inode编号，文件系统还没有根目录时创建它并记录到超级块。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @return      根目录的inode编号（出错时为-1）。
+ **/
+ssize_t fs_root(FileSystem *fs) {
+    return dir_root(fs, true);
+}
+
+/**
+ * 在目录中按名称查找目录项。"."和".."分别返回目录自身和父目录。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       dir     要查找的目录。
+ * @param       name    以NUL结尾的名称。
+ * @return      目录项指向的inode编号（不存在或出错时为-1）。
+ **/
+ssize_t fs_lookup(FileSystem *fs, size_t dir, const char *name) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_lookup_untimed(fs, dir, name);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_LOOKUP, start, result >= 0, 0);
+    return result;
+}
+
+/**
+ * fs_lookup的实现（不记录统计）。
+ **/
+ssize_t fs_lookup_untimed(FileSystem *fs, size_t dir, const char *name) {
+    DirHeader header;
+    if (name == NULL || !dir_read_header(fs, dir, &header)) {
+        return -1;
+    }
+
+    if (strcmp(name, ".") == 0) {
+        return dir;
+    }
+    if (strcmp(name, "..") == 0) {
+        return header.parent;
+    }
+
+    size_t length = strlen(name);
+    if (!dir_valid_name(name, length)) {
+        return -1;
+    }
+
+    uint32_t  hash = dir_hash(name, length);
+    DirBucket bucket;
+    if (!dir_read_block(fs, dir, header.table[hash & ((1u << header.depth) - 1)], &bucket)) {
+        return -1;
+    }
+
+    DirRecord *record = dir_find(&bucket, name, length);
+    return record ? (ssize_t)record->inode_number : -1;
+}
+
+/**
+ * 在目录中创建子目录。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       dir     父目录。
+ * @param       name    新目录的名称。
+ * @return      新目录的inode编号（名称已存在或出错时为-1）。
+ **/
+ssize_t fs_mkdir(FileSystem *fs, size_t dir, const char *name) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_mkdir_untimed(fs, dir, name);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_MKDIR, start, result >= 0, 0);
+    return result;
+}
+
+/**
+ * fs_mkdir的实现（不记录统计）。
+ **/
+ssize_t fs_mkdir_untimed(FileSystem *fs, size_t dir, const char *name) {
+    if (name == NULL || !dir_valid_name(name, strlen(name)) || fs_lookup(fs, dir, name) >= 0) {
+        return -1;
+    }
+
+    ssize_t inode_number = fs_create(fs);
+    if (inode_number < 0) {
+        return -1;
+    }
+
+    if (!dir_init(fs, inode_number, dir) || !dir_insert(fs, dir, name, inode_number, DIR_TYPE_DIRECTORY) ||
+        dir_adjust_links(fs, inode_number, 1) < 0) {
+        dir_destroy(fs, inode_number);
+        return -1;
+    }
+
+    return inode_number;
+}
+
+/**
+ * 在目录中添加指向普通文件的目录项，并增加文件的链接数。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       dir             目录。
+ * @param       name            目录项名称。
+ * @param       inode_number    目录项指向的文件（不能是目录）。
+ * @return      是否成功（名称已存在、文件无效或出错时为false）。
+ **/
+bool fs_link(FileSystem *fs, size_t dir, const char *name, size_t inode_number) {
+    uint64_t start  = stats_now();
+    bool     result = fs_link_untimed(fs, dir, name, inode_number);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_LINK, start, result, 0);
+    return result;
+}
+
+/**
+ * fs_link的实现（不记录统计）。
+ **/
+bool fs_link_untimed(FileSystem *fs, size_t dir, const char *name, size_t inode_number) {
+    Block inode_block;
+    Inode *inode;
+
+    if (name == NULL || !dir_valid_name(name, strlen(name))) {
+        return false;
+    }
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid ||
+        (inode->flags & INODE_DIRECTORY)) {
+        return false;
+    }
+
+    return dir_insert(fs, dir, name, inode_number, DIR_TYPE_FILE) &&
+           dir_adjust_links(fs, inode_number, 1) >= 0;
+}
+
+/**
+ * 从目录中删除目录项，执行以下操作：
+ *
+ *  1. 找到并删除目录项。
+ *
+ *  2. 减少目标的链接数，最后一个链接被删除时删除目标inode。
+ *
+ * 注意：非空目录不能删除。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       dir     目录。
+ * @param       name    要删除的目录项名称。
+ * @return      是否成功。
+ **/
+bool fs_unlink(FileSystem *fs, size_t dir, const char *name) {
+    uint64_t start  = stats_now();
+    bool     result = fs_unlink_untimed(fs, dir, name);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_UNLINK, start, result, 0);
+    return result;
+}
+
+/**
+ * fs_unlink的实现（不记录统计）。
+ **/
+bool fs_unlink_untimed(FileSystem *fs, size_t dir, const char *name) {
+    DirHeader header;
+    if (name == NULL || !dir_read_header(fs, dir, &header)) {
+        return false;
+    }
+
+    size_t length = strlen(name);
+    if (!dir_valid_name(name, length)) {
+        return false;
+    }
+
+    uint32_t  hash  = dir_hash(name, length);
+    size_t    index = header.table[hash & ((1u << header.depth) - 1)];
+    DirBucket bucket;
+    if (!dir_read_block(fs, dir, index, &bucket)) {
+        return false;
+    }
+
+    DirRecord *record = dir_find(&bucket, name, length);
+    if (record == NULL) {
+        return false;
+    }
+
+    size_t  target = record->inode_number;
+    uint8_t type   = record->type;
+    if (type == DIR_TYPE_DIRECTORY) {
+        DirHeader child;
+        if (!dir_read_header(fs, target, &child) || child.entries != 0) {
+            return false;
+        }
+    }
+
+    size_t   offset = (uint8_t *)record - bucket.records;
+    size_t   size   = sizeof(DirRecord) + record->length;
+    memmove(bucket.records + offset, bucket.records + offset + size, bucket.used - offset - size);
+    bucket.used -= size;
+    memset(bucket.records + bucket.used, 0, size);
+    header.entries--;
+
+    if (!dir_write_block(fs, dir, index, &bucket) || !dir_write_block(fs, dir, 0, &header)) {
+        return false;
+    }
+
+    ssize_t links = dir_adjust_links(fs, target, -1);
+    if (links < 0) {
+        return false;
+    }
+
+    if (links > 0) {
+        return true;
+    }
+
+    return (type == DIR_TYPE_DIRECTORY) ? dir_destroy(fs, target) : fs_remove(fs, target);
+}
+
+/**
+ * 遍历目录中的目录项。cookie从0开始，每次调用返回一个目录项并前进cookie。
+ *
+ * 注意：遍历过程中修改目录可能导致目录项被跳过或重复返回。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       dir     目录。
+ * @param       cookie  遍历位置（桶的逻辑块号 * BLOCK_SIZE + 桶内偏移）。
+ * @param       entry   用于返回目录项。
+ * @return      返回了目录项时为1，遍历结束为0，出错为-1。
+ **/
+int fs_readdir(FileSystem *fs, size_t dir, size_t *cookie, DirEntry *entry) {
+    uint64_t start  = stats_now();
+    int      result = fs_readdir_untimed(fs, dir, cookie, entry);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_READDIR, start, result >= 0, 0);
+    return result;
+}
+
+/**
+ * fs_readdir的实现（不记录统计）。
+ **/
+int fs_readdir_untimed(FileSystem *fs, size_t dir, size_t *cookie, DirEntry *entry) {
+    DirHeader header;
+    if (cookie == NULL || entry == NULL || !dir_read_header(fs, dir, &header)) {
+        return -1;
+    }
+
+    size_t index  = max(*cookie / BLOCK_SIZE, 1);
+    size_t offset = (*cookie / BLOCK_SIZE) ? *cookie % BLOCK_SIZE : 0;
+
+    for (; index <= header.buckets; index++, offset = 0) {
+        DirBucket bucket;
+        if (!dir_read_block(fs, dir, index, &bucket)) {
+            return -1;
+        }
+
+        if (offset < bucket.used) {
+            DirRecord *record = (DirRecord *)(bucket.records + offset);
+            entry->inode_number = record->inode_number;
+            entry->type = record->type;
+            memcpy(entry->name, record->name, record->length);
+            entry->name[record->length] = 0;
+
+            *cookie = index * BLOCK_SIZE + offset + sizeof(DirRecord) + record->length;
+            return 1;
+        }
+    }
+
+    *cookie = index * BLOCK_SIZE;
+    return 0;
+}
+
+/**
+ * 从根目录开始解析路径。开头的"/"可以省略，空的路径分量被忽略。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       path    以"/"分隔的路径。
+ * @return      路径指向的inode编号（不存在或出错时为-1）。
+ **/
+ssize_t fs_resolve(FileSystem *fs, const char *path) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_resolve_untimed(fs, path);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_RESOLVE, start, result >= 0, 0);
+    return result;
+}
+
+/**
+ * fs_resolve的实现（不记录统计）。
+ **/
+ssize_t fs_resolve_untimed(FileSystem *fs, const char *path) {
+    ssize_t root = dir_root(fs, false);
+    if (root < 0 || path == NULL) {
+        return -1;
+    }
+
+    return dir_walk(fs, root, path, strlen(path));
+}
+
+/**
+ * 解析路径的父目录，并返回路径的最后一个分量（需要时创建根目录）。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       path    以"/"分隔的路径。
+ * @param       name    用于返回最后一个分量的缓冲区（FS_NAME_MAX + 1字节）。
+ * @return      父目录的inode编号（不存在、路径没有分量或出错时为-1）。
+ **/
+ssize_t fs_resolve_parent(FileSystem *fs, const char *path, char *name) {
+    if (path == NULL || name == NULL) {
+        return -1;
+    }
+
+    size_t end = strlen(path);
+    while (end > 0 && path[end - 1] == '/') {
+        end--;
+    }
+
+    size_t start = end;
+    while (start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+
+    if (start == end || end - start > FS_NAME_MAX) {
+        return -1;
+    }
+
+    ssize_t root = dir_root(fs, true);
+    if (root < 0) {
+        return -1;
+    }
+
+    memcpy(name, path + start, end - start);
+    name[end - start] = 0;
+    return dir_walk(fs, root, path, start);
+}
+
+/* 内部函数 */
+
+/**
+ * 返回根目录的inode编号。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       create  根目录不存在时是否创建。
+ * @return      根目录的inode编号（不存在或出错时为-1）。
+ **/
+ssize_t dir_root(FileSystem *fs, bool create) {
+    if (fs == NULL || fs->disk == NULL) {
+        return -1;
+    }
+
+    if (fs->meta_data.flags & FS_NAMESPACE) {
+        return fs->meta_data.root;
+    }
+
+    if (!create) {
+        return -1;
+    }
+
+    ssize_t inode_number = fs_create(fs);
+    if (inode_number < 0) {
+        return -1;
+    }
+
+    Block super_block;
+    if (!dir_init(fs, inode_number, inode_number) || dir_adjust_links(fs, inode_number, 1) < 0 ||
+        disk_read(fs->disk, 0, super_block.data) == DISK_FAILURE) {
+        dir_destroy(fs, inode_number);
+        return -1;
+    }
+
+    super_block.super.flags |= FS_NAMESPACE;
+    super_block.super.root = inode_number;
+    if (disk_write(fs->disk, 0, super_block.data) == DISK_FAILURE) {
+        return -1;
+    }
+
+    fs->meta_data = super_block.super;
+    return inode_number;
+}
+
+/**
+ * 将刚分配的inode初始化为空目录：写入头块和第一个桶，然后标记为目录。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    fs_create分配的inode。
+ * @param       parent          父目录的inode编号。
+ * @return      是否成功。
+ **/
+bool dir_init(FileSystem *fs, size_t inode_number, size_t parent) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode)) {
+        return false;
+    }
+
+    inode->flags = 0;
+    if (!fs_save_inode(fs, inode_number, &inode_block)) {
+        return false;
+    }
+
+    DirHeader header = {0};
+    DirBucket bucket = {0};
+    header.buckets  = 1;
+    header.parent   = parent;
+    header.table[0] = 1;
+
+    if (!dir_write_block(fs, inode_number, 0, &header) || !dir_write_block(fs, inode_number, 1, &bucket) ||
+        !fs_load_inode(fs, inode_number, &inode_block, &inode)) {
+        return false;
+    }
+
+    inode->flags = INODE_DIRECTORY;
+    return fs_save_inode(fs, inode_number, &inode_block);
+}
+
+/**
+ * 删除没有链接的目录inode（清除目录标志后交给fs_remove）。
+ **/
+bool dir_destroy(FileSystem *fs, size_t inode_number) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode)) {
+        return false;
+    }
+
+    inode->flags &= ~INODE_DIRECTORY;
+    return fs_save_inode(fs, inode_number, &inode_block) && fs_remove(fs, inode_number);
+}
+
+/**
+ * 检查inode是目录并读取目录头块。
+ **/
+bool dir_read_header(FileSystem *fs, size_t dir, DirHeader *header) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, dir, &inode_block, &inode) || !inode->valid ||
+        !(inode->flags & INODE_DIRECTORY)) {
+        return false;
+    }
+
+    return dir_read_block(fs, dir, 0, header);
+}
+
+/**
+ * 读取目录的第index个逻辑块（头块或桶）。
+ **/
+bool dir_read_block(FileSystem *fs, size_t dir, size_t index, void *block) {
+    return fs_read_untimed(fs, dir, block, BLOCK_SIZE, index * BLOCK_SIZE) == BLOCK_SIZE;
+}
+
+/**
+ * 写入目录的第index个逻辑块（头块或桶）。
+ **/
+bool dir_write_block(FileSystem *fs, size_t dir, size_t index, const void *block) {
+    return fs_write_untimed(fs, dir, (char *)block, BLOCK_SIZE, index * BLOCK_SIZE) == BLOCK_SIZE;
+}
+
+/**
+ * 检查名称是否可以作为目录项：非空、不超过FS_NAME_MAX、不含"/"且不是"."或".."。
+ **/
+bool dir_valid_name(const char *name, size_t length) {
+    if (length == 0 || length > FS_NAME_MAX || memchr(name, '/', length) != NULL) {
+        return false;
+    }
+
+    return strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+/**
+ * 计算名称的哈希值。
+ **/
+uint32_t dir_hash(const char *name, size_t length) {
+    return crc32c(0, name, length);
+}
+
+/**
+ * 在桶中查找名称。
+ *
+ * @return      指向桶中目录项的指针（不存在时为NULL）。
+ **/
+DirRecord *dir_find(DirBucket *bucket, const char *name, size_t length) {
+    size_t offset = 0;
+
+    while (offset < bucket->used) {
+        DirRecord *record = (DirRecord *)(bucket->records + offset);
+        if (record->length == length && memcmp(record->name, name, length) == 0) {
+            return record;
+        }
+        offset += sizeof(DirRecord) + record->length;
+    }
+
+    return NULL;
+}
+
+/**
+ * 在桶的末尾追加目录项（调用者保证空间足够）。
+ **/
+void dir_append(DirBucket *bucket, uint32_t inode_number, uint8_t type, const char *name, size_t length) {
+    DirRecord *record = (DirRecord *)(bucket->records + bucket->used);
+
+    record->inode_number = inode_number;
+    record->type = type;
+    record->length = length;
+    memcpy(record->name, name, length);
+    bucket->used += sizeof(DirRecord) + length;
+}
+
+/**
+ * 向目录中插入目录项，执行以下操作：
+ *
+ *  1. 根据名称的哈希值找到桶，名称已存在时失败。
+ *
+ *  2. 桶中有空间时直接追加。
+ *
+ *  3. 否则分裂桶（需要时先将哈希表加倍）并重试。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       dir             目录。
+ * @param       name            目录项名称（调用者已检查）。
+ * @param       inode_number    目录项指向的inode。
+ * @param       type            目录项类型。
+ * @return      是否成功（名称已存在、目录已满或出错时为false）。
+ **/
+bool dir_insert(FileSystem *fs, size_t dir, const char *name, size_t inode_number, uint8_t type) {
+    DirHeader header;
+    if (!dir_read_header(fs, dir, &header)) {
+        return false;
+    }
+
+    size_t   length = strlen(name);
+    uint32_t hash   = dir_hash(name, length);
+
+    while (true) {
+        size_t    index = header.table[hash & ((1u << header.depth) - 1)];
+        DirBucket bucket;
+        if (!dir_read_block(fs, dir, index, &bucket) || dir_find(&bucket, name, length) != NULL) {
+            return false;
+        }
+
+        if (bucket.used + sizeof(DirRecord) + length <= DIR_BUCKET_BYTES) {
+            dir_append(&bucket, inode_number, type, name, length);
+            header.entries++;
+            return dir_write_block(fs, dir, index, &bucket) && dir_write_block(fs, dir, 0, &header);
+        }
+
+        if (!dir_split(fs, dir, &header, index, &bucket)) {
+            return false;
+        }
+    }
+}
+
+/**
+ * 分裂已满的桶，执行以下操作：
+ *
+ *  1. 桶的局部深度等于全局深度时，将哈希表加倍（达到DIR_MAX_DEPTH时失败）。
+ *
+ *  2. 在目录末尾新建一个桶，按哈希值的下一位重新分配目录项。
+ *
+ *  3. 将原来指向旧桶且该位为1的槽改为指向新桶，并写回两个桶和头块。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       dir     目录。
+ * @param       header  目录头块（会被更新）。
+ * @param       index   要分裂的桶的逻辑块号。
+ * @param       bucket  要分裂的桶。
+ * @return      是否成功。
+ **/
+bool dir_split(FileSystem *fs, size_t dir, DirHeader *header, size_t index, DirBucket *bucket) {
+    if (bucket->depth == header->depth) {
+        if (header->depth == DIR_MAX_DEPTH) {
+            return false;
+        }
+
+        size_t slots = 1u << header->depth;
+        memcpy(header->table + slots, header->table, slots * sizeof(uint16_t));
+        header->depth++;
+    }
+
+    uint32_t  bit     = 1u << bucket->depth;
+    size_t    sibling = header->buckets + 1;
+    DirBucket old     = *bucket;
+    DirBucket split   = {0};
+
+    memset(bucket, 0, sizeof(DirBucket));
+    bucket->depth = split.depth = old.depth + 1;
+
+    for (size_t offset = 0; offset < old.used; ) {
+        DirRecord *record = (DirRecord *)(old.records + offset);
+        DirBucket *target = (dir_hash(record->name, record->length) & bit) ? &split : bucket;
+        dir_append(target, record->inode_number, record->type, record->name, record->length);
+        offset += sizeof(DirRecord) + record->length;
+    }
+
+    for (size_t slot = 0; slot < (1u << header->depth); slot++) {
+        if (header->table[slot] == index && (slot & bit)) {
+            header->table[slot] = sibling;
+        }
+    }
+    header->buckets = sibling;
+
+    return dir_write_block(fs, dir, sibling, &split) && dir_write_block(fs, dir, index, bucket) &&
+           dir_write_block(fs, dir, 0, header);
+}
+
+/**
+ * 调整inode的链接数。
+ *
+ * @return      调整后的链接数（出错时为-1）。
+ **/
+ssize_t dir_adjust_links(FileSystem *fs, size_t inode_number, int delta) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid) {
+        return -1;
+    }
+
+    if ((delta < 0 && inode->links < -delta) || (delta > 0 && inode->links > UINT16_MAX - delta)) {
+        return -1;
+    }
+
+    inode->links += delta;
+    if (!fs_save_inode(fs, inode_number, &inode_block)) {
+        return -1;
+    }
+
+    return inode->links;
+}
+
+/**
+ * 从目录dir开始解析路径的前length个字符。
+ *
+ * @return      路径指向的inode编号（不存在或出错时为-1）。
+ **/
+ssize_t dir_walk(FileSystem *fs, size_t dir, const char *path, size_t length) {
+    ssize_t inode_number = dir;
+    size_t  start = 0;
+
+    while (start < length) {
+        size_t end = start;
+        while (end < length && path[end] != '/') {
+            end++;
+        }
+
+        if (end > start) {
+            char name[FS_NAME_MAX + 1];
+            if (end - start > FS_NAME_MAX) {
+                return -1;
+            }
+
+            memcpy(name, path + start, end - start);
+            name[end - start] = 0;
+
+            inode_number = fs_lookup(fs, inode_number, name);
+            if (inode_number < 0) {
+                return -1;
+            }
+        }
+
+        start = end + 1;
+    }
+
+    return inode_number;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -1,14 +1,75 @@
 /* disk.c: SimpleFS 磁盘模拟器 */
 
+#define _GNU_SOURCE
+
+#include "sfs/crc32c.h"
 #include "sfs/disk.h"
 #include "sfs/logging.h"
+#include "sfs/utils.h"
 
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* 内部常量 */
+
+#define DISK_SCAN_BLOCKS    (64)                /* 计算或校验校验和时每次读取的块数 */
+#define DISK_VERIFY_PER_CPU (4)                 /* 每个CPU最多的校验线程数 */
+
+/* 内部结构 */
+
+typedef struct DiskVerifyTask DiskVerifyTask;
+struct DiskVerifyTask {
+    Disk       *disk;                           /* 被校验的磁盘 */
+    size_t      start;                          /* 第一个块 */
+    size_t      end;                            /* 最后一个块之后的块 */
+    size_t      bad;                            /* 校验失败的块数 */
+};
+
+typedef struct DiskMemberTask DiskMemberTask;
+struct DiskMemberTask {
+    Disk          *disk;                        /* 成员磁盘 */
+    DiskRequest   *requests;                    /* 该成员的子批次（条带磁盘中块号已转换为成员内的块号） */
+    size_t         count;                       /* 子批次中的请求数 */
+};
+
+typedef struct DiskQueueEntry DiskQueueEntry;
+struct DiskQueueEntry {
+    size_t      key;                            /* 电梯顺序：从head开始向上扫描，到末尾后回到块0 */
+    size_t      index;                          /* 请求在批次中的下标（相同key时保持提交顺序） */
+};
+
 /* 内部属性 */
 
 bool    disk_sanity_check(Disk *disk, size_t blocknum, const char *data);
+uint32_t disk_checksum(size_t block, const char *data);
+bool    disk_checksum_open(Disk *disk, const char *path);
+bool    disk_generation_open(Disk *disk, const char *path, bool create);
+bool    disk_track(Disk *disk, size_t block, size_t count);
+void *  disk_verify_thread(void *arg);
+size_t  disk_copy_range(int in_fd, off_t in_offset, int out_fd, off_t out_offset, size_t length);
+ssize_t disk_read_untimed(Disk *disk, size_t block, char *data);
+ssize_t disk_write_untimed(Disk *disk, size_t block, char *data);
+void    disk_account(Disk *disk, bool write, size_t block, uint64_t start, size_t depth, ssize_t result);
+int     disk_queue_compare(const void *a, const void *b);
+size_t  disk_dispatch(Disk *disk, DiskRequest *requests, const DiskQueueEntry *entries, size_t count);
+void    disk_release(Disk *disk);
+Disk *  disk_open_members(const char *const *paths, size_t count, size_t blocks, size_t member_blocks, const DiskOptions *options);
+size_t  disk_locate(Disk *disk, size_t block, size_t *member_block);
+ssize_t disk_submit_striped(Disk *disk, DiskRequest *requests, size_t count);
+ssize_t disk_submit_mirrored(Disk *disk, DiskRequest *requests, size_t count);
+void    disk_fan_out(DiskMemberTask *tasks, size_t members);
+void *  disk_submit_thread(void *arg);
+size_t  disk_complete(Disk *disk, DiskRequest *requests, size_t count, uint64_t start);
+ssize_t disk_pick_replica(Disk *disk, const bool *excluded);
+ssize_t disk_read_mirrored(Disk *disk, size_t block, char *data);
+ssize_t disk_write_mirrored(Disk *disk, size_t block, char *data);
+void    disk_mark_stale(Disk *disk, size_t replica);
 
 /* 外部函数 */
 
@@ -28,11 +89,31 @@ bool    disk_sanity_check(Disk *disk, size_t blocknum, const char *data);
  * @return      指向新分配并配置的Disk结构的指针（失败时为NULL）。
  **/
 Disk *disk_open(const char *path, size_t blocks) {
+    return disk_open_with(path, blocks, NULL);
+}
+
+/**
+ * 按照给定的选项打开磁盘（options为NULL时使用默认选项）。启用校验和时，
+ * 校验和保存在<path>.crc中；该文件不存在或大小不符时根据映像当前的内容重新生成。
+ * 启用变更跟踪或<path>.gen已经存在时，每次写入都在<path>.gen中记录块的代数（见disk_checkpoint），
+ * 因此跟踪一旦开始，之后不带选项打开映像的写入也不会遗漏。
+ * 启用跟踪时，之后的每次disk_read/disk_write都追加到跟踪文件（见trace.h）。
+ * 指定延迟模型时，每次成功的disk_read/disk_write都按模型计入模拟的耗时（见model.h）。
+ *
+ * @param       path        要创建的磁盘映像的路径。
+ * @param       blocks      为磁盘映像分配的块数。
+ * @param       options     磁盘选项。
+ *
+ * @return      指向新分配并配置的Disk结构的指针（失败时为NULL）。
+ **/
+Disk *disk_open_with(const char *path, size_t blocks, const DiskOptions *options) {
 
-    Disk *disk = (Disk *)malloc(sizeof(Disk));
+    Disk *disk = (Disk *)calloc(1, sizeof(Disk));
     if (disk == NULL){
         return NULL;
     }
+    disk->checksum_fd = -1;
+    disk->generation_fd = -1;
     
     disk->fd = open(path, O_RDWR|O_CREAT, 0644);
     if (disk->fd == -1)
@@ -44,6 +125,7 @@ Disk *disk_open(const char *path, size_t blocks) {
     disk->blocks = blocks;
     disk->reads = 0;
     disk->writes = 0;
+    disk->discard = options != NULL && options->discard;
 
 
     off_t file_size = blocks * BLOCK_SIZE;
@@ -55,17 +137,179 @@ Disk *disk_open(const char *path, size_t blocks) {
         return NULL;
     }
 
+    if ((options != NULL && options->checksums && !disk_checksum_open(disk, path)) ||
+        !disk_generation_open(disk, path, options != NULL && options->track) ||
+        (options != NULL && options->trace && (disk->trace = trace_open(options->trace, blocks)) == NULL)) {
+        if (disk->checksum_fd >= 0)
+            close(disk->checksum_fd);
+        if (disk->generation_fd >= 0)
+            close(disk->generation_fd);
+        close(disk->fd);
+        free(disk->checksums);
+        free(disk->generations);
+        free(disk);
+        return NULL;
+    }
+
+    if (options != NULL && options->model.type != MODEL_NONE && (disk->model = model_open(&options->model, blocks)) == NULL) {
+        trace_close(disk->trace);
+        if (disk->checksum_fd >= 0)
+            close(disk->checksum_fd);
+        if (disk->generation_fd >= 0)
+            close(disk->generation_fd);
+        close(disk->fd);
+        free(disk->checksums);
+        free(disk->generations);
+        free(disk);
+        return NULL;
+    }
+
     return disk;
 }
 
 /**
- * 关闭磁盘结构，执行以下操作：
+ * 把多个映像组合成一个条带磁盘：逻辑块按条带单元轮流分布到各个成员上，
+ * 第i个条带单元位于成员i % count中从(i / count) * stripe开始的块。
+ * disk_submit把一批请求按成员拆分后并行分发，因此大的顺序扫描随成员数扩展。
+ * 校验和与延迟模型作用于每个成员（每个成员有自己的<path>.crc），跟踪记录逻辑块的访问。
+ *
+ * @param       paths       成员映像的路径。
+ * @param       count       成员数。
+ * @param       blocks      逻辑块数。
+ * @param       options     磁盘选项（NULL表示默认选项；条带单元见DiskOptions.stripe）。
+ *
+ * @return      指向新分配并配置的Disk结构的指针（失败时为NULL）。
+ **/
+Disk *disk_open_striped(const char *const *paths, size_t count, size_t blocks, const DiskOptions *options) {
+    size_t stripe = options != NULL && options->stripe ? options->stripe : DISK_STRIPE_DEFAULT;
+    size_t units  = (blocks + stripe - 1) / stripe;
+
+    Disk *disk = count ? disk_open_members(paths, count, blocks, (units + count - 1) / count * stripe, options) : NULL;
+    if (disk != NULL) {
+        disk->stripe = stripe;
+    }
+    return disk;
+}
+
+/**
+ * 把多个映像组合成一个镜像磁盘：每个块写入所有健康的副本，读取由负载最低的副本完成，
+ * 大的批量读取（disk_submit）分成几段由各副本并行读取；某个副本读取失败时在其他副本上重试，
+ * 并用读到的数据修复该副本。写入失败的副本被标记为落后（Disk.stale），直到disk_resync。
+ * 校验和与延迟模型作用于每个副本，跟踪记录逻辑块的访问。
  *
- *  1. 关闭磁盘文件描述符。
+ * @param       paths       副本映像的路径。
+ * @param       count       副本数。
+ * @param       blocks      块数（每个副本的大小）。
+ * @param       options     磁盘选项（NULL表示默认选项）。
  *
- *  2. 报告磁盘读取和写入的次数。
+ * @return      指向新分配并配置的Disk结构的指针（失败时为NULL）。
+ **/
+Disk *disk_open_mirrored(const char *const *paths, size_t count, size_t blocks, const DiskOptions *options) {
+    Disk *disk = disk_open_members(paths, count, blocks, blocks, options);
+    if (disk != NULL) {
+        disk->mirrored = true;
+    }
+    return disk;
+}
+
+/**
+ * 分配组合磁盘并打开每个成员映像（成员不记录跟踪，跟踪记录在组合磁盘上）。
  *
- *  3. 释放磁盘结构的内存。
+ * @param       paths           成员映像的路径。
+ * @param       count           成员数。
+ * @param       blocks          组合磁盘的逻辑块数。
+ * @param       member_blocks   每个成员的块数。
+ * @param       options         磁盘选项（NULL表示默认选项）。
+ *
+ * @return      指向Disk结构的指针（失败时为NULL）。
+ **/
+Disk *disk_open_members(const char *const *paths, size_t count, size_t blocks, size_t member_blocks, const DiskOptions *options) {
+    if (paths == NULL || count == 0) {
+        return NULL;
+    }
+
+    Disk *disk = (Disk *)calloc(1, sizeof(Disk));
+    if (disk == NULL) {
+        return NULL;
+    }
+    disk->fd          = -1;
+    disk->checksum_fd = -1;
+    disk->generation_fd = -1;
+    disk->blocks      = blocks;
+    disk->discard     = options != NULL && options->discard;
+    disk->members     = (Disk **)calloc(count, sizeof(Disk *));
+    if (disk->members == NULL) {
+        free(disk);
+        return NULL;
+    }
+
+    DiskOptions member_options = {0};
+    if (options != NULL) {
+        member_options = *options;
+        member_options.trace = NULL;
+    }
+
+    for (; disk->member_count < count; disk->member_count++) {
+        Disk *member = disk_open_with(paths[disk->member_count], member_blocks, &member_options);
+        if (member == NULL) {
+            disk_release(disk);
+            return NULL;
+        }
+        disk->members[disk->member_count] = member;
+    }
+
+    if (options != NULL && options->trace && (disk->trace = trace_open(options->trace, blocks)) == NULL) {
+        disk_release(disk);
+        return NULL;
+    }
+
+    return disk;
+}
+
+/**
+ * 打开用逗号分隔的映像列表：只有一个路径时等同于disk_open_with，
+ * 否则打开条带磁盘（DiskOptions.mirror为true时打开镜像磁盘）。
+ *
+ * @param       list        映像路径的列表（例如"a.image,b.image"）。
+ * @param       blocks      逻辑块数。
+ * @param       options     磁盘选项（NULL表示默认选项）。
+ *
+ * @return      指向新分配并配置的Disk结构的指针（失败时为NULL）。
+ **/
+Disk *disk_open_list(const char *list, size_t blocks, const DiskOptions *options) {
+    if (list == NULL || strchr(list, ',') == NULL) {
+        return list ? disk_open_with(list, blocks, options) : NULL;
+    }
+
+    char   *copy  = strdup(list);
+    size_t  count = 1;
+    for (const char *c = list; *c; c++) {
+        count += *c == ',';
+    }
+
+    const char **paths = (const char **)malloc(count * sizeof(char *));
+    Disk        *disk  = NULL;
+    if (copy != NULL && paths != NULL) {
+        char *save = NULL;
+        count = 0;
+        for (char *path = strtok_r(copy, ",", &save); path; path = strtok_r(NULL, ",", &save)) {
+            paths[count++] = path;
+        }
+        disk = options != NULL && options->mirror ? disk_open_mirrored(paths, count, blocks, options)
+                                                  : disk_open_striped(paths, count, blocks, options);
+    }
+
+    free(paths);
+    free(copy);
+    return disk;
+}
+
+/**
+ * 关闭磁盘结构，执行以下操作：
+ *
+ *  1. 报告磁盘读取、写入和打洞释放的块数（条带和镜像磁盘包括成员的模拟耗时和校验失败次数）。
+ *
+ *  2. 关闭文件描述符和成员磁盘，写入并关闭块I/O跟踪（如果启用），释放内存（见disk_release）。
  *
  * @param       disk        指向Disk结构的指针。
  */
@@ -73,13 +317,28 @@ void disk_close(Disk *disk) {
     if (disk == NULL)
         return;
 
-    close(disk->fd);
+    bool     modeled         = disk->model != NULL;
+    uint64_t simulated       = disk->simulated;
+    size_t   checksum_errors = disk->checksum_errors;
+    for (size_t i = 0; i < disk->member_count; i++) {
+        modeled         |= disk->members[i]->model != NULL;
+        simulated       += disk->members[i]->simulated;
+        checksum_errors += disk->members[i]->checksum_errors;
+    }
 
     printf("Number of reads: %zu\n", disk->reads);
     printf("Number of writes: %zu\n", disk->writes);
-    
-    free(disk);
+    if (modeled) {
+        printf("Simulated time: %.3f ms\n", simulated / 1e6);
+    }
+    if (checksum_errors > 0) {
+        printf("Number of checksum errors: %zu\n", checksum_errors);
+    }
+    if (disk->discards > 0) {
+        printf("Number of discarded blocks: %zu\n", disk->discards);
+    }
 
+    disk_release(disk);
 }
 
 /**
@@ -91,35 +350,63 @@ void disk_close(Disk *disk) {
  *
  *  3. 从块中读取数据到数据缓冲区（必须为BLOCK_SIZE）。
  *
+ *  4. 启用校验和时，校验读取的数据。
+ *
  * @param       disk        指向Disk结构的指针。
  * @param       block       要执行操作的块编号。
  * @param       data        数据缓冲区。
  *
  * @return      读取的字节数。
- *              （成功时为BLOCK_SIZE，失败时为DISK_FAILURE）。
+ *              （成功时为BLOCK_SIZE，失败或校验和不匹配时为DISK_FAILURE）。
  **/
 ssize_t disk_read(Disk *disk, size_t block, char *data) {
+    uint64_t start  = stats_now();
+    size_t   depth  = disk ? __atomic_add_fetch(&disk->inflight, 1, __ATOMIC_RELAXED) : 0;
+    ssize_t  result = disk_read_untimed(disk, block, data);
+
+    disk_account(disk, false, block, start, depth, result);
+    return result;
+}
+
+/**
+ * disk_read的实现（不记录统计）。
+ **/
+ssize_t disk_read_untimed(Disk *disk, size_t block, char *data) {
     
     if (!disk_sanity_check(disk, block, data))
     {
         return DISK_FAILURE;
     }
-    
-
-    off_t offset = (off_t)BLOCK_SIZE * block;
 
-    if (lseek(disk->fd, offset, SEEK_SET) == -1){
-        return DISK_FAILURE;
+    if (disk->members != NULL) {
+        size_t  member_block = block;
+        ssize_t result;
+        if (disk->mirrored) {
+            result = disk_read_mirrored(disk, block, data);
+        } else {
+            Disk *member = disk->members[disk_locate(disk, block, &member_block)];
+            result = disk_read(member, member_block, data);
+        }
+        __atomic_add_fetch(&disk->reads, result != DISK_FAILURE, __ATOMIC_RELAXED);
+        return result;
     }
 
-    ssize_t bytes_read = read(disk->fd, data, BLOCK_SIZE);
+    off_t offset = (off_t)BLOCK_SIZE * block;
+
+    ssize_t bytes_read = pread(disk->fd, data, BLOCK_SIZE, offset);
 
     if (bytes_read == -1)
     {
         return DISK_FAILURE;
     }
 
-    disk->reads ++;
+    __atomic_add_fetch(&disk->reads, 1, __ATOMIC_RELAXED);
+
+    if (disk->checksums != NULL && disk_checksum(block, data) != disk->checksums[block]) {
+        error("Checksum mismatch in block %zu", block);
+        __atomic_add_fetch(&disk->checksum_errors, 1, __ATOMIC_RELAXED);
+        return DISK_FAILURE;
+    }
     
     return bytes_read;
 
@@ -135,6 +422,8 @@ ssize_t disk_read(Disk *disk, size_t block, char *data) {
  *
  *  3. 将数据缓冲区（必须为BLOCK_SIZE）写入磁盘块。
  *
+ *  4. 启用校验和时，更新并保存该块的校验和。
+ *
  * @param       disk        指向Disk结构的指针。
  * @param       block       要执行操作的块编号。
  * @param       data        数据缓冲区。
@@ -143,35 +432,490 @@ ssize_t disk_read(Disk *disk, size_t block, char *data) {
  *              （成功时为BLOCK_SIZE，失败时为DISK_FAILURE）。
  **/
 ssize_t disk_write(Disk *disk, size_t block, char *data) {
+    uint64_t start  = stats_now();
+    size_t   depth  = disk ? __atomic_add_fetch(&disk->inflight, 1, __ATOMIC_RELAXED) : 0;
+    ssize_t  result = disk_write_untimed(disk, block, data);
+
+    disk_account(disk, true, block, start, depth, result);
+    return result;
+}
+
+/**
+ * disk_write的实现（不记录统计）。
+ **/
+ssize_t disk_write_untimed(Disk *disk, size_t block, char *data) {
 
     if (!disk_sanity_check(disk, block, data))
     {
         return DISK_FAILURE;
     }
-    
+
+    if (disk->members != NULL) {
+        size_t  member_block = block;
+        ssize_t result;
+        if (disk->mirrored) {
+            result = disk_write_mirrored(disk, block, data);
+        } else {
+            Disk *member = disk->members[disk_locate(disk, block, &member_block)];
+            result = disk_write(member, member_block, data);
+        }
+        __atomic_add_fetch(&disk->writes, result != DISK_FAILURE, __ATOMIC_RELAXED);
+        return result;
+    }
 
     off_t offset = (off_t)BLOCK_SIZE * block;
 
-    if (lseek(disk->fd, offset, SEEK_SET) == -1){
+    ssize_t bytes_written = pwrite(disk->fd, data, BLOCK_SIZE, offset);
+
+    if (bytes_written == -1)
+    {
         return DISK_FAILURE;
     }
-    
 
-    
-    ssize_t bytes_written = write(disk->fd, data, BLOCK_SIZE);
+    if (disk->checksums != NULL) {
+        disk->checksums[block] = disk_checksum(block, data);
+        off_t checksum_offset = (off_t)sizeof(uint32_t) * block;
+        if (pwrite(disk->checksum_fd, &disk->checksums[block], sizeof(uint32_t), checksum_offset) != sizeof(uint32_t))
+            return DISK_FAILURE;
+    }
 
-    if (bytes_written == -1)
-    {
+    if (!disk_track(disk, block, 1)) {
         return DISK_FAILURE;
     }
-    
 
 
-    disk->writes++;
+    __atomic_add_fetch(&disk->writes, 1, __ATOMIC_RELAXED);
 
     return bytes_written;
 }
 
+/**
+ * 提交一批块请求，执行以下操作：
+ *
+ *  1. 按电梯（C-SCAN）顺序排序：从上次访问位置开始向上，到末尾后回到块0；
+ *     同一个块的多个请求保持提交顺序，因此批内的读写语义与逐个执行相同。
+ *
+ *  2. 把方向相同的相邻块合并成一次preadv/pwritev（最多DISK_QUEUE_MERGE块）。
+ *
+ *  3. 依次分发；合并的I/O失败时逐块重试，以便确定每个请求的结果。
+ *
+ * 批次本身就是截止期限：批内的请求全部完成后才返回，不同批次之间不会重排。
+ * 条带和镜像磁盘先按成员拆分批次，各成员并行执行上述步骤（见disk_submit_striped和disk_submit_mirrored）。
+ *
+ * @param       disk        指向Disk结构的指针。
+ * @param       requests    请求数组（完成后设置每个请求的result）。
+ * @param       count       请求数。
+ *
+ * @return      成功的请求数（参数无效时为DISK_FAILURE）。
+ **/
+ssize_t disk_submit(Disk *disk, DiskRequest *requests, size_t count) {
+    if (disk == NULL || (requests == NULL && count > 0)) {
+        return DISK_FAILURE;
+    }
+
+    if (disk->members != NULL) {
+        return disk->mirrored ? disk_submit_mirrored(disk, requests, count) : disk_submit_striped(disk, requests, count);
+    }
+
+    DiskQueueEntry *queue = (DiskQueueEntry *)malloc(max(count, 1) * sizeof(DiskQueueEntry));
+    if (queue == NULL) {
+        return DISK_FAILURE;
+    }
+
+    size_t head = __atomic_load_n(&disk->head, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < count; i++) {
+        size_t block = requests[i].block;
+        queue[i].index = i;
+        queue[i].key   = block >= head ? block - head : block + disk->blocks - head;
+    }
+    qsort(queue, count, sizeof(DiskQueueEntry), disk_queue_compare);
+
+    size_t done = 0;
+    for (size_t i = 0; i < count; ) {
+        const DiskRequest *first = &requests[queue[i].index];
+        size_t run = 1;
+        while (i + run < count && run < DISK_QUEUE_MERGE) {
+            const DiskRequest *next = &requests[queue[i + run].index];
+            if (next->write != first->write || next->block != first->block + run) {
+                break;
+            }
+            run++;
+        }
+
+        done += disk_dispatch(disk, requests, queue + i, run);
+        i += run;
+    }
+
+    free(queue);
+    return done;
+}
+
+/**
+ * 将从block开始的count个连续块直接复制到文件描述符的offset处，执行以下操作：
+ *
+ *  1. 未启用校验和和延迟模型时，用copy_file_range在内核中复制，数据不经过用户空间。
+ *
+ *  2. 内核复制不可用（例如跨文件系统）、启用了校验和或延迟模型时，逐块disk_read（校验）后写入。
+ *
+ * 条带磁盘按条带单元把范围拆分给各个成员复制；镜像磁盘从一个健康副本复制（失败时换一个副本）。
+ *
+ * @param       disk        指向Disk结构的指针。
+ * @param       block       第一个块。
+ * @param       count       块数。
+ * @param       fd          目标文件描述符（必须支持pwrite）。
+ * @param       offset      目标文件中的字节偏移。
+ *
+ * @return      复制的块数（失败时为DISK_FAILURE）。
+ **/
+ssize_t disk_copy_out(Disk *disk, size_t block, size_t count, int fd, off_t offset) {
+    if (disk == NULL || block + count > disk->blocks || block + count < block) {
+        return DISK_FAILURE;
+    }
+
+    size_t done = 0;
+    if (disk->mirrored) {
+        bool tried[disk->member_count];
+        memset(tried, 0, sizeof(tried));
+        for (ssize_t m = disk_pick_replica(disk, NULL); m >= 0 && done < count; m = disk_pick_replica(disk, tried)) {
+            tried[m] = true;
+            if (disk_copy_out(disk->members[m], block, count, fd, offset) == (ssize_t)count) {
+                __atomic_add_fetch(&disk->reads, count, __ATOMIC_RELAXED);
+                done = count;
+            }
+        }
+    } else if (disk->members != NULL) {
+        for (; done < count; ) {
+            size_t member_block;
+            Disk  *member = disk->members[disk_locate(disk, block + done, &member_block)];
+            size_t run    = min(count - done, disk->stripe - (block + done) % disk->stripe);
+            if (disk_copy_out(member, member_block, run, fd, offset + (off_t)BLOCK_SIZE * done) == DISK_FAILURE) {
+                return DISK_FAILURE;
+            }
+            __atomic_add_fetch(&disk->reads, run, __ATOMIC_RELAXED);
+            done += run;
+        }
+    } else if (disk->checksums == NULL && disk->model == NULL) {
+        uint64_t start = stats_now();
+        done = disk_copy_range(disk->fd, (off_t)BLOCK_SIZE * block, fd, offset, count * BLOCK_SIZE) / BLOCK_SIZE;
+        __atomic_add_fetch(&disk->reads, done, __ATOMIC_RELAXED);
+        for (size_t i = 0; i < done; i++) {
+            trace_record(disk->trace, TRACE_READ, block + i, start, true);
+        }
+    }
+
+    char buffer[BLOCK_SIZE];
+    for (; done < count; done++) {
+        if (disk_read(disk, block + done, buffer) == DISK_FAILURE ||
+            pwrite(fd, buffer, BLOCK_SIZE, offset + (off_t)BLOCK_SIZE * done) != BLOCK_SIZE) {
+            return DISK_FAILURE;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * 将文件描述符offset处的count个块直接复制到从block开始的连续块，执行以下操作：
+ *
+ *  1. 未启用校验和和延迟模型时，用copy_file_range在内核中复制，数据不经过用户空间。
+ *
+ *  2. 内核复制不可用、启用了校验和或延迟模型时，逐块读取后disk_write（更新校验和）。
+ *
+ * 条带磁盘按条带单元把范围拆分给各个成员复制；镜像磁盘复制到每个健康副本。
+ *
+ * @param       disk        指向Disk结构的指针。
+ * @param       block       第一个块。
+ * @param       count       块数。
+ * @param       fd          源文件描述符（必须支持pread，且至少包含count个块）。
+ * @param       offset      源文件中的字节偏移。
+ *
+ * @return      复制的块数（失败时为DISK_FAILURE）。
+ **/
+ssize_t disk_copy_in(Disk *disk, size_t block, size_t count, int fd, off_t offset) {
+    if (disk == NULL || block + count > disk->blocks || block + count < block) {
+        return DISK_FAILURE;
+    }
+
+    size_t done = 0;
+    if (disk->mirrored) {
+        size_t members = disk->member_count;
+        bool   failed[members];
+        size_t succeeded = 0;
+        for (size_t m = 0; m < members; m++) {
+            failed[m] = false;
+            if (!disk->members[m]->stale) {
+                failed[m]  = disk_copy_in(disk->members[m], block, count, fd, offset) == DISK_FAILURE;
+                succeeded += !failed[m];
+            }
+        }
+        for (size_t m = 0; m < members && succeeded > 0; m++) {
+            if (failed[m]) {
+                disk_mark_stale(disk, m);
+            }
+        }
+        if (succeeded == 0) {
+            return DISK_FAILURE;
+        }
+        __atomic_add_fetch(&disk->writes, count, __ATOMIC_RELAXED);
+        done = count;
+    } else if (disk->members != NULL) {
+        for (; done < count; ) {
+            size_t member_block;
+            Disk  *member = disk->members[disk_locate(disk, block + done, &member_block)];
+            size_t run    = min(count - done, disk->stripe - (block + done) % disk->stripe);
+            if (disk_copy_in(member, member_block, run, fd, offset + (off_t)BLOCK_SIZE * done) == DISK_FAILURE) {
+                return DISK_FAILURE;
+            }
+            __atomic_add_fetch(&disk->writes, run, __ATOMIC_RELAXED);
+            done += run;
+        }
+    } else if (disk->checksums == NULL && disk->model == NULL) {
+        uint64_t start = stats_now();
+        done = disk_copy_range(fd, offset, disk->fd, (off_t)BLOCK_SIZE * block, count * BLOCK_SIZE) / BLOCK_SIZE;
+        __atomic_add_fetch(&disk->writes, done, __ATOMIC_RELAXED);
+        for (size_t i = 0; i < done; i++) {
+            trace_record(disk->trace, TRACE_WRITE, block + i, start, true);
+        }
+        if (!disk_track(disk, block, done)) {
+            return DISK_FAILURE;
+        }
+    }
+
+    char buffer[BLOCK_SIZE];
+    for (; done < count; done++) {
+        if (pread(fd, buffer, BLOCK_SIZE, offset + (off_t)BLOCK_SIZE * done) != BLOCK_SIZE ||
+            disk_write(disk, block + done, buffer) == DISK_FAILURE) {
+            return DISK_FAILURE;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * 释放[block, block + count)占用的存储空间：在映像文件中打洞（FALLOC_FL_PUNCH_HOLE，文件大小不变），
+ * 这些块此后读取为全零，启用校验和时更新为全零块的校验和。
+ * 条带磁盘按条带单元把范围拆分给各个成员；镜像磁盘在每个健康副本上打洞。
+ *
+ * @param       disk        指向Disk结构的指针。
+ * @param       block       第一个块。
+ * @param       count       块数。
+ *
+ * @return      释放的块数（映像所在的文件系统不支持打洞或出错时为DISK_FAILURE）。
+ **/
+ssize_t disk_discard(Disk *disk, size_t block, size_t count) {
+    if (disk == NULL || block + count > disk->blocks || block + count < block) {
+        return DISK_FAILURE;
+    }
+
+    if (disk->mirrored) {
+        for (size_t m = 0; m < disk->member_count; m++) {
+            if (!disk->members[m]->stale && disk_discard(disk->members[m], block, count) == DISK_FAILURE) {
+                return DISK_FAILURE;
+            }
+        }
+    } else if (disk->members != NULL) {
+        for (size_t done = 0; done < count; ) {
+            size_t member_block;
+            Disk  *member = disk->members[disk_locate(disk, block + done, &member_block)];
+            size_t run    = min(count - done, disk->stripe - (block + done) % disk->stripe);
+            if (disk_discard(member, member_block, run) == DISK_FAILURE) {
+                return DISK_FAILURE;
+            }
+            done += run;
+        }
+    } else if (count > 0) {
+        if (fallocate(disk->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      (off_t)BLOCK_SIZE * block, (off_t)BLOCK_SIZE * count) == -1) {
+            return DISK_FAILURE;
+        }
+
+        if (disk->checksums != NULL) {
+            char zero[BLOCK_SIZE] = {0};
+            for (size_t i = 0; i < count; i++) {
+                disk->checksums[block + i] = disk_checksum(block + i, zero);
+            }
+            size_t bytes = count * sizeof(uint32_t);
+            if (pwrite(disk->checksum_fd, &disk->checksums[block], bytes, (off_t)sizeof(uint32_t) * block) != (ssize_t)bytes) {
+                return DISK_FAILURE;
+            }
+        }
+
+        if (!disk_track(disk, block, count)) {
+            return DISK_FAILURE;
+        }
+    }
+
+    disk->discards += count;
+    return count;
+}
+
+/**
+ * 建立一个检查点：返回当前代数并开始新的一代。代数大于检查点的块就是检查点之后写入（或打洞）的块，
+ * 增量发送（见delta.h）据此只传输变化的块。条带和镜像磁盘的每个成员映像分别跟踪，需要逐个发送。
+ *
+ * @param       disk        指向Disk结构的指针。
+ *
+ * @return      检查点（未启用变更跟踪或出错时为DISK_FAILURE）。
+ **/
+ssize_t disk_checkpoint(Disk *disk) {
+    if (disk == NULL || disk->generations == NULL || disk->generation == UINT32_MAX) {
+        return DISK_FAILURE;
+    }
+
+    uint32_t next = disk->generation + 1;
+    if (pwrite(disk->generation_fd, &next, sizeof(uint32_t), 0) != sizeof(uint32_t)) {
+        return DISK_FAILURE;
+    }
+
+    uint32_t checkpoint = disk->generation;
+    disk->generation = next;
+    return checkpoint;
+}
+
+/**
+ * 使用多个线程校验整个磁盘映像的所有块，报告每个校验失败的块（条带和镜像磁盘依次校验每个成员）。
+ *
+ * @param       disk        指向Disk结构的指针。
+ * @param       threads     校验线程数（0视为1，最多为CPU数的DISK_VERIFY_PER_CPU倍）。
+ *
+ * @return      校验失败的块数（未启用校验和或出错时为-1）。
+ **/
+ssize_t disk_verify(Disk *disk, size_t threads) {
+    if (disk != NULL && disk->members != NULL) {
+        ssize_t bad = 0;
+        for (size_t i = 0; i < disk->member_count; i++) {
+            ssize_t result = disk_verify(disk->members[i], threads);
+            if (result < 0) {
+                return -1;
+            }
+            bad += result;
+        }
+        return bad;
+    }
+
+    if (disk == NULL || disk->checksums == NULL) {
+        return -1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = max(1, min(threads, min(disk->blocks, (size_t)max(cpus, 1) * DISK_VERIFY_PER_CPU)));
+
+    DiskVerifyTask *tasks      = (DiskVerifyTask *)calloc(threads, sizeof(DiskVerifyTask));
+    pthread_t      *thread_ids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    size_t          per_thread = (disk->blocks + threads - 1) / threads;
+    ssize_t         bad = 0;
+
+    if (tasks == NULL || thread_ids == NULL) {
+        free(tasks);
+        free(thread_ids);
+        return -1;
+    }
+
+    for (size_t t = 0; t < threads; t++) {
+        tasks[t].disk  = disk;
+        tasks[t].start = min(t * per_thread, disk->blocks);
+        tasks[t].end   = min(tasks[t].start + per_thread, disk->blocks);
+        tasks[t].bad   = 0;
+
+        if (pthread_create(&thread_ids[t], NULL, disk_verify_thread, &tasks[t]) != 0) {
+            threads = t;
+            bad = -1;
+            break;
+        }
+    }
+
+    for (size_t t = 0; t < threads; t++) {
+        pthread_join(thread_ids[t], NULL);
+        if (bad >= 0) {
+            bad += tasks[t].bad;
+        }
+    }
+
+    free(tasks);
+    free(thread_ids);
+    return bad;
+}
+
+/**
+ * 重新同步镜像磁盘的一个副本（例如写入失败而落后的副本，或者替换后的新映像）：
+ *
+ *  1. 选择另一个健康副本作为来源，按DISK_SCAN_BLOCKS个块为一批读取来源和目标。
+ *
+ *  2. 把与来源不同（或在目标上读取失败）的块写入目标。
+ *
+ *  3. 全部完成后清除目标的落后标记。
+ *
+ * 同步期间不应有其他线程写入该磁盘。
+ *
+ * @param       disk        镜像磁盘。
+ * @param       replica     要同步的副本下标。
+ *
+ * @return      修复的块数（不是镜像磁盘、没有其他健康副本或出错时为-1）。
+ **/
+ssize_t disk_resync(Disk *disk, size_t replica) {
+    if (disk == NULL || !disk->mirrored || replica >= disk->member_count) {
+        return -1;
+    }
+
+    bool excluded[disk->member_count];
+    memset(excluded, 0, sizeof(excluded));
+    excluded[replica] = true;
+
+    ssize_t source_index = disk_pick_replica(disk, excluded);
+    if (source_index < 0) {
+        return -1;
+    }
+
+    Disk        *source   = disk->members[source_index];
+    Disk        *target   = disk->members[replica];
+    char        *buffer   = (char *)malloc(2 * DISK_SCAN_BLOCKS * BLOCK_SIZE);
+    DiskRequest *requests = (DiskRequest *)malloc(2 * DISK_SCAN_BLOCKS * sizeof(DiskRequest));
+    ssize_t      repaired = 0;
+
+    if (buffer == NULL || requests == NULL) {
+        free(buffer);
+        free(requests);
+        return -1;
+    }
+
+    for (size_t block = 0; block < disk->blocks && repaired >= 0; block += DISK_SCAN_BLOCKS) {
+        size_t count = min(DISK_SCAN_BLOCKS, disk->blocks - block);
+        for (size_t i = 0; i < count; i++) {
+            requests[i]         = (DiskRequest){.block = block + i, .data = buffer + i * BLOCK_SIZE};
+            requests[count + i] = (DiskRequest){.block = block + i, .data = buffer + (count + i) * BLOCK_SIZE};
+        }
+
+        if (disk_submit(source, requests, count) != (ssize_t)count) {
+            repaired = -1;
+            break;
+        }
+        disk_submit(target, requests + count, count);
+
+        size_t writes = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (requests[count + i].result == DISK_FAILURE || memcmp(requests[i].data, requests[count + i].data, BLOCK_SIZE) != 0) {
+                requests[i].write = true;
+                requests[writes++] = requests[i];
+            }
+        }
+
+        if (disk_submit(target, requests, writes) != (ssize_t)writes) {
+            repaired = -1;
+            break;
+        }
+        repaired += writes;
+    }
+
+    free(buffer);
+    free(requests);
+
+    if (repaired >= 0) {
+        target->stale = false;
+    }
+    return repaired;
+}
+
 /* 内部函数 */
 
 /**
@@ -198,4 +942,716 @@ bool disk_sanity_check(Disk *disk, size_t block, const char *data) {
 
 }
 
+/**
+ * 计算块的校验和。以块号作为初始值，写错位置的块也能被发现。
+ *
+ * @param       block       块编号。
+ * @param       data        块数据（BLOCK_SIZE字节）。
+ *
+ * @return      块的CRC32C校验和。
+ **/
+uint32_t disk_checksum(size_t block, const char *data) {
+    return crc32c((uint32_t)block, data, BLOCK_SIZE);
+}
+
+/**
+ * 加载校验和文件，执行以下操作：
+ *
+ *  1. 打开（或创建）<path>.crc。
+ *
+ *  2. 文件大小与块数相符时直接读入校验和。
+ *
+ *  3. 否则根据映像当前的内容计算所有块的校验和并写入文件。
+ *
+ * @param       disk        指向Disk结构的指针。
+ * @param       path        磁盘映像的路径。
+ *
+ * @return      是否成功。
+ **/
+bool disk_checksum_open(Disk *disk, const char *path) {
+    char checksum_path[PATH_MAX];
+    if (snprintf(checksum_path, sizeof(checksum_path), "%s.crc", path) >= (int)sizeof(checksum_path)) {
+        return false;
+    }
+
+    disk->checksum_fd = open(checksum_path, O_RDWR|O_CREAT, 0644);
+    if (disk->checksum_fd == -1) {
+        return false;
+    }
+
+    size_t bytes = disk->blocks * sizeof(uint32_t);
+    disk->checksums = (uint32_t *)malloc(max(bytes, 1));
+    if (disk->checksums == NULL) {
+        return false;
+    }
+
+    struct stat s;
+    if (fstat(disk->checksum_fd, &s) == 0 && (size_t)s.st_size == bytes &&
+        pread(disk->checksum_fd, disk->checksums, bytes, 0) == (ssize_t)bytes) {
+        return true;
+    }
+
+    info("Computing checksums for %zu blocks of %s", disk->blocks, path);
+
+    char *buffer = (char *)malloc(DISK_SCAN_BLOCKS * BLOCK_SIZE);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    for (size_t block = 0; block < disk->blocks; block += DISK_SCAN_BLOCKS) {
+        size_t count = min(DISK_SCAN_BLOCKS, disk->blocks - block);
+        if (pread(disk->fd, buffer, count * BLOCK_SIZE, (off_t)block * BLOCK_SIZE) != (ssize_t)(count * BLOCK_SIZE)) {
+            free(buffer);
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            disk->checksums[block + i] = disk_checksum(block + i, buffer + i * BLOCK_SIZE);
+        }
+    }
+    free(buffer);
+
+    return ftruncate(disk->checksum_fd, bytes) == 0 &&
+           pwrite(disk->checksum_fd, disk->checksums, bytes, 0) == (ssize_t)bytes;
+}
+
+/**
+ * 加载代数文件，执行以下操作：
+ *
+ *  1. 打开<path>.gen（create为false且文件不存在时不跟踪）。
+ *
+ *  2. 文件大小与块数相符时读入当前代数（第一项）和每个块的代数。
+ *
+ *  3. 否则开始新的一代，所有块都记录为这一代，因此之前的任何检查点都会发送整个映像。
+ *
+ * @param       disk        指向Disk结构的指针。
+ * @param       path        磁盘映像的路径。
+ * @param       create      代数文件不存在时是否创建。
+ *
+ * @return      是否成功。
+ **/
+bool disk_generation_open(Disk *disk, const char *path, bool create) {
+    char generation_path[PATH_MAX];
+    if (snprintf(generation_path, sizeof(generation_path), "%s.gen", path) >= (int)sizeof(generation_path)) {
+        return false;
+    }
+
+    disk->generation_fd = open(generation_path, O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (disk->generation_fd == -1) {
+        return !create && errno == ENOENT;
+    }
+
+    size_t bytes = disk->blocks * sizeof(uint32_t);
+    disk->generations = (uint32_t *)malloc(max(bytes, 1));
+    if (disk->generations == NULL) {
+        return false;
+    }
+
+    struct stat s;
+    if (fstat(disk->generation_fd, &s) == 0 && (size_t)s.st_size == bytes + sizeof(uint32_t) &&
+        pread(disk->generation_fd, &disk->generation, sizeof(uint32_t), 0) == sizeof(uint32_t) &&
+        pread(disk->generation_fd, disk->generations, bytes, sizeof(uint32_t)) == (ssize_t)bytes) {
+        return true;
+    }
+
+    uint32_t previous = 0;
+    if (pread(disk->generation_fd, &previous, sizeof(uint32_t), 0) != sizeof(uint32_t) || previous == UINT32_MAX) {
+        previous = 0;
+    }
+
+    info("Tracking changes to %zu blocks of %s", disk->blocks, path);
+    disk->generation = previous + 1;
+    for (size_t block = 0; block < disk->blocks; block++) {
+        disk->generations[block] = disk->generation;
+    }
+
+    return ftruncate(disk->generation_fd, 0) == 0 &&
+           pwrite(disk->generation_fd, &disk->generation, sizeof(uint32_t), 0) == sizeof(uint32_t) &&
+           pwrite(disk->generation_fd, disk->generations, bytes, sizeof(uint32_t)) == (ssize_t)bytes;
+}
+
+/**
+ * 把[block, block + count)记录为当前代数写入的块，只保存代数变化的部分（未跟踪时什么也不做）。
+ *
+ * @return      是否成功。
+ **/
+bool disk_track(Disk *disk, size_t block, size_t count) {
+    if (disk->generations == NULL) {
+        return true;
+    }
+
+    size_t first = count, last = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (disk->generations[block + i] != disk->generation) {
+            disk->generations[block + i] = disk->generation;
+            first = min(first, i);
+            last  = i;
+        }
+    }
+    if (first == count) {
+        return true;
+    }
+
+    size_t bytes = (last - first + 1) * sizeof(uint32_t);
+    return pwrite(disk->generation_fd, &disk->generations[block + first], bytes,
+                  (off_t)sizeof(uint32_t) * (block + first + 1)) == (ssize_t)bytes;
+}
+
+/**
+ * 校验线程：按DISK_SCAN_BLOCKS个块为一批读取并校验[start, end)范围内的块。
+ *
+ * @param       arg         指向DiskVerifyTask结构的指针。
+ *
+ * @return      NULL。
+ **/
+void *disk_verify_thread(void *arg) {
+    DiskVerifyTask *task = (DiskVerifyTask *)arg;
+    Disk           *disk = task->disk;
+
+    char *buffer = (char *)malloc(DISK_SCAN_BLOCKS * BLOCK_SIZE);
+    if (buffer == NULL) {
+        task->bad = task->end - task->start;
+        return NULL;
+    }
+
+    for (size_t block = task->start; block < task->end; block += DISK_SCAN_BLOCKS) {
+        size_t count = min(DISK_SCAN_BLOCKS, task->end - block);
+        if (pread(disk->fd, buffer, count * BLOCK_SIZE, (off_t)block * BLOCK_SIZE) != (ssize_t)(count * BLOCK_SIZE)) {
+            error("Unable to read blocks %zu-%zu", block, block + count - 1);
+            task->bad += count;
+            continue;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (disk_checksum(block + i, buffer + i * BLOCK_SIZE) != disk->checksums[block + i]) {
+                error("Checksum mismatch in block %zu", block + i);
+                task->bad++;
+            }
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * 用copy_file_range在两个文件描述符之间复制数据，直到完成或内核复制失败。
+ *
+ * @return      复制的字节数（内核复制不可用时为0）。
+ **/
+size_t disk_copy_range(int in_fd, off_t in_offset, int out_fd, off_t out_offset, size_t length) {
+    size_t copied = 0;
+
+    while (copied < length) {
+        ssize_t result = copy_file_range(in_fd, &in_offset, out_fd, &out_offset, length - copied, 0);
+        if (result <= 0) {
+            break;
+        }
+        copied += result;
+    }
+
+    return copied;
+}
+
+/**
+ * 记录一次块访问：更新磁头位置和寻道距离，成功时施加延迟模型的模拟耗时，再记录统计和跟踪，
+ * 因此统计和跟踪中的延迟都包含模拟的耗时。
+ **/
+void disk_account(Disk *disk, bool write, size_t block, uint64_t start, size_t depth, ssize_t result) {
+    if (disk == NULL) {
+        return;
+    }
+
+    size_t head = __atomic_exchange_n(&disk->head, block + 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&disk->seek_distance, block > head ? block - head : head - block, __ATOMIC_RELAXED);
+
+    if (result != DISK_FAILURE && disk->model != NULL) {
+        __atomic_fetch_add(&disk->simulated, model_access(disk->model, write, block, depth), __ATOMIC_RELAXED);
+    }
+
+    stats_record(&disk->stats, write ? STATS_DISK_WRITE : STATS_DISK_READ, start, result != DISK_FAILURE, max(result, 0));
+    trace_record(disk->trace, write ? TRACE_WRITE : TRACE_READ, block, start, result != DISK_FAILURE);
+    __atomic_sub_fetch(&disk->inflight, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * 按电梯顺序比较两个队列项（key相同时按提交顺序）。
+ **/
+int disk_queue_compare(const void *a, const void *b) {
+    const DiskQueueEntry *x = (const DiskQueueEntry *)a;
+    const DiskQueueEntry *y = (const DiskQueueEntry *)b;
+
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * 分发count个方向相同、块号连续的请求：多于一个时用一次preadv/pwritev完成，
+ * 否则（或向量I/O失败时）逐块调用disk_read/disk_write。合并请求中的每个块都按队列深度1
+ * 计入延迟模型（对HDD而言后续块是连续访问），统计、跟踪和读写次数也按块记录。
+ *
+ * @return      成功的请求数。
+ **/
+size_t disk_dispatch(Disk *disk, DiskRequest *requests, const DiskQueueEntry *entries, size_t count) {
+    DiskRequest *first = &requests[entries[0].index];
+    bool         write = first->write;
+    bool         valid = count > 1 && first->block + count <= disk->blocks;
+    struct iovec vector[DISK_QUEUE_MERGE];
+
+    for (size_t i = 0; i < count; i++) {
+        vector[i].iov_base = requests[entries[i].index].data;
+        vector[i].iov_len  = BLOCK_SIZE;
+        valid = valid && vector[i].iov_base != NULL;
+    }
+
+    if (valid) {
+        uint64_t start  = stats_now();
+        off_t    offset = (off_t)BLOCK_SIZE * first->block;
+        ssize_t  bytes;
+
+        __atomic_add_fetch(&disk->inflight, count, __ATOMIC_RELAXED);
+        if (write) {
+            bytes = pwritev(disk->fd, vector, count, offset);
+            if (bytes == (ssize_t)(count * BLOCK_SIZE) && disk->checksums != NULL) {
+                for (size_t i = 0; i < count; i++) {
+                    disk->checksums[first->block + i] = disk_checksum(first->block + i, vector[i].iov_base);
+                }
+                size_t length = count * sizeof(uint32_t);
+                if (pwrite(disk->checksum_fd, &disk->checksums[first->block], length, (off_t)sizeof(uint32_t) * first->block) != (ssize_t)length) {
+                    bytes = -1;
+                }
+            }
+            if (bytes == (ssize_t)(count * BLOCK_SIZE) && !disk_track(disk, first->block, count)) {
+                bytes = -1;
+            }
+        } else {
+            bytes = preadv(disk->fd, vector, count, offset);
+        }
+
+        if (bytes == (ssize_t)(count * BLOCK_SIZE)) {
+            size_t done = 0;
+            for (size_t i = 0; i < count; i++) {
+                DiskRequest *request = &requests[entries[i].index];
+                request->result = BLOCK_SIZE;
+                if (write) {
+                    __atomic_add_fetch(&disk->writes, 1, __ATOMIC_RELAXED);
+                } else {
+                    __atomic_add_fetch(&disk->reads, 1, __ATOMIC_RELAXED);
+                    if (disk->checksums != NULL && disk_checksum(request->block, request->data) != disk->checksums[request->block]) {
+                        error("Checksum mismatch in block %zu", request->block);
+                        __atomic_add_fetch(&disk->checksum_errors, 1, __ATOMIC_RELAXED);
+                        request->result = DISK_FAILURE;
+                    }
+                }
+
+                disk_account(disk, write, request->block, start, 1, request->result);
+                done += request->result != DISK_FAILURE;
+            }
+            return done;
+        }
+
+        __atomic_sub_fetch(&disk->inflight, count, __ATOMIC_RELAXED);
+    }
+
+    size_t done = 0;
+    for (size_t i = 0; i < count; i++) {
+        DiskRequest *request = &requests[entries[i].index];
+        request->result = write ? disk_write(disk, request->block, request->data) : disk_read(disk, request->block, request->data);
+        done += request->result != DISK_FAILURE;
+    }
+    return done;
+}
+
+/**
+ * 关闭文件描述符和成员磁盘，写入并关闭块I/O跟踪（如果启用），释放磁盘结构的内存（不报告统计）。
+ **/
+void disk_release(Disk *disk) {
+    for (size_t i = 0; i < disk->member_count; i++) {
+        disk_release(disk->members[i]);
+    }
+
+    if (disk->fd >= 0) {
+        close(disk->fd);
+    }
+    if (disk->checksum_fd >= 0) {
+        close(disk->checksum_fd);
+    }
+    if (disk->generation_fd >= 0) {
+        close(disk->generation_fd);
+    }
+
+    if (!trace_close(disk->trace)) {
+        error("Unable to write block I/O trace");
+    }
+
+    model_close(disk->model);
+    free(disk->members);
+    free(disk->checksums);
+    free(disk->generations);
+    free(disk);
+}
+
+/**
+ * 返回条带磁盘中逻辑块所在的成员，并设置它在成员中的块号。
+ **/
+size_t disk_locate(Disk *disk, size_t block, size_t *member_block) {
+    size_t unit = block / disk->stripe;
+
+    *member_block = unit / disk->member_count * disk->stripe + block % disk->stripe;
+    return unit % disk->member_count;
+}
+
+/**
+ * 提交条带磁盘的一批请求，执行以下操作：
+ *
+ *  1. 按成员拆分成子批次（块号转换为成员内的块号，数据缓冲区不复制）。
+ *
+ *  2. 各成员并行提交自己的子批次（见disk_fan_out），每个成员内部仍按电梯顺序合并。
+ *
+ *  3. 把结果复制回原请求，按逻辑块记录读写次数、统计和跟踪。
+ *
+ * @return      成功的请求数（内存不足时为DISK_FAILURE）。
+ **/
+ssize_t disk_submit_striped(Disk *disk, DiskRequest *requests, size_t count) {
+    size_t          members = disk->member_count;
+    DiskRequest    *batch   = (DiskRequest *)malloc(max(count, 1) * sizeof(DiskRequest));
+    size_t         *origin  = (size_t *)malloc(max(count, 1) * sizeof(size_t));
+    DiskMemberTask  tasks[members];
+
+    if (batch == NULL || origin == NULL) {
+        free(batch);
+        free(origin);
+        return DISK_FAILURE;
+    }
+
+    for (size_t m = 0; m < members; m++) {
+        tasks[m] = (DiskMemberTask){.disk = disk->members[m]};
+    }
+
+    size_t member_block;
+    for (size_t i = 0; i < count; i++) {
+        requests[i].result = DISK_FAILURE;
+        if (requests[i].block < disk->blocks) {
+            tasks[disk_locate(disk, requests[i].block, &member_block)].count++;
+        }
+    }
+
+    for (size_t m = 0, offset = 0; m < members; m++) {
+        tasks[m].requests = batch + offset;
+        offset += tasks[m].count;
+        tasks[m].count = 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (requests[i].block < disk->blocks) {
+            DiskMemberTask *task  = &tasks[disk_locate(disk, requests[i].block, &member_block)];
+            DiskRequest    *entry = &task->requests[task->count++];
+            *entry = requests[i];
+            entry->block  = member_block;
+            origin[entry - batch] = i;
+        }
+    }
+
+    uint64_t start = stats_now();
+    __atomic_add_fetch(&disk->inflight, count, __ATOMIC_RELAXED);
+    disk_fan_out(tasks, members);
+
+    for (size_t m = 0; m < members; m++) {
+        for (size_t j = 0; j < tasks[m].count; j++) {
+            requests[origin[tasks[m].requests + j - batch]].result = tasks[m].requests[j].result;
+        }
+    }
+
+    free(batch);
+    free(origin);
+    return disk_complete(disk, requests, count, start);
+}
+
+/**
+ * 提交镜像磁盘的一批请求，执行以下操作：
+ *
+ *  1. 写请求复制到每个健康的副本；读请求按提交顺序分成连续的几段，每个健康副本读取一段，
+ *     因此大的顺序读取由所有副本分担，每段内部仍可合并。同一个块的读写在同一个副本上保持顺序。
+ *
+ *  2. 各副本并行提交自己的子批次（见disk_fan_out）。
+ *
+ *  3. 写请求至少在一个副本上成功即为成功，写入失败的副本被标记为落后；
+ *     失败的读请求在其他副本上重试（见disk_read_mirrored）。
+ *
+ *  4. 按逻辑块记录读写次数、统计和跟踪。
+ *
+ * @return      成功的请求数（内存不足时为DISK_FAILURE）。
+ **/
+ssize_t disk_submit_mirrored(Disk *disk, DiskRequest *requests, size_t count) {
+    size_t          members = disk->member_count;
+    size_t          healthy[members];
+    size_t          replicas = 0;
+    size_t          reads    = 0;
+    size_t          writes   = 0;
+    DiskMemberTask  tasks[members];
+
+    for (size_t m = 0; m < members; m++) {
+        tasks[m] = (DiskMemberTask){.disk = disk->members[m]};
+        if (!disk->members[m]->stale) {
+            healthy[replicas++] = m;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        requests[i].result = DISK_FAILURE;
+        if (requests[i].block < disk->blocks) {
+            reads  += !requests[i].write;
+            writes +=  requests[i].write;
+        }
+    }
+
+    size_t       total  = reads + writes * replicas;
+    DiskRequest *batch  = (DiskRequest *)malloc(max(total, 1) * sizeof(DiskRequest));
+    size_t      *origin = (size_t *)malloc(max(total, 1) * sizeof(size_t));
+    size_t      *succeeded = (size_t *)calloc(max(count, 1), sizeof(size_t));
+    if (batch == NULL || origin == NULL || succeeded == NULL) {
+        free(batch);
+        free(origin);
+        free(succeeded);
+        return DISK_FAILURE;
+    }
+
+    size_t share = replicas ? (reads + replicas - 1) / replicas : 0;
+    for (size_t r = 0, offset = 0; r < replicas; r++) {
+        DiskMemberTask *task = &tasks[healthy[r]];
+        task->requests = batch + offset;
+        offset += writes + min(share, reads - min(reads, r * share));
+    }
+
+    for (size_t i = 0, read = 0; i < count && replicas > 0; i++) {
+        if (requests[i].block >= disk->blocks) {
+            continue;
+        }
+
+        for (size_t r = 0; r < replicas; r++) {
+            DiskMemberTask *task = &tasks[healthy[r]];
+            if (requests[i].write || read / share == r) {
+                origin[task->requests + task->count - batch] = i;
+                task->requests[task->count++] = requests[i];
+            }
+        }
+        read += !requests[i].write;
+    }
+
+    uint64_t start = stats_now();
+    __atomic_add_fetch(&disk->inflight, count, __ATOMIC_RELAXED);
+    disk_fan_out(tasks, members);
+
+    for (size_t m = 0; m < members; m++) {
+        for (size_t j = 0; j < tasks[m].count; j++) {
+            succeeded[origin[tasks[m].requests + j - batch]] += tasks[m].requests[j].result != DISK_FAILURE;
+        }
+    }
+
+    for (size_t m = 0; m < members; m++) {
+        for (size_t j = 0; j < tasks[m].count; j++) {
+            const DiskRequest *entry = &tasks[m].requests[j];
+            if (entry->write && entry->result == DISK_FAILURE && succeeded[origin[entry - batch]] > 0) {
+                disk_mark_stale(disk, m);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        DiskRequest *request = &requests[i];
+        if (succeeded[i] > 0) {
+            request->result = BLOCK_SIZE;
+        } else if (!request->write && request->block < disk->blocks) {
+            request->result = disk_read_mirrored(disk, request->block, request->data);
+        }
+    }
+
+    free(batch);
+    free(origin);
+    free(succeeded);
+    return disk_complete(disk, requests, count, start);
+}
+
+/**
+ * 并行提交各成员的子批次：每个有请求的成员在自己的线程中disk_submit（第一个在调用线程中执行，
+ * 无法创建线程时也在调用线程中执行）。出错时子批次中的请求保持DISK_FAILURE。
+ *
+ * @param       tasks       每个成员的子批次。
+ * @param       members     成员数。
+ **/
+void disk_fan_out(DiskMemberTask *tasks, size_t members) {
+    pthread_t thread_ids[members];
+    bool      started[members];
+    size_t    inline_member = members;
+
+    for (size_t m = 0; m < members; m++) {
+        started[m] = false;
+        for (size_t i = 0; i < tasks[m].count; i++) {
+            tasks[m].requests[i].result = DISK_FAILURE;
+        }
+    }
+
+    for (size_t m = 0; m < members; m++) {
+        if (tasks[m].count == 0) {
+            continue;
+        }
+        if (inline_member == members) {
+            inline_member = m;
+        } else {
+            started[m] = pthread_create(&thread_ids[m], NULL, disk_submit_thread, &tasks[m]) == 0;
+            if (!started[m]) {
+                disk_submit_thread(&tasks[m]);
+            }
+        }
+    }
+
+    if (inline_member < members) {
+        disk_submit_thread(&tasks[inline_member]);
+    }
+
+    for (size_t m = 0; m < members; m++) {
+        if (started[m]) {
+            pthread_join(thread_ids[m], NULL);
+        }
+    }
+}
+
+/**
+ * 分发线程：提交一个成员的子批次。
+ **/
+void *disk_submit_thread(void *arg) {
+    DiskMemberTask *task = (DiskMemberTask *)arg;
+
+    disk_submit(task->disk, task->requests, task->count);
+    return NULL;
+}
+
+/**
+ * 条带或镜像磁盘的批次完成后，按逻辑块记录读写次数、统计和跟踪。
+ *
+ * @return      成功的请求数。
+ **/
+size_t disk_complete(Disk *disk, DiskRequest *requests, size_t count, uint64_t start) {
+    size_t done = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        DiskRequest *request = &requests[i];
+        if (request->result != DISK_FAILURE) {
+            if (request->write) {
+                __atomic_add_fetch(&disk->writes, 1, __ATOMIC_RELAXED);
+            } else {
+                __atomic_add_fetch(&disk->reads, 1, __ATOMIC_RELAXED);
+            }
+            done++;
+        }
+        disk_account(disk, request->write, request->block, start, 1, request->result);
+    }
+
+    return done;
+}
+
+/**
+ * 选择负载最低的健康副本：正在进行的请求最少，其次是累计读取次数最少（单线程时轮流读取各副本）。
+ *
+ * @param       disk        镜像磁盘。
+ * @param       excluded    不考虑的副本（NULL表示都考虑）。
+ *
+ * @return      副本的下标（没有可用的副本时为-1）。
+ **/
+ssize_t disk_pick_replica(Disk *disk, const bool *excluded) {
+    ssize_t best = -1;
+
+    for (size_t m = 0; m < disk->member_count; m++) {
+        Disk *member = disk->members[m];
+        if (member->stale || (excluded && excluded[m])) {
+            continue;
+        }
+
+        if (best < 0) {
+            best = m;
+            continue;
+        }
+
+        Disk  *other    = disk->members[best];
+        size_t inflight = __atomic_load_n(&member->inflight, __ATOMIC_RELAXED);
+        size_t current  = __atomic_load_n(&other->inflight, __ATOMIC_RELAXED);
+        if (inflight < current || (inflight == current && __atomic_load_n(&member->reads, __ATOMIC_RELAXED) < __atomic_load_n(&other->reads, __ATOMIC_RELAXED))) {
+            best = m;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * 从镜像磁盘读取一个块：先读负载最低的健康副本，失败时依次尝试其余健康副本。
+ * 读取成功后，把正确的数据写回之前读取失败的副本（写回也失败的副本被标记为落后）。
+ *
+ * @return      BLOCK_SIZE（所有健康副本都失败时为DISK_FAILURE）。
+ **/
+ssize_t disk_read_mirrored(Disk *disk, size_t block, char *data) {
+    size_t members = disk->member_count;
+    bool   tried[members];
+
+    memset(tried, 0, sizeof(tried));
+    for (ssize_t m = disk_pick_replica(disk, NULL); m >= 0; m = disk_pick_replica(disk, tried)) {
+        tried[m] = true;
+        if (disk_read(disk->members[m], block, data) == DISK_FAILURE) {
+            continue;
+        }
+
+        for (size_t f = 0; f < members; f++) {
+            if (tried[f] && f != (size_t)m) {
+                info("Repairing block %zu on replica %zu", block, f);
+                if (disk_write(disk->members[f], block, data) == DISK_FAILURE) {
+                    disk_mark_stale(disk, f);
+                }
+            }
+        }
+        return BLOCK_SIZE;
+    }
+
+    return DISK_FAILURE;
+}
+
+/**
+ * 把一个块写入镜像磁盘的每个健康副本。至少一个副本成功即为成功，
+ * 此时写入失败的副本被标记为落后（全部失败时副本之间没有差异，不标记）。
+ *
+ * @return      BLOCK_SIZE（所有健康副本都失败时为DISK_FAILURE）。
+ **/
+ssize_t disk_write_mirrored(Disk *disk, size_t block, char *data) {
+    size_t members = disk->member_count;
+    bool   failed[members];
+    size_t succeeded = 0;
+
+    for (size_t m = 0; m < members; m++) {
+        failed[m] = false;
+        if (!disk->members[m]->stale) {
+            failed[m]  = disk_write(disk->members[m], block, data) == DISK_FAILURE;
+            succeeded += !failed[m];
+        }
+    }
+
+    for (size_t m = 0; m < members && succeeded > 0; m++) {
+        if (failed[m]) {
+            disk_mark_stale(disk, m);
+        }
+    }
+
+    return succeeded > 0 ? BLOCK_SIZE : DISK_FAILURE;
+}
+
+/**
+ * 把镜像副本标记为落后：之后的读写都不再使用它，直到disk_resync。
+ **/
+void disk_mark_stale(Disk *disk, size_t replica) {
+    if (!disk->members[replica]->stale) {
+        error("Replica %zu fell behind; resync it before using it again", replica);
+        disk->members[replica]->stale = true;
+    }
+}
+
 /* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
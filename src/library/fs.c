@@ -1,11 +1,205 @@
 /* fs.c: SimpleFS 文件系统 */
 
+#include "sfs/crc32c.h"
 #include "sfs/fs.h"
 #include "sfs/logging.h"
+#include "sfs/lz.h"
 #include "sfs/utils.h"
 
+#include <ctype.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+/* 内部常量 */
+
+#define FS_COPY_BLOCKS      (64)                /* 无法直接复制时每次经过缓冲区的块数 */
+#define FS_SCAN_BATCH       (256)               /* 挂载扫描、格式化和写回时每批提交给请求队列的块数 */
+#define FS_INSPECT_BATCH    (16)                /* 检查线程每次领取的inode块数 */
+#define FS_INSPECT_FLUSH    (1<<16)             /* 检查线程积累多少字节的记录后写入输出流 */
+#define FS_INSPECT_THREADS  (64)                /* 检查线程数的上限 */
+
+/* 内部结构 */
+
+typedef struct BlockMap BlockMap;
+struct BlockMap {
+    size_t      inode_number;                   /* 被映射的inode编号 */
+    Inode      *inode;                          /* 被映射的inode */
+    Block       indirect;                       /* 按需加载的间接块（只使用前block_size字节） */
+    bool        loaded;                         /* 间接块是否已加载 */
+    bool        dirty;                          /* 间接块是否需要写回 */
+    size_t      goal;                           /* 没有更好的位置时分配的起点（inode所在分配组的第一个数据块） */
+};
+
+struct FsEngine {
+    pthread_t           thread;                 /* 引擎线程 */
+    pthread_mutex_t     lock;                   /* 保护队列、pending和stop */
+    pthread_cond_t      submitted;              /* 通知引擎有新请求或应该退出 */
+    pthread_cond_t      completed;              /* 通知fs_async_reap有请求完成 */
+    FsRequest          *queue;                  /* 已提交、尚未执行的请求（按提交顺序） */
+    FsRequest          *queue_tail;             /* queue的最后一个请求 */
+    FsRequest          *done;                   /* 已完成、等待fs_async_reap取回的请求 */
+    FsRequest          *done_tail;              /* done的最后一个请求 */
+    size_t              pending;                /* 已提交但尚未完成的请求数 */
+    bool                stop;                   /* 执行完队列中的请求后退出 */
+};
+
+typedef struct FreeList FreeList;
+struct FreeList {
+    size_t     *blocks;                         /* 待释放的块 */
+    size_t      count;                          /* blocks中的块数 */
+    size_t      capacity;                       /* blocks的容量 */
+};
+
+typedef struct InspectScan InspectScan;
+struct InspectScan {
+    FileSystem             fs;                  /* 按超级块设置了几何的文件系统（不挂载） */
+    const InspectOptions  *options;             /* 过滤条件和输出格式 */
+    FILE                  *stream;              /* 输出流 */
+    pthread_mutex_t        lock;                /* 保护stream */
+    size_t                 next;                /* 下一个未被领取的inode块（原子地领取） */
+    size_t                 end;                 /* 要扫描的最后一个inode块之后的块 */
+    size_t                 reported;            /* 输出的inode数（原子地累加） */
+    bool                   failed;              /* 是否有读取或写入失败（原子地设置） */
+};
+
+typedef struct InspectWalk InspectWalk;
+struct InspectWalk {
+    size_t          blocks;                     /* 数据块数 */
+    size_t          indirect;                   /* 间接块数 */
+    size_t          extents;                    /* 连续区间数 */
+    InspectExtent   current;                    /* 正在延伸的区间 */
+    InspectExtent  *list;                       /* 已结束的区间（只在请求区间列表时记录） */
+    size_t          listed;                     /* list中的区间数 */
+    size_t          capacity;                   /* list的容量 */
+    char           *levels[3];                  /* 每一层间接块的缓冲区 */
+    bool            failed;                     /* 是否有间接块读取失败 */
+};
+
+typedef struct InspectOutput InspectOutput;
+struct InspectOutput {
+    char       *data;                           /* 尚未写入输出流的记录 */
+    size_t      length;                         /* data中的字节数 */
+    size_t      capacity;                       /* data的容量 */
+};
+
+typedef struct AsyncCopy AsyncCopy;
+struct AsyncCopy {
+    size_t      request;                        /* 读入中转缓冲区的块请求 */
+    char       *target;                         /* 调用者缓冲区中的位置 */
+    size_t      skip;                           /* 块内的起始偏移 */
+    size_t      bytes;                          /* 复制的字节数 */
+};
+
+/* 内部函数 */
+
+bool        fs_geometry(FileSystem *fs, size_t block_size, size_t inode_size);
+ssize_t     fs_read_block(FileSystem *fs, size_t block, char *data);
+ssize_t     fs_write_block(FileSystem *fs, size_t block, char *data);
+bool        fs_submit(FileSystem *fs, DiskRequest *requests, size_t count);
+size_t      fs_inode_block(FileSystem *fs, size_t inode_number);
+size_t      fs_inode_table_block(FileSystem *fs, size_t index);
+size_t      fs_group_start(FileSystem *fs, size_t group);
+size_t      fs_group_count(const SuperBlock *super);
+bool        fs_inode_grow(FileSystem *fs);
+size_t      fs_block_group(FileSystem *fs, size_t block);
+bool        fs_is_data_block(FileSystem *fs, size_t block);
+size_t      fs_inode_goal(FileSystem *fs, size_t inode_number);
+size_t      fs_dedup_start(FileSystem *fs);
+bool        fs_groups_open(FileSystem *fs);
+void        fs_groups_close(FileSystem *fs);
+size_t      fs_group_extent(FileSystem *fs, AllocGroup *group);
+size_t      fs_free_block_count(FileSystem *fs);
+void        fs_save_counts(FileSystem *fs);
+Inode *     fs_inode_at(FileSystem *fs, char *data, size_t inode_number);
+InodeExtension *fs_inode_extension(FileSystem *fs, Inode *inode);
+size_t      fs_file_size(FileSystem *fs, Inode *inode);
+void        fs_set_file_size(FileSystem *fs, Inode *inode, size_t size);
+bool        fs_validate(FileSystem *fs, const SuperBlock *super, Disk *disk);
+void        fs_map_init(FileSystem *fs, BlockMap *map, size_t inode_number, Inode *inode);
+bool        fs_mount_scan(FileSystem *fs);
+bool        fs_scan_indirect(FileSystem *fs, DiskRequest *requests, size_t count);
+bool        fs_scan_tree(FileSystem *fs, size_t block, size_t depth);
+void        fs_mark_used(FileSystem *fs, size_t block);
+size_t      fs_data_start(FileSystem *fs);
+bool        fs_load_inode(FileSystem *fs, size_t inode_number, Block *inode_block, Inode **inode);
+bool        fs_save_inode(FileSystem *fs, size_t inode_number, Block *inode_block);
+ssize_t     fs_allocate_block(FileSystem *fs, size_t goal);
+void        fs_release_block(FileSystem *fs, size_t block);
+void        fs_discard_flush(FileSystem *fs);
+size_t      fs_find_run(FileSystem *fs, size_t count, size_t goal, size_t *start);
+bool        fs_map_load(FileSystem *fs, BlockMap *map, bool create, size_t goal);
+ssize_t     fs_map_lookup(FileSystem *fs, BlockMap *map, size_t block_index);
+uint32_t *  fs_map_slot(FileSystem *fs, BlockMap *map, size_t block_index, size_t goal);
+bool        fs_map_flush(FileSystem *fs, BlockMap *map);
+bool        fs_map_deep(FileSystem *fs, BlockMap *map, size_t index, bool create, size_t goal, uint32_t **slot);
+char *      fs_map_cache_get(FileSystem *fs, size_t block, bool fresh, bool touch);
+bool        fs_map_cache_flush(FileSystem *fs);
+size_t      fs_map_limit(FileSystem *fs);
+bool        fs_free_tail(FileSystem *fs, BlockMap *map, size_t first);
+bool        fs_free_collect(FileSystem *fs, BlockMap *map, size_t first, FreeList *freed);
+bool        fs_free_tree(FileSystem *fs, size_t block, size_t depth, size_t span, size_t first, FreeList *freed);
+bool        fs_free_add(FreeList *freed, size_t block);
+bool        fs_zero_range(FileSystem *fs, BlockMap *map, size_t from, size_t to);
+bool        fs_zero_groups(FileSystem *fs, BlockMap *map, size_t from, size_t to);
+size_t      fs_map_capacity(FileSystem *fs, const Inode *inode);
+bool        fs_is_zero(const char *data, size_t length);
+char *      fs_group_load(FileSystem *fs, BlockMap *map, size_t group, bool fill);
+bool        fs_group_store(FileSystem *fs, BlockMap *map, size_t group, const char *data);
+void        fs_group_invalidate(FileSystem *fs, size_t inode_number);
+void        fs_view_open(FileSystem *fs);
+void        fs_view_close(FileSystem *fs);
+ViewPage *  fs_view_page(FileSystem *fs, BlockMap *map, size_t index, size_t size);
+void        fs_view_invalidate(FileSystem *fs, size_t inode_number);
+ssize_t     fs_read_blocks(FileSystem *fs, BlockMap *map, char *data, size_t length, size_t offset);
+size_t      fs_write_blocks(FileSystem *fs, BlockMap *map, char *data, size_t length, size_t offset);
+ssize_t     fs_store_block(FileSystem *fs, BlockMap *map, size_t block_index, char *data, size_t goal);
+bool        fs_dedup_open(FileSystem *fs);
+void        fs_dedup_build(FileSystem *fs);
+void        fs_dedup_close(FileSystem *fs);
+uint32_t    fs_dedup_hash(FileSystem *fs, const char *data);
+ssize_t     fs_dedup_find(FileSystem *fs, uint32_t hash, const char *data);
+void        fs_dedup_insert(FileSystem *fs, size_t block, uint32_t hash);
+void        fs_dedup_remove(FileSystem *fs, size_t block);
+ssize_t     fs_dedup_store(FileSystem *fs, BlockMap *map, uint32_t *slot, char *data, size_t goal);
+ssize_t     fs_read_compressed(FileSystem *fs, BlockMap *map, char *data, size_t length, size_t offset);
+ssize_t     fs_copyin_buffered(FileSystem *fs, size_t inode_number, int fd);
+ssize_t     fs_copyout_buffered(FileSystem *fs, size_t inode_number, int fd);
+size_t      fs_map_run(FileSystem *fs, BlockMap *map, size_t block_index, size_t limit, ssize_t *start);
+size_t      fs_write_compressed(FileSystem *fs, BlockMap *map, char *data, size_t length, size_t offset);
+bool        fs_format_with_untimed(FileSystem *fs, Disk *disk, const FormatOptions *options);
+bool        fs_mount_untimed(FileSystem *fs, Disk *disk);
+ssize_t     fs_create_untimed(FileSystem *fs);
+bool        fs_remove_untimed(FileSystem *fs, size_t inode_number);
+ssize_t     fs_create_many_untimed(FileSystem *fs, size_t *inodes, size_t count);
+ssize_t     fs_remove_many_untimed(FileSystem *fs, const size_t *inodes, size_t count);
+int         fs_inode_compare(const void *a, const void *b);
+ssize_t     fs_trim_untimed(FileSystem *fs);
+bool        fs_statfs_untimed(FileSystem *fs, SpaceStats *stats);
+ssize_t     fs_stat_untimed(FileSystem *fs, size_t inode_number);
+ssize_t     fs_read_untimed(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset);
+ssize_t     fs_read_view_untimed(FileSystem *fs, size_t inode_number, FsView *view, size_t length, size_t offset);
+bool        fs_async_submit(FileSystem *fs, FsRequest *request, bool write);
+bool        fs_async_start(FileSystem *fs);
+void        fs_async_stop(FileSystem *fs);
+void *      fs_async_thread(void *arg);
+void        fs_async_execute(FileSystem *fs, FsRequest *batch);
+void        fs_async_read_batch(FileSystem *fs, FsRequest *first, size_t count);
+ssize_t     fs_write_untimed(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset);
+bool        fs_truncate_untimed(FileSystem *fs, size_t inode_number, size_t size);
+bool        fs_fallocate_untimed(FileSystem *fs, size_t inode_number, size_t offset, size_t length);
+bool        fs_set_compression_untimed(FileSystem *fs, size_t inode_number, bool enabled);
+ssize_t     fs_copyin_untimed(FileSystem *fs, size_t inode_number, int fd);
+ssize_t     fs_copyout_untimed(FileSystem *fs, size_t inode_number, int fd);
+void *      fs_inspect_thread(void *arg);
+void        fs_inspect_inode(InspectScan *scan, InspectWalk *walk, InspectOutput *output, size_t inode_number, Inode *inode);
+void        fs_inspect_add(InspectScan *scan, InspectWalk *walk, uint32_t pointer, bool list);
+void        fs_inspect_tree(InspectScan *scan, InspectWalk *walk, uint32_t block, size_t depth, bool list);
+bool        fs_inspect_append(InspectOutput *output, const void *data, size_t length);
+bool        fs_inspect_flush(InspectScan *scan, InspectOutput *output);
 
 /* 外部函数 */
 
@@ -14,12 +208,13 @@
  *
  *  1. 读取超级块并报告其信息。
  *
- *  2. 读取inode表并报告每个i节点的信息。
+ *  2. 读取inode表并报告每个i节点的信息（按超级块中记录的块大小和inode大小）。
  *
  * @param       disk        指向Disk结构的指针。
  **/
 void fs_debug(Disk *disk) {
-    Block block;
+    Block      block;
+    FileSystem fs = {.disk = disk};
 
     /* 读取超级块 */
     if (disk_read(disk, 0, block.data) == DISK_FAILURE) {
@@ -27,30 +222,80 @@ void fs_debug(Disk *disk) {
     }
 
 
+    SuperBlock super = fs.meta_data = block.super;
+    if (!fs_geometry(&fs, super.block_size, super.inode_size)) {
+        printf("SuperBlock:\n    invalid geometry (%u byte blocks, %u byte inodes)\n", super.block_size, super.inode_size);
+        return;
+    }
+
     printf("SuperBlock:\n");
-    printf("    %u blocks\n"         , block.super.blocks);
-    printf("    %u inode blocks\n"   , block.super.inode_blocks);
-    printf("    %u inodes\n"         , block.super.inodes);
+    printf("    %u blocks\n"         , super.blocks);
+    printf("    %u inode blocks\n"   , super.inode_blocks);
+    printf("    %u inodes\n"         , super.inodes);
+    if (fs.block_size != BLOCK_SIZE || fs.inode_size != FS_INODE_SIZE_MIN) {
+        printf("    %zu byte blocks, %zu byte inodes\n", fs.block_size, fs.inode_size);
+    }
+    if (super.flags & FS_COMPRESS) {
+        printf("    compression on\n");
+    }
+    if (super.flags & FS_DEDUP) {
+        printf("    %u dedup blocks\n"  , super.dedup_blocks);
+    }
+    if (super.flags & FS_NAMESPACE) {
+        printf("    root directory inode %u\n", super.root);
+    }
+    if (super.flags & FS_LARGE) {
+        printf("    64-bit file sizes\n");
+    }
+    if ((super.flags & FS_GROUPS) && super.group_inode_blocks > 0) {
+        printf("    %zu allocation groups of %u blocks (%u inode blocks each)\n",
+               fs_group_count(&super), super.group_blocks, super.group_inode_blocks);
+    } else if (super.flags & FS_GROUPS) {
+        printf("    %zu allocation groups of %u blocks\n", fs_group_count(&super), super.group_blocks);
+    }
+    if (super.flags & FS_INODE_MAP) {
+        printf("    %u of %u inode chunks (%u blocks each)\n", super.inode_chunks, FS_INODE_CHUNKS, super.chunk_blocks);
+    }
+    if (super.free_block_count || super.free_inode_count) {
+        printf("    %u free blocks, %u free inodes\n", super.free_block_count, super.free_inode_count);
+    }
 
     /* 读取inode表 */
     printf("\nInode Table:\n");
-    for (size_t block_number = 1; block_number <= block.super.inode_blocks; block_number ++ ){
-        if (disk_read(disk, block_number, block.data) == DISK_FAILURE){
+    for (size_t index = 0; index < super.inode_blocks; index++) {
+        if (fs_read_block(&fs, fs_inode_table_block(&fs, index), block.data) == DISK_FAILURE){
             return;
         }
 
-        Inode *inodes = block.inodes;
-
-        for (size_t i = 0; i < INODES_PER_BLOCK; i++){
-            if (inodes[i].valid == 1){
-                printf("Inode %ld:\n", i + (block_number - 1) * INODES_PER_BLOCK);
-                printf("    File size: %u bytes\n", inodes[i].size);
+        for (size_t i = 0; i < fs.inodes_per_block; i++){
+            Inode *inode = fs_inode_at(&fs, block.data, i);
+            if (inode->valid == 1){
+                printf("Inode %ld:\n", i + index * fs.inodes_per_block);
+                printf("    File size: %zu bytes\n", fs_file_size(&fs, inode));
+                if (inode->flags & INODE_DIRECTORY) {
+                    printf("    Directory\n");
+                }
+                if (inode->flags & INODE_COMPRESSED) {
+                    printf("    Compressed\n");
+                }
+                if (inode->links) {
+                    printf("    Links: %u\n", inode->links);
+                }
                 printf("    Direct pointers: ");
                 for (size_t j = 0; j < POINTERS_PER_INODE; j++){
-                    printf("%u ", inodes[i].direct[j]);
+                    if (inode->direct[j] & COMPRESSED_MARK) {
+                        printf("z%u ", inode->direct[j] & ~COMPRESSED_MARK);
+                    } else {
+                        printf("%u ", inode->direct[j]);
+                    }
                 }
                 printf("\n");
-                printf("    Indirect pointers: %u\n", inodes[i].indirect);
+                printf("    Indirect pointers: %u\n", inode->indirect);
+                InodeExtension *extension = fs_inode_extension(&fs, inode);
+                if (extension && (extension->double_indirect || extension->triple_indirect)) {
+                    printf("    Double indirect pointers: %u\n", extension->double_indirect);
+                    printf("    Triple indirect pointers: %u\n", extension->triple_indirect);
+                }
                 printf("\n");
             }
             
@@ -63,13 +308,159 @@ void fs_debug(Disk *disk) {
 
 }
 
+/**
+ * 检查文件系统中的inode，把每个符合过滤条件的inode作为一条记录写入stream，执行以下操作：
+ *
+ *  1. 读取并检查超级块（不需要挂载，也不修改磁盘）。
+ *
+ *  2. 二进制格式时写入InspectHeader。
+ *
+ *  3. 启动threads个线程（不超过FS_INSPECT_THREADS和要扫描的批数），每个线程每次领取FS_INSPECT_BATCH个inode块，读取其中有效inode的间接块，
+ *     统计数据块、间接块和连续区间（碎片程度），把记录积累在自己的缓冲区中，
+ *     超过FS_INSPECT_FLUSH字节时一次写入stream。
+ *
+ * JSON行格式的每一行是一个对象，例如：
+ *
+ *  {"inode":3,"size":300000,"directory":false,"compressed":false,"links":0,"blocks":74,
+ *   "indirect_blocks":1,"extents":2,"fragmentation":0.0137,"map":[[20,5],[26,69]]}
+ *
+ * 其中fragmentation为(extents - 1) / (blocks - 1)，map只在请求区间列表时输出。
+ *
+ * 注意：同一批inode块内的记录按编号顺序输出，不同批之间的顺序取决于线程调度。
+ * 只扫描inode范围覆盖的inode块。
+ *
+ * @param       disk        指向Disk结构的指针。
+ * @param       options     过滤条件和输出格式（NULL表示默认选项：一个线程、全部inode、JSON行）。
+ * @param       stream      输出流。
+ * @return      输出的记录数（超级块无效或读写失败时为-1）。
+ **/
+ssize_t fs_inspect(Disk *disk, const InspectOptions *options, FILE *stream) {
+    InspectOptions defaults = {0};
+    options = options ? options : &defaults;
+
+    if (disk == NULL || stream == NULL) {
+        return -1;
+    }
+
+    InspectScan scan = {.options = options, .stream = stream};
+    Block       super_block;
+    scan.fs.disk = disk;
+    if (disk_read(disk, 0, super_block.data) == DISK_FAILURE || !fs_validate(&scan.fs, &super_block.super, disk)) {
+        return -1;
+    }
+    scan.fs.meta_data = super_block.super;
+
+    size_t inodes = scan.fs.meta_data.inodes;
+    size_t end    = options->end_inode ? min(options->end_inode, inodes) : inodes;
+    scan.next = min(options->first_inode, end) >> scan.fs.inode_shift;
+    scan.end  = (end + scan.fs.inodes_per_block - 1) >> scan.fs.inode_shift;
+
+    size_t     batches = (scan.end - scan.next + FS_INSPECT_BATCH - 1) / FS_INSPECT_BATCH;
+    size_t     count   = max(min(options->threads, min(batches, FS_INSPECT_THREADS)), 1);
+    pthread_t *threads = (pthread_t *)calloc(count, sizeof(pthread_t));
+    if (threads == NULL) {
+        return -1;
+    }
+
+    if (options->binary) {
+        InspectHeader header = {
+            .magic      = INSPECT_MAGIC,
+            .version    = INSPECT_VERSION,
+            .block_size = scan.fs.block_size,
+            .inodes     = inodes,
+        };
+        if (fwrite(&header, sizeof(header), 1, stream) != 1) {
+            free(threads);
+            return -1;
+        }
+    }
+
+    size_t started = 0;
+
+    pthread_mutex_init(&scan.lock, NULL);
+    for (; started < count; started++) {
+        if (pthread_create(&threads[started], NULL, fs_inspect_thread, &scan) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        fs_inspect_thread(&scan);
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&scan.lock);
+    free(threads);
+
+    return scan.failed || fflush(stream) != 0 ? -1 : (ssize_t)scan.reported;
+}
+
+/**
+ * 解析检查选项：用逗号分隔的"threads=<n>"、"inodes=<first>-<last>"、"size=<min>-<max>"、
+ * "extents"和"binary"（范围包含两端，省略的一端表示不限，单个数字表示只有这一个值）。
+ *
+ * @param       spec        选项描述（例如"threads=8,size=1048576-,extents"）。
+ * @param       options     输出的检查选项（未指定的项为默认值）。
+ *
+ * @return      描述是否合法。
+ **/
+bool fs_inspect_parse(const char *spec, InspectOptions *options) {
+    memset(options, 0, sizeof(InspectOptions));
+
+    while (spec != NULL && *spec) {
+        size_t      length = strcspn(spec, ",");
+        const char *value  = memchr(spec, '=', length);
+        size_t      name   = value ? (size_t)(value - spec) : length;
+        char       *end    = (char *)(value ? value + 1 : spec + length);
+        size_t      first  = 0, last = 0;
+        bool        range  = strncmp(spec, "inodes", name) == 0 || strncmp(spec, "size", name) == 0;
+
+        if (range && value) {
+            first = strtoul(end, &end, 10);
+            last  = first + 1;
+            if (*end == '-') {
+                last = isdigit(end[1]) ? strtoul(end + 1, &end, 10) + 1 : 0;
+                end += *end == '-';
+            }
+        }
+
+        if (name == 6 && strncmp(spec, "inodes", 6) == 0 && value) {
+            options->first_inode = first;
+            options->end_inode   = last;
+        } else if (name == 4 && strncmp(spec, "size", 4) == 0 && value) {
+            options->min_size = first;
+            options->end_size = last;
+        } else if (name == 7 && strncmp(spec, "threads", 7) == 0 && value) {
+            options->threads = strtoul(value + 1, &end, 10);
+        } else if (length == 7 && strncmp(spec, "extents", 7) == 0) {
+            options->extents = true;
+        } else if (length == 6 && strncmp(spec, "binary", 6) == 0) {
+            options->binary = true;
+        } else {
+            return false;
+        }
+
+        if (end != spec + length) {
+            return false;
+        }
+        spec += length + (spec[length] == ',');
+    }
+
+    return true;
+}
+
 /**
  * 格式化磁盘，执行以下操作：
  *
- *  1. 写入超级块（具有适当的魔数、块数、inode块数和inode数）。
+ *  1. 写入超级块（具有适当的魔数、块数、inode块数、inode数、几何参数和分配组）。
  *
  *  2. 清除所有其余的块。
  *
+ * 超级块和去重哈希块之后的区域被划分为分配组。默认不预留inode表：inode表由fs_create按需
+ * 分块增长，每块的位置记录在超级块的inode块映射中，块数的上限与预留完整inode表时相同。
+ * 指定fixed_inodes时每组开头是自己的inode片段（每个块一个inode），其后是数据块；
+ * 比inode片段还短的尾部并入最后一组。
+ *
  * 注意：不要格式化已挂载的磁盘！
  *
  * @param       fs      指向FileSystem结构的指针。
@@ -77,28 +468,110 @@ void fs_debug(Disk *disk) {
  * @return      所有磁盘操作是否成功（成功为true，失败为false）。
  **/
 bool fs_format(FileSystem *fs, Disk *disk) {
+    return fs_format_with(fs, disk, NULL);
+}
+
+/**
+ * 按照给定的格式化选项格式化磁盘（options为NULL时使用默认选项）。
+ * 文件系统块由block_size / BLOCK_SIZE个连续的磁盘块组成，超级块总是位于第一个磁盘块中。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       disk    指向Disk结构的指针。
+ * @param       options 格式化选项。
+ * @return      所有磁盘操作是否成功（成功为true，失败为false）。
+ **/
+bool fs_format_with(FileSystem *fs, Disk *disk, const FormatOptions *options) {
+    uint64_t start  = stats_now();
+    bool     result = fs_format_with_untimed(fs, disk, options);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_FORMAT, start, result, 0);
+    return result;
+}
+
+/**
+ * fs_format_with的实现（不记录统计）。
+ **/
+bool fs_format_with_untimed(FileSystem *fs, Disk *disk, const FormatOptions *options) {
     
     if (fs == NULL || disk == NULL) return false;
     if (fs->disk == disk){
         return false;
     }
+
+    bool       large      = options != NULL && options->large;
+    size_t     inode_size = options != NULL ? options->inode_size : 0;
+    FileSystem geometry   = {0};
+    if (large && inode_size == 0) {
+        inode_size = FS_LARGE_INODE_SIZE;
+    }
+    if (!fs_geometry(&geometry, options ? options->block_size : 0, inode_size) ||
+        (large && geometry.inode_size < FS_LARGE_INODE_SIZE)) {
+        return false;
+    }
+
+    /* 块号是31位的（最高位是COMPRESSED_MARK）：更大的磁盘需要更大的块 */
+    size_t blocks = disk->blocks / geometry.sectors;
+    if (blocks < 2 || blocks >= COMPRESSED_MARK) {
+        return false;
+    }
     
     Block super_block;
-    memset(&super_block, 0, sizeof(super_block));
+    memset(&super_block, 0, BLOCK_SIZE);
     super_block.super.magic_number = MAGIC_NUMBER;
-    super_block.super.blocks = disk->blocks;
-    super_block.super.inode_blocks = (disk->blocks + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK;
-    super_block.super.inodes = super_block.super.inode_blocks * INODES_PER_BLOCK;
+    super_block.super.blocks = blocks;
+    super_block.super.block_size = geometry.block_size;
+    super_block.super.inode_size = geometry.inode_size;
+    super_block.super.flags = FS_GROUPS;
+    if (options != NULL && options->compress) {
+        super_block.super.flags |= FS_COMPRESS;
+    }
+    if (large) {
+        super_block.super.flags |= FS_LARGE;
+    }
+    if (options != NULL && options->dedup) {
+        super_block.super.flags |= FS_DEDUP;
+        super_block.super.dedup_blocks = (blocks * sizeof(uint32_t) + geometry.block_size - 1) / geometry.block_size;
+    }
+
+    size_t base         = 1 + super_block.super.dedup_blocks;
+    size_t group_blocks = options != NULL && options->group_blocks ? options->group_blocks : FS_GROUP_BLOCKS;
+    if (base >= blocks || group_blocks < 2) {
+        return false;
+    }
+
+    size_t data_blocks  = blocks - base;
+    group_blocks        = min(group_blocks, data_blocks);
+    super_block.super.group_blocks = group_blocks;
+
+    if (options == NULL || !options->fixed_inodes) {
+        size_t table = (blocks + geometry.inodes_per_block - 1) / geometry.inodes_per_block;
+        super_block.super.flags       |= FS_INODE_MAP;
+        super_block.super.chunk_blocks = (table + FS_INODE_CHUNKS - 1) / FS_INODE_CHUNKS;
+    } else {
+        size_t inode_blocks = (group_blocks + geometry.inodes_per_block - 1) / geometry.inodes_per_block;
+        size_t groups       = data_blocks / group_blocks + (data_blocks % group_blocks > inode_blocks);
+        if (inode_blocks >= data_blocks || groups * inode_blocks * geometry.inodes_per_block > UINT32_MAX) {
+            return false;
+        }
+
+        super_block.super.group_inode_blocks = inode_blocks;
+        super_block.super.inode_blocks       = groups * inode_blocks;
+        super_block.super.inodes             = super_block.super.inode_blocks * geometry.inodes_per_block;
+    }
 
 
     if (disk_write(disk, 0, super_block.data) == DISK_FAILURE)
         return false;
     
-    Block empty_block;
-    memset(&empty_block, 0, sizeof(Block));
-    for (size_t block_number = 1; block_number < disk->blocks; block_number++)
-        if (disk_write(disk, block_number, empty_block.data) == DISK_FAILURE)
+    char empty_block[BLOCK_SIZE] = {0};
+    DiskRequest requests[FS_SCAN_BATCH];
+    for (size_t block_number = 1; block_number < disk->blocks; block_number += FS_SCAN_BATCH) {
+        size_t count = min(FS_SCAN_BATCH, disk->blocks - block_number);
+        for (size_t i = 0; i < count; i++)
+            requests[i] = (DiskRequest){.block = block_number + i, .write = true, .data = empty_block};
+        if (disk_submit(disk, requests, count) != (ssize_t)count)
             return false;
+    }
 
  
     
@@ -108,13 +581,13 @@ bool fs_format(FileSystem *fs, Disk *disk) {
 /**
  * 将指定的文件系统挂载到给定的磁盘上，执行以下操作：
  *
- *  1. 读取和检查超级块（验证属性）。
+ *  1. 读取和检查超级块（见fs_validate，不相符的映像被拒绝）。
  *
  *  2. 验证和记录文件系统磁盘属性。
  *
- *  3. 复制超级块到文件系统元数据属性。
+ *  3. 复制超级块到文件系统元数据属性，分配压缩组缓存。
  *
- *  4. 初始化文件系统的空闲块位图。
+ *  4. 初始化文件系统的空闲块位图（启用去重时同时计算引用计数并加载哈希索引）和分配组的空闲计数。
  *
  * 注意：不要挂载已经挂载过的磁盘！
  *
@@ -123,6 +596,17 @@ bool fs_format(FileSystem *fs, Disk *disk) {
  * @return      挂载操作是否成功（成功为true，失败为false）。
  **/
 bool fs_mount(FileSystem *fs, Disk *disk) {
+    uint64_t start  = stats_now();
+    bool     result = fs_mount_untimed(fs, disk);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_MOUNT, start, result, 0);
+    return result;
+}
+
+/**
+ * fs_mount的实现（不记录统计）。
+ **/
+bool fs_mount_untimed(FileSystem *fs, Disk *disk) {
     if (fs == NULL || disk == NULL){
         return false;
     }
@@ -131,79 +615,62 @@ bool fs_mount(FileSystem *fs, Disk *disk) {
     {
         return false;
     }
-    fs->disk = disk;
 
     Block super_block;
-    memset(&super_block, 0, sizeof(super_block));
-
-
     if (disk_read(disk, 0, super_block.data) == DISK_FAILURE)
         return false;
-   
-    
 
-    
-    memcpy(&(fs->meta_data), super_block.data, sizeof(SuperBlock));
+    if (!fs_validate(fs, &super_block.super, disk)) {
+        return false;
+    }
+
+    fs->disk = disk;
+    fs_view_open(fs);
+    memcpy(&(fs->meta_data), &super_block.super, sizeof(SuperBlock));
+    memset(&(fs->dedup), 0, sizeof(DedupIndex));
+    fs->cache.valid = false;
+    fs->cache.data = (char *)malloc(COMPRESS_GROUP * fs->block_size);
+    fs->cache.packed = (char *)malloc(COMPRESS_GROUP * fs->block_size);
+    memset(&(fs->map_cache), 0, sizeof(MapCache));
+    if (fs->meta_data.flags & FS_LARGE) {
+        fs->map_cache.data = (char *)malloc(FS_MAP_CACHE * fs->block_size);
+    }
+    fs->inode_hint = 0;
+    fs->groups = NULL;
+    fs->group_count = 0;
     fs->free_blocks = (bool *)malloc(fs->meta_data.blocks * sizeof(bool));
+    fs->discards.blocks = NULL;
+    fs->discards.count = 0;
+    if (disk->discard) {
+        fs->discards.blocks = (size_t *)malloc(FS_DISCARD_BATCH * sizeof(size_t));
+        pthread_mutex_init(&fs->discards.lock, NULL);
+    }
 
-    if (fs->free_blocks == NULL)
+    if (fs->free_blocks == NULL || fs->cache.data == NULL || fs->cache.packed == NULL ||
+        ((fs->meta_data.flags & FS_LARGE) && fs->map_cache.data == NULL) ||
+        (disk->discard && fs->discards.blocks == NULL)) {
+        fs_unmount(fs);
         return false;
+    }
     
     for (size_t i = 0; i < fs->meta_data.blocks; i++)
-        fs->free_blocks[i] = true;
-    
-    
-    for (size_t i = 0; i <= fs->meta_data.inode_blocks; i++)
-        fs->free_blocks[i] = false;
-    
-    
-    for (size_t block_number = 1; block_number <= fs->meta_data.inode_blocks; block_number++){
-        
-        Block inode_block;
-
-        if (disk_read(fs->disk,block_number, inode_block.data) == DISK_FAILURE){
-            return false;
-        }
-        
-        Inode *inodes = inode_block.inodes;
-
-        for (int i = 0; i < INODES_PER_BLOCK; i ++ )
-            if (inodes[i].valid == 1)
-            {    
-                for (size_t j = 0; j < POINTERS_PER_INODE; j ++ )
-                    if (inodes[i].direct[j] != 0){
-                        fs->free_blocks[inodes[i].direct[j]] = false;
-                    }
+        fs->free_blocks[i] = fs_is_data_block(fs, i);
 
-                if (inodes[i].indirect != 0)
-                {
-                    fs->free_blocks[inodes[i].indirect] = false;
-                    
-                    Block indirect_block;
-                    if (disk_read(fs->disk, inodes[i].indirect, indirect_block.data) == DISK_FAILURE)
-                        return false;
-                    
-                    for (size_t j = 0; j < POINTERS_PER_BLOCK; j++){
-                        size_t pointer = indirect_block.pointers[j];
-
-                        if (pointer != 0){
-                            fs->free_blocks[pointer] = false;
-                        }
-                        
-
-                    }
-                    
-
-                }
-
-            }
-
-       
-        
-        
+    if ((fs->meta_data.flags & FS_DEDUP) && !fs_dedup_open(fs)) {
+        fs_unmount(fs);
+        return false;
+    }
 
+    if (!fs_mount_scan(fs) || !fs_groups_open(fs)) {
+        fs_unmount(fs);
+        return false;
     }
+    fs->meta_data.free_block_count = fs_free_block_count(fs);
+    fs->meta_data.free_inode_count = fs->free_inodes;
 
+    if (fs->dedup.refcounts != NULL) {
+        fs_dedup_build(fs);
+    }
 
     return true;
 }
@@ -211,22 +678,53 @@ bool fs_mount(FileSystem *fs, Disk *disk) {
 /**
  * 通过执行以下操作从内部磁盘卸载文件系统：
  *
- *  1. 设置文件系统的磁盘属性。
+ *  1. 停止定期输出指标的线程和异步I/O引擎（如果有，先执行完已提交的异步请求）。
+ *
+ *  2. 对等待打洞的已释放块打洞，空闲块数或空闲inode数变化时把它们写回超级块，
+ *     写回去重索引中修改过的哈希块。
+ *
+ *  3. 设置文件系统的磁盘属性。
  *
- *  2. 释放空闲块位图。
+ *  4. 释放空闲块位图、分配组、打洞队列、压缩组缓存、指针块缓存和读取视图缓存（此前应释放所有视图）。
  *
  * @param       fs      指向FileSystem结构的指针。
  **/
 void  fs_unmount(FileSystem *fs) {
 
     if (fs == NULL) return;
+
+    fs_stats_stop(fs);
+    fs_async_stop(fs);
+
+    if (fs->disk != NULL) {
+        if (fs->groups != NULL) {
+            fs_discard_flush(fs);
+            fs_save_counts(fs);
+        }
+        fs_dedup_close(fs);
+        fs_view_close(fs);
+        if (fs->disk->discard) {
+            pthread_mutex_destroy(&fs->discards.lock);
+        }
+    }
     
     if (fs->free_blocks != NULL){
         free(fs->free_blocks);
     }
+    fs_groups_close(fs);
+    free(fs->discards.blocks);
+    fs->discards.blocks = NULL;
+    fs->discards.count = 0;
     
+    free(fs->cache.data);
+    free(fs->cache.packed);
+    free(fs->map_cache.data);
     
     fs->free_blocks = NULL;
+    fs->cache.data = NULL;
+    fs->cache.packed = NULL;
+    fs->map_cache.data = NULL;
+    fs->cache.valid = false;
     fs->disk = NULL;
 
 }
@@ -238,45 +736,63 @@ void  fs_unmount(FileSystem *fs) {
  *
  *  2. 在inode表中保留空闲inode。
  *
- * 注意：务必记录对i节点表的更新到磁盘。
+ * 注意：务必记录对i节点表的更新到磁盘。搜索从inode_hint开始，每个inode块只读取一次；
+ * inode表已满时按需增长（见fs_inode_grow）。
  *
  * @param       fs      指向FileSystem结构的指针。
  * @return      分配的inode的inode编号。
  **/
 ssize_t fs_create(FileSystem *fs) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_create_untimed(fs);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_CREATE, start, result >= 0, 0);
+    return result;
+}
+
+/**
+ * fs_create的实现（不记录统计）。
+ **/
+ssize_t fs_create_untimed(FileSystem *fs) {
 
-    if (fs == NULL)
+    if (fs == NULL || fs->disk == NULL)
         return -1;
-    
-    for (size_t inode_number  = 0; inode_number  < fs->meta_data.inodes; inode_number ++){
-            
-        
-        size_t block_number = 1 + inode_number / INODES_PER_BLOCK;
-        Block inode_block;
-        
 
-        if(disk_read(fs->disk, block_number, inode_block.data) == DISK_FAILURE)
+    Block  inode_block;
+    size_t loaded_block = 0;
+
+    for (size_t inode_number = fs->inode_hint; ; inode_number++) {
+        if (inode_number >= fs->meta_data.inodes && !fs_inode_grow(fs)) {
             return -1;
+        }
 
-           
-        size_t index_within_block  = inode_number % INODES_PER_BLOCK;
+        size_t block_number = fs_inode_block(fs, inode_number);
 
-  
+        if (block_number != loaded_block) {
+            if (fs_read_block(fs, block_number, inode_block.data) == DISK_FAILURE)
+                return -1;
+            loaded_block = block_number;
+        }
 
-        if (inode_block.inodes[index_within_block].valid == true) continue;
-        inode_block.inodes[index_within_block].valid = true;
-        
-        if(disk_write(fs->disk, block_number, inode_block.data) == DISK_FAILURE)
-            return -1;
+        Inode *inode = fs_inode_at(fs, inode_block.data, inode_number);
+        if (inode->valid) {
+            fs->inode_hint = inode_number + 1;
+            continue;
+        }
+
+        memset(inode, 0, fs->inode_size);
+        inode->valid = true;
+        if (fs->meta_data.flags & FS_COMPRESS) {
+            inode->flags = INODE_COMPRESSED;
+        }
 
-        inode_block.inodes[index_within_block].size = 0; 
+        if (fs_write_block(fs, block_number, inode_block.data) == DISK_FAILURE)
+            return -1;
 
+        fs->inode_hint = inode_number + 1;
+        fs->free_inodes--;
         return inode_number;
-        
     }
-    
-    return -1;
-    
 }
 
 /**
@@ -290,104 +806,244 @@ ssize_t fs_create(FileSystem *fs) {
  *
  *  4. 在inode表中标记inode为空闲。
  *
+ * 注意：目录只能通过fs_unlink删除。
+ *
  * @param       fs              指向FileSystem结构的指针。
  * @param       inode_number    要删除的i节点。
  * @return      是否成功删除指定i节点（成功为true，失败为false）。
  **/
-
 bool fs_remove(FileSystem *fs, size_t inode_number) {
+    uint64_t start  = stats_now();
+    bool     result = fs_remove_untimed(fs, inode_number);
 
-    if (fs == NULL || fs->disk == NULL || fs->free_blocks == NULL) {
-        return false; 
-    }
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_REMOVE, start, result, 0);
+    return result;
+}
 
-    if (inode_number >= fs->meta_data.inodes) {
+/**
+ * fs_remove的实现（不记录统计）。
+ **/
+bool fs_remove_untimed(FileSystem *fs, size_t inode_number) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid) {
         return false;
     }
+    fs_view_invalidate(fs, inode_number);
 
-    size_t block_number = 1 + inode_number / INODES_PER_BLOCK;
-    Block inode_block;
-    if (disk_read(fs->disk, block_number, inode_block.data) == DISK_FAILURE){
+    if (inode->flags & INODE_DIRECTORY) {
         return false;
     }
-    size_t index_within_block  = inode_number % INODES_PER_BLOCK;
 
-    Inode *inodes  = inode_block.inodes;
+    BlockMap map;
+    fs_map_init(fs, &map, inode_number, inode);
+    if (!fs_free_tail(fs, &map, 0)) {
+        return false;
+    }
 
-    
-    uint32_t *direct = inodes[index_within_block].direct;
-    uint32_t indirect = inodes[index_within_block].indirect;
+    fs_group_invalidate(fs, inode_number);
+    memset(inode, 0, fs->inode_size);
+    fs->inode_hint = min(fs->inode_hint, inode_number);
+    bool result = fs_save_inode(fs, inode_number, &inode_block);
+    fs->free_inodes += result;
+    fs_discard_flush(fs);
+    return result;
+}
 
-    if (inodes[index_within_block].valid == false) return false;
-    inodes[index_within_block].valid = false;
+/**
+ * 批量创建count个inode（与逐个调用fs_create的结果相同），编号写入inodes。
+ * 同一个inode块中的inode一起创建，每个修改过的inode块只读取和写回一次；inode表已满时按需增长。
+ *
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       inodes      返回创建的inode编号（至少count项）。
+ * @param       count       要创建的inode数。
+ * @return      创建的inode数（inode表已满时少于count，错误时为-1）。
+ **/
+ssize_t fs_create_many(FileSystem *fs, size_t *inodes, size_t count) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_create_many_untimed(fs, inodes, count);
 
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_CREATE_MANY, start, result >= 0, 0);
+    return result;
+}
 
-    for (size_t i = 0; i < POINTERS_PER_INODE; i++){
-        if (direct[i] != 0){
-            fs->free_blocks[direct[i]] = true;
-            inodes[index_within_block].direct[i] = 0;
-        }
+/**
+ * fs_create_many的实现（不记录统计）。
+ **/
+ssize_t fs_create_many_untimed(FileSystem *fs, size_t *inodes, size_t count) {
+    if (fs == NULL || fs->disk == NULL || inodes == NULL) {
+        return -1;
     }
-    
 
+    Block  inode_block;
+    size_t loaded_block = 0;
+    bool   dirty        = false;
+    size_t created      = 0;
+    size_t inode_number = fs->inode_hint;
 
-    if (indirect != 0)
-    {
-        Block indirect_block;
-        
-        
-        fs->free_blocks[indirect] = true;     
+    while (created < count) {
+        if (inode_number >= fs->meta_data.inodes && !fs_inode_grow(fs)) {
+            break;
+        }
 
-        if (disk_read(fs->disk, indirect, indirect_block.data) == DISK_FAILURE)
-            return false;
-      
-        for (size_t i = 0; i < POINTERS_PER_BLOCK; i ++){
-            if (indirect_block.pointers[i] != 0){
-                fs->free_blocks[indirect_block.pointers[i]] = true;
+        size_t block_number = fs_inode_block(fs, inode_number);
+        if (block_number != loaded_block) {
+            if (dirty && fs_write_block(fs, loaded_block, inode_block.data) == DISK_FAILURE) {
+                return -1;
             }
-            
+            if (fs_read_block(fs, block_number, inode_block.data) == DISK_FAILURE) {
+                return -1;
+            }
+            loaded_block = block_number;
+            dirty        = false;
         }
 
+        Inode *inode = fs_inode_at(fs, inode_block.data, inode_number);
+        if (!inode->valid) {
+            memset(inode, 0, fs->inode_size);
+            inode->valid = true;
+            if (fs->meta_data.flags & FS_COMPRESS) {
+                inode->flags = INODE_COMPRESSED;
+            }
+            inodes[created++] = inode_number;
+            fs->free_inodes--;
+            dirty = true;
+        }
+        inode_number++;
     }
-    
-    inodes[index_within_block].size = 0;
 
-    if (disk_write(fs->disk, block_number, inode_block.data) == DISK_FAILURE){
-        return false;
+    if (dirty && fs_write_block(fs, loaded_block, inode_block.data) == DISK_FAILURE) {
+        return -1;
     }
-    
-    
 
-    return true;
+    fs->inode_hint = inode_number;
+    return created;
 }
 
 /**
- * 返回指定inode的大小。
+ * 批量删除inode及其数据（与逐个调用fs_remove的结果相同，重复的编号只删除一次）。
+ * inode按编号排序后按inode块分组处理，每个修改过的inode块只读取和写回一次。
  *
- * @param       fs              指向FileSystem结构的指针。
- * @param       inode_number    要删除的inode。
- * @return      指定inode的大小（如果不存在则为-1）。
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       inodes      要删除的inode编号。
+ * @param       count       inodes的项数。
+ * @return      删除的inode数（无效的inode和目录被跳过，错误时为-1）。
  **/
-ssize_t fs_stat(FileSystem *fs, size_t inode_number) {
-    if (fs == NULL || fs->disk == NULL || fs->free_blocks == NULL) {
-        return -1; 
-    }
+ssize_t fs_remove_many(FileSystem *fs, const size_t *inodes, size_t count) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_remove_many_untimed(fs, inodes, count);
 
-    if (inode_number >= fs->meta_data.inodes) {
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_REMOVE_MANY, start, result >= 0, 0);
+    return result;
+}
+
+/**
+ * fs_remove_many的实现（不记录统计）。
+ **/
+ssize_t fs_remove_many_untimed(FileSystem *fs, const size_t *inodes, size_t count) {
+    if (fs == NULL || fs->disk == NULL || (inodes == NULL && count > 0)) {
         return -1;
     }
 
-    size_t block_number = 1 + inode_number / INODES_PER_BLOCK;
-    Block inode_block;
-    if (disk_read(fs->disk, block_number, inode_block.data) == DISK_FAILURE){
+    size_t *sorted = (size_t *)malloc(max(count, 1) * sizeof(size_t));
+    if (sorted == NULL) {
         return -1;
     }
-    size_t index_within_block  = inode_number % INODES_PER_BLOCK;
+    memcpy(sorted, inodes, count * sizeof(size_t));
+    qsort(sorted, count, sizeof(size_t), fs_inode_compare);
 
-    Inode *inodes  = inode_block.inodes;
+    Block   inode_block;
+    size_t  loaded_block = 0;
+    bool    dirty        = false;
+    ssize_t removed      = 0;
 
-    if (inodes[index_within_block].valid == 1) return  inodes[index_within_block].size;  
-    return -1;
+    for (size_t i = 0; i < count && removed >= 0; i++) {
+        size_t inode_number = sorted[i];
+        if ((i > 0 && inode_number == sorted[i - 1]) || inode_number >= fs->meta_data.inodes) {
+            continue;
+        }
+
+        size_t block_number = fs_inode_block(fs, inode_number);
+        if (block_number != loaded_block) {
+            if ((dirty && fs_write_block(fs, loaded_block, inode_block.data) == DISK_FAILURE) ||
+                fs_read_block(fs, block_number, inode_block.data) == DISK_FAILURE) {
+                removed = -1;
+                break;
+            }
+            loaded_block = block_number;
+            dirty        = false;
+        }
+
+        Inode *inode = fs_inode_at(fs, inode_block.data, inode_number);
+        if (!inode->valid || (inode->flags & INODE_DIRECTORY)) {
+            continue;
+        }
+        fs_view_invalidate(fs, inode_number);
+
+        /* 释放失败时恢复这个inode（与fs_remove一样不写回），以免同一块中其他inode的修改把它写回 */
+        char     saved[FS_INODE_SIZE_MAX];
+        BlockMap map;
+        memcpy(saved, inode, fs->inode_size);
+        fs_map_init(fs, &map, inode_number, inode);
+        if (!fs_free_tail(fs, &map, 0)) {
+            memcpy(inode, saved, fs->inode_size);
+            continue;
+        }
+
+        fs_group_invalidate(fs, inode_number);
+        memset(inode, 0, fs->inode_size);
+        fs->inode_hint = min(fs->inode_hint, inode_number);
+        fs->free_inodes++;
+        dirty = true;
+        removed++;
+    }
+
+    if (removed >= 0 && dirty && fs_write_block(fs, loaded_block, inode_block.data) == DISK_FAILURE) {
+        removed = -1;
+    }
+
+    free(sorted);
+    fs_discard_flush(fs);
+    return removed;
+}
+
+/**
+ * 按编号比较两个inode或块号（qsort）。
+ **/
+int fs_inode_compare(const void *a, const void *b) {
+    size_t x = *(const size_t *)a;
+    size_t y = *(const size_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * 返回指定inode的大小。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    要删除的inode。
+ * @return      指定inode的大小（如果不存在则为-1）。
+ **/
+ssize_t fs_stat(FileSystem *fs, size_t inode_number) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_stat_untimed(fs, inode_number);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_STAT, start, result >= 0, 0);
+    return result;
+}
+
+/**
+ * fs_stat的实现（不记录统计）。
+ **/
+ssize_t fs_stat_untimed(FileSystem *fs, size_t inode_number) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid) {
+        return -1;
+    }
+
+    return fs_file_size(fs, inode);
 }
 
 /**
@@ -397,7 +1053,8 @@ ssize_t fs_stat(FileSystem *fs, size_t inode_number) {
  *
  *  2. 连续读取块并将数据复制到缓冲区。
  *
- *  注意：首先从直接块中读取数据，然后从间接块中读取数据。
+ *  注意：空洞（指针为0的块）读取为全零；整块对齐的读取直接读入调用者的缓冲区；
+ *  压缩文件按压缩组解压后复制。
  *
  * @param       fs              指向FileSystem结构的指针。
  * @param       inode_number    要从中读取数据的inode。
@@ -407,261 +1064,3469 @@ ssize_t fs_stat(FileSystem *fs, size_t inode_number) {
  * @return      读取的字节数（错误时为-1）。
  **/
 ssize_t fs_read(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset) {
-    if (fs == NULL || fs->disk == NULL || fs->free_blocks == NULL) {
-        return -1; 
-    }
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_read_untimed(fs, inode_number, data, length, offset);
 
-    if (inode_number >= fs->meta_data.inodes) {
-        return -1;
-    }
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_READ, start, result >= 0, max(result, 0));
+    return result;
+}
 
-    size_t block_number = 1 + inode_number / INODES_PER_BLOCK;
+/**
+ * fs_read的实现（不记录统计）。
+ **/
+ssize_t fs_read_untimed(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset) {
     Block inode_block;
-    if (disk_read(fs->disk, block_number, inode_block.data) == DISK_FAILURE){
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid) {
         return -1;
     }
-    size_t index_within_block  = inode_number % INODES_PER_BLOCK;
 
-    Inode *inodes  = inode_block.inodes;
-    Inode *inode = &inodes[index_within_block];
-    if (inode->valid == 0) return -1;
+    size_t size = fs_file_size(fs, inode);
+    if (offset >= size) {
+        return 0;
+    }
+    length = min(length, size - offset);
 
-    ssize_t bytes_read = 0; 
-    size_t current_offset = offset;
-    
-    while (current_offset < inode->size && bytes_read < length){
-        char buf[BLOCK_SIZE];
-       
+    BlockMap map;
+    fs_map_init(fs, &map, inode_number, inode);
+    if (inode->flags & INODE_COMPRESSED) {
+        return fs_read_compressed(fs, &map, data, length, offset);
+    }
 
-        // 计算要读取的块和偏移量
-        size_t block_offset = current_offset % BLOCK_SIZE;
-        size_t block_index = current_offset / BLOCK_SIZE;
-        size_t bytes_to_read = BLOCK_SIZE - block_offset;
+    return fs_read_blocks(fs, &map, data, length, offset);
+}
 
-        if(block_index > POINTERS_PER_INODE) break;
+/**
+ * 返回inode中从offset开始的length字节的只读视图，不复制数据：视图的iovec按文件顺序
+ * 指向读取视图缓存中的块，这些块被视图固定（引用计数加一），在fs_release_view之前不会被替换。
+ *
+ *  注意：一个视图最多覆盖FS_VIEW_PAGES个块，范围更大或缓存页被其他视图占满时视图比length短，
+ *  调用者释放视图后从view->length之后继续。视图是读取时的快照：之后对文件的修改使缓存页失效，
+ *  但不改变已经返回的视图的内容。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    要读取的inode。
+ * @param       view            返回的视图（用完后必须传给fs_release_view）。
+ * @param       length          要读取的字节数。
+ * @param       offset          从哪里开始读取的字节偏移。
+ * @return      视图覆盖的字节数（在文件末尾时为0，错误或缓存页全部被固定时为-1）。
+ **/
+ssize_t fs_read_view(FileSystem *fs, size_t inode_number, FsView *view, size_t length, size_t offset) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_read_view_untimed(fs, inode_number, view, length, offset);
 
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_READ_VIEW, start, result >= 0, max(result, 0));
+    return result;
+}
 
-        if (bytes_to_read > length - bytes_read) {
-            bytes_to_read = length - bytes_read;
-        }
+/**
+ * fs_read_view的实现（不记录统计）。
+ **/
+ssize_t fs_read_view_untimed(FileSystem *fs, size_t inode_number, FsView *view, size_t length, size_t offset) {
+    Block inode_block;
+    Inode *inode;
 
-        if (disk_read(fs->disk, inode->direct[block_index], buf) == DISK_FAILURE)
-            return -1;
+    if (view == NULL) {
+        return -1;
+    }
+    view->count  = 0;
+    view->length = 0;
 
-        memcpy(data + bytes_read, buf + block_offset, bytes_to_read);
-        bytes_read += bytes_to_read;
-        current_offset += bytes_to_read;
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid) {
+        return -1;
+    }
 
+    size_t size = fs_file_size(fs, inode);
+    if (offset >= size) {
+        return 0;
     }
-    
-    if (inode->indirect != 0){
-               
-        Block indirect_block;
-        
+    length = min(length, size - offset);
 
-        if (disk_read(fs->disk, inode->indirect, indirect_block.data) == DISK_FAILURE)
-            return false;
+    BlockMap map;
+    fs_map_init(fs, &map, inode_number, inode);
 
-        uint32_t pointer = 0; 
-        
-        while (current_offset < inode->size && bytes_read < length){
-            
-           
-                char buf[BLOCK_SIZE];
-                // 计算要读取的块和偏移量
-                size_t block_offset = current_offset % BLOCK_SIZE;
-                size_t block_index = current_offset / BLOCK_SIZE - POINTERS_PER_INODE;
-                size_t bytes_to_read = BLOCK_SIZE - block_offset;
-                if (block_index >= POINTERS_PER_BLOCK || block_index < 0) break;
-                
-                
-
-
-                ssize_t pointer = indirect_block.pointers[block_index];
-                if (pointer != 0)
-                {
-
-                    if (bytes_to_read > length - bytes_read) {
-                        bytes_to_read = length - bytes_read;
-                    }
+    pthread_mutex_lock(&fs->views.lock);
+    while (view->length < length && view->count < FS_VIEW_PAGES) {
+        size_t current_offset = offset + view->length;
+        size_t block_offset   = current_offset & (fs->block_size - 1);
+        size_t bytes          = min(fs->block_size - block_offset, length - view->length);
 
-                    if (disk_read(fs->disk, pointer, buf) == DISK_FAILURE)
-                        return -1; 
+        ViewPage *page = fs_view_page(fs, &map, current_offset >> fs->block_shift, size);
+        if (page == NULL) {
+            break;
+        }
 
-                    memcpy(data + bytes_read, buf + block_offset, bytes_to_read);
-                    bytes_read += bytes_to_read;
-                    current_offset += bytes_to_read;
+        view->pages[view->count] = page;
+        view->iov[view->count]   = (struct iovec){.iov_base = page->data + block_offset, .iov_len = bytes};
+        view->count++;
+        view->length += bytes;
+    }
+    pthread_mutex_unlock(&fs->views.lock);
 
-            }
+    return view->count > 0 ? (ssize_t)view->length : -1;
+}
+
+/**
+ * 释放视图固定的缓存页（引用计数减一）。视图的iovec此后不能再使用。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       view    fs_read_view返回的视图。
+ **/
+void fs_release_view(FileSystem *fs, FsView *view) {
+    if (fs == NULL || fs->disk == NULL || view == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&fs->views.lock);
+    for (size_t i = 0; i < view->count; i++) {
+        if (view->pages[i]->refs > 0) {
+            view->pages[i]->refs--;
         }
     }
-    
-    
-    return bytes_read;
+    pthread_mutex_unlock(&fs->views.lock);
+
+    view->count  = 0;
+    view->length = 0;
 }
 
 /**
- * 向指定的inode写入数据，从指定的偏移开始精确地写入长度字节，执行以下操作：
+ * 提交一个异步读取：由I/O引擎线程执行，结果与fs_read相同，通过request->callback或完成队列返回。
+ * 引擎把同时排队的读取合并成一批块请求一起提交，因此一个线程可以让很多文件的读取同时进行。
  *
- *  1. 加载inode信息。
+ *  注意：异步请求完成之前，调用者只能调用fs_read_async、fs_write_async和fs_async_reap
+ *  （回调函数中也可以提交新请求），不能同时调用其他文件系统函数。
  *
- *  2. 连续从缓冲区复制数据到块。
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       request     填好inode_number、data、length、offset、callback和context的请求。
+ * @return      是否成功提交。
+ **/
+bool fs_read_async(FileSystem *fs, FsRequest *request) {
+    return fs_async_submit(fs, request, false);
+}
+
+/**
+ * 提交一个异步写入（与fs_read_async对应，结果与fs_write相同）。同一个文件系统的异步请求
+ * 按提交顺序生效：写入之后提交的读取能看到写入的数据。
  *
- *  注意：首先从直接块中读取数据，然后从间接块中读取数据。
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       request     填好inode_number、data、length、offset、callback和context的请求。
+ * @return      是否成功提交。
+ **/
+bool fs_write_async(FileSystem *fs, FsRequest *request) {
+    return fs_async_submit(fs, request, true);
+}
+
+/**
+ * 从完成队列中取回一个完成的请求（没有设置回调的请求完成后进入完成队列）。
  *
- * @param       fs              指向FileSystem结构的指针。
- * @param       inode_number    要写入数据的i节点。
- * @param       data            包含要复制的数据的缓冲区。
- * @param       length          要写入的字节数。
- * @param       offset          从哪里开始写入的字节偏移。
- * @return      写入的字节数（错误时为-1）。
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       wait        完成队列为空时是否等待，直到有请求完成或所有请求都已完成。
+ * @return      完成的请求（没有时为NULL）。
  **/
-ssize_t fs_write(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset) {
-    if (fs == NULL || fs->disk == NULL || fs->free_blocks == NULL) {
-        return -1; 
+FsRequest *fs_async_reap(FileSystem *fs, bool wait) {
+    if (fs == NULL || fs->engine == NULL) {
+        return NULL;
     }
 
-    if (inode_number >= fs->meta_data.inodes) {
-        return -1;
+    FsEngine *engine = fs->engine;
+    pthread_mutex_lock(&engine->lock);
+    while (wait && engine->done == NULL && engine->pending > 0) {
+        pthread_cond_wait(&engine->completed, &engine->lock);
     }
 
+    FsRequest *request = engine->done;
+    if (request != NULL) {
+        engine->done = request->next;
+        if (engine->done == NULL) {
+            engine->done_tail = NULL;
+        }
+        request->next = NULL;
+    }
+    pthread_mutex_unlock(&engine->lock);
 
-    size_t block_number = 1 + inode_number / INODES_PER_BLOCK;
-    Block inode_block;
-    if (disk_read(fs->disk, block_number, inode_block.data) == DISK_FAILURE){
-        return -1;
+    return request;
+}
+
+/**
+ * 将请求加入引擎的队列（需要时先启动引擎）。
+ **/
+bool fs_async_submit(FileSystem *fs, FsRequest *request, bool write) {
+    if (fs == NULL || fs->disk == NULL || request == NULL) {
+        return false;
     }
-    size_t index_within_block  = inode_number % INODES_PER_BLOCK;
 
-    Inode *inodes  = inode_block.inodes;
-    Inode *inode = &inodes[index_within_block];
-    if (inode->valid == 0) return -1;
+    if (fs->engine == NULL && !fs_async_start(fs)) {
+        return false;
+    }
 
+    request->write     = write;
+    request->result    = 0;
+    request->submitted = stats_now();
+    request->next      = NULL;
 
-    size_t end_offset = offset + length;
-    size_t end_block = (end_offset + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    FsEngine *engine = fs->engine;
+    pthread_mutex_lock(&engine->lock);
+    if (engine->queue_tail != NULL) {
+        engine->queue_tail->next = request;
+    } else {
+        engine->queue = request;
+    }
+    engine->queue_tail = request;
+    engine->pending++;
+    pthread_cond_signal(&engine->submitted);
+    pthread_mutex_unlock(&engine->lock);
 
-     
-    size_t current_offset = offset;
-    size_t current_block = (current_offset + BLOCK_SIZE - 1) / BLOCK_SIZE;
-    size_t bytes_written = 0;
+    return true;
+}
 
-    while (current_block < end_block&& bytes_written < length){
+/**
+ * 启动异步I/O引擎线程。
+ **/
+bool fs_async_start(FileSystem *fs) {
+    FsEngine *engine = (FsEngine *)calloc(1, sizeof(FsEngine));
+    if (engine == NULL) {
+        return false;
+    }
 
-        char buf[BLOCK_SIZE];
-        size_t block_index = current_block;
+    pthread_mutex_init(&engine->lock, NULL);
+    pthread_cond_init(&engine->submitted, NULL);
+    pthread_cond_init(&engine->completed, NULL);
+    fs->engine = engine;
 
-        if (block_index < POINTERS_PER_INODE){
-            
-            if (inode->direct[block_index] == 0){
-                size_t pointer = 0;
-                for (size_t i = fs->meta_data.inode_blocks + 1; i < fs->meta_data.blocks; i++){
-                    if (fs->free_blocks[i] == true)
-                    {
-                        pointer = i;
-                        inode->direct[block_index] = pointer;
-                        fs->free_blocks[i] = false;
-                        break;
-                    } 
-                }
-                
-                if (pointer == 0) return -1;
-            }
+    if (pthread_create(&engine->thread, NULL, fs_async_thread, fs) != 0) {
+        pthread_cond_destroy(&engine->completed);
+        pthread_cond_destroy(&engine->submitted);
+        pthread_mutex_destroy(&engine->lock);
+        free(engine);
+        fs->engine = NULL;
+        return false;
+    }
 
-            size_t block_offset = current_offset % BLOCK_SIZE;
-            size_t bytes_to_write = BLOCK_SIZE - block_offset;
+    return true;
+}
 
-            if (bytes_to_write > length - bytes_written) {
-                bytes_to_write = length - bytes_written;
-            }
+/**
+ * 停止异步I/O引擎：引擎执行完队列中的请求后退出。完成队列中未取回的请求不再能被取回。
+ **/
+void fs_async_stop(FileSystem *fs) {
+    if (fs->engine == NULL) {
+        return;
+    }
 
-            if (disk_read(fs->disk, inode->direct[block_index], buf) == DISK_FAILURE){
-                return -1;
-            }
-            memcpy(buf + block_offset, data + bytes_written, bytes_to_write);
+    FsEngine *engine = fs->engine;
+    pthread_mutex_lock(&engine->lock);
+    engine->stop = true;
+    pthread_cond_signal(&engine->submitted);
+    pthread_mutex_unlock(&engine->lock);
+    pthread_join(engine->thread, NULL);
+
+    pthread_cond_destroy(&engine->completed);
+    pthread_cond_destroy(&engine->submitted);
+    pthread_mutex_destroy(&engine->lock);
+    free(engine);
+    fs->engine = NULL;
+}
 
-            if (disk_write(fs->disk, inode->direct[block_index], buf));
-            current_offset += bytes_to_write;
-            current_block = current_offset / BLOCK_SIZE;
-            bytes_written += bytes_to_write;
+/**
+ * 引擎线程：每次取出队列中的全部请求作为一批执行，然后逐个完成（调用回调或放入完成队列）。
+ **/
+void *fs_async_thread(void *arg) {
+    FileSystem *fs     = (FileSystem *)arg;
+    FsEngine   *engine = fs->engine;
+
+    pthread_mutex_lock(&engine->lock);
+    while (true) {
+        while (engine->queue == NULL && !engine->stop) {
+            pthread_cond_wait(&engine->submitted, &engine->lock);
+        }
+        if (engine->queue == NULL) {
+            break;
         }
-        else
-        {
-            if (inode->indirect == 0)
-            {
-                size_t pointer = 0;
-                for (size_t i = fs->meta_data.inode_blocks + 1; i < fs->meta_data.blocks; i++){
-                    if (fs->free_blocks[i] == true)
-                    {
-                        pointer = i;
-                        inode->indirect = pointer;
-                        fs->free_blocks[i] = false;
-                        break;
-                    } 
-                }
-                
-                if (pointer == 0) return -1;
-            }
-            
-            Block indirect_block;
-            uint32_t indirect_index = block_index - POINTERS_PER_INODE;
 
-            if (indirect_index >= POINTERS_PER_BLOCK) return -1;
-           
-            
-            
-            if (disk_read(fs->disk, inode->indirect, indirect_block.data)){
-                return -1;
+        FsRequest *batch = engine->queue;
+        engine->queue      = NULL;
+        engine->queue_tail = NULL;
+        pthread_mutex_unlock(&engine->lock);
+
+        fs_async_execute(fs, batch);
+
+        while (batch != NULL) {
+            FsRequest *request = batch;
+            batch = request->next;
+
+            stats_record(&fs->stats, request->write ? STATS_FS_WRITE_ASYNC : STATS_FS_READ_ASYNC,
+                         request->submitted, request->result >= 0, max(request->result, 0));
+            request->next = NULL;
+
+            /* 回调可能释放或重新提交请求：调用之后不再访问request */
+            FsCallback callback = request->callback;
+            if (callback != NULL) {
+                callback(request);
             }
 
-            uint32_t *pointer = &indirect_block.pointers[indirect_index];
-            
-            if (*pointer == 0)
-            {
-                for (size_t i = fs->meta_data.inode_blocks + 1; i < fs->meta_data.blocks; i++){
-                    if (fs->free_blocks[i] == true)
-                    {
-                        *pointer = i;
-                        fs->free_blocks[i] = false;
-                        break;
-                    } 
+            pthread_mutex_lock(&engine->lock);
+            if (callback == NULL) {
+                if (engine->done_tail != NULL) {
+                    engine->done_tail->next = request;
+                } else {
+                    engine->done = request;
                 }
+                engine->done_tail = request;
+            }
+            engine->pending--;
+            pthread_cond_broadcast(&engine->completed);
+            pthread_mutex_unlock(&engine->lock);
+        }
+
+        pthread_mutex_lock(&engine->lock);
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    return NULL;
+}
+
+/**
+ * 按提交顺序执行一批请求：相邻的读取合并执行（见fs_async_read_batch），写入逐个执行。
+ **/
+void fs_async_execute(FileSystem *fs, FsRequest *batch) {
+    FsRequest *reads = NULL;
+    size_t     count = 0;
+
+    for (FsRequest *request = batch; request != NULL; request = request->next) {
+        if (!request->write) {
+            reads = count == 0 ? request : reads;
+            count++;
+            continue;
+        }
 
-                if (*pointer == 0) return -1;
+        if (count > 0) {
+            fs_async_read_batch(fs, reads, count);
+            count = 0;
+        }
+        request->result = fs_write_untimed(fs, request->inode_number, request->data, request->length, request->offset);
+    }
+
+    if (count > 0) {
+        fs_async_read_batch(fs, reads, count);
+    }
+}
+
+/**
+ * 执行一批读取：先映射所有文件的块（空洞直接清零，压缩文件同步解压），
+ * 再把所有文件的块请求作为一批交给请求队列，由电梯调度排序合并。整块直接读入调用者的缓冲区，
+ * 部分块经过中转缓冲区。批量提交失败时无法区分是哪个文件，逐个文件重新同步读取。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       first   这批读取中的第一个请求（之后的请求通过next相连）。
+ * @param       count   这批读取的请求数。
+ **/
+void fs_async_read_batch(FileSystem *fs, FsRequest *first, size_t count) {
+    DiskRequest *requests = NULL;
+    AsyncCopy   *copies   = NULL;
+    size_t       used = 0, capacity = 0;
+    size_t       copied = 0, copy_capacity = 0;
+    bool         success = true;
+
+    FsRequest *request = first;
+    for (size_t i = 0; i < count; i++, request = request->next) {
+        Block  inode_block;
+        Inode *inode;
+
+        request->result = -1;
+        if (!fs_load_inode(fs, request->inode_number, &inode_block, &inode) || !inode->valid) {
+            continue;
+        }
+
+        size_t size = fs_file_size(fs, inode);
+        if (request->offset >= size) {
+            request->result = 0;
+            continue;
+        }
+        size_t length = min(request->length, size - request->offset);
+
+        BlockMap map;
+        fs_map_init(fs, &map, request->inode_number, inode);
+        if (inode->flags & INODE_COMPRESSED) {
+            request->result = fs_read_compressed(fs, &map, request->data, length, request->offset);
+            continue;
+        }
 
+        size_t bytes_read = 0;
+        while (success && bytes_read < length) {
+            size_t  current_offset = request->offset + bytes_read;
+            size_t  block_offset   = current_offset & (fs->block_size - 1);
+            size_t  bytes          = min(fs->block_size - block_offset, length - bytes_read);
+            char   *target         = request->data + bytes_read;
+            ssize_t pointer        = fs_map_lookup(fs, &map, current_offset >> fs->block_shift);
+            if (pointer < 0) {
+                break;
             }
 
-            if (disk_read(fs->disk, *pointer, buf) == DISK_FAILURE){
-                return -1;
+            bytes_read += bytes;
+            if (pointer == 0) {
+                memset(target, 0, bytes);
+                continue;
             }
-            
-            size_t block_offset = current_offset % BLOCK_SIZE;
-            size_t bytes_to_write = BLOCK_SIZE - block_offset;
 
-            if (bytes_to_write > length - bytes_written) {
-                bytes_to_write = length - bytes_written;
+            if (used == capacity) {
+                capacity = capacity ? 2 * capacity : 64;
+                DiskRequest *grown = (DiskRequest *)realloc(requests, capacity * sizeof(DiskRequest));
+                success = grown != NULL;
+                requests = grown ? grown : requests;
+            }
+            if (success && bytes < fs->block_size && copied == copy_capacity) {
+                copy_capacity = copy_capacity ? 2 * copy_capacity : 16;
+                AsyncCopy *grown = (AsyncCopy *)realloc(copies, copy_capacity * sizeof(AsyncCopy));
+                success = grown != NULL;
+                copies = grown ? grown : copies;
+            }
+            if (!success) {
+                break;
             }
 
+            if (bytes < fs->block_size) {
+                copies[copied++] = (AsyncCopy){.request = used, .target = target, .skip = block_offset, .bytes = bytes};
+                target = NULL;
+            }
+            requests[used++] = (DiskRequest){.block = pointer, .data = target};
+        }
 
+        if (bytes_read == length) {
+            request->result = length;
+        }
+    }
 
-            memcpy(buf + block_offset, data + bytes_written, bytes_to_write);
+    char *bounce = copied > 0 ? (char *)malloc(copied * fs->block_size) : NULL;
+    success = success && (copied == 0 || bounce != NULL);
+    for (size_t i = 0; success && i < copied; i++) {
+        requests[copies[i].request].data = bounce + i * fs->block_size;
+    }
 
-            if (disk_write(fs->disk, *pointer, buf));
-            current_offset += bytes_to_write;
-            current_block = current_offset / BLOCK_SIZE;
-            bytes_written += bytes_to_write;
+    if (success && used > 0) {
+        success = fs_submit(fs, requests, used);
+    }
+    for (size_t i = 0; success && i < copied; i++) {
+        memcpy(copies[i].target, bounce + i * fs->block_size + copies[i].skip, copies[i].bytes);
+    }
 
+    if (!success) {
+        request = first;
+        for (size_t i = 0; i < count; i++, request = request->next) {
+            request->result = fs_read_untimed(fs, request->inode_number, request->data, request->length, request->offset);
         }
-        
     }
-    
-    if (end_offset > inode->size) {
-        inode->size = end_offset;
+
+    free(bounce);
+    free(copies);
+    free(requests);
+}
+
+/**
+ * 向指定的inode写入数据，从指定的偏移开始精确地写入长度字节，执行以下操作：
+ *
+ *  1. 加载inode信息。
+ *
+ *  2. 连续从缓冲区复制数据到块，按需分配数据块和间接块。
+ *
+ *  3. 写回间接块和inode。
+ *
+ *  注意：新块优先分配在文件上一个块之后，以保持文件在磁盘上连续；
+ *  压缩文件按压缩组读取、修改后重新压缩存储。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    要写入数据的i节点。
+ * @param       data            包含要复制的数据的缓冲区。
+ * @param       length          要写入的字节数。
+ * @param       offset          从哪里开始写入的字节偏移。
+ * @return      写入的字节数（空间不足时可能少于length，错误时为-1）。
+ **/
+ssize_t fs_write(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_write_untimed(fs, inode_number, data, length, offset);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_WRITE, start, result >= 0, max(result, 0));
+    return result;
+}
+
+/**
+ * fs_write的实现（不记录统计）。
+ **/
+ssize_t fs_write_untimed(FileSystem *fs, size_t inode_number, char *data, size_t length, size_t offset) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid) {
+        return -1;
     }
-    if (disk_write(fs->disk, block_number, inode_block.data) == DISK_FAILURE)
+    fs_view_invalidate(fs, inode_number);
+
+    BlockMap map;
+    fs_map_init(fs, &map, inode_number, inode);
+
+    /* 跳过文件末尾写入时，先清除旧末尾之后残留的数据 */
+    size_t size = fs_file_size(fs, inode);
+    if (offset > size && !fs_zero_range(fs, &map, size, offset)) {
         return -1;
+    }
 
-    return bytes_written;
+    size_t bytes_written;
+    if (inode->flags & INODE_COMPRESSED) {
+        bytes_written = fs_write_compressed(fs, &map, data, length, offset);
+    } else {
+        bytes_written = fs_write_blocks(fs, &map, data, length, offset);
+    }
+
+    if (offset + bytes_written > size) {
+        fs_set_file_size(fs, inode, offset + bytes_written);
+    }
+
+    if (!fs_map_flush(fs, &map) || !fs_save_inode(fs, inode_number, &inode_block)) {
+        return -1;
+    }
+
+    return (bytes_written > 0 || length == 0) ? (ssize_t)bytes_written : -1;
+}
+
+/**
+ * 将指定inode截断（或扩展）到给定大小，执行以下操作：
+ *
+ *  1. 释放新末尾之后的所有数据块（包括预分配的块），必要时释放间接块。
+ *
+ *  2. 清零保留下来的最后一个块（压缩文件为最后一个压缩组）中新末尾之后的部分。
+ *
+ *  3. 扩展时，清零旧末尾到新末尾之间已映射的块；未映射的部分作为空洞读取为零。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    要截断的inode。
+ * @param       size            新的文件大小（字节）。
+ * @return      是否成功（成功为true，失败为false）。
+ **/
+bool fs_truncate(FileSystem *fs, size_t inode_number, size_t size) {
+    uint64_t start  = stats_now();
+    bool     result = fs_truncate_untimed(fs, inode_number, size);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_TRUNCATE, start, result, 0);
+    return result;
+}
+
+/**
+ * fs_truncate的实现（不记录统计）。
+ **/
+bool fs_truncate_untimed(FileSystem *fs, size_t inode_number, size_t size) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid) {
+        return false;
+    }
+    fs_view_invalidate(fs, inode_number);
+
+    if (size > fs_map_capacity(fs, inode) << fs->block_shift) {
+        return false;
+    }
+
+    BlockMap map;
+    fs_map_init(fs, &map, inode_number, inode);
+    size_t unit = (inode->flags & INODE_COMPRESSED) ? COMPRESS_GROUP : 1;
+    size_t keep = (size + (unit << fs->block_shift) - 1) / (unit << fs->block_shift) * unit;
+
+    fs_group_invalidate(fs, inode_number);
+
+    if (!fs_free_tail(fs, &map, keep)) {
+        return false;
+    }
+
+    size_t old_size = fs_file_size(fs, inode);
+    if (size < old_size) {
+        if (!fs_zero_range(fs, &map, size, min(old_size, keep << fs->block_shift)))
+            return false;
+    } else if (!fs_zero_range(fs, &map, old_size, size)) {
+        return false;
+    }
+
+    fs_set_file_size(fs, inode, size);
+    bool result = fs_map_flush(fs, &map) && fs_save_inode(fs, inode_number, &inode_block);
+    fs_discard_flush(fs);
+    return result;
+}
+
+/**
+ * 为inode预留[offset, offset + length)范围内的数据块，执行以下操作：
+ *
+ *  1. 统计需要新分配的块数（包括可能需要的间接块），空间不足时不做任何修改。
+ *
+ *  2. 在空闲块中寻找足够长的连续区间（找不到时从最长的空闲区间开始）。
+ *
+ *  3. 按逻辑顺序把区间中的块映射到inode上。
+ *
+ *  注意：预留的块不会被清零，文件大小也不会改变；后续的fs_write直接写入这些块。
+ *  压缩文件只检查空间是否足够，不预留块。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    要预留空间的inode。
+ * @param       offset          预留范围的起始字节偏移。
+ * @param       length          预留范围的字节数。
+ * @return      是否成功预留整个范围（成功为true，失败为false）。
+ **/
+bool fs_fallocate(FileSystem *fs, size_t inode_number, size_t offset, size_t length) {
+    uint64_t start  = stats_now();
+    bool     result = fs_fallocate_untimed(fs, inode_number, offset, length);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_FALLOCATE, start, result, 0);
+    return result;
+}
+
+/**
+ * fs_fallocate的实现（不记录统计）。
+ **/
+bool fs_fallocate_untimed(FileSystem *fs, size_t inode_number, size_t offset, size_t length) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid) {
+        return false;
+    }
+    fs_view_invalidate(fs, inode_number);
+
+    if (length == 0) {
+        return true;
+    }
+
+    size_t first = offset >> fs->block_shift;
+    size_t last  = (offset + length - 1) >> fs->block_shift;
+    if (last >= fs_map_capacity(fs, inode)) {
+        return false;
+    }
+
+    /* 压缩文件写入前无法知道压缩后的大小，只检查最坏情况下的空间是否足够 */
+    if (inode->flags & INODE_COMPRESSED) {
+        size_t start;
+        return fs_find_run(fs, last - first + 2, fs_inode_goal(fs, inode_number), &start) > 0;
+    }
+
+    BlockMap map;
+    fs_map_init(fs, &map, inode_number, inode);
+    size_t needed = 0;
+
+    if (last >= POINTERS_PER_INODE && inode->indirect == 0) {
+        needed++;
+    }
+
+    /* 二级和三级间接树中可能需要的指针块（上界）：每个叶子块映射pointers_per_block个块 */
+    size_t deep = POINTERS_PER_INODE + fs->pointers_per_block;
+    if (last >= deep) {
+        needed += 2 * ((last - max(first, deep)) / fs->pointers_per_block + 1) + 2;
+    }
+
+    for (size_t block_index = first; block_index <= last; block_index++) {
+        ssize_t pointer = fs_map_lookup(fs, &map, block_index);
+        if (pointer < 0) {
+            return false;
+        }
+        if (pointer == 0) {
+            needed++;
+        }
+    }
+
+    if (needed == 0) {
+        return true;
+    }
+
+    size_t goal;
+    if (fs_find_run(fs, needed, map.goal, &goal) == 0) {
+        return false;
+    }
+
+    bool success = true;
+    for (size_t block_index = first; block_index <= last && success; block_index++) {
+        uint32_t *slot = fs_map_slot(fs, &map, block_index, goal);
+        if (slot == NULL) {
+            success = false;
+            break;
+        }
+
+        if (*slot == 0) {
+            ssize_t pointer = fs_allocate_block(fs, goal);
+            if (pointer < 0) {
+                success = false;
+                break;
+            }
+            *slot = pointer;
+            map.dirty = true;
+        }
+        goal = *slot + 1;
+    }
+
+    /* 中途失败时也写回映射和inode：已经分配的块（包括新的间接块）由inode引用，不会泄漏 */
+    bool saved = fs_map_flush(fs, &map) && fs_save_inode(fs, inode_number, &inode_block);
+    return success && saved;
+}
+
+/**
+ * 为空文件打开或关闭压缩。已经包含数据的文件不能切换，以免同一文件中混用两种块映射方式。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    要设置的inode。
+ * @param       enabled         是否压缩。
+ * @return      是否成功（inode无效或文件非空时为false）。
+ **/
+bool fs_set_compression(FileSystem *fs, size_t inode_number, bool enabled) {
+    uint64_t start  = stats_now();
+    bool     result = fs_set_compression_untimed(fs, inode_number, enabled);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_SET_COMPRESSION, start, result, 0);
+    return result;
+}
+
+/**
+ * fs_set_compression的实现（不记录统计）。
+ **/
+bool fs_set_compression_untimed(FileSystem *fs, size_t inode_number, bool enabled) {
+    Block inode_block;
+    Inode *inode;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid) {
+        return false;
+    }
+
+    InodeExtension *extension = fs_inode_extension(fs, inode);
+    if (fs_file_size(fs, inode) != 0 || inode->indirect != 0 || (inode->flags & INODE_DIRECTORY) ||
+        (extension && (extension->double_indirect || extension->triple_indirect))) {
+        return false;
+    }
+
+    for (size_t i = 0; i < POINTERS_PER_INODE; i++) {
+        if (inode->direct[i] != 0) {
+            return false;
+        }
+    }
+
+    if (enabled) {
+        inode->flags |= INODE_COMPRESSED;
+    } else {
+        inode->flags &= ~INODE_COMPRESSED;
+    }
+
+    fs_group_invalidate(fs, inode_number);
+    return fs_save_inode(fs, inode_number, &inode_block);
+}
+
+/**
+ * 统计去重效果：去重比例为logical_blocks / physical_blocks。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       stats   用于返回统计信息的结构。
+ * @return      是否成功（文件系统未挂载或未启用去重时为false）。
+ **/
+bool fs_dedup_stats(FileSystem *fs, DedupStats *stats) {
+    if (fs == NULL || fs->disk == NULL || fs->dedup.refcounts == NULL || stats == NULL) {
+        return false;
+    }
+
+    memset(stats, 0, sizeof(DedupStats));
+    for (size_t block = fs_data_start(fs); block < fs->meta_data.blocks; block++) {
+        uint32_t references = fs->dedup.refcounts[block];
+        if (references > 0) {
+            stats->physical_blocks++;
+            stats->logical_blocks += references;
+            stats->shared_blocks  += references > 1;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * 对文件系统中所有的空闲数据块打洞（用于回收以前没有启用打洞模式时释放的空间），
+ * 先处理等待打洞的已释放块，再按分配组把连续的空闲块合并成区间交给disk_discard。
+ * 每组在持有自己的锁时打洞，期间该组的块不会被分配。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @return      打洞的块数（出错时为-1）。
+ **/
+ssize_t fs_trim(FileSystem *fs) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_trim_untimed(fs);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_TRIM, start, result >= 0, 0);
+    return result;
+}
+
+/**
+ * fs_trim的实现（不记录统计）。
+ **/
+ssize_t fs_trim_untimed(FileSystem *fs) {
+    if (fs == NULL || fs->disk == NULL) {
+        return -1;
+    }
+
+    fs_discard_flush(fs);
+
+    ssize_t trimmed = 0;
+    for (size_t i = 0; i < fs->group_count && trimmed >= 0; i++) {
+        AllocGroup *group = &fs->groups[i];
+        size_t      run   = 0;
+
+        pthread_mutex_lock(&group->lock);
+        for (size_t block = group->data; block <= group->end; block++) {
+            if (block < group->end && fs->free_blocks[block]) {
+                run++;
+                continue;
+            }
+            if (run > 0) {
+                if (disk_discard(fs->disk, (block - run) * fs->sectors, run * fs->sectors) == DISK_FAILURE) {
+                    trimmed = -1;
+                    break;
+                }
+                trimmed += run;
+                run = 0;
+            }
+        }
+        pthread_mutex_unlock(&group->lock);
+    }
+
+    return trimmed;
+}
+
+/**
+ * 返回空间和inode的使用情况。计数随每次分配、释放、创建和删除更新，最长空闲区间按分配组缓存，
+ * 只重新扫描上次查询之后分配或释放过块的组，因此频繁查询不需要扫描整个磁盘或inode表。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       stats   用于返回统计信息的结构。
+ * @return      是否成功（文件系统未挂载时为false）。
+ **/
+bool fs_statfs(FileSystem *fs, SpaceStats *stats) {
+    uint64_t start  = stats_now();
+    bool     result = fs_statfs_untimed(fs, stats);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_STATFS, start, result, 0);
+    return result;
+}
+
+/**
+ * fs_statfs的实现（不记录统计）。
+ **/
+bool fs_statfs_untimed(FileSystem *fs, SpaceStats *stats) {
+    if (fs == NULL || fs->disk == NULL || stats == NULL) {
+        return false;
+    }
+
+    memset(stats, 0, sizeof(SpaceStats));
+    stats->block_size   = fs->block_size;
+    stats->total_blocks = fs->meta_data.blocks;
+    stats->total_inodes = fs->meta_data.inodes;
+    stats->free_inodes  = fs->free_inodes;
+
+    for (size_t g = 0; g < fs->group_count; g++) {
+        AllocGroup *group = &fs->groups[g];
+        pthread_mutex_lock(&group->lock);
+        stats->data_blocks    += group->end - group->data;
+        stats->free_blocks    += group->free;
+        stats->largest_extent  = max(stats->largest_extent, fs_group_extent(fs, group));
+        pthread_mutex_unlock(&group->lock);
+    }
+
+    return true;
+}
+
+/**
+ * 用宿主文件的全部内容替换inode的内容，执行以下操作：
+ *
+ *  1. 截断inode，按宿主文件大小预分配块。
+ *
+ *  2. 对每段物理上连续的完整块，用disk_copy_in在内核中直接复制。
+ *
+ *  3. 最后不足一块的部分经过一个块缓冲区写入。
+ *
+ * 注意：压缩文件、启用去重的文件系统和不能pread的描述符需要检查数据，
+ * 退回到每次FS_COPY_BLOCKS块的缓冲区循环（每个字节只复制一次）。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    目标inode。
+ * @param       fd              宿主文件的描述符（从偏移0开始读取）。
+ * @return      复制的字节数（出错时为-1）。
+ **/
+ssize_t fs_copyin(FileSystem *fs, size_t inode_number, int fd) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_copyin_untimed(fs, inode_number, fd);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_COPYIN, start, result >= 0, max(result, 0));
+    return result;
+}
+
+/**
+ * fs_copyin的实现（不记录统计）。
+ **/
+ssize_t fs_copyin_untimed(FileSystem *fs, size_t inode_number, int fd) {
+    Block inode_block;
+    Inode *inode;
+    struct stat s;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid || fstat(fd, &s) < 0) {
+        return -1;
+    }
+
+    if (!fs_truncate_untimed(fs, inode_number, 0)) {
+        return -1;
+    }
+
+    if (!S_ISREG(s.st_mode) || (inode->flags & INODE_COMPRESSED) || fs->dedup.refcounts != NULL) {
+        return fs_copyin_buffered(fs, inode_number, fd);
+    }
+
+    size_t size = s.st_size;
+    if (!fs_fallocate_untimed(fs, inode_number, 0, size) || !fs_load_inode(fs, inode_number, &inode_block, &inode)) {
+        return -1;
+    }
+
+    BlockMap map;
+    fs_map_init(fs, &map, inode_number, inode);
+    size_t   full = size >> fs->block_shift;
+    size_t   tail = size & (fs->block_size - 1);
+
+    for (size_t block_index = 0; block_index < full; ) {
+        ssize_t start;
+        size_t  count = fs_map_run(fs, &map, block_index, full, &start);
+        if (count == 0 || start == 0 ||
+            disk_copy_in(fs->disk, start * fs->sectors, count * fs->sectors, fd,
+                         (off_t)block_index << fs->block_shift) == DISK_FAILURE) {
+            return -1;
+        }
+        block_index += count;
+    }
+
+    if (tail) {
+        Block   buf;
+        ssize_t pointer = fs_map_lookup(fs, &map, full);
+        memset(buf.data + tail, 0, fs->block_size - tail);
+        if (pointer <= 0 || pread(fd, buf.data, tail, (off_t)full << fs->block_shift) != (ssize_t)tail ||
+            fs_write_block(fs, pointer, buf.data) == DISK_FAILURE) {
+            return -1;
+        }
+    }
+
+    fs_set_file_size(fs, inode, size);
+    return fs_save_inode(fs, inode_number, &inode_block) ? (ssize_t)size : -1;
+}
+
+/**
+ * 将inode的全部内容复制到宿主文件，执行以下操作：
+ *
+ *  1. 截断宿主文件。
+ *
+ *  2. 对每段物理上连续的完整块，用disk_copy_out在内核中直接复制；空洞跳过，
+ *     最后用ftruncate设置文件大小，在宿主文件中同样成为空洞。
+ *
+ *  3. 最后不足一块的部分经过一个块缓冲区写入。
+ *
+ * 注意：压缩文件和不是普通文件的描述符（管道、终端）退回到缓冲区循环。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    源inode。
+ * @param       fd              宿主文件的描述符。
+ * @return      复制的字节数（出错时为-1）。
+ **/
+ssize_t fs_copyout(FileSystem *fs, size_t inode_number, int fd) {
+    uint64_t start  = stats_now();
+    ssize_t  result = fs_copyout_untimed(fs, inode_number, fd);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_COPYOUT, start, result >= 0, max(result, 0));
+    return result;
+}
+
+/**
+ * fs_copyout的实现（不记录统计）。
+ **/
+ssize_t fs_copyout_untimed(FileSystem *fs, size_t inode_number, int fd) {
+    Block inode_block;
+    Inode *inode;
+    struct stat s;
+
+    if (!fs_load_inode(fs, inode_number, &inode_block, &inode) || !inode->valid || fstat(fd, &s) < 0) {
+        return -1;
+    }
+
+    if (!S_ISREG(s.st_mode) || (inode->flags & INODE_COMPRESSED)) {
+        return fs_copyout_buffered(fs, inode_number, fd);
+    }
+
+    if (ftruncate(fd, 0) < 0) {
+        return -1;
+    }
+
+    BlockMap map;
+    size_t   size = fs_file_size(fs, inode);
+    size_t   full = size >> fs->block_shift;
+
+    fs_map_init(fs, &map, inode_number, inode);
+
+    for (size_t block_index = 0; block_index < full; ) {
+        ssize_t start;
+        size_t  count = fs_map_run(fs, &map, block_index, full, &start);
+        if (count == 0 || (start > 0 &&
+            disk_copy_out(fs->disk, start * fs->sectors, count * fs->sectors, fd,
+                          (off_t)block_index << fs->block_shift) == DISK_FAILURE)) {
+            return -1;
+        }
+        block_index += count;
+    }
+
+    size_t tail = size & (fs->block_size - 1);
+    if (tail) {
+        Block   buf;
+        ssize_t pointer = fs_map_lookup(fs, &map, full);
+        if (pointer == 0) {
+            memset(buf.data, 0, tail);
+        }
+        if (pointer < 0 || (pointer > 0 && fs_read_block(fs, pointer, buf.data) == DISK_FAILURE) ||
+            pwrite(fd, buf.data, tail, (off_t)full << fs->block_shift) != (ssize_t)tail) {
+            return -1;
+        }
+    }
+
+    return ftruncate(fd, size) == 0 ? (ssize_t)size : -1;
+}
+
+/* 内部函数 */
+
+/**
+ * 检查并设置文件系统的几何参数，同时计算按2的幂寻址用的移位量。
+ *
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       block_size  文件系统块大小（0表示BLOCK_SIZE）。
+ * @param       inode_size  inode大小（0表示FS_INODE_SIZE_MIN）。
+ * @return      几何参数是否合法（块大小是BLOCK_SIZE的2的幂倍且不超过FS_BLOCK_SIZE_MAX，
+ *              inode大小是FS_INODE_SIZE_MIN到FS_INODE_SIZE_MAX之间的2的幂）。
+ **/
+bool fs_geometry(FileSystem *fs, size_t block_size, size_t inode_size) {
+    block_size = block_size ? block_size : BLOCK_SIZE;
+    inode_size = inode_size ? inode_size : FS_INODE_SIZE_MIN;
+
+    if (block_size < FS_BLOCK_SIZE_MIN || block_size > FS_BLOCK_SIZE_MAX || (block_size & (block_size - 1)) ||
+        inode_size < FS_INODE_SIZE_MIN || inode_size > FS_INODE_SIZE_MAX || (inode_size & (inode_size - 1))) {
+        return false;
+    }
+
+    fs->block_size          = block_size;
+    fs->block_shift         = __builtin_ctzl(block_size);
+    fs->sectors             = block_size / BLOCK_SIZE;
+    fs->inode_size          = inode_size;
+    fs->inodes_per_block    = block_size / inode_size;
+    fs->inode_shift         = __builtin_ctzl(fs->inodes_per_block);
+    fs->pointers_per_block  = block_size / sizeof(uint32_t);
+    return true;
+}
+
+/**
+ * 读取一个文件系统块。块大小等于磁盘块时直接调用disk_read；否则通过fs_submit
+ * 读取对应的连续磁盘块（请求队列把它们合并为一次向量I/O）。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       block   文件系统块号。
+ * @param       data    用于保存数据的缓冲区（block_size字节）。
+ * @return      读取的字节数（出错时为DISK_FAILURE）。
+ **/
+ssize_t fs_read_block(FileSystem *fs, size_t block, char *data) {
+    if (fs->sectors == 1) {
+        return disk_read(fs->disk, block, data);
+    }
+
+    DiskRequest request = {.block = block, .data = data};
+    return fs_submit(fs, &request, 1) ? (ssize_t)fs->block_size : DISK_FAILURE;
+}
+
+/**
+ * 写入一个文件系统块（与fs_read_block对应）。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       block   文件系统块号。
+ * @param       data    要写入的数据（block_size字节）。
+ * @return      写入的字节数（出错时为DISK_FAILURE）。
+ **/
+ssize_t fs_write_block(FileSystem *fs, size_t block, char *data) {
+    if (fs->sectors == 1) {
+        return disk_write(fs->disk, block, data);
+    }
+
+    DiskRequest request = {.block = block, .write = true, .data = data};
+    return fs_submit(fs, &request, 1) ? (ssize_t)fs->block_size : DISK_FAILURE;
+}
+
+/**
+ * 通过请求队列提交一批文件系统块的读写（块号和缓冲区都以文件系统块为单位）。
+ * 块大小大于磁盘块时，每个请求被展开为对应的连续磁盘块请求。
+ *
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       requests    文件系统块的读写请求。
+ * @param       count       请求数。
+ * @return      是否全部成功。
+ **/
+bool fs_submit(FileSystem *fs, DiskRequest *requests, size_t count) {
+    if (fs->sectors == 1) {
+        return disk_submit(fs->disk, requests, count) == (ssize_t)count;
+    }
+
+    DiskRequest  local[FS_BLOCK_SIZE_MAX / BLOCK_SIZE];
+    size_t       total   = count * fs->sectors;
+    DiskRequest *sectors = total <= sizeof(local) / sizeof(local[0]) ? local : (DiskRequest *)malloc(total * sizeof(DiskRequest));
+    if (sectors == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < total; i++) {
+        const DiskRequest *request = &requests[i / fs->sectors];
+        size_t             sector  = i % fs->sectors;
+        sectors[i] = (DiskRequest){
+            .block = request->block * fs->sectors + sector,
+            .write = request->write,
+            .data  = request->data + sector * BLOCK_SIZE,
+        };
+    }
+
+    bool success = disk_submit(fs->disk, sectors, total) == (ssize_t)total;
+    if (sectors != local) {
+        free(sectors);
+    }
+    return success;
+}
+
+/**
+ * 返回inode所在的inode块的块号。
+ **/
+size_t fs_inode_block(FileSystem *fs, size_t inode_number) {
+    return fs_inode_table_block(fs, inode_number >> fs->inode_shift);
+}
+
+/**
+ * 返回inode表中第index个inode块的块号：inode表按需增长时查找inode块映射，
+ * 不分组时inode表紧跟在超级块之后，否则每group_inode_blocks个inode块位于一个分配组的开头。
+ **/
+size_t fs_inode_table_block(FileSystem *fs, size_t index) {
+    if (fs->meta_data.flags & FS_INODE_MAP) {
+        return fs->meta_data.inode_map[index / fs->meta_data.chunk_blocks] + index % fs->meta_data.chunk_blocks;
+    }
+
+    if (!(fs->meta_data.flags & FS_GROUPS)) {
+        return 1 + index;
+    }
+
+    size_t per_group = fs->meta_data.group_inode_blocks;
+    return fs_group_start(fs, index / per_group) + index % per_group;
+}
+
+/**
+ * 返回分配组的第一个块（组的inode片段的开始；不分组时为inode表的开始）。
+ **/
+size_t fs_group_start(FileSystem *fs, size_t group) {
+    if (!(fs->meta_data.flags & FS_GROUPS)) {
+        return 1;
+    }
+    return 1 + fs->meta_data.dedup_blocks + group * fs->meta_data.group_blocks;
+}
+
+/**
+ * 返回块所在的分配组（超级块和去重哈希块视为属于第一组）。
+ **/
+size_t fs_block_group(FileSystem *fs, size_t block) {
+    size_t base = fs_group_start(fs, 0);
+
+    if (!(fs->meta_data.flags & FS_GROUPS) || block < base) {
+        return 0;
+    }
+
+    return min((block - base) / fs->meta_data.group_blocks, fs_group_count(&fs->meta_data) - 1);
+}
+
+/**
+ * 返回超级块描述的分配组数（不分组的文件系统视为一组）。
+ * 比组的inode片段还短的尾部并入最后一组，inode表按需增长时任何尾部都自成一组。
+ **/
+size_t fs_group_count(const SuperBlock *super) {
+    if (!(super->flags & FS_GROUPS)) {
+        return 1;
+    }
+
+    size_t data = super->blocks - 1 - super->dedup_blocks;
+    return data / super->group_blocks + (data % super->group_blocks > super->group_inode_blocks);
+}
+
+/**
+ * 判断块是否是数据块（不是超级块、inode块或去重哈希块）。
+ **/
+bool fs_is_data_block(FileSystem *fs, size_t block) {
+    if (block >= fs->meta_data.blocks) {
+        return false;
+    }
+
+    if (!(fs->meta_data.flags & FS_GROUPS)) {
+        return block >= fs_data_start(fs);
+    }
+
+    return block >= fs_group_start(fs, fs_block_group(fs, block)) + fs->meta_data.group_inode_blocks;
+}
+
+/**
+ * 返回inode的数据默认分配的位置：inode块所在分配组的第一个数据块，使文件的元数据和数据靠在一起。
+ **/
+size_t fs_inode_goal(FileSystem *fs, size_t inode_number) {
+    if (!(fs->meta_data.flags & FS_GROUPS) || inode_number >= fs->meta_data.inodes) {
+        return fs_data_start(fs);
+    }
+
+    size_t group = fs_block_group(fs, fs_inode_block(fs, inode_number));
+    return fs_group_start(fs, group) + fs->meta_data.group_inode_blocks;
+}
+
+/**
+ * 返回第一个去重哈希块（不分组时在inode表之后，否则紧跟在超级块之后）。
+ **/
+size_t fs_dedup_start(FileSystem *fs) {
+    return (fs->meta_data.flags & FS_GROUPS) ? 1 : 1 + fs->meta_data.inode_blocks;
+}
+
+/**
+ * 挂载扫描之后建立分配组：记录每组的数据区范围，统计空闲块并初始化组的分配锁。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @return      是否成功（内存不足时为false）。
+ **/
+bool fs_groups_open(FileSystem *fs) {
+    size_t count = fs_group_count(&fs->meta_data);
+
+    fs->groups = (AllocGroup *)calloc(count, sizeof(AllocGroup));
+    if (fs->groups == NULL) {
+        return false;
+    }
+
+    for (size_t g = 0; g < count; g++) {
+        AllocGroup *group = &fs->groups[g];
+        group->data = (fs->meta_data.flags & FS_GROUPS) ? fs_group_start(fs, g) + fs->meta_data.group_inode_blocks
+                                                        : fs_data_start(fs);
+        group->end  = g + 1 < count ? fs_group_start(fs, g + 1) : fs->meta_data.blocks;
+        for (size_t block = group->data; block < group->end; block++) {
+            group->free += fs->free_blocks[block];
+        }
+        group->extent_stale = true;
+        pthread_mutex_init(&group->lock, NULL);
+        fs->group_count++;
+    }
+
+    return true;
+}
+
+/**
+ * 返回分配组内最长的空闲区间（调用者持有组的锁）。只有组内分配或释放过块之后才重新扫描，
+ * 全空或全满的组不需要扫描。
+ **/
+size_t fs_group_extent(FileSystem *fs, AllocGroup *group) {
+    if (!group->extent_stale) {
+        return group->extent;
+    }
+
+    if (group->free == 0 || group->free == group->end - group->data) {
+        group->extent = group->free;
+    } else {
+        size_t run = 0;
+        group->extent = 0;
+        for (size_t block = group->data; block < group->end; block++) {
+            run = fs->free_blocks[block] ? run + 1 : 0;
+            group->extent = max(group->extent, run);
+        }
+    }
+
+    group->extent_stale = false;
+    return group->extent;
+}
+
+/**
+ * 返回各分配组的空闲块数之和。
+ **/
+size_t fs_free_block_count(FileSystem *fs) {
+    size_t free_blocks = 0;
+    for (size_t g = 0; g < fs->group_count; g++) {
+        free_blocks += fs->groups[g].free;
+    }
+    return free_blocks;
+}
+
+/**
+ * 空闲块数或空闲inode数与超级块中记录的不同时（即挂载后修改过文件系统），把它们写回超级块。
+ **/
+void fs_save_counts(FileSystem *fs) {
+    size_t free_blocks = fs_free_block_count(fs);
+    if (free_blocks == fs->meta_data.free_block_count && fs->free_inodes == fs->meta_data.free_inode_count) {
+        return;
+    }
+
+    Block super_block;
+    memset(super_block.data, 0, BLOCK_SIZE);
+    super_block.super = fs->meta_data;
+    super_block.super.free_block_count = free_blocks;
+    super_block.super.free_inode_count = fs->free_inodes;
+
+    if (disk_write(fs->disk, 0, super_block.data) == DISK_FAILURE) {
+        error("Unable to save free block and inode counts");
+        return;
+    }
+    fs->meta_data = super_block.super;
+}
+
+/**
+ * 销毁分配组的锁并释放分配组。
+ **/
+void fs_groups_close(FileSystem *fs) {
+    for (size_t g = 0; g < fs->group_count; g++) {
+        pthread_mutex_destroy(&fs->groups[g].lock);
+    }
+
+    free(fs->groups);
+    fs->groups      = NULL;
+    fs->group_count = 0;
+}
+
+/**
+ * 为inode表增加一个块组：在下一个分配组（按块组序号轮流）中寻找chunk_blocks个连续的空闲块，
+ * 清零后记录到inode块映射中并写回超级块。新的inode块先于超级块写入，
+ * 因此中途失败不会让超级块引用未初始化的inode块。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @return      是否增加了inode（inode表不能增长、映射已满或没有足够的连续空闲块时为false）。
+ **/
+bool fs_inode_grow(FileSystem *fs) {
+    SuperBlock *super = &fs->meta_data;
+    size_t      count = super->chunk_blocks;
+    size_t      start = 0;
+
+    if (!(super->flags & FS_INODE_MAP) || super->inode_chunks >= FS_INODE_CHUNKS ||
+        super->inodes + count * fs->inodes_per_block > UINT32_MAX) {
+        return false;
+    }
+
+    size_t goal = fs_group_start(fs, super->inode_chunks % fs->group_count);
+    if (fs_find_run(fs, count, goal, &start) < count) {
+        return false;
+    }
+
+    Block  empty;
+    size_t claimed = 0;
+    memset(empty.data, 0, fs->block_size);
+    while (claimed < count) {
+        ssize_t block = fs_allocate_block(fs, start + claimed);
+        if (block != (ssize_t)(start + claimed)) {
+            if (block >= 0) {
+                fs_release_block(fs, block);
+            }
+            break;
+        }
+        if (fs->dedup.refcounts != NULL) {
+            fs->dedup.refcounts[block] = 0;
+        }
+        claimed++;
+        if (fs_write_block(fs, block, empty.data) == DISK_FAILURE) {
+            break;
+        }
+    }
+
+    Block super_block;
+    memset(super_block.data, 0, BLOCK_SIZE);
+    super_block.super = *super;
+    super_block.super.inode_map[super->inode_chunks] = start;
+    super_block.super.inode_chunks++;
+    super_block.super.inode_blocks += count;
+    super_block.super.inodes       += count * fs->inodes_per_block;
+
+    if (claimed < count || disk_write(fs->disk, 0, super_block.data) == DISK_FAILURE) {
+        for (size_t i = 0; i < claimed; i++) {
+            fs_release_block(fs, start + i);
+        }
+        return false;
+    }
+
+    *super = super_block.super;
+    fs->free_inodes += count * fs->inodes_per_block;
+    return true;
+}
+
+/**
+ * 返回inode块数据中指定inode的位置（每个inode占用inode_size字节，超出Inode的部分保留）。
+ **/
+Inode *fs_inode_at(FileSystem *fs, char *data, size_t inode_number) {
+    return (Inode *)(data + (inode_number & (fs->inodes_per_block - 1)) * fs->inode_size);
+}
+
+/**
+ * 返回FS_LARGE文件系统中紧跟在inode之后的扩展字段（其他文件系统为NULL）。
+ **/
+InodeExtension *fs_inode_extension(FileSystem *fs, Inode *inode) {
+    return (fs->meta_data.flags & FS_LARGE) ? (InodeExtension *)(inode + 1) : NULL;
+}
+
+/**
+ * 返回文件大小（FS_LARGE文件系统中包括扩展字段中的高32位）。
+ **/
+size_t fs_file_size(FileSystem *fs, Inode *inode) {
+    InodeExtension *extension = fs_inode_extension(fs, inode);
+    return inode->size | (extension ? (size_t)extension->size_high << 32 : 0);
+}
+
+/**
+ * 设置文件大小（调用者保证大小不超过fs_map_capacity，未启用FS_LARGE时不超过32位）。
+ **/
+void fs_set_file_size(FileSystem *fs, Inode *inode, size_t size) {
+    InodeExtension *extension = fs_inode_extension(fs, inode);
+    inode->size = (uint32_t)size;
+    if (extension) {
+        extension->size_high = size >> 32;
+    }
+}
+
+/**
+ * 挂载前检查超级块并设置几何参数：魔数、标志、几何参数和各区域的大小都必须
+ * 与本实现和磁盘相符，否则拒绝挂载（例如其他版本格式化的映像、被截断的映像或损坏的超级块）。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       super   从磁盘读取的超级块。
+ * @param       disk    要挂载的磁盘。
+ * @return      是否可以挂载。
+ **/
+bool fs_validate(FileSystem *fs, const SuperBlock *super, Disk *disk) {
+    if (super->magic_number != MAGIC_NUMBER) {
+        error("Bad magic number %#x", super->magic_number);
+        return false;
+    }
+
+    if (super->flags & ~FS_FEATURES) {
+        error("Unsupported file system features %#x", super->flags & ~FS_FEATURES);
+        return false;
+    }
+
+    if (!fs_geometry(fs, super->block_size, super->inode_size) ||
+        ((super->flags & FS_LARGE) && fs->inode_size < FS_LARGE_INODE_SIZE)) {
+        error("Unsupported geometry: %u byte blocks, %u byte inodes", super->block_size, super->inode_size);
+        return false;
+    }
+
+    if ((size_t)super->blocks * fs->sectors > disk->blocks) {
+        error("File system has %u blocks but the disk only holds %zu", super->blocks, disk->blocks / fs->sectors);
+        return false;
+    }
+
+    if (super->blocks >= COMPRESSED_MARK) {
+        error("File system has %u blocks but block pointers only address %u", super->blocks, COMPRESSED_MARK);
+        return false;
+    }
+
+    bool   mapped = super->flags & FS_INODE_MAP;
+    size_t base   = 1 + (size_t)super->dedup_blocks;
+    if ((super->flags & FS_GROUPS) &&
+        (super->group_blocks == 0 || super->group_inode_blocks >= super->group_blocks || base >= super->blocks ||
+         fs_group_count(super) == 0 || mapped != (super->group_inode_blocks == 0) ||
+         (!mapped && super->inode_blocks != fs_group_count(super) * super->group_inode_blocks))) {
+        error("Inconsistent allocation groups: %u blocks with %u inode blocks each", super->group_blocks, super->group_inode_blocks);
+        return false;
+    }
+
+    if (mapped &&
+        (!(super->flags & FS_GROUPS) || super->chunk_blocks == 0 || super->inode_chunks > FS_INODE_CHUNKS ||
+         super->inode_blocks != (size_t)super->inode_chunks * super->chunk_blocks)) {
+        error("Inconsistent inode map: %u chunks of %u blocks", super->inode_chunks, super->chunk_blocks);
+        return false;
+    }
+
+    for (size_t i = 0; mapped && i < super->inode_chunks; i++) {
+        if (super->inode_map[i] < base || (size_t)super->inode_map[i] + super->chunk_blocks > super->blocks) {
+            error("Inode chunk %zu at block %u is outside the file system", i, super->inode_map[i]);
+            return false;
+        }
+    }
+
+    if (super->inodes > (size_t)super->inode_blocks * fs->inodes_per_block ||
+        1 + (size_t)super->inode_blocks + super->dedup_blocks > super->blocks) {
+        error("Inconsistent superblock: %u inodes in %u inode blocks", super->inodes, super->inode_blocks);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * 初始化inode的块映射状态（不清零间接块缓冲区，它在加载时才被填充），
+ * 并丢弃上一个操作留在指针块缓存中的内容。
+ **/
+void fs_map_init(FileSystem *fs, BlockMap *map, size_t inode_number, Inode *inode) {
+    map->inode_number = inode_number;
+    map->inode        = inode;
+    map->loaded       = false;
+    map->dirty        = false;
+    map->goal         = fs_inode_goal(fs, inode_number);
+
+    memset(fs->map_cache.blocks, 0, sizeof(fs->map_cache.blocks));
+    memset(fs->map_cache.touched, 0, sizeof(fs->map_cache.touched));
+}
+
+/**
+ * 扫描inode表（分组时是各组的inode片段），将所有被引用的块（直接块、间接块及其指向的块）标记为已使用，
+ * 并统计空闲的inode数。
+ * inode块和间接块都成批通过请求队列读取（每批约FS_SCAN_BATCH个磁盘块），间接块因此按块号顺序访问。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @return      是否成功。
+ **/
+bool fs_mount_scan(FileSystem *fs) {
+    size_t       batch           = FS_SCAN_BATCH / fs->sectors;
+    char        *inode_blocks    = (char *)malloc(batch * fs->block_size);
+    char        *indirect_blocks = (char *)malloc(batch * fs->block_size);
+    DiskRequest  requests[FS_SCAN_BATCH];
+    DiskRequest  indirect[FS_SCAN_BATCH];
+    size_t       pending = 0;
+    size_t       used    = 0;
+    bool         success = inode_blocks != NULL && indirect_blocks != NULL;
+
+    /* 按需增长的inode块位于数据区中 */
+    for (size_t i = 0; (fs->meta_data.flags & FS_INODE_MAP) && i < fs->meta_data.inode_blocks; i++) {
+        fs->free_blocks[fs_inode_table_block(fs, i)] = false;
+    }
+
+    for (size_t first = 0; success && first < fs->meta_data.inode_blocks; first += batch) {
+        size_t count = min(batch, fs->meta_data.inode_blocks - first);
+        for (size_t i = 0; i < count; i++) {
+            requests[i] = (DiskRequest){
+                .block = fs_inode_table_block(fs, first + i),
+                .data  = inode_blocks + (i << fs->block_shift),
+            };
+        }
+        if (!fs_submit(fs, requests, count)) {
+            success = false;
+            break;
+        }
+
+        for (size_t b = 0; success && b < count; b++) {
+            for (size_t i = 0; i < fs->inodes_per_block; i ++ ) {
+                Inode *inode = fs_inode_at(fs, requests[b].data, i);
+                if (inode->valid == 1)
+                {    
+                    used++;
+                    for (size_t j = 0; j < POINTERS_PER_INODE; j ++ )
+                        fs_mark_used(fs, inode->direct[j]);
+
+                    InodeExtension *extension = fs_inode_extension(fs, inode);
+                    if (extension && success) {
+                        success = fs_scan_tree(fs, extension->double_indirect, 2) &&
+                                  fs_scan_tree(fs, extension->triple_indirect, 3);
+                    }
+
+                    if (inode->indirect != 0 && inode->indirect < fs->meta_data.blocks)
+                    {
+                        fs_mark_used(fs, inode->indirect);
+                        indirect[pending] = (DiskRequest){
+                            .block = inode->indirect,
+                            .data  = indirect_blocks + (pending << fs->block_shift),
+                        };
+                        if (++pending == batch) {
+                            success = fs_scan_indirect(fs, indirect, pending);
+                            pending = 0;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    success = success && fs_scan_indirect(fs, indirect, pending);
+    free(inode_blocks);
+    free(indirect_blocks);
+    fs->free_inodes = fs->meta_data.inodes - used;
+    return success;
+}
+
+/**
+ * 通过请求队列读取一批间接块（按块号排序并合并相邻块），标记其中引用的块。
+ *
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       requests    间接块的读取请求。
+ * @param       count       请求数。
+ * @return      是否全部读取成功。
+ **/
+bool fs_scan_indirect(FileSystem *fs, DiskRequest *requests, size_t count) {
+    if (!fs_submit(fs, requests, count)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t *pointers = (const uint32_t *)requests[i].data;
+        for (size_t j = 0; j < fs->pointers_per_block; j++){
+            fs_mark_used(fs, pointers[j]);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * 标记二级或三级间接树中的所有块（树很少见，逐块递归读取）。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       block   树的根（0或不在数据区内时什么也不做）。
+ * @param       depth   树的层数（1表示block中的指针直接指向数据块）。
+ * @return      是否成功。
+ **/
+bool fs_scan_tree(FileSystem *fs, size_t block, size_t depth) {
+    if (!fs_is_data_block(fs, block)) {
+        return true;
+    }
+
+    Block buf;
+    fs_mark_used(fs, block);
+    if (fs_read_block(fs, block, buf.data) == DISK_FAILURE) {
+        return false;
+    }
+
+    for (size_t i = 0; i < fs->pointers_per_block; i++) {
+        if (depth == 1) {
+            fs_mark_used(fs, buf.pointers[i]);
+        } else if (!fs_scan_tree(fs, buf.pointers[i], depth - 1)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * 挂载时标记一个被引用的块；启用去重时增加其引用计数。
+ * 压缩组的长度标记不是块号，空指针和不在数据区内的指针也被忽略。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       block   被引用的块号。
+ **/
+void fs_mark_used(FileSystem *fs, size_t block) {
+    if (!fs_is_data_block(fs, block)) {
+        return;
+    }
+
+    fs->free_blocks[block] = false;
+    if (fs->dedup.refcounts != NULL) {
+        fs->dedup.refcounts[block]++;
+    }
+}
+
+/**
+ * 返回数据区的第一个块（超级块、inode表和去重哈希块之后；分组时是第一组的第一个数据块）。
+ **/
+size_t fs_data_start(FileSystem *fs) {
+    if (fs->meta_data.flags & FS_GROUPS) {
+        return 1 + fs->meta_data.dedup_blocks + fs->meta_data.group_inode_blocks;
+    }
+    return 1 + fs->meta_data.inode_blocks + fs->meta_data.dedup_blocks;
+}
+
+/**
+ * 读取inode所在的inode块，并返回指向块中该inode的指针。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    要加载的inode。
+ * @param       inode_block     用于保存inode块的缓冲区。
+ * @param       inode           返回指向inode_block中该inode的指针。
+ * @return      是否成功加载（文件系统未挂载或inode越界时为false）。
+ **/
+bool fs_load_inode(FileSystem *fs, size_t inode_number, Block *inode_block, Inode **inode) {
+    if (fs == NULL || fs->disk == NULL || fs->free_blocks == NULL) {
+        return false;
+    }
+
+    if (inode_number >= fs->meta_data.inodes) {
+        return false;
+    }
+
+    if (fs_read_block(fs, fs_inode_block(fs, inode_number), inode_block->data) == DISK_FAILURE) {
+        return false;
+    }
+
+    *inode = fs_inode_at(fs, inode_block->data, inode_number);
+    return true;
+}
+
+/**
+ * 将fs_load_inode加载的inode块写回磁盘。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    inode块中被修改的inode。
+ * @param       inode_block     包含该inode的inode块。
+ * @return      是否成功写回。
+ **/
+bool fs_save_inode(FileSystem *fs, size_t inode_number, Block *inode_block) {
+    return fs_write_block(fs, fs_inode_block(fs, inode_number), inode_block->data) != DISK_FAILURE;
+}
+
+/**
+ * 分配一个空闲数据块：先在goal所在的分配组中从goal开始向后查找（到组末尾后回到组的开头），
+ * 该组已满时依次查找之后的各组。每组只在持有自己的锁时查找和修改，
+ * 因此在不同组中分配的写入者互不等待；空闲计数为0的组直接跳过。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       goal    期望分配的块号（0表示没有偏好，从第一组开始）。
+ * @return      分配的块号（没有空闲块时为-1）。
+ **/
+ssize_t fs_allocate_block(FileSystem *fs, size_t goal) {
+    size_t first = fs_block_group(fs, goal);
+
+    for (size_t i = 0; i < fs->group_count; i++) {
+        AllocGroup *group = &fs->groups[(first + i) % fs->group_count];
+        size_t      from  = (i == 0 && goal >= group->data && goal < group->end) ? goal : group->data;
+        ssize_t     found = -1;
+
+        pthread_mutex_lock(&group->lock);
+        for (size_t n = 0; group->free > 0 && n < group->end - group->data; n++) {
+            size_t block = from + n < group->end ? from + n : from + n - (group->end - group->data);
+            if (fs->free_blocks[block]) {
+                fs->free_blocks[block] = false;
+                group->free--;
+                group->extent_stale = true;
+                found = block;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&group->lock);
+
+        if (found >= 0) {
+            if (fs->dedup.refcounts != NULL) {
+                fs->dedup.refcounts[found] = 1;
+            }
+            return found;
+        }
+    }
+
+    if (fs->discards.count > 0) {
+        fs_discard_flush(fs);
+        return fs_allocate_block(fs, goal);
+    }
+
+    return -1;
+}
+
+/**
+ * 释放对一个数据块的引用。启用去重时只有最后一个引用被释放后块才变为空闲，
+ * 并从哈希索引中删除。启用打洞时块先进入打洞队列，打洞之后才变为空闲（见fs_discard_flush），
+ * 因此在打洞之前不会被重新分配和写入。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       block   要释放的块号。
+ **/
+void fs_release_block(FileSystem *fs, size_t block) {
+    if (!fs_is_data_block(fs, block)) {
+        return;
+    }
+
+    if (fs->dedup.refcounts != NULL) {
+        if (fs->dedup.refcounts[block] > 1) {
+            fs->dedup.refcounts[block]--;
+            return;
+        }
+        fs->dedup.refcounts[block] = 0;
+        fs_dedup_remove(fs, block);
+    }
+
+    if (fs->discards.blocks != NULL) {
+        pthread_mutex_lock(&fs->discards.lock);
+        bool queued = fs->discards.blocks != NULL;
+        if (queued) {
+            fs->discards.blocks[fs->discards.count++] = block;
+        }
+        bool full = fs->discards.count == FS_DISCARD_BATCH;
+        pthread_mutex_unlock(&fs->discards.lock);
+
+        if (full) {
+            fs_discard_flush(fs);
+        }
+        if (queued) {
+            return;
+        }
+    }
+
+    AllocGroup *group = &fs->groups[fs_block_group(fs, block)];
+    pthread_mutex_lock(&group->lock);
+    if (!fs->free_blocks[block]) {
+        fs->free_blocks[block] = true;
+        group->free++;
+        group->extent_stale = true;
+    }
+    pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * 对打洞队列中的块打洞并把它们标记为空闲：块按编号排序后合并成连续区间，
+ * 每个区间调用一次disk_discard。打洞失败时（例如宿主文件系统不支持）记录错误，
+ * 队列中的块照常释放，本次挂载不再打洞。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ **/
+void fs_discard_flush(FileSystem *fs) {
+    DiscardQueue *queue = &fs->discards;
+    if (queue->blocks == NULL || queue->count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    size_t *blocks = queue->blocks;
+    size_t  count  = queue->count;
+    bool    failed = false;
+
+    qsort(blocks, count, sizeof(size_t), fs_inode_compare);
+    for (size_t i = 0, j = 0; i < count && !failed; i = j) {
+        for (j = i + 1; j < count && blocks[j] <= blocks[j - 1] + 1; j++);
+
+        size_t first = blocks[i], length = blocks[j - 1] - first + 1;
+        if (disk_discard(fs->disk, first * fs->sectors, length * fs->sectors) == DISK_FAILURE) {
+            error("Unable to discard blocks %zu to %zu, discard disabled", first, first + length - 1);
+            failed = true;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        AllocGroup *group = &fs->groups[fs_block_group(fs, blocks[i])];
+        pthread_mutex_lock(&group->lock);
+        if (!fs->free_blocks[blocks[i]]) {
+            fs->free_blocks[blocks[i]] = true;
+            group->free++;
+            group->extent_stale = true;
+        }
+        pthread_mutex_unlock(&group->lock);
+    }
+
+    queue->count = 0;
+    if (failed) {
+        queue->blocks = NULL;
+        free(blocks);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * 查找至少包含count个连续空闲块的区间（首次适配）；若不存在，返回最长的空闲区间。
+ * 从goal所在的分配组开始依次查找各组，区间不跨越分配组。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       count   需要的块数。
+ * @param       goal    期望的块号（决定从哪个分配组开始查找）。
+ * @param       start   返回区间的起始块号。
+ * @return      空闲块总数不足count时为0，否则为找到的区间长度。
+ **/
+size_t fs_find_run(FileSystem *fs, size_t count, size_t goal, size_t *start) {
+    size_t total = 0;
+
+    fs_discard_flush(fs);
+    size_t best_start = 0, best_length = 0;
+    size_t first = fs_block_group(fs, goal);
+
+    for (size_t i = 0; i < fs->group_count && best_length < count; i++) {
+        AllocGroup *group = &fs->groups[(first + i) % fs->group_count];
+        size_t run_start = 0, run_length = 0;
+
+        pthread_mutex_lock(&group->lock);
+        for (size_t block = group->data; block < group->end; block++) {
+            if (!fs->free_blocks[block]) {
+                run_length = 0;
+                continue;
+            }
+
+            if (run_length++ == 0) {
+                run_start = block;
+            }
+            total++;
+
+            if (run_length > best_length) {
+                best_start  = run_start;
+                best_length = run_length;
+                if (best_length >= count) {
+                    break;
+                }
+            }
+        }
+        pthread_mutex_unlock(&group->lock);
+    }
+
+    if (best_length < count && total < count) {
+        return 0;
+    }
+
+    *start = best_start;
+    return best_length;
+}
+
+/**
+ * 确保inode的间接块已加载到map中，需要时分配新的间接块。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       create  间接块不存在时是否分配。
+ * @param       goal    分配间接块时期望的块号。
+ * @return      间接块是否可用（不存在且不分配，或出错时为false）。
+ **/
+bool fs_map_load(FileSystem *fs, BlockMap *map, bool create, size_t goal) {
+    if (map->loaded) {
+        return true;
+    }
+
+    if (map->inode->indirect == 0) {
+        if (!create) {
+            return false;
+        }
+
+        ssize_t pointer = fs_allocate_block(fs, goal);
+        if (pointer < 0) {
+            return false;
+        }
+
+        map->inode->indirect = pointer;
+        memset(map->indirect.data, 0, fs->block_size);
+        map->dirty = true;
+    } else if (fs_read_block(fs, map->inode->indirect, map->indirect.data) == DISK_FAILURE) {
+        return false;
+    }
+
+    map->loaded = true;
+    return true;
+}
+
+/**
+ * 查找逻辑块对应的物理块号。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       map             inode的块映射状态。
+ * @param       block_index     文件中的逻辑块序号。
+ * @return      物理块号（空洞为0，出错或越界时为-1）。
+ **/
+ssize_t fs_map_lookup(FileSystem *fs, BlockMap *map, size_t block_index) {
+    if (block_index < POINTERS_PER_INODE) {
+        return map->inode->direct[block_index];
+    }
+
+    block_index -= POINTERS_PER_INODE;
+    if (block_index >= fs->pointers_per_block) {
+        uint32_t *slot;
+        if (!fs_map_deep(fs, map, block_index - fs->pointers_per_block, false, 0, &slot)) {
+            return -1;
+        }
+        return slot ? *slot : 0;
+    }
+
+    if (map->inode->indirect == 0) {
+        return 0;
+    }
+
+    if (!fs_map_load(fs, map, false, 0)) {
+        return -1;
+    }
+
+    return map->indirect.pointers[block_index];
+}
+
+/**
+ * 返回逻辑块在inode或间接块中的指针槽位，需要时分配间接块。
+ * 调用者通过槽位修改指针后需要设置map->dirty，间接块会在fs_map_flush时写回。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       map             inode的块映射状态。
+ * @param       block_index     文件中的逻辑块序号。
+ * @param       goal            分配间接块时期望的块号。
+ * @return      指向指针槽位的指针（越界或空间不足时为NULL）。
+ **/
+uint32_t *fs_map_slot(FileSystem *fs, BlockMap *map, size_t block_index, size_t goal) {
+    if (block_index < POINTERS_PER_INODE) {
+        return &map->inode->direct[block_index];
+    }
+
+    block_index -= POINTERS_PER_INODE;
+    if (block_index >= fs->pointers_per_block) {
+        uint32_t *slot;
+        return fs_map_deep(fs, map, block_index - fs->pointers_per_block, true, goal, &slot) ? slot : NULL;
+    }
+
+    if (!fs_map_load(fs, map, true, goal)) {
+        return NULL;
+    }
+
+    return &map->indirect.pointers[block_index];
+}
+
+/**
+ * 将map中被修改过的间接块（包括指针块缓存中的二级和三级间接块）写回磁盘。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @return      是否成功写回。
+ **/
+bool fs_map_flush(FileSystem *fs, BlockMap *map) {
+    if (!map->dirty) {
+        return true;
+    }
+
+    if (map->loaded && map->inode->indirect != 0 &&
+        fs_write_block(fs, map->inode->indirect, map->indirect.data) == DISK_FAILURE) {
+        return false;
+    }
+
+    if (!fs_map_cache_flush(fs)) {
+        return false;
+    }
+
+    map->dirty = false;
+    return true;
+}
+
+/**
+ * 在二级或三级间接树中查找逻辑块的指针槽位。index从二级间接树映射的第一个块开始计数，
+ * 超出二级间接树的部分属于三级间接树。路径上的指针块经过指针块缓存访问。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       index   相对于二级间接树的逻辑块序号。
+ * @param       create  路径上的指针块不存在时是否分配（新块清零，在fs_map_flush时写回）。
+ * @param       goal    分配指针块时期望的块号。
+ * @param       slot    返回指针槽位（路径上的块不存在且不分配时为NULL）。
+ * @return      是否成功（不是FS_LARGE文件系统、越界、空间不足或读取出错时为false）。
+ **/
+bool fs_map_deep(FileSystem *fs, BlockMap *map, size_t index, bool create, size_t goal, uint32_t **slot) {
+    InodeExtension *extension = fs_inode_extension(fs, map->inode);
+    size_t          pointers  = fs->pointers_per_block;
+    size_t          span      = pointers * pointers;
+    size_t          depth     = 2;
+    uint32_t       *pointer;
+
+    *slot = NULL;
+    if (extension == NULL) {
+        return false;
+    }
+
+    if (index < span) {
+        pointer = &extension->double_indirect;
+    } else {
+        index -= span;
+        span  *= pointers;
+        depth  = 3;
+        if (index >= span) {
+            return false;
+        }
+        pointer = &extension->triple_indirect;
+    }
+
+    for (size_t level = 0; level < depth; level++) {
+        char *data;
+
+        if (*pointer == 0) {
+            if (!create) {
+                return true;
+            }
+
+            ssize_t block = fs_allocate_block(fs, goal);
+            if (block < 0) {
+                return false;
+            }
+            *pointer   = block;
+            map->dirty = true;
+            data = fs_map_cache_get(fs, block, true, true);
+        } else {
+            data = fs_map_cache_get(fs, *pointer, false, create);
+        }
+
+        if (data == NULL) {
+            return false;
+        }
+
+        span   /= pointers;
+        pointer = (uint32_t *)data + index / span;
+        index  %= span;
+    }
+
+    *slot = pointer;
+    return true;
+}
+
+/**
+ * 从指针块缓存中取得一个指针块，不在缓存中时替换最久未使用的项（被修改过的项先写回）。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       block   指针块号。
+ * @param       fresh   是否是新分配的块（清零而不是从磁盘读取）。
+ * @param       touch   是否为修改而访问（该项在fs_map_flush时写回）。
+ * @return      指向缓存中块数据的指针（出错时为NULL）。
+ **/
+char *fs_map_cache_get(FileSystem *fs, size_t block, bool fresh, bool touch) {
+    MapCache *cache  = &fs->map_cache;
+    size_t    victim = 0;
+
+    for (size_t i = 0; i < FS_MAP_CACHE; i++) {
+        if (cache->blocks[i] == block) {
+            cache->used[i]     = ++cache->clock;
+            cache->touched[i] |= touch;
+            return cache->data + (i << fs->block_shift);
+        }
+        if (cache->blocks[i] == 0 ? cache->blocks[victim] != 0 || i < victim : cache->used[i] < cache->used[victim]) {
+            victim = i;
+        }
+    }
+
+    char *data = cache->data + (victim << fs->block_shift);
+    if (cache->blocks[victim] != 0 && cache->touched[victim] &&
+        fs_write_block(fs, cache->blocks[victim], data) == DISK_FAILURE) {
+        return NULL;
+    }
+
+    cache->blocks[victim] = 0;
+    if (fresh) {
+        memset(data, 0, fs->block_size);
+    } else if (fs_read_block(fs, block, data) == DISK_FAILURE) {
+        return NULL;
+    }
+
+    cache->blocks[victim]  = block;
+    cache->touched[victim] = touch || fresh;
+    cache->used[victim]    = ++cache->clock;
+    return data;
+}
+
+/**
+ * 写回指针块缓存中为修改而访问过的块。
+ **/
+bool fs_map_cache_flush(FileSystem *fs) {
+    MapCache *cache = &fs->map_cache;
+
+    for (size_t i = 0; i < FS_MAP_CACHE; i++) {
+        if (cache->blocks[i] != 0 && cache->touched[i]) {
+            if (fs_write_block(fs, cache->blocks[i], cache->data + (i << fs->block_shift)) == DISK_FAILURE) {
+                return false;
+            }
+            cache->touched[i] = false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * 释放逻辑块序号不小于first的所有数据块；如果间接块不再被使用，也一并释放。
+ * 要释放的块先收集起来，全部间接块都读取成功之后才释放：失败时inode在磁盘上引用的块仍然是已用的，
+ * 不会被重新分配或打洞。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       first   第一个要释放的逻辑块序号。
+ * @return      是否成功（读取间接块失败时为false，此时没有块被释放）。
+ **/
+bool fs_free_tail(FileSystem *fs, BlockMap *map, size_t first) {
+    FreeList freed   = {0};
+    bool     success = fs_free_collect(fs, map, first, &freed);
+
+    for (size_t i = 0; success && i < freed.count; i++) {
+        fs_release_block(fs, freed.blocks[i]);
+    }
+
+    free(freed.blocks);
+    return success;
+}
+
+/**
+ * fs_free_tail的实现：清除inode和间接块中的指针，把要释放的块加入freed。
+ **/
+bool fs_free_collect(FileSystem *fs, BlockMap *map, size_t first, FreeList *freed) {
+    Inode *inode = map->inode;
+
+    for (size_t i = first; i < POINTERS_PER_INODE; i++) {
+        if (inode->direct[i] != 0) {
+            if (!(inode->direct[i] & COMPRESSED_MARK) && !fs_free_add(freed, inode->direct[i]))
+                return false;
+            inode->direct[i] = 0;
+        }
+    }
+
+    size_t start = first > POINTERS_PER_INODE ? first - POINTERS_PER_INODE : 0;
+    if (inode->indirect != 0 && start < fs->pointers_per_block) {
+        if (!fs_map_load(fs, map, false, 0)) {
+            return false;
+        }
+
+        for (size_t i = start; i < fs->pointers_per_block; i++) {
+            if (map->indirect.pointers[i] != 0) {
+                if (!(map->indirect.pointers[i] & COMPRESSED_MARK) && !fs_free_add(freed, map->indirect.pointers[i]))
+                    return false;
+                map->indirect.pointers[i] = 0;
+                map->dirty = true;
+            }
+        }
+
+        if (start == 0) {
+            if (!fs_free_add(freed, inode->indirect)) {
+                return false;
+            }
+            inode->indirect = 0;
+            map->loaded = false;
+            map->dirty  = false;
+        }
+    }
+
+    InodeExtension *extension = fs_inode_extension(fs, inode);
+    if (extension == NULL || (extension->double_indirect == 0 && extension->triple_indirect == 0)) {
+        return true;
+    }
+
+    /* 二级和三级间接树直接在磁盘上修改，先写回并丢弃缓存中的指针块 */
+    if (!fs_map_cache_flush(fs)) {
+        return false;
+    }
+    memset(fs->map_cache.blocks, 0, sizeof(fs->map_cache.blocks));
+
+    size_t    pointers = fs->pointers_per_block;
+    size_t    base     = POINTERS_PER_INODE + pointers;
+    uint32_t *roots[]  = {&extension->double_indirect, &extension->triple_indirect};
+    size_t    spans[]  = {pointers, pointers * pointers};
+
+    for (size_t tree = 0; tree < 2; tree++) {
+        size_t relative = first > base ? first - base : 0;
+        if (*roots[tree] != 0 && relative < spans[tree] * pointers) {
+            if (!fs_free_tree(fs, *roots[tree], tree + 2, spans[tree], relative, freed)) {
+                return false;
+            }
+            if (relative == 0) {
+                *roots[tree] = 0;
+            }
+        }
+        base += spans[tree] * pointers;
+    }
+
+    return true;
+}
+
+/**
+ * 收集间接树中（相对于这棵树的）逻辑块序号不小于first的数据块；
+ * first为0时整棵树被释放，否则修改后的指针块被写回。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       block   树的根。
+ * @param       depth   树的层数（1表示block中的指针直接指向数据块）。
+ * @param       span    block中每个指针映射的逻辑块数。
+ * @param       first   第一个要释放的逻辑块序号（相对于这棵树）。
+ * @param       freed   要释放的块（由fs_free_tail在成功后释放）。
+ * @return      是否成功。
+ **/
+bool fs_free_tree(FileSystem *fs, size_t block, size_t depth, size_t span, size_t first, FreeList *freed) {
+    Block buf;
+    bool  changed = false;
+
+    if (fs_read_block(fs, block, buf.data) == DISK_FAILURE) {
+        return false;
+    }
+
+    for (size_t i = first / span; i < fs->pointers_per_block; i++) {
+        uint32_t pointer = buf.pointers[i];
+        size_t   from    = i == first / span ? first % span : 0;
+        if (pointer == 0) {
+            continue;
+        }
+
+        if (depth == 1) {
+            if (!(pointer & COMPRESSED_MARK) && !fs_free_add(freed, pointer))
+                return false;
+        } else if (pointer < fs->meta_data.blocks &&
+                   !fs_free_tree(fs, pointer, depth - 1, span / fs->pointers_per_block, from, freed)) {
+            return false;
+        }
+
+        if (from == 0) {
+            buf.pointers[i] = 0;
+            changed = true;
+        }
+    }
+
+    if (first == 0) {
+        return fs_free_add(freed, block);
+    }
+
+    return !changed || fs_write_block(fs, block, buf.data) != DISK_FAILURE;
+}
+
+/**
+ * 把一个块加入待释放的列表（按需扩大）。
+ **/
+bool fs_free_add(FreeList *freed, size_t block) {
+    if (freed->count == freed->capacity) {
+        size_t  capacity = max(freed->capacity * 2, 64);
+        size_t *grown    = (size_t *)realloc(freed->blocks, capacity * sizeof(size_t));
+        if (grown == NULL) {
+            return false;
+        }
+        freed->blocks   = grown;
+        freed->capacity = capacity;
+    }
+
+    freed->blocks[freed->count++] = block;
+    return true;
+}
+
+/**
+ * 将文件中[from, to)范围内已映射的字节清零，空洞保持不变（压缩文件按压缩组处理）。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       from    起始字节偏移。
+ * @param       to      结束字节偏移（不包含）。
+ * @return      是否成功。
+ **/
+bool fs_zero_range(FileSystem *fs, BlockMap *map, size_t from, size_t to) {
+    if (map->inode->flags & INODE_COMPRESSED) {
+        return fs_zero_groups(fs, map, from, to);
+    }
+
+    while (from < to) {
+        size_t block_index  = from >> fs->block_shift;
+        size_t block_offset = from & (fs->block_size - 1);
+        size_t bytes        = min(fs->block_size - block_offset, to - from);
+
+        ssize_t pointer = fs_map_lookup(fs, map, block_index);
+        if (pointer < 0) {
+            /* 超出可映射范围的部分本来就不存在数据 */
+            return block_index >= fs_map_limit(fs);
+        }
+
+        if (pointer != 0) {
+            Block buf;
+            if (bytes < fs->block_size && fs_read_block(fs, pointer, buf.data) == DISK_FAILURE)
+                return false;
+
+            memset(buf.data + block_offset, 0, bytes);
+            if (fs_store_block(fs, map, block_index, buf.data, pointer) < 0)
+                return false;
+        }
+
+        from += bytes;
+    }
+
+    return true;
+}
+
+/**
+ * 挂载时初始化读取视图缓存（页的数据在第一次使用时分配）。
+ **/
+void fs_view_open(FileSystem *fs) {
+    memset(fs->views.pages, 0, sizeof(fs->views.pages));
+    fs->views.clock = 0;
+    pthread_mutex_init(&fs->views.lock, NULL);
+}
+
+/**
+ * 卸载时释放读取视图缓存。仍被视图固定的页也会被释放，因此卸载前应释放所有视图。
+ **/
+void fs_view_close(FileSystem *fs) {
+    for (size_t i = 0; i < FS_VIEW_PAGES; i++) {
+        ViewPage *page = &fs->views.pages[i];
+        if (page->refs > 0) {
+            error("View page of inode %u block %lu is still pinned at unmount", page->inode_number, page->index);
+        }
+        free(page->data);
+        page->data = NULL;
+    }
+    pthread_mutex_destroy(&fs->views.lock);
+}
+
+/**
+ * 返回文件第index个块的缓存页并固定它：命中时直接引用，否则替换最久未用的未固定页并读入数据。
+ * 调用者必须持有视图缓存的锁。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       index   文件的逻辑块号。
+ * @param       size    文件大小（最后一个块只读取文件末尾之前的部分）。
+ * @return      固定的缓存页（所有页都被固定或读取出错时为NULL）。
+ **/
+ViewPage *fs_view_page(FileSystem *fs, BlockMap *map, size_t index, size_t size) {
+    ViewCache *cache  = &fs->views;
+    ViewPage  *victim = NULL;
+
+    for (size_t i = 0; i < FS_VIEW_PAGES; i++) {
+        ViewPage *page = &cache->pages[i];
+        if (page->valid && page->inode_number == map->inode_number && page->index == index) {
+            page->refs++;
+            page->used = ++cache->clock;
+            return page;
+        }
+        if (page->refs == 0 && (victim == NULL || page->used < victim->used)) {
+            victim = page;
+        }
+    }
+
+    if (victim == NULL || (victim->data == NULL && (victim->data = (char *)malloc(fs->block_size)) == NULL)) {
+        return NULL;
+    }
+
+    victim->valid = false;
+
+    size_t  start  = index << fs->block_shift;
+    size_t  bytes  = min(fs->block_size, size - start);
+    ssize_t result = (map->inode->flags & INODE_COMPRESSED) ? fs_read_compressed(fs, map, victim->data, bytes, start)
+                                                            : fs_read_blocks(fs, map, victim->data, bytes, start);
+    if (result != (ssize_t)bytes) {
+        return NULL;
+    }
+
+    victim->valid        = true;
+    victim->inode_number = map->inode_number;
+    victim->index        = index;
+    victim->refs         = 1;
+    victim->used         = ++cache->clock;
+    return victim;
+}
+
+/**
+ * 使inode的所有缓存页失效（文件被修改时调用）。仍被视图固定的页保留原来的内容直到视图被释放。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       inode_number    被修改的inode。
+ **/
+void fs_view_invalidate(FileSystem *fs, size_t inode_number) {
+    pthread_mutex_lock(&fs->views.lock);
+    for (size_t i = 0; i < FS_VIEW_PAGES; i++) {
+        if (fs->views.pages[i].inode_number == inode_number) {
+            fs->views.pages[i].valid = false;
+        }
+    }
+    pthread_mutex_unlock(&fs->views.lock);
+}
+
+/**
+ * 按块读取未压缩文件的数据，空洞读取为全零，整块对齐的读取直接读入调用者的缓冲区。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       data    用于复制数据的缓冲区。
+ * @param       length  要读取的字节数（不超过文件末尾）。
+ * @param       offset  从哪里开始读取的字节偏移。
+ * @return      读取的字节数（错误时为-1）。
+ **/
+ssize_t fs_read_blocks(FileSystem *fs, BlockMap *map, char *data, size_t length, size_t offset) {
+    size_t bytes_read = 0;
+
+    while (bytes_read < length) {
+        size_t current_offset = offset + bytes_read;
+        size_t block_index    = current_offset >> fs->block_shift;
+        size_t block_offset   = current_offset & (fs->block_size - 1);
+        size_t bytes_to_read  = min(fs->block_size - block_offset, length - bytes_read);
+
+        ssize_t pointer = fs_map_lookup(fs, map, block_index);
+        if (pointer < 0) {
+            return -1;
+        }
+
+        if (pointer == 0) {
+            memset(data + bytes_read, 0, bytes_to_read);
+        } else if (bytes_to_read == fs->block_size) {
+            if (fs_read_block(fs, pointer, data + bytes_read) == DISK_FAILURE)
+                return -1;
+        } else {
+            Block buf;
+            if (fs_read_block(fs, pointer, buf.data) == DISK_FAILURE)
+                return -1;
+            memcpy(data + bytes_read, buf.data + block_offset, bytes_to_read);
+        }
+
+        bytes_read += bytes_to_read;
+    }
+
+    return bytes_read;
+}
+
+/**
+ * 按块写入未压缩文件的数据，按需分配数据块和间接块。新块优先分配在文件上一个块之后，
+ * 整块对齐的写入直接从调用者的缓冲区写出。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       data    包含要复制的数据的缓冲区。
+ * @param       length  要写入的字节数。
+ * @param       offset  从哪里开始写入的字节偏移。
+ * @return      写入的字节数（空间不足或出错时少于length）。
+ **/
+size_t fs_write_blocks(FileSystem *fs, BlockMap *map, char *data, size_t length, size_t offset) {
+    size_t bytes_written = 0;
+    size_t goal = map->goal;
+
+    while (bytes_written < length) {
+        size_t current_offset = offset + bytes_written;
+        size_t block_index    = current_offset >> fs->block_shift;
+        size_t block_offset   = current_offset & (fs->block_size - 1);
+        size_t bytes_to_write = min(fs->block_size - block_offset, length - bytes_written);
+
+        Block  buf;
+        char  *block_data = data + bytes_written;
+
+        if (bytes_to_write < fs->block_size) {
+            ssize_t pointer = fs_map_lookup(fs, map, block_index);
+            if (pointer < 0) {
+                break;
+            }
+
+            if (pointer == 0) {
+                memset(buf.data, 0, fs->block_size);
+            } else if (fs_read_block(fs, pointer, buf.data) == DISK_FAILURE) {
+                break;
+            }
+
+            memcpy(buf.data + block_offset, data + bytes_written, bytes_to_write);
+            block_data = buf.data;
+        }
+
+        ssize_t pointer = fs_store_block(fs, map, block_index, block_data, goal);
+        if (pointer < 0) {
+            break;
+        }
+
+        goal = pointer ? pointer + 1 : goal;
+        bytes_written += bytes_to_write;
+    }
+
+    return bytes_written;
+}
+
+/**
+ * 将一个完整的数据块存储到文件的指定逻辑块，执行以下操作：
+ *
+ *  1. 未启用去重时，需要时分配新块，然后原地写入。
+ *
+ *  2. 启用去重时交给fs_dedup_store处理。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       map             inode的块映射状态。
+ * @param       block_index     文件中的逻辑块序号。
+ * @param       data            块数据（block_size字节）。
+ * @param       goal            分配新块时期望的块号。
+ * @return      存储数据的物理块号（去重后的空洞为0，出错或空间不足时为-1）。
+ **/
+ssize_t fs_store_block(FileSystem *fs, BlockMap *map, size_t block_index, char *data, size_t goal) {
+    uint32_t *slot = fs_map_slot(fs, map, block_index, goal);
+    if (slot == NULL) {
+        return -1;
+    }
+
+    if (fs->dedup.refcounts != NULL) {
+        return fs_dedup_store(fs, map, slot, data, goal);
+    }
+
+    if (*slot == 0) {
+        ssize_t pointer = fs_allocate_block(fs, goal);
+        if (pointer < 0) {
+            return -1;
+        }
+        *slot = pointer;
+        map->dirty = true;
+    }
+
+    if (fs_write_block(fs, *slot, data) == DISK_FAILURE) {
+        return -1;
+    }
+
+    return *slot;
+}
+
+/**
+ * 读取压缩文件的数据：逐个加载（解压）涉及的压缩组并复制。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       data    用于复制数据的缓冲区。
+ * @param       length  要读取的字节数（不超过文件末尾）。
+ * @param       offset  从哪里开始读取的字节偏移。
+ * @return      读取的字节数（错误时为-1）。
+ **/
+ssize_t fs_read_compressed(FileSystem *fs, BlockMap *map, char *data, size_t length, size_t offset) {
+    size_t group_size = COMPRESS_GROUP << fs->block_shift;
+    size_t bytes_read = 0;
+
+    while (bytes_read < length) {
+        size_t current_offset = offset + bytes_read;
+        size_t group          = current_offset / group_size;
+        size_t group_offset   = current_offset % group_size;
+        size_t bytes_to_read  = min(group_size - group_offset, length - bytes_read);
+
+        char *buf = fs_group_load(fs, map, group, true);
+        if (buf == NULL) {
+            return -1;
+        }
+
+        memcpy(data + bytes_read, buf + group_offset, bytes_to_read);
+        bytes_read += bytes_to_read;
+    }
+
+    return bytes_read;
+}
+
+/**
+ * 写入压缩文件的数据：逐个加载涉及的压缩组（整组覆盖时不需要加载），修改后重新压缩存储。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       data    包含要复制的数据的缓冲区。
+ * @param       length  要写入的字节数。
+ * @param       offset  从哪里开始写入的字节偏移。
+ * @return      写入的字节数（空间不足或出错时少于length）。
+ **/
+size_t fs_write_compressed(FileSystem *fs, BlockMap *map, char *data, size_t length, size_t offset) {
+    size_t group_size    = COMPRESS_GROUP << fs->block_shift;
+    size_t bytes_written = 0;
+
+    while (bytes_written < length) {
+        size_t current_offset = offset + bytes_written;
+        size_t group          = current_offset / group_size;
+        size_t group_offset   = current_offset % group_size;
+        size_t bytes_to_write = min(group_size - group_offset, length - bytes_written);
+
+        char *buf = fs_group_load(fs, map, group, bytes_to_write < group_size);
+        if (buf == NULL) {
+            break;
+        }
+
+        memcpy(buf + group_offset, data + bytes_written, bytes_to_write);
+        if (!fs_group_store(fs, map, group, buf)) {
+            break;
+        }
+
+        bytes_written += bytes_to_write;
+    }
+
+    return bytes_written;
+}
+
+/**
+ * 判断数据是否全部为零。
+ **/
+bool fs_is_zero(const char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * 返回文件最多可以映射的逻辑块数：直接块和一级间接块，FS_LARGE文件系统中再加上二级和三级间接树。
+ **/
+size_t fs_map_limit(FileSystem *fs) {
+    size_t pointers = fs->pointers_per_block;
+    size_t limit    = POINTERS_PER_INODE + pointers;
+
+    if (fs->meta_data.flags & FS_LARGE) {
+        limit += pointers * pointers + pointers * pointers * pointers;
+    }
+    return limit;
+}
+
+/**
+ * 返回inode最多可以映射的逻辑块数（压缩文件向下对齐到整数个压缩组）。
+ **/
+size_t fs_map_capacity(FileSystem *fs, const Inode *inode) {
+    size_t capacity = fs_map_limit(fs);
+
+    if (inode->flags & INODE_COMPRESSED) {
+        capacity -= capacity % COMPRESS_GROUP;
+    }
+    return capacity;
+}
+
+/**
+ * 将压缩组加载到文件系统的压缩组缓存中，执行以下操作：
+ *
+ *  1. 缓存命中时直接返回缓存的数据。
+ *
+ *  2. 最后一个指针槽带有COMPRESSED_MARK时，读取前面的压缩块并解压。
+ *
+ *  3. 否则按未压缩的方式逐块读取（空洞为全零）。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       group   压缩组序号。
+ * @param       fill    是否需要读取数据（整组覆盖时为false，只占用缓存）。
+ * @return      指向缓存中压缩组数据的指针（出错或越界时为NULL）。
+ **/
+char *fs_group_load(FileSystem *fs, BlockMap *map, size_t group, bool fill) {
+    GroupCache *cache = &fs->cache;
+
+    if (cache->valid && cache->inode_number == map->inode_number && cache->group == group) {
+        return cache->data;
+    }
+
+    size_t first = group * COMPRESS_GROUP;
+    if (first + COMPRESS_GROUP > fs_map_capacity(fs, map->inode)) {
+        return NULL;
+    }
+
+    cache->valid = false;
+
+    if (fill) {
+        ssize_t pointers[COMPRESS_GROUP];
+        for (size_t i = 0; i < COMPRESS_GROUP; i++) {
+            if ((pointers[i] = fs_map_lookup(fs, map, first + i)) < 0)
+                return NULL;
+        }
+
+        if (pointers[COMPRESS_GROUP - 1] & COMPRESSED_MARK) {
+            size_t group_size  = COMPRESS_GROUP << fs->block_shift;
+            size_t packed_size = pointers[COMPRESS_GROUP - 1] & ~COMPRESSED_MARK;
+            size_t count       = (packed_size + fs->block_size - 1) >> fs->block_shift;
+
+            if (count >= COMPRESS_GROUP) {
+                return NULL;
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                if (pointers[i] == 0 || fs_read_block(fs, pointers[i], cache->packed + (i << fs->block_shift)) == DISK_FAILURE)
+                    return NULL;
+            }
+
+            if (lz_decompress(cache->packed, packed_size, cache->data, group_size) != (ssize_t)group_size) {
+                error("Corrupt compressed group %zu of inode %zu", group, map->inode_number);
+                return NULL;
+            }
+        } else {
+            for (size_t i = 0; i < COMPRESS_GROUP; i++) {
+                char *buf = cache->data + (i << fs->block_shift);
+                if (pointers[i] == 0) {
+                    memset(buf, 0, fs->block_size);
+                } else if (fs_read_block(fs, pointers[i], buf) == DISK_FAILURE) {
+                    return NULL;
+                }
+            }
+        }
+    }
+
+    cache->inode_number = map->inode_number;
+    cache->group        = group;
+    cache->valid        = true;
+    return cache->data;
+}
+
+/**
+ * 存储压缩组，执行以下操作：
+ *
+ *  1. 释放压缩组原来占用的块。
+ *
+ *  2. 全零的压缩组存储为空洞。
+ *
+ *  3. 压缩后至少节省一个块时，把压缩数据写入前面的块，并在最后一个指针槽中记录
+ *     COMPRESSED_MARK | 压缩后字节数。
+ *
+ *  4. 否则按未压缩的方式逐块存储（全零的块存储为空洞）。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       group   压缩组序号。
+ * @param       data    压缩组的未压缩数据（COMPRESS_GROUP个块）。
+ * @return      是否成功（失败时压缩组缓存被作废）。
+ **/
+bool fs_group_store(FileSystem *fs, BlockMap *map, size_t group, const char *data) {
+    size_t    first = group * COMPRESS_GROUP;
+    uint32_t *slots[COMPRESS_GROUP];
+    size_t    goal = map->goal;
+
+    for (size_t i = 0; i < COMPRESS_GROUP; i++) {
+        if ((slots[i] = fs_map_slot(fs, map, first + i, goal)) == NULL) {
+            fs_group_invalidate(fs, map->inode_number);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < COMPRESS_GROUP; i++) {
+        if (*slots[i] != 0 && !(*slots[i] & COMPRESSED_MARK)) {
+            goal = goal ? goal : *slots[i];
+            fs_release_block(fs, *slots[i]);
+        }
+        *slots[i] = 0;
+    }
+    map->dirty = true;
+
+    size_t group_size = COMPRESS_GROUP << fs->block_shift;
+    if (fs_is_zero(data, group_size)) {
+        return true;
+    }
+
+    char  *packed      = fs->cache.packed;
+    size_t packed_size = lz_compress(data, group_size, packed, (COMPRESS_GROUP - 1) << fs->block_shift);
+    size_t count       = (packed_size + fs->block_size - 1) >> fs->block_shift;
+
+    if (packed_size > 0) {
+        memset(packed + packed_size, 0, (count << fs->block_shift) - packed_size);
+    }
+
+    for (size_t i = 0; i < (packed_size > 0 ? count : COMPRESS_GROUP); i++) {
+        const char *buf = (packed_size > 0 ? packed : data) + (i << fs->block_shift);
+        if (packed_size == 0 && fs_is_zero(buf, fs->block_size)) {
+            continue;
+        }
+
+        ssize_t pointer = fs_allocate_block(fs, goal);
+        if (pointer < 0 || fs_write_block(fs, pointer, (char *)buf) == DISK_FAILURE) {
+            fs_group_invalidate(fs, map->inode_number);
+            return false;
+        }
+
+        *slots[i] = pointer;
+        goal = pointer + 1;
+    }
+
+    if (packed_size > 0) {
+        *slots[COMPRESS_GROUP - 1] = COMPRESSED_MARK | packed_size;
+    }
+
+    return true;
+}
+
+/**
+ * 将压缩文件中[from, to)范围内的字节清零，完全没有映射的压缩组保持为空洞。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       from    起始字节偏移。
+ * @param       to      结束字节偏移（不包含）。
+ * @return      是否成功。
+ **/
+bool fs_zero_groups(FileSystem *fs, BlockMap *map, size_t from, size_t to) {
+    size_t capacity   = fs_map_capacity(fs, map->inode) << fs->block_shift;
+    size_t group_size = COMPRESS_GROUP << fs->block_shift;
+
+    for (to = min(to, capacity); from < to; ) {
+        size_t group        = from / group_size;
+        size_t group_offset = from % group_size;
+        size_t bytes        = min(group_size - group_offset, to - from);
+
+        bool mapped = false;
+        for (size_t i = 0; i < COMPRESS_GROUP; i++) {
+            ssize_t pointer = fs_map_lookup(fs, map, group * COMPRESS_GROUP + i);
+            if (pointer < 0) {
+                return false;
+            }
+            mapped |= pointer != 0;
+        }
+
+        if (mapped) {
+            char *buf = fs_group_load(fs, map, group, true);
+            if (buf == NULL) {
+                return false;
+            }
+
+            memset(buf + group_offset, 0, bytes);
+            if (!fs_group_store(fs, map, group, buf)) {
+                return false;
+            }
+        }
+
+        from += bytes;
+    }
+
+    return true;
+}
+
+/**
+ * 作废属于指定inode的压缩组缓存。
+ **/
+void fs_group_invalidate(FileSystem *fs, size_t inode_number) {
+    if (fs->cache.inode_number == inode_number) {
+        fs->cache.valid = false;
+    }
+}
+
+/**
+ * 加载去重索引，执行以下操作：
+ *
+ *  1. 分配引用计数、哈希和哈希桶数组。
+ *
+ *  2. 从inode表之后的哈希块中读取每个块的内容哈希。
+ *
+ * 注意：引用计数在随后的inode表扫描中计算，哈希桶在fs_dedup_build中建立。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @return      是否成功。
+ **/
+bool fs_dedup_open(FileSystem *fs) {
+    DedupIndex *dedup  = &fs->dedup;
+    size_t      blocks = fs->meta_data.blocks;
+    size_t      table  = fs->meta_data.dedup_blocks;
+
+    if ((table << fs->block_shift) < blocks * sizeof(uint32_t)) {
+        return false;
+    }
+
+    size_t buckets = 1;
+    while (buckets < blocks) {
+        buckets <<= 1;
+    }
+
+    dedup->hashes    = (uint32_t *)calloc((table << fs->block_shift) / sizeof(uint32_t), sizeof(uint32_t));
+    dedup->refcounts = (uint32_t *)calloc(blocks, sizeof(uint32_t));
+    dedup->buckets   = (uint32_t *)calloc(buckets, sizeof(uint32_t));
+    dedup->next      = (uint32_t *)calloc(blocks, sizeof(uint32_t));
+    dedup->dirty     = (bool *)calloc(table, sizeof(bool));
+    dedup->mask      = buckets - 1;
+
+    if (!dedup->hashes || !dedup->refcounts || !dedup->buckets || !dedup->next || !dedup->dirty) {
+        return false;
+    }
+
+    DiskRequest requests[FS_SCAN_BATCH];
+    for (size_t first = 0; first < table; first += FS_SCAN_BATCH) {
+        size_t count = min(FS_SCAN_BATCH, table - first);
+        for (size_t i = 0; i < count; i++) {
+            requests[i] = (DiskRequest){
+                .block = fs_dedup_start(fs) + first + i,
+                .data  = (char *)dedup->hashes + ((first + i) << fs->block_shift),
+            };
+        }
+        if (!fs_submit(fs, requests, count)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * 根据引用计数建立哈希桶：丢弃不再被引用的块的哈希，其余的块加入索引。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ **/
+void fs_dedup_build(FileSystem *fs) {
+    DedupIndex *dedup = &fs->dedup;
+
+    for (size_t block = fs_data_start(fs); block < fs->meta_data.blocks; block++) {
+        uint32_t hash = dedup->hashes[block];
+        if (hash == 0) {
+            continue;
+        }
+
+        dedup->hashes[block] = 0;
+        if (dedup->refcounts[block] > 0) {
+            fs_dedup_insert(fs, block, hash);
+        } else {
+            dedup->dirty[(block * sizeof(uint32_t)) >> fs->block_shift] = true;
+        }
+    }
+}
+
+/**
+ * 写回修改过的哈希块并释放去重索引。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ **/
+void fs_dedup_close(FileSystem *fs) {
+    DedupIndex *dedup = &fs->dedup;
+
+    if (dedup->hashes != NULL && dedup->dirty != NULL) {
+        DiskRequest requests[FS_SCAN_BATCH];
+        size_t      count = 0;
+        for (size_t i = 0; i <= fs->meta_data.dedup_blocks; i++) {
+            if (i < fs->meta_data.dedup_blocks && dedup->dirty[i]) {
+                requests[count++] = (DiskRequest){
+                    .block = fs_dedup_start(fs) + i,
+                    .write = true,
+                    .data  = (char *)dedup->hashes + (i << fs->block_shift),
+                };
+            }
+            if ((count == FS_SCAN_BATCH || i == fs->meta_data.dedup_blocks) && count > 0) {
+                if (!fs_submit(fs, requests, count)) {
+                    error("Unable to write dedup hash blocks");
+                }
+                count = 0;
+            }
+        }
+    }
+
+    free(dedup->hashes);
+    free(dedup->refcounts);
+    free(dedup->buckets);
+    free(dedup->next);
+    free(dedup->dirty);
+    memset(dedup, 0, sizeof(DedupIndex));
+}
+
+/**
+ * 计算数据块的内容哈希（CRC32C，0保留表示未索引）。
+ **/
+uint32_t fs_dedup_hash(FileSystem *fs, const char *data) {
+    uint32_t hash = crc32c(0, data, fs->block_size);
+    return hash ? hash : 1;
+}
+
+/**
+ * 在哈希索引中查找内容相同的块。哈希相同的候选块会被读出并逐字节比较，
+ * 因此哈希冲突不会导致错误的共享。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       hash    数据的内容哈希。
+ * @param       data    块数据（block_size字节）。
+ * @return      内容相同的块号（没有时为0，读取出错时为-1）。
+ **/
+ssize_t fs_dedup_find(FileSystem *fs, uint32_t hash, const char *data) {
+    DedupIndex *dedup = &fs->dedup;
+
+    for (uint32_t block = dedup->buckets[hash & dedup->mask]; block != 0; block = dedup->next[block]) {
+        if (dedup->hashes[block] != hash) {
+            continue;
+        }
+
+        Block buf;
+        if (fs_read_block(fs, block, buf.data) == DISK_FAILURE) {
+            return -1;
+        }
+
+        if (memcmp(buf.data, data, fs->block_size) == 0) {
+            return block;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * 将块加入哈希索引。
+ **/
+void fs_dedup_insert(FileSystem *fs, size_t block, uint32_t hash) {
+    DedupIndex *dedup  = &fs->dedup;
+    size_t      bucket = hash & dedup->mask;
+
+    dedup->hashes[block]  = hash;
+    dedup->next[block]    = dedup->buckets[bucket];
+    dedup->buckets[bucket] = block;
+    dedup->dirty[(block * sizeof(uint32_t)) >> fs->block_shift] = true;
+}
+
+/**
+ * 将块从哈希索引中删除（块不在索引中时什么也不做）。
+ **/
+void fs_dedup_remove(FileSystem *fs, size_t block) {
+    DedupIndex *dedup = &fs->dedup;
+    uint32_t    hash  = dedup->hashes[block];
+
+    if (hash == 0) {
+        return;
+    }
+
+    uint32_t *link = &dedup->buckets[hash & dedup->mask];
+    while (*link != 0 && *link != block) {
+        link = &dedup->next[*link];
+    }
+    if (*link == block) {
+        *link = dedup->next[block];
+    }
+
+    dedup->hashes[block] = 0;
+    dedup->next[block]   = 0;
+    dedup->dirty[(block * sizeof(uint32_t)) >> fs->block_shift] = true;
+}
+
+/**
+ * 以去重的方式存储一个完整的数据块，执行以下操作：
+ *
+ *  1. 全零的块存储为空洞。
+ *
+ *  2. 已存在内容相同的块时，增加它的引用计数并指向它。
+ *
+ *  3. 原来的块只被当前文件引用时原地覆盖，否则（写时复制）分配新块。
+ *
+ *  4. 将写入的块加入哈希索引。
+ *
+ * @param       fs      指向FileSystem结构的指针。
+ * @param       map     inode的块映射状态。
+ * @param       slot    逻辑块的指针槽位。
+ * @param       data    块数据（block_size字节）。
+ * @param       goal    分配新块时期望的块号。
+ * @return      存储数据的物理块号（空洞为0，出错或空间不足时为-1）。
+ **/
+ssize_t fs_dedup_store(FileSystem *fs, BlockMap *map, uint32_t *slot, char *data, size_t goal) {
+    DedupIndex *dedup = &fs->dedup;
+    uint32_t    old   = *slot;
+
+    if (fs_is_zero(data, fs->block_size)) {
+        if (old != 0) {
+            fs_release_block(fs, old);
+            *slot = 0;
+            map->dirty = true;
+        }
+        return 0;
+    }
+
+    uint32_t hash     = fs_dedup_hash(fs, data);
+    ssize_t  existing = fs_dedup_find(fs, hash, data);
+    if (existing < 0) {
+        return -1;
+    }
+
+    if (existing > 0) {
+        if (existing != old) {
+            dedup->refcounts[existing]++;
+            if (old != 0) {
+                fs_release_block(fs, old);
+            }
+            *slot = existing;
+            map->dirty = true;
+        }
+        return existing;
+    }
+
+    if (old != 0 && dedup->refcounts[old] == 1) {
+        fs_dedup_remove(fs, old);
+    } else {
+        ssize_t pointer = fs_allocate_block(fs, goal);
+        if (pointer < 0) {
+            return -1;
+        }
+        if (old != 0) {
+            fs_release_block(fs, old);
+        }
+        *slot = old = pointer;
+        map->dirty = true;
+    }
+
+    if (fs_write_block(fs, old, data) == DISK_FAILURE) {
+        return -1;
+    }
+
+    fs_dedup_insert(fs, old, hash);
+    return old;
+}
+
+/**
+ * 返回从block_index开始（不超过limit）物理上连续的一段块：要么全是空洞，要么映射到连续的物理块。
+ *
+ * @param       fs              指向FileSystem结构的指针。
+ * @param       map             inode的块映射状态。
+ * @param       block_index     第一个逻辑块。
+ * @param       limit           最后一个逻辑块之后的块。
+ * @param       start           返回第一个物理块（空洞为0）。
+ * @return      这一段的块数（出错时为0）。
+ **/
+size_t fs_map_run(FileSystem *fs, BlockMap *map, size_t block_index, size_t limit, ssize_t *start) {
+    *start = fs_map_lookup(fs, map, block_index);
+    if (*start < 0) {
+        return 0;
+    }
+
+    size_t count = 1;
+    while (block_index + count < limit) {
+        ssize_t pointer = fs_map_lookup(fs, map, block_index + count);
+        if (pointer < 0) {
+            return 0;
+        }
+        if (*start == 0 ? pointer != 0 : pointer != *start + (ssize_t)count) {
+            break;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * 经过缓冲区把宿主文件写入inode：每次读取FS_COPY_BLOCKS块，整块部分由fs_write直接写入磁盘。
+ **/
+ssize_t fs_copyin_buffered(FileSystem *fs, size_t inode_number, int fd) {
+    size_t size   = FS_COPY_BLOCKS << fs->block_shift;
+    char  *buffer = (char *)malloc(size);
+    size_t offset = 0;
+
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    while (true) {
+        ssize_t result = read(fd, buffer, size);
+        if (result < 0) {
+            offset = -1;
+            break;
+        }
+        if (result == 0) {
+            break;
+        }
+
+        if (fs_write_untimed(fs, inode_number, buffer, result, offset) != result) {
+            offset = -1;
+            break;
+        }
+        offset += result;
+    }
+
+    free(buffer);
+    return offset;
+}
+
+/**
+ * 经过缓冲区把inode写入宿主文件：整块对齐的fs_read直接读入缓冲区，再写入描述符。
+ **/
+ssize_t fs_copyout_buffered(FileSystem *fs, size_t inode_number, int fd) {
+    size_t size   = FS_COPY_BLOCKS << fs->block_shift;
+    char  *buffer = (char *)malloc(size);
+    size_t offset = 0;
+
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    while (true) {
+        ssize_t result = fs_read_untimed(fs, inode_number, buffer, size, offset);
+        if (result <= 0) {
+            if (result < 0) {
+                offset = -1;
+            }
+            break;
+        }
+
+        for (ssize_t written = 0; written < result; ) {
+            ssize_t n = write(fd, buffer + written, result - written);
+            if (n <= 0) {
+                free(buffer);
+                return -1;
+            }
+            written += n;
+        }
+        offset += result;
+    }
+
+    free(buffer);
+    return offset;
+}
+
+/**
+ * 检查线程：领取一批inode块，逐个检查其中的有效inode，最后写入剩余的记录。
+ *
+ * @param       arg     指向InspectScan结构的指针。
+ * @return      NULL。
+ **/
+void *fs_inspect_thread(void *arg) {
+    InspectScan   *scan   = (InspectScan *)arg;
+    FileSystem    *fs     = &scan->fs;
+    InspectWalk    walk   = {0};
+    InspectOutput  output = {0};
+    char          *table  = (char *)malloc(fs->block_size);
+    bool           ready  = table != NULL;
+
+    for (size_t level = 0; level < 3; level++) {
+        walk.levels[level] = (char *)malloc(fs->block_size);
+        ready = ready && walk.levels[level] != NULL;
+    }
+
+    while (ready && !__atomic_load_n(&scan->failed, __ATOMIC_RELAXED)) {
+        size_t first = __atomic_fetch_add(&scan->next, FS_INSPECT_BATCH, __ATOMIC_RELAXED);
+        if (first >= scan->end) {
+            break;
+        }
+
+        for (size_t index = first; index < min(first + FS_INSPECT_BATCH, scan->end); index++) {
+            if (fs_read_block(fs, fs_inode_table_block(fs, index), table) == DISK_FAILURE) {
+                error("Unable to read inode block %zu", index);
+                __atomic_store_n(&scan->failed, true, __ATOMIC_RELAXED);
+                break;
+            }
+
+            for (size_t i = 0; i < fs->inodes_per_block; i++) {
+                Inode *inode = fs_inode_at(fs, table, i);
+                if (inode->valid == 1) {
+                    fs_inspect_inode(scan, &walk, &output, (index << fs->inode_shift) + i, inode);
+                }
+            }
+        }
+
+        if (output.length >= FS_INSPECT_FLUSH && !fs_inspect_flush(scan, &output)) {
+            __atomic_store_n(&scan->failed, true, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (!ready || !fs_inspect_flush(scan, &output)) {
+        __atomic_store_n(&scan->failed, true, __ATOMIC_RELAXED);
+    }
+
+    for (size_t level = 0; level < 3; level++) {
+        free(walk.levels[level]);
+    }
+    free(walk.list);
+    free(output.data);
+    free(table);
+    return NULL;
+}
+
+/**
+ * 检查一个有效的inode：符合过滤条件时遍历它的块指针（直接块、间接块和多级间接块），
+ * 把记录追加到线程的输出缓冲区。
+ **/
+void fs_inspect_inode(InspectScan *scan, InspectWalk *walk, InspectOutput *output, size_t inode_number, Inode *inode) {
+    const InspectOptions *options   = scan->options;
+    FileSystem           *fs        = &scan->fs;
+    size_t                size      = fs_file_size(fs, inode);
+    InodeExtension       *extension = fs_inode_extension(fs, inode);
+
+    if (inode_number < options->first_inode || (options->end_inode && inode_number >= options->end_inode) ||
+        size < options->min_size || (options->end_size && size >= options->end_size)) {
+        return;
+    }
+
+    InspectExtent *list     = walk->list;
+    size_t         capacity = walk->capacity;
+    memset(walk, 0, offsetof(InspectWalk, levels));
+    walk->list     = list;
+    walk->capacity = capacity;
+
+    for (size_t i = 0; i < POINTERS_PER_INODE; i++) {
+        fs_inspect_add(scan, walk, inode->direct[i], options->extents);
+    }
+    fs_inspect_tree(scan, walk, inode->indirect, 1, options->extents);
+    if (extension) {
+        fs_inspect_tree(scan, walk, extension->double_indirect, 2, options->extents);
+        fs_inspect_tree(scan, walk, extension->triple_indirect, 3, options->extents);
+    }
+    fs_inspect_add(scan, walk, 0, options->extents);
+
+    if (walk->failed) {
+        __atomic_store_n(&scan->failed, true, __ATOMIC_RELAXED);
+        return;
+    }
+
+    bool success;
+    if (options->binary) {
+        InspectRecord record = {
+            .inode           = inode_number,
+            .size            = size,
+            .flags           = inode->flags,
+            .links           = inode->links,
+            .blocks          = walk->blocks,
+            .indirect_blocks = walk->indirect,
+            .extents         = walk->extents,
+            .listed          = walk->listed,
+        };
+        success = fs_inspect_append(output, &record, sizeof(record)) &&
+                  fs_inspect_append(output, walk->list, walk->listed * sizeof(InspectExtent));
+    } else {
+        char line[512];
+        int  length = snprintf(line, sizeof(line),
+            "{\"inode\":%zu,\"size\":%zu,\"directory\":%s,\"compressed\":%s,\"links\":%u,"
+            "\"blocks\":%zu,\"indirect_blocks\":%zu,\"extents\":%zu,\"fragmentation\":%.4f",
+            inode_number, size, (inode->flags & INODE_DIRECTORY) ? "true" : "false",
+            (inode->flags & INODE_COMPRESSED) ? "true" : "false", inode->links, walk->blocks, walk->indirect,
+            walk->extents, walk->blocks > 1 ? (double)(walk->extents - 1) / (walk->blocks - 1) : 0.0);
+        success = fs_inspect_append(output, line, length);
+
+        if (options->extents) {
+            success = success && fs_inspect_append(output, ",\"map\":[", 8);
+            for (size_t i = 0; success && i < walk->listed; i++) {
+                length  = snprintf(line, sizeof(line), "%s[%llu,%llu]", i ? "," : "",
+                                   (unsigned long long)walk->list[i].start, (unsigned long long)walk->list[i].length);
+                success = fs_inspect_append(output, line, length);
+            }
+            success = success && fs_inspect_append(output, "]", 1);
+        }
+        success = success && fs_inspect_append(output, "}\n", 2);
+    }
+
+    if (!success) {
+        __atomic_store_n(&scan->failed, true, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_add_fetch(&scan->reported, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * 按文件顺序加入一个块指针：延伸当前区间或开始新的区间。压缩组的长度标记、空指针和不在数据区内的指针
+ * 被忽略；pointer为0时结束当前区间（遍历结束时调用）。
+ **/
+void fs_inspect_add(InspectScan *scan, InspectWalk *walk, uint32_t pointer, bool list) {
+    bool data = !(pointer & COMPRESSED_MARK) && fs_is_data_block(&scan->fs, pointer);
+    if (data && walk->current.length > 0 && pointer == walk->current.start + walk->current.length) {
+        walk->current.length++;
+        walk->blocks++;
+        return;
+    }
+    if (!data && pointer != 0) {
+        return;
+    }
+
+    if (walk->current.length > 0 && list) {
+        if (walk->listed == walk->capacity) {
+            size_t         capacity = max(walk->capacity * 2, 16);
+            InspectExtent *grown    = (InspectExtent *)realloc(walk->list, capacity * sizeof(InspectExtent));
+            if (grown == NULL) {
+                walk->failed = true;
+                return;
+            }
+            walk->list     = grown;
+            walk->capacity = capacity;
+        }
+        walk->list[walk->listed++] = walk->current;
+    }
+
+    walk->current = (InspectExtent){.start = pointer, .length = data};
+    walk->blocks  += data;
+    walk->extents += data;
+}
+
+/**
+ * 遍历一棵depth层的间接块树（depth为1时是单级间接块），每层使用walk中自己的缓冲区。
+ **/
+void fs_inspect_tree(InspectScan *scan, InspectWalk *walk, uint32_t block, size_t depth, bool list) {
+    FileSystem *fs = &scan->fs;
+    if (walk->failed || !fs_is_data_block(fs, block)) {
+        return;
+    }
+
+    char *data = walk->levels[depth - 1];
+    if (fs_read_block(fs, block, data) == DISK_FAILURE) {
+        error("Unable to read indirect block %u", block);
+        walk->failed = true;
+        return;
+    }
+    walk->indirect++;
+
+    const uint32_t *pointers = (const uint32_t *)data;
+    for (size_t i = 0; i < fs->pointers_per_block && !walk->failed; i++) {
+        if (depth == 1) {
+            fs_inspect_add(scan, walk, pointers[i], list);
+        } else if (pointers[i] != 0) {
+            fs_inspect_tree(scan, walk, pointers[i], depth - 1, list);
+        }
+    }
+}
+
+/**
+ * 把length字节追加到输出缓冲区（按需扩大）。
+ **/
+bool fs_inspect_append(InspectOutput *output, const void *data, size_t length) {
+    if (length == 0) {
+        return true;
+    }
+
+    if (output->length + length > output->capacity) {
+        size_t capacity = max(output->capacity * 2, max(output->length + length, FS_INSPECT_FLUSH * 2));
+        char  *grown    = (char *)realloc(output->data, capacity);
+        if (grown == NULL) {
+            return false;
+        }
+        output->data     = grown;
+        output->capacity = capacity;
+    }
+
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    return true;
+}
+
+/**
+ * 在持有输出流的锁时把缓冲的记录一次写入输出流。
+ **/
+bool fs_inspect_flush(InspectScan *scan, InspectOutput *output) {
+    if (output->length == 0) {
+        return true;
+    }
+
+    pthread_mutex_lock(&scan->lock);
+    bool success = fwrite(output->data, 1, output->length, scan->stream) == output->length;
+    pthread_mutex_unlock(&scan->lock);
+
+    output->length = 0;
+    return success;
 }
 
 /* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,428 @@
+/* import.c: SimpleFS 批量导入 */
+
+#include "sfs/dir.h"
+#include "sfs/import.h"
+#include "sfs/logging.h"
+#include "sfs/utils.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+/* 内部结构 */
+
+typedef struct ImportFile ImportFile;
+struct ImportFile {
+    char       *path;                           /* 宿主文件路径 */
+    size_t      inode_number;                   /* 文件系统中的inode */
+    size_t      size;                           /* 遍历时的文件大小 */
+    bool        failed;                         /* 读取或写入是否失败 */
+};
+
+typedef struct ImportChunk ImportChunk;
+struct ImportChunk {
+    size_t      file;                           /* 数据所属的文件（files中的下标） */
+    size_t      offset;                         /* 数据在文件中的偏移 */
+    size_t      length;                         /* 数据长度 */
+    char       *data;                           /* 读取线程分配、写入方释放的数据 */
+};
+
+typedef struct Import Import;
+struct Import {
+    FileSystem          *fs;                    /* 目标文件系统（只由调用线程访问） */
+    const ImportOptions *options;               /* 导入选项 */
+    ImportStats         *stats;                 /* 导入统计 */
+
+    ImportFile          *files;                 /* 遍历得到的普通文件 */
+    size_t               count;                 /* 文件个数 */
+    size_t               capacity;              /* files数组的容量 */
+    size_t               next;                  /* 下一个要读取的文件 */
+
+    ImportChunk         *queue;                 /* 读取线程到写入方的环形队列 */
+    size_t               queue_capacity;        /* 队列容量 */
+    size_t               queue_head;            /* 队首位置 */
+    size_t               queue_length;          /* 队列中的数据块数 */
+    size_t               readers;               /* 仍在运行的读取线程数 */
+
+    pthread_mutex_t      lock;                  /* 保护next、队列、readers和failed */
+    pthread_cond_t       not_empty;             /* 队列非空或读取线程全部结束 */
+    pthread_cond_t       not_full;              /* 队列未满 */
+};
+
+/* 内部函数 */
+
+bool        fs_import_untimed(FileSystem *fs, const char *host_path, size_t dir, const ImportOptions *options, ImportStats *stats);
+void        import_walk(Import *import, const char *host_path, size_t dir, const char *image_path);
+void        import_add(Import *import, const char *host_path, size_t dir, const char *name, const char *image_path, size_t size);
+bool        import_transfer(Import *import);
+void *      import_reader(void *arg);
+void        import_push(Import *import, ImportChunk chunk);
+void        import_fail(Import *import, size_t file);
+
+/* 外部函数 */
+
+/**
+ * 将宿主机上的目录树（或单个文件）导入到文件系统的目录中，执行以下操作：
+ *
+ *  1. 遍历宿主目录树，创建目录、创建并链接文件的inode，按文件大小预分配块，
+ *     并输出inode与路径的清单。
+ *
+ *  2. 由读取线程池并行读取宿主文件，每次最多IMPORT_CHUNK_SIZE字节，
+ *     通过有界队列交给调用线程。
+ *
+ *  3. 调用线程按块写入文件系统（文件系统不是线程安全的，只在调用线程中访问）。
+ *
+ * 注意：清单中的路径相对于目标目录；已存在的同名文件不会被覆盖而是计为错误。
+ *
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       host_path   宿主机上的目录或文件。
+ * @param       dir         目标目录的inode编号。
+ * @param       options     导入选项（NULL表示使用默认选项）。
+ * @param       stats       用于返回导入统计（可以为NULL）。
+ * @return      是否全部导入成功。
+ **/
+bool fs_import(FileSystem *fs, const char *host_path, size_t dir, const ImportOptions *options, ImportStats *stats) {
+    ImportStats ignored = {0};
+    uint64_t    start   = stats_now();
+    bool        result  = fs_import_untimed(fs, host_path, dir, options, stats ? stats : &ignored);
+
+    stats_record(fs ? &fs->stats : NULL, STATS_FS_IMPORT, start, result, stats ? stats->bytes : ignored.bytes);
+    return result;
+}
+
+/**
+ * fs_import的实现（不记录统计）。
+ **/
+bool fs_import_untimed(FileSystem *fs, const char *host_path, size_t dir, const ImportOptions *options, ImportStats *stats) {
+    ImportOptions defaults = {0};
+    ImportStats   ignored;
+
+    if (fs == NULL || fs->disk == NULL || host_path == NULL) {
+        return false;
+    }
+
+    Import import = {
+        .fs      = fs,
+        .options = options ? options : &defaults,
+        .stats   = stats ? stats : &ignored,
+    };
+    memset(import.stats, 0, sizeof(ImportStats));
+
+    struct stat s;
+    if (stat(host_path, &s) < 0) {
+        error("Unable to stat %s: %s", host_path, strerror(errno));
+        return false;
+    }
+
+    if (S_ISDIR(s.st_mode)) {
+        import_walk(&import, host_path, dir, "");
+    } else if (S_ISREG(s.st_mode)) {
+        const char *name = strrchr(host_path, '/');
+        name = name ? name + 1 : host_path;
+        import_add(&import, host_path, dir, name, name, s.st_size);
+    } else {
+        import.stats->skipped++;
+    }
+
+    bool transferred = import_transfer(&import);
+
+    for (size_t i = 0; i < import.count; i++) {
+        if (import.files[i].failed) {
+            import.stats->errors++;
+        } else {
+            import.stats->files++;
+        }
+        free(import.files[i].path);
+    }
+    free(import.files);
+
+    return transferred && import.stats->errors == 0;
+}
+
+/* 内部函数 */
+
+/**
+ * 递归遍历宿主目录，在文件系统中创建对应的目录并登记普通文件。
+ *
+ * @param       import      导入状态。
+ * @param       host_path   宿主目录。
+ * @param       dir         对应的文件系统目录。
+ * @param       image_path  目录相对于导入目标的路径（顶层为空串）。
+ **/
+void import_walk(Import *import, const char *host_path, size_t dir, const char *image_path) {
+    DIR *stream = opendir(host_path);
+    if (stream == NULL) {
+        error("Unable to open %s: %s", host_path, strerror(errno));
+        import->stats->errors++;
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(stream)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        char child_host[PATH_MAX];
+        char child_image[PATH_MAX];
+        struct stat s;
+
+        if (snprintf(child_host, sizeof(child_host), "%s/%s", host_path, entry->d_name) >= (int)sizeof(child_host) ||
+            snprintf(child_image, sizeof(child_image), "%s%s%s", image_path, *image_path ? "/" : "", entry->d_name) >= (int)sizeof(child_image) ||
+            lstat(child_host, &s) < 0) {
+            import->stats->errors++;
+            continue;
+        }
+
+        if (S_ISREG(s.st_mode)) {
+            import_add(import, child_host, dir, entry->d_name, child_image, s.st_size);
+            continue;
+        }
+
+        if (!S_ISDIR(s.st_mode)) {
+            import->stats->skipped++;
+            continue;
+        }
+
+        ssize_t child = fs_lookup(import->fs, dir, entry->d_name);
+        if (child < 0) {
+            child = fs_mkdir(import->fs, dir, entry->d_name);
+            if (child < 0) {
+                error("Unable to create directory %s", child_image);
+                import->stats->errors++;
+                continue;
+            }
+            import->stats->directories++;
+        }
+
+        if (import->options->manifest) {
+            fprintf(import->options->manifest, "%zd\t%s/\n", child, child_image);
+        }
+
+        import_walk(import, child_host, child, child_image);
+    }
+
+    closedir(stream);
+}
+
+/**
+ * 为宿主文件创建inode、链接到目录并预分配空间，然后登记到待读取的文件列表。
+ **/
+void import_add(Import *import, const char *host_path, size_t dir, const char *name, const char *image_path, size_t size) {
+    FileSystem *fs = import->fs;
+
+    if (import->count == import->capacity) {
+        size_t      capacity = max(import->capacity * 2, 64);
+        ImportFile *files    = realloc(import->files, capacity * sizeof(ImportFile));
+        if (files == NULL) {
+            import->stats->errors++;
+            return;
+        }
+        import->files    = files;
+        import->capacity = capacity;
+    }
+
+    ssize_t inode_number = fs_create(fs);
+    if (inode_number < 0) {
+        error("Unable to create inode for %s", image_path);
+        import->stats->errors++;
+        return;
+    }
+
+    if (!fs_link(fs, dir, name, inode_number)) {
+        error("Unable to link %s", image_path);
+        fs_remove(fs, inode_number);
+        import->stats->errors++;
+        return;
+    }
+
+    if (!fs_fallocate(fs, inode_number, 0, size)) {
+        error("Unable to reserve %zu bytes for %s", size, image_path);
+        fs_unlink(fs, dir, name);
+        import->stats->errors++;
+        return;
+    }
+
+    ImportFile *file = &import->files[import->count++];
+    file->path         = strdup(host_path);
+    file->inode_number = inode_number;
+    file->size         = size;
+    file->failed       = (file->path == NULL);
+
+    if (import->options->manifest) {
+        fprintf(import->options->manifest, "%zd\t%s\n", inode_number, image_path);
+    }
+}
+
+/**
+ * 启动读取线程，并在调用线程中把队列中的数据写入文件系统，直到所有文件读完。
+ *
+ * @param       import      导入状态。
+ * @return      是否成功启动读取线程。
+ **/
+bool import_transfer(Import *import) {
+    if (import->count == 0) {
+        return true;
+    }
+
+    size_t threads = import->options->threads;
+    if (threads == 0) {
+        threads = max(sysconf(_SC_NPROCESSORS_ONLN), 1);
+    }
+    threads = min(threads, import->count);
+
+    import->queue_capacity = threads * IMPORT_QUEUE_DEPTH;
+    import->queue = calloc(import->queue_capacity, sizeof(ImportChunk));
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    if (import->queue == NULL || workers == NULL) {
+        free(import->queue);
+        free(workers);
+        for (size_t i = 0; i < import->count; i++) {
+            import->files[i].failed = true;
+        }
+        return false;
+    }
+
+    pthread_mutex_init(&import->lock, NULL);
+    pthread_cond_init(&import->not_empty, NULL);
+    pthread_cond_init(&import->not_full, NULL);
+
+    /* 创建线程期间持有锁，读取线程在readers确定之后才开始工作 */
+    pthread_mutex_lock(&import->lock);
+    size_t started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, import_reader, import) != 0) {
+            break;
+        }
+    }
+
+    import->readers = started;
+    if (started == 0) {
+        import->next = import->count;
+        for (size_t i = 0; i < import->count; i++) {
+            import->files[i].failed = true;
+        }
+    }
+    pthread_mutex_unlock(&import->lock);
+
+    while (true) {
+        pthread_mutex_lock(&import->lock);
+        while (import->queue_length == 0 && import->readers > 0) {
+            pthread_cond_wait(&import->not_empty, &import->lock);
+        }
+        if (import->queue_length == 0) {
+            pthread_mutex_unlock(&import->lock);
+            break;
+        }
+
+        ImportChunk chunk = import->queue[import->queue_head];
+        import->queue_head = (import->queue_head + 1) % import->queue_capacity;
+        import->queue_length--;
+        bool failed = import->files[chunk.file].failed;
+        pthread_cond_signal(&import->not_full);
+        pthread_mutex_unlock(&import->lock);
+
+        if (!failed) {
+            ssize_t written = fs_write(import->fs, import->files[chunk.file].inode_number, chunk.data, chunk.length, chunk.offset);
+            if (written == (ssize_t)chunk.length) {
+                import->stats->bytes += written;
+            } else {
+                error("Unable to write %s", import->files[chunk.file].path);
+                import_fail(import, chunk.file);
+            }
+        }
+        free(chunk.data);
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&import->not_full);
+    pthread_cond_destroy(&import->not_empty);
+    pthread_mutex_destroy(&import->lock);
+    free(workers);
+    free(import->queue);
+    return started > 0;
+}
+
+/**
+ * 读取线程：依次领取文件，按IMPORT_CHUNK_SIZE读取并放入队列。
+ **/
+void *import_reader(void *arg) {
+    Import *import = (Import *)arg;
+
+    while (true) {
+        pthread_mutex_lock(&import->lock);
+        size_t index = import->next++;
+        pthread_mutex_unlock(&import->lock);
+
+        if (index >= import->count) {
+            break;
+        }
+
+        ImportFile *file = &import->files[index];
+        int fd = file->failed ? -1 : open(file->path, O_RDONLY);
+        if (fd < 0) {
+            import_fail(import, index);
+            continue;
+        }
+
+        for (size_t offset = 0; offset < file->size; ) {
+            size_t  length = min(IMPORT_CHUNK_SIZE, file->size - offset);
+            char   *data   = malloc(length);
+            ssize_t result = data ? pread(fd, data, length, offset) : -1;
+
+            if (result <= 0) {
+                free(data);
+                if (result < 0) {
+                    import_fail(import, index);
+                }
+                break;
+            }
+
+            import_push(import, (ImportChunk){index, offset, result, data});
+            offset += result;
+        }
+
+        close(fd);
+    }
+
+    pthread_mutex_lock(&import->lock);
+    import->readers--;
+    pthread_cond_broadcast(&import->not_empty);
+    pthread_mutex_unlock(&import->lock);
+    return NULL;
+}
+
+/**
+ * 将数据块放入队列，队列满时等待。
+ **/
+void import_push(Import *import, ImportChunk chunk) {
+    pthread_mutex_lock(&import->lock);
+    while (import->queue_length == import->queue_capacity) {
+        pthread_cond_wait(&import->not_full, &import->lock);
+    }
+
+    import->queue[(import->queue_head + import->queue_length) % import->queue_capacity] = chunk;
+    import->queue_length++;
+    pthread_cond_signal(&import->not_empty);
+    pthread_mutex_unlock(&import->lock);
+}
+
+/**
+ * 标记文件导入失败。
+ **/
+void import_fail(Import *import, size_t file) {
+    pthread_mutex_lock(&import->lock);
+    import->files[file].failed = true;
+    pthread_mutex_unlock(&import->lock);
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,214 @@
+/* lz.c: LZ压缩编解码器 */
+
+#include "sfs/lz.h"
+#include "sfs/utils.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/* 内部常量 */
+
+#define LZ_HASH_BITS    (12)
+#define LZ_SKIP_SHIFT   (5)
+
+/* 内部函数 */
+
+uint32_t    lz_read32(const char *p);
+uint32_t    lz_hash(uint32_t sequence);
+char *      lz_put_length(char *op, const char *end, size_t length);
+
+/* 外部函数 */
+
+/**
+ * 压缩数据，输出格式类似LZ4块格式：
+ *
+ *  1. 每个序列以一个标记字节开始，高4位为字面量长度，低4位为匹配长度减去LZ_MIN_MATCH。
+ *
+ *  2. 长度为15时后面跟随扩展长度字节（每个255，直到小于255的字节为止）。
+ *
+ *  3. 字面量之后是2字节小端序的回溯距离；最后一个序列只有字面量。
+ *
+ * 注意：使用单条目哈希表进行贪心匹配，连续未命中时逐渐加大步长以快速跳过不可压缩的数据。
+ *
+ * @param       src         要压缩的数据。
+ * @param       length      数据的字节数。
+ * @param       dst         输出缓冲区。
+ * @param       capacity    输出缓冲区的字节数。
+ * @return      压缩后的字节数（输出超过capacity时为0）。
+ **/
+size_t lz_compress(const char *src, size_t length, char *dst, size_t capacity) {
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const char *ip     = src;
+    const char *anchor = src;
+    const char *end    = src + length;
+    char       *op     = dst;
+    char       *op_end = dst + capacity;
+    size_t      misses = 0;
+
+    while (end - ip >= LZ_MIN_MATCH) {
+        uint32_t    sequence = lz_read32(ip);
+        uint32_t    h        = lz_hash(sequence);
+        const char *ref      = src + table[h];
+        table[h] = ip - src;
+
+        if (ref >= ip || ip - ref > LZ_MAX_OFFSET || lz_read32(ref) != sequence) {
+            ip += 1 + (misses++ >> LZ_SKIP_SHIFT);
+            continue;
+        }
+        misses = 0;
+
+        size_t match = LZ_MIN_MATCH;
+        while (ip + match < end && ref[match] == ip[match]) {
+            match++;
+        }
+
+        size_t literals = ip - anchor;
+        if (op + 1 + literals / 255 + literals + 2 + (match - LZ_MIN_MATCH) / 255 + 2 > op_end) {
+            return 0;
+        }
+
+        char *token = op++;
+        *token = (char)((min(literals, 15) << 4) | min(match - LZ_MIN_MATCH, 15));
+        op = lz_put_length(op, op_end, literals);
+        memcpy(op, anchor, literals);
+        op += literals;
+
+        size_t offset = ip - ref;
+        *op++ = (char)(offset & 0xff);
+        *op++ = (char)(offset >> 8);
+        op = lz_put_length(op, op_end, match - LZ_MIN_MATCH);
+
+        ip    += match;
+        anchor = ip;
+    }
+
+    size_t literals = end - anchor;
+    if (op + 1 + literals / 255 + 1 + literals > op_end) {
+        return 0;
+    }
+
+    *op++ = (char)(min(literals, 15) << 4);
+    op = lz_put_length(op, op_end, literals);
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - dst;
+}
+
+/**
+ * 解压由lz_compress生成的数据，所有的读写都进行边界检查，损坏的输入不会越界访问。
+ *
+ * @param       src         压缩数据。
+ * @param       length      压缩数据的字节数。
+ * @param       dst         输出缓冲区。
+ * @param       capacity    输出缓冲区的字节数。
+ * @return      解压后的字节数（输入损坏或输出超过capacity时为-1）。
+ **/
+ssize_t lz_decompress(const char *src, size_t length, char *dst, size_t capacity) {
+    const unsigned char *ip     = (const unsigned char *)src;
+    const unsigned char *end    = ip + length;
+    char                *op     = dst;
+    char                *op_end = dst + capacity;
+
+    while (ip < end) {
+        unsigned char token = *ip++;
+
+        /* 字面量 */
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            unsigned char byte;
+            do {
+                if (ip >= end) return -1;
+                byte = *ip++;
+                literals += byte;
+            } while (byte == 255);
+        }
+
+        if ((size_t)(end - ip) < literals || (size_t)(op_end - op) < literals) {
+            return -1;
+        }
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == end) {
+            break;
+        }
+
+        /* 匹配 */
+        if (end - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        size_t match = token & 0x0f;
+        if (match == 15) {
+            unsigned char byte;
+            do {
+                if (ip >= end) return -1;
+                byte = *ip++;
+                match += byte;
+            } while (byte == 255);
+        }
+        match += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(op_end - op) < match) {
+            return -1;
+        }
+
+        const char *ref = op - offset;
+        if (offset >= match) {
+            memcpy(op, ref, match);
+            op += match;
+        } else {
+            while (match--) {
+                *op++ = *ref++;
+            }
+        }
+    }
+
+    return op - dst;
+}
+
+/* 内部函数 */
+
+/**
+ * 读取未对齐的32位值。
+ **/
+uint32_t lz_read32(const char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/**
+ * 计算4字节序列的哈希值（Knuth乘法哈希）。
+ **/
+uint32_t lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * 写入长度字段的扩展字节（长度小于15时不写入任何字节）。
+ *
+ * @param       op      输出位置。
+ * @param       end     输出缓冲区末尾（调用者已保证空间足够）。
+ * @param       length  字面量长度或匹配长度减去LZ_MIN_MATCH。
+ * @return      写入之后的输出位置。
+ **/
+char *lz_put_length(char *op, const char *end, size_t length) {
+    if (length < 15) {
+        return op;
+    }
+
+    for (length -= 15; length >= 255 && op < end; length -= 255) {
+        *op++ = (char)255;
+    }
+    *op++ = (char)length;
+    return op;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,204 @@
+/* model.c: SimpleFS 磁盘延迟模型 */
+
+#include "sfs/disk.h"
+#include "sfs/model.h"
+#include "sfs/stats.h"
+#include "sfs/utils.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/* 内部结构 */
+
+struct Model {
+    ModelOptions        options;                /* 模型选项（已填入默认值） */
+    size_t              blocks;                 /* 磁盘块数 */
+    uint64_t            clock;                  /* 模拟时钟：所有访问的模拟耗时之和（纳秒） */
+    size_t              head;                   /* HDD：磁头位置（上次访问的块之后的块） */
+    size_t              written;                /* SSD：当前擦除块中已写入的页数 */
+    pthread_mutex_t     lock;                   /* 保护clock、head和written */
+};
+
+/* 内部函数 */
+
+uint64_t    model_hdd(Model *model, size_t block);
+uint64_t    model_ssd(Model *model, bool write, size_t depth);
+
+/* 外部函数 */
+
+/**
+ * 解析模型描述："none"、"constant[:微秒]"、"hdd[:转速]"或"ssd[:通道数]"，
+ * 后面可以加",sleep"表示真正睡眠模拟的时间。
+ *
+ * @param       spec        模型描述。
+ * @param       options     输出的模型选项。
+ *
+ * @return      描述是否合法。
+ **/
+bool model_parse(const char *spec, ModelOptions *options) {
+    const struct {
+        const char *name;
+        ModelType   type;
+    } types[] = {
+        {"none",     MODEL_NONE},
+        {"constant", MODEL_CONSTANT_LATENCY},
+        {"hdd",      MODEL_HDD},
+        {"ssd",      MODEL_SSD},
+    };
+
+    memset(options, 0, sizeof(ModelOptions));
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        size_t length = strlen(types[i].name);
+        if (strncmp(spec, types[i].name, length) != 0) {
+            continue;
+        }
+
+        const char *rest = spec + length;
+        if (*rest == ':') {
+            char *end;
+            options->parameter = strtoul(rest + 1, &end, 10);
+            rest = end;
+        }
+        if (strcmp(rest, ",sleep") == 0) {
+            options->sleep = true;
+            rest += strlen(rest);
+        }
+
+        options->type = types[i].type;
+        return *rest == 0;
+    }
+
+    return false;
+}
+
+/**
+ * 创建模型状态（未指定的参数使用默认值）。
+ *
+ * @param       options     模型选项。
+ * @param       blocks      磁盘块数。
+ *
+ * @return      模型状态（类型为MODEL_NONE或分配失败时为NULL）。
+ **/
+Model *model_open(const ModelOptions *options, size_t blocks) {
+    if (options == NULL || options->type == MODEL_NONE) {
+        return NULL;
+    }
+
+    Model *model = (Model *)calloc(1, sizeof(Model));
+    if (model == NULL) {
+        return NULL;
+    }
+
+    model->options = *options;
+    model->blocks  = max(blocks, 1);
+    if (model->options.parameter == 0) {
+        switch (model->options.type) {
+            case MODEL_CONSTANT_LATENCY: model->options.parameter = MODEL_CONSTANT; break;
+            case MODEL_HDD:              model->options.parameter = MODEL_HDD_RPM; break;
+            case MODEL_SSD:              model->options.parameter = MODEL_SSD_CHANNELS; break;
+            default:                     break;
+        }
+    }
+
+    pthread_mutex_init(&model->lock, NULL);
+    return model;
+}
+
+/**
+ * 计算一次块访问的模拟耗时并施加到调用线程：启用sleep时睡眠这段时间，
+ * 否则把它加到调用线程的统计时钟上（见stats_advance），
+ * 这样无论是否睡眠，所有用stats_now测量的延迟都包含模拟的耗时。
+ *
+ * @param       model       模型状态（NULL时不模拟）。
+ * @param       write       是否是写入。
+ * @param       block       块编号。
+ * @param       depth       包括本次访问在内正在进行的访问数。
+ *
+ * @return      模拟的耗时（纳秒）。
+ **/
+uint64_t model_access(Model *model, bool write, size_t block, size_t depth) {
+    if (model == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&model->lock);
+    uint64_t cost = 0;
+    switch (model->options.type) {
+        case MODEL_CONSTANT_LATENCY: cost = model->options.parameter * 1000ull; break;
+        case MODEL_HDD:              cost = model_hdd(model, block); break;
+        case MODEL_SSD:              cost = model_ssd(model, write, depth); break;
+        default:                     break;
+    }
+    model->clock += cost;
+    pthread_mutex_unlock(&model->lock);
+
+    if (model->options.sleep) {
+        struct timespec delay = {.tv_sec = cost / 1000000000ull, .tv_nsec = cost % 1000000000ull};
+        nanosleep(&delay, NULL);
+    } else {
+        stats_advance(cost);
+    }
+
+    return cost;
+}
+
+/**
+ * 释放模型状态。
+ **/
+void model_close(Model *model) {
+    if (model == NULL) {
+        return;
+    }
+
+    pthread_mutex_destroy(&model->lock);
+    free(model);
+}
+
+/* 内部函数 */
+
+/**
+ * HDD模型：连续访问只有传输时间；否则先寻道（与距离的平方根成正比，
+ * 同一磁道内不寻道），再等待目标块按模拟时钟转到磁头下，最后传输。
+ **/
+uint64_t model_hdd(Model *model, size_t block) {
+    uint64_t rotation = 60000000000ull / model->options.parameter;
+    uint64_t transfer = (uint64_t)BLOCK_SIZE * 1000000000ull / ((uint64_t)MODEL_HDD_TRANSFER << 20);
+    uint64_t cost     = transfer;
+
+    if (block != model->head) {
+        size_t distance = block > model->head ? block - model->head : model->head - block;
+        if (block / MODEL_HDD_TRACK_BLOCKS != model->head / MODEL_HDD_TRACK_BLOCKS) {
+            cost += MODEL_HDD_SEEK_MIN + (MODEL_HDD_SEEK_MAX - MODEL_HDD_SEEK_MIN) * sqrt((double)distance / model->blocks);
+        }
+
+        uint64_t angle  = (model->clock + cost) % rotation;
+        uint64_t target = (block % MODEL_HDD_TRACK_BLOCKS) * rotation / MODEL_HDD_TRACK_BLOCKS;
+        cost += (target + rotation - angle) % rotation;
+    }
+
+    model->head = block + 1;
+    return cost;
+}
+
+/**
+ * SSD模型：通道数以内的访问并行完成，队列深度每多一倍通道数，页读写时间增加一倍；
+ * 写入按日志方式填充擦除块，每写满一个擦除块，下一次写入需要先擦除一个块（模拟垃圾回收）。
+ **/
+uint64_t model_ssd(Model *model, bool write, size_t depth) {
+    uint64_t base = write ? MODEL_SSD_WRITE : MODEL_SSD_READ;
+    uint64_t cost = base * ((max(depth, 1) + model->options.parameter - 1) / model->options.parameter);
+
+    if (write) {
+        if (model->written == MODEL_SSD_ERASE_BLOCKS) {
+            model->written = 0;
+            cost += MODEL_SSD_ERASE;
+        }
+        model->written++;
+    }
+
+    return cost;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
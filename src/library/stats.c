@@ -0,0 +1,434 @@
+/* stats.c: SimpleFS 运行统计 */
+
+#include "sfs/fs.h"
+#include "sfs/logging.h"
+#include "sfs/stats.h"
+#include "sfs/utils.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* 内部结构 */
+
+struct StatsDumper {
+    FileSystem          *fs;                    /* 被统计的文件系统 */
+    char                *path;                  /* 指标文件路径 */
+    unsigned int         interval;              /* 输出间隔（秒） */
+    bool                 stop;                  /* 是否应该退出 */
+    pthread_t            thread;                /* 输出线程 */
+    pthread_mutex_t      lock;                  /* 保护stop */
+    pthread_cond_t       wakeup;                /* 通知线程退出 */
+};
+
+/* 内部函数 */
+
+void *  stats_dump_thread(void *arg);
+bool    stats_dump(FileSystem *fs, const char *path);
+size_t  stats_bucket(uint64_t nanoseconds);
+
+/* 内部常量 */
+
+const char *STATS_NAMES[STATS_OPERATIONS] = {
+    [STATS_DISK_READ]           = "disk_read",
+    [STATS_DISK_WRITE]          = "disk_write",
+    [STATS_FS_FORMAT]           = "fs_format",
+    [STATS_FS_MOUNT]            = "fs_mount",
+    [STATS_FS_CREATE]           = "fs_create",
+    [STATS_FS_REMOVE]           = "fs_remove",
+    [STATS_FS_CREATE_MANY]      = "fs_create_many",
+    [STATS_FS_REMOVE_MANY]      = "fs_remove_many",
+    [STATS_FS_TRIM]             = "fs_trim",
+    [STATS_FS_STATFS]           = "fs_statfs",
+    [STATS_FS_STAT]             = "fs_stat",
+    [STATS_FS_READ]             = "fs_read",
+    [STATS_FS_READ_VIEW]        = "fs_read_view",
+    [STATS_FS_READ_ASYNC]       = "fs_read_async",
+    [STATS_FS_WRITE_ASYNC]      = "fs_write_async",
+    [STATS_FS_WRITE]            = "fs_write",
+    [STATS_FS_TRUNCATE]         = "fs_truncate",
+    [STATS_FS_FALLOCATE]        = "fs_fallocate",
+    [STATS_FS_SET_COMPRESSION]  = "fs_set_compression",
+    [STATS_FS_COPYIN]           = "fs_copyin",
+    [STATS_FS_COPYOUT]          = "fs_copyout",
+    [STATS_FS_LOOKUP]           = "fs_lookup",
+    [STATS_FS_MKDIR]            = "fs_mkdir",
+    [STATS_FS_LINK]             = "fs_link",
+    [STATS_FS_UNLINK]           = "fs_unlink",
+    [STATS_FS_READDIR]          = "fs_readdir",
+    [STATS_FS_RESOLVE]          = "fs_resolve",
+    [STATS_FS_IMPORT]           = "fs_import",
+};
+
+/* 内部变量 */
+
+__thread uint64_t StatsSimulated = 0;           /* 本线程的统计时钟比单调时钟快的纳秒数 */
+
+/* 外部函数 */
+
+/**
+ * 返回调用线程的统计时钟（纳秒），作为stats_record的start参数：
+ * 单调时钟加上本线程通过stats_advance累计的模拟时间。
+ **/
+uint64_t stats_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec + StatsSimulated;
+}
+
+/**
+ * 将调用线程的统计时钟向前拨动（用于不睡眠的磁盘延迟模型），
+ * 之后在本线程中测量的所有延迟都包含这段模拟的时间。
+ **/
+void stats_advance(uint64_t nanoseconds) {
+    StatsSimulated += nanoseconds;
+}
+
+/**
+ * 记录一次操作。计数器用宽松的原子加更新，因此可以在多个线程中同时记录，
+ * 也可以在记录的同时被输出线程读取。
+ *
+ * @param       stats       统计结构（NULL时忽略）。
+ * @param       operation   操作类型。
+ * @param       start       操作开始时stats_now的返回值。
+ * @param       success     操作是否成功。
+ * @param       bytes       操作读写的字节数。
+ **/
+void stats_record(Stats *stats, StatsOperation operation, uint64_t start, bool success, size_t bytes) {
+    if (stats == NULL || operation >= STATS_OPERATIONS) {
+        return;
+    }
+
+    uint64_t      elapsed = stats_now() - start;
+    StatsCounter *counter = &stats->counters[operation];
+
+    __atomic_fetch_add(&counter->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->nanoseconds, elapsed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->histogram[stats_bucket(elapsed)], 1, __ATOMIC_RELAXED);
+    if (success) {
+        __atomic_fetch_add(&counter->bytes, bytes, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&counter->errors, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * 复制统计结构（逐个原子读取，可以与stats_record并发执行）。
+ *
+ * @param       stats       源统计结构。
+ * @param       snapshot    目标统计结构。
+ **/
+void stats_snapshot(const Stats *stats, Stats *snapshot) {
+    const uint64_t *source = (const uint64_t *)stats;
+    uint64_t       *target = (uint64_t *)snapshot;
+
+    for (size_t i = 0; i < sizeof(Stats) / sizeof(uint64_t); i++) {
+        target[i] = __atomic_load_n(&source[i], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * 将source中的所有计数器加到target中。
+ *
+ * @param       target      目标统计结构。
+ * @param       source      源统计结构。
+ **/
+void stats_merge(Stats *target, const Stats *source) {
+    const uint64_t *from = (const uint64_t *)source;
+    uint64_t       *to   = (uint64_t *)target;
+
+    for (size_t i = 0; i < sizeof(Stats) / sizeof(uint64_t); i++) {
+        to[i] += __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * 清零所有计数器。
+ *
+ * @param       stats       统计结构。
+ **/
+void stats_reset(Stats *stats) {
+    uint64_t *counters = (uint64_t *)stats;
+
+    for (size_t i = 0; i < sizeof(Stats) / sizeof(uint64_t); i++) {
+        __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * 返回操作的名称（即被统计的函数名）。
+ **/
+const char *stats_name(StatsOperation operation) {
+    return operation < STATS_OPERATIONS ? STATS_NAMES[operation] : "unknown";
+}
+
+/**
+ * 根据直方图估计延迟的百分位数：返回包含该百分位的桶的上界（纳秒）。
+ *
+ * @param       counter     计数器。
+ * @param       percentile  百分位（0到100）。
+ *
+ * @return      延迟上界（没有记录时为0）。
+ **/
+uint64_t stats_percentile(const StatsCounter *counter, double percentile) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        total += counter->histogram[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        seen += counter->histogram[i];
+        if (seen > rank) {
+            return 1ull << i;
+        }
+    }
+
+    return 1ull << (STATS_BUCKETS - 1);
+}
+
+/**
+ * 以表格形式输出所有调用过的操作（延迟单位为微秒）。
+ *
+ * @param       stats       统计结构。
+ * @param       stream      输出流。
+ **/
+void stats_print(const Stats *stats, FILE *stream) {
+    fprintf(stream, "%-20s %10s %8s %12s %10s %10s %10s %10s\n",
+            "operation", "calls", "errors", "bytes", "avg(us)", "p50(us)", "p99(us)", "p999(us)");
+
+    for (size_t i = 0; i < STATS_OPERATIONS; i++) {
+        const StatsCounter *counter = &stats->counters[i];
+        if (counter->calls == 0) {
+            continue;
+        }
+
+        fprintf(stream, "%-20s %10lu %8lu %12lu %10.1f %10.1f %10.1f %10.1f\n",
+                stats_name(i), counter->calls, counter->errors, counter->bytes,
+                counter->nanoseconds / 1e3 / counter->calls,
+                stats_percentile(counter, 50) / 1e3,
+                stats_percentile(counter, 99) / 1e3,
+                stats_percentile(counter, 99.9) / 1e3);
+    }
+}
+
+/**
+ * 以Prometheus文本格式输出所有调用过的操作（延迟直方图的桶是累积的，单位为秒）。
+ *
+ * @param       stats       统计结构。
+ * @param       stream      输出流。
+ **/
+void stats_write_metrics(const Stats *stats, FILE *stream) {
+    const char *families[] = {"calls", "errors", "bytes"};
+
+    for (size_t family = 0; family < sizeof(families) / sizeof(families[0]); family++) {
+        fprintf(stream, "# TYPE sfs_%s_total counter\n", families[family]);
+        for (size_t i = 0; i < STATS_OPERATIONS; i++) {
+            const StatsCounter *counter = &stats->counters[i];
+            uint64_t            values[] = {counter->calls, counter->errors, counter->bytes};
+            if (counter->calls > 0) {
+                fprintf(stream, "sfs_%s_total{op=\"%s\"} %lu\n", families[family], stats_name(i), values[family]);
+            }
+        }
+    }
+
+    fprintf(stream, "# TYPE sfs_latency_seconds histogram\n");
+    for (size_t i = 0; i < STATS_OPERATIONS; i++) {
+        const StatsCounter *counter = &stats->counters[i];
+        const char         *name    = stats_name(i);
+        if (counter->calls == 0) {
+            continue;
+        }
+
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket < STATS_BUCKETS; bucket++) {
+            cumulative += counter->histogram[bucket];
+            fprintf(stream, "sfs_latency_seconds_bucket{op=\"%s\",le=\"%g\"} %lu\n",
+                    name, (double)(1ull << bucket) / 1e9, cumulative);
+        }
+        fprintf(stream, "sfs_latency_seconds_bucket{op=\"%s\",le=\"+Inf\"} %lu\n", name, counter->calls);
+        fprintf(stream, "sfs_latency_seconds_sum{op=\"%s\"} %.9f\n", name, counter->nanoseconds / 1e9);
+        fprintf(stream, "sfs_latency_seconds_count{op=\"%s\"} %lu\n", name, counter->calls);
+    }
+}
+
+/**
+ * 获取文件系统的统计：文件系统入口函数的计数器加上已挂载磁盘的读写计数器。
+ *
+ * @param       fs          指向FileSystem结构的指针。
+ * @param       stats       输出的统计结构。
+ **/
+void fs_stats(FileSystem *fs, Stats *stats) {
+    memset(stats, 0, sizeof(Stats));
+    if (fs == NULL) {
+        return;
+    }
+
+    stats_snapshot(&fs->stats, stats);
+    if (fs->disk != NULL) {
+        stats_merge(stats, &fs->disk->stats);
+    }
+}
+
+/**
+ * 清零文件系统及其已挂载磁盘的统计。
+ *
+ * @param       fs          指向FileSystem结构的指针。
+ **/
+void fs_stats_reset(FileSystem *fs) {
+    if (fs == NULL) {
+        return;
+    }
+
+    stats_reset(&fs->stats);
+    if (fs->disk != NULL) {
+        stats_reset(&fs->disk->stats);
+    }
+}
+
+/**
+ * 启动输出线程，每interval秒把fs_stats的结果以Prometheus文本格式写入path
+ * （先写入<path>.tmp再重命名，读者不会看到写了一半的文件）。已有的输出线程会先被停止；
+ * 卸载文件系统时输出线程自动停止。
+ *
+ * @param       fs          指向FileSystem结构的指针（必须已挂载）。
+ * @param       path        指标文件路径。
+ * @param       interval    输出间隔（秒，必须大于0）。
+ *
+ * @return      是否成功启动。
+ **/
+bool fs_stats_start(FileSystem *fs, const char *path, unsigned int interval) {
+    if (fs == NULL || fs->disk == NULL || path == NULL || interval == 0) {
+        return false;
+    }
+
+    fs_stats_stop(fs);
+    if (!stats_dump(fs, path)) {
+        return false;
+    }
+
+    StatsDumper *dumper = (StatsDumper *)calloc(1, sizeof(StatsDumper));
+    if (dumper == NULL) {
+        return false;
+    }
+
+    dumper->fs       = fs;
+    dumper->path     = strdup(path);
+    dumper->interval = interval;
+    pthread_mutex_init(&dumper->lock, NULL);
+    pthread_cond_init(&dumper->wakeup, NULL);
+
+    if (dumper->path == NULL || pthread_create(&dumper->thread, NULL, stats_dump_thread, dumper) != 0) {
+        pthread_cond_destroy(&dumper->wakeup);
+        pthread_mutex_destroy(&dumper->lock);
+        free(dumper->path);
+        free(dumper);
+        return false;
+    }
+
+    fs->dumper = dumper;
+    return true;
+}
+
+/**
+ * 停止输出线程（停止前最后输出一次）。
+ *
+ * @param       fs          指向FileSystem结构的指针。
+ **/
+void fs_stats_stop(FileSystem *fs) {
+    if (fs == NULL || fs->dumper == NULL) {
+        return;
+    }
+
+    StatsDumper *dumper = fs->dumper;
+    pthread_mutex_lock(&dumper->lock);
+    dumper->stop = true;
+    pthread_cond_signal(&dumper->wakeup);
+    pthread_mutex_unlock(&dumper->lock);
+    pthread_join(dumper->thread, NULL);
+
+    stats_dump(fs, dumper->path);
+
+    pthread_cond_destroy(&dumper->wakeup);
+    pthread_mutex_destroy(&dumper->lock);
+    free(dumper->path);
+    free(dumper);
+    fs->dumper = NULL;
+}
+
+/* 内部函数 */
+
+/**
+ * 输出线程：每隔interval秒输出一次，直到stop被设置。
+ **/
+void *stats_dump_thread(void *arg) {
+    StatsDumper *dumper = (StatsDumper *)arg;
+
+    pthread_mutex_lock(&dumper->lock);
+    while (!dumper->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += dumper->interval;
+
+        while (!dumper->stop && pthread_cond_timedwait(&dumper->wakeup, &dumper->lock, &deadline) != ETIMEDOUT);
+        if (dumper->stop) {
+            break;
+        }
+
+        pthread_mutex_unlock(&dumper->lock);
+        stats_dump(dumper->fs, dumper->path);
+        pthread_mutex_lock(&dumper->lock);
+    }
+    pthread_mutex_unlock(&dumper->lock);
+
+    return NULL;
+}
+
+/**
+ * 将fs_stats的结果写入<path>.tmp后重命名为path。
+ *
+ * @return      是否成功写入。
+ **/
+bool stats_dump(FileSystem *fs, const char *path) {
+    char temporary[BUFSIZ];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary)) {
+        return false;
+    }
+
+    FILE *stream = fopen(temporary, "w");
+    if (stream == NULL) {
+        error("Unable to open %s: %s", temporary, strerror(errno));
+        return false;
+    }
+
+    Stats stats;
+    fs_stats(fs, &stats);
+    stats_write_metrics(&stats, stream);
+
+    if (fclose(stream) != 0 || rename(temporary, path) != 0) {
+        error("Unable to write %s: %s", path, strerror(errno));
+        unlink(temporary);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * 返回延迟所在的直方图桶：0纳秒在桶0，[2^(i-1), 2^i)纳秒在桶i，过大的延迟在最后一个桶。
+ **/
+size_t stats_bucket(uint64_t nanoseconds) {
+    if (nanoseconds == 0) {
+        return 0;
+    }
+
+    return min((size_t)(64 - __builtin_clzll(nanoseconds)), STATS_BUCKETS - 1);
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,153 @@
+/* trace.c: SimpleFS 块I/O跟踪 */
+
+#include "sfs/disk.h"
+#include "sfs/logging.h"
+#include "sfs/stats.h"
+#include "sfs/trace.h"
+
+#include <pthread.h>
+#include <string.h>
+
+/* 内部结构 */
+
+struct Trace {
+    FILE               *stream;                 /* 跟踪文件 */
+    uint64_t            origin;                 /* 跟踪开始时stats_now的返回值 */
+    TraceRecord         buffer[TRACE_BUFFER];   /* 尚未写入文件的记录 */
+    size_t              count;                  /* buffer中的记录数 */
+    bool                failed;                 /* 是否有写入失败 */
+    pthread_mutex_t     lock;                   /* 保护buffer、count和failed */
+};
+
+/* 内部函数 */
+
+void    trace_flush(Trace *trace);
+
+/* 外部函数 */
+
+/**
+ * 创建跟踪文件并写入文件头。
+ *
+ * @param       path        跟踪文件路径（已存在时被覆盖）。
+ * @param       blocks      被跟踪的磁盘的块数。
+ *
+ * @return      跟踪结构（失败时为NULL）。
+ **/
+Trace *trace_open(const char *path, size_t blocks) {
+    Trace *trace = (Trace *)calloc(1, sizeof(Trace));
+    if (trace == NULL) {
+        return NULL;
+    }
+
+    trace->stream = fopen(path, "w");
+    if (trace->stream == NULL) {
+        error("Unable to open trace %s: %s", path, strerror(errno));
+        free(trace);
+        return NULL;
+    }
+
+    TraceHeader header = {
+        .magic      = TRACE_MAGIC,
+        .version    = TRACE_VERSION,
+        .block_size = BLOCK_SIZE,
+        .blocks     = blocks,
+    };
+    if (fwrite(&header, sizeof(header), 1, trace->stream) != 1) {
+        fclose(trace->stream);
+        free(trace);
+        return NULL;
+    }
+
+    trace->origin = stats_now();
+    pthread_mutex_init(&trace->lock, NULL);
+    return trace;
+}
+
+/**
+ * 追加一条记录（缓冲区满时写入文件）。可以在多个线程中同时调用。
+ *
+ * @param       trace       跟踪结构（NULL时忽略）。
+ * @param       operation   TRACE_READ或TRACE_WRITE。
+ * @param       block       块编号。
+ * @param       start       操作开始时stats_now的返回值。
+ * @param       success     操作是否成功。
+ **/
+void trace_record(Trace *trace, uint8_t operation, size_t block, uint64_t start, bool success) {
+    if (trace == NULL) {
+        return;
+    }
+
+    uint64_t latency = stats_now() - start;
+
+    pthread_mutex_lock(&trace->lock);
+    TraceRecord *record = &trace->buffer[trace->count++];
+    record->timestamp = start - trace->origin;
+    record->block     = block;
+    record->latency   = latency > UINT32_MAX ? UINT32_MAX : latency;
+    record->operation = operation;
+    record->status    = success ? 0 : 1;
+
+    if (trace->count == TRACE_BUFFER) {
+        trace_flush(trace);
+    }
+    pthread_mutex_unlock(&trace->lock);
+}
+
+/**
+ * 写入缓冲的记录并关闭跟踪文件。
+ *
+ * @param       trace       跟踪结构（NULL时忽略）。
+ *
+ * @return      所有记录是否都已写入。
+ **/
+bool trace_close(Trace *trace) {
+    if (trace == NULL) {
+        return true;
+    }
+
+    trace_flush(trace);
+    bool success = !trace->failed && fclose(trace->stream) == 0;
+
+    pthread_mutex_destroy(&trace->lock);
+    free(trace);
+    return success;
+}
+
+/**
+ * 读取并检查跟踪文件头。
+ *
+ * @param       stream      跟踪文件。
+ * @param       header      输出的文件头。
+ *
+ * @return      是否是本版本可以读取的跟踪文件。
+ **/
+bool trace_read_header(FILE *stream, TraceHeader *header) {
+    return fread(header, sizeof(TraceHeader), 1, stream) == 1 &&
+           header->magic == TRACE_MAGIC && header->version == TRACE_VERSION;
+}
+
+/**
+ * 读取下一条记录。
+ *
+ * @param       stream      跟踪文件（已读取文件头）。
+ * @param       record      输出的记录。
+ *
+ * @return      是否读到了完整的记录（文件结束时为false）。
+ **/
+bool trace_read(FILE *stream, TraceRecord *record) {
+    return fread(record, sizeof(TraceRecord), 1, stream) == 1;
+}
+
+/* 内部函数 */
+
+/**
+ * 将缓冲的记录写入文件（调用者持有锁或独占trace）。
+ **/
+void trace_flush(Trace *trace) {
+    if (trace->count > 0 && fwrite(trace->buffer, sizeof(TraceRecord), trace->count, trace->stream) != trace->count) {
+        trace->failed = true;
+    }
+    trace->count = 0;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -1,13 +1,18 @@
 /* sfssh.c: SimpleFS命令行界面 */
 
+#include "sfs/dir.h"
 #include "sfs/disk.h"
+#include "sfs/import.h"
 #include "sfs/fs.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <unistd.h>
+
 /*  宏定义 */
 
 #define streq(a, b)	(strcmp((a), (b)) == 0)
@@ -19,26 +24,64 @@ void do_format(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
 void do_mount(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
 void do_create(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
 void do_remove(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_remove_range(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
 void do_stat(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
 void do_copyout(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
 void do_cat(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
 void do_copyin(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_truncate(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_compress(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_verify(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_resync(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_dedup(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_trim(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_df(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_inspect(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_mkdir(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_ls(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_link(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_unlink(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_import(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_stats(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
+void do_metrics(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
 void do_help(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2);
 
 /* 实用函数原型 */
 
 bool copyout(FileSystem *fs, size_t inode_number, const char *path);
 bool copyin(FileSystem *fs, const char *path, size_t inode_number);
+ssize_t inode_arg(FileSystem *fs, const char *arg, bool create);
 
 /* 主程序 */
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-	fprintf(stderr, "Usage: %s <diskfile> <nblocks>\n", argv[0]);
+    DiskOptions options = {0};
+    int option;
+
+    while ((option = getopt(argc, argv, "cdt:l:S:m")) != -1) {
+        switch (option) {
+            case 'c': options.checksums = true; break;
+            case 'd': options.discard = true; break;
+            case 'S': options.stripe = strtoul(optarg, NULL, 10); break;
+            case 'm': options.mirror = true; break;
+            case 't': options.trace = optarg; break;
+            case 'l': argc = model_parse(optarg, &options.model) ? argc : 0; break;
+            default:  argc = 0; break;
+        }
+    }
+
+    if (argc - optind != 2) {
+	fprintf(stderr, "Usage: %s [-c] [-d] [-t trace] [-l model] [-S stripe | -m] <diskfile>[,<diskfile>...] <nblocks>\n", argv[0]);
+	fprintf(stderr, "    -c  Maintain and verify per-block checksums\n");
+	fprintf(stderr, "    -d  Punch holes in the disk files for freed blocks\n");
+	fprintf(stderr, "    -t  Record every block read and write to a trace file\n");
+	fprintf(stderr, "    -l  Latency model: none, constant[:us], hdd[:rpm], ssd[:channels] [,sleep]\n");
+	fprintf(stderr, "    -S  Stripe unit in blocks when several disk files are given (default %d)\n", DISK_STRIPE_DEFAULT);
+	fprintf(stderr, "    -m  Mirror the disk files instead of striping them\n");
 	return EXIT_FAILURE;
     }
 
-    Disk *disk = disk_open(argv[1], atoi(argv[2]));
+    Disk *disk = disk_open_list(argv[optind], strtoul(argv[optind + 1], NULL, 10), &options);
     if (!disk) {
     	return EXIT_FAILURE;
     }
@@ -69,6 +112,8 @@ int main(int argc, char *argv[]) {
 	    do_create(disk, &fs, args, arg1, arg2);
         } else if (streq(cmd, "remove")) {
 	    do_remove(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "remove-range")) {
+	    do_remove_range(disk, &fs, args, arg1, arg2);
         } else if (streq(cmd, "stat")) {
 	    do_stat(disk, &fs, args, arg1, arg2);
         } else if (streq(cmd, "copyout")) {
@@ -77,6 +122,36 @@ int main(int argc, char *argv[]) {
 	    do_cat(disk, &fs, args, arg1, arg2);
         } else if (streq(cmd, "copyin")) {
 	    do_copyin(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "truncate")) {
+	    do_truncate(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "compress")) {
+	    do_compress(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "verify")) {
+	    do_verify(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "resync")) {
+	    do_resync(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "dedup")) {
+	    do_dedup(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "trim")) {
+	    do_trim(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "df")) {
+	    do_df(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "inspect")) {
+	    do_inspect(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "mkdir")) {
+	    do_mkdir(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "ls")) {
+	    do_ls(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "link")) {
+	    do_link(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "unlink")) {
+	    do_unlink(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "import")) {
+	    do_import(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "stats")) {
+	    do_stats(disk, &fs, args, arg1, arg2);
+        } else if (streq(cmd, "metrics")) {
+	    do_metrics(disk, &fs, args, arg1, arg2);
         } else if (streq(cmd, "help")) {
 	    do_help(disk, &fs, args, arg1, arg2);
 	} else if (streq(cmd, "exit") || streq(cmd, "quit")) {
@@ -105,12 +180,32 @@ void do_debug(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
 }
 
 void do_format(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
-    if (args != 1) {
-	printf("Usage: format\n");
-	return;
+    FormatOptions options = {0};
+
+    char *features[] = {arg1, arg2};
+
+    for (int i = 0; i < args - 1; i++) {
+        if (streq(features[i], "compress")) {
+            options.compress = true;
+        } else if (streq(features[i], "dedup")) {
+            options.dedup = true;
+        } else if (streq(features[i], "large")) {
+            options.large = true;
+        } else if (streq(features[i], "fixed")) {
+            options.fixed_inodes = true;
+        } else if (strncmp(features[i], "block=", 6) == 0) {
+            options.block_size = strtoul(features[i] + 6, NULL, 10);
+        } else if (strncmp(features[i], "inode=", 6) == 0) {
+            options.inode_size = strtoul(features[i] + 6, NULL, 10);
+        } else if (strncmp(features[i], "group=", 6) == 0) {
+            options.group_blocks = strtoul(features[i] + 6, NULL, 10);
+        } else {
+            printf("Usage: format [compress] [dedup] [large] [fixed] [block=<bytes>] [inode=<bytes>] [group=<blocks>]\n");
+            return;
+        }
     }
 
-    if (fs_format(fs, disk)) {
+    if (fs_format_with(fs, disk, &options)) {
         printf("disk formatted.\n");
     } else {
         printf("format failed!\n");
@@ -131,17 +226,35 @@ void do_mount(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
 }
 
 void do_create(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
-    if (args != 1) {
-        printf("Usage: create\n");
+    if (args != 1 && args != 2) {
+        printf("Usage: create [count]\n");
         return;
     }
 
-    ssize_t inode_number = fs_create(fs);
-    if (inode_number >= 0) {
-        printf("created inode %ld.\n", inode_number);
+    if (args == 1) {
+        ssize_t inode_number = fs_create(fs);
+        if (inode_number >= 0) {
+            printf("created inode %ld.\n", inode_number);
+        } else {
+            printf("create failed!\n");
+        }
+        return;
+    }
+
+    size_t count = strtoul(arg1, NULL, 10);
+    if (count == 0) {
+        printf("Usage: create [count]\n");
+        return;
+    }
+
+    size_t *inodes = (size_t *)malloc(count * sizeof(size_t));
+    ssize_t result = inodes ? fs_create_many(fs, inodes, count) : -1;
+    if (result > 0) {
+        printf("created %ld inodes (%zu to %zu).\n", result, inodes[0], inodes[result - 1]);
     } else {
         printf("create failed!\n");
     }
+    free(inodes);
 }
 
 void do_remove(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
@@ -158,13 +271,44 @@ void do_remove(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
     }
 }
 
+void do_remove_range(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 3) {
+        printf("Usage: remove-range <first> <last>\n");
+        return;
+    }
+
+    size_t first = strtoul(arg1, NULL, 10);
+    size_t last  = strtoul(arg2, NULL, 10);
+    if (last < first) {
+        printf("Usage: remove-range <first> <last>\n");
+        return;
+    }
+
+    size_t *inodes = (size_t *)malloc((last - first + 1) * sizeof(size_t));
+    if (inodes == NULL) {
+        printf("remove failed!\n");
+        return;
+    }
+    for (size_t i = first; i <= last; i++) {
+        inodes[i - first] = i;
+    }
+
+    ssize_t removed = fs_remove_many(fs, inodes, last - first + 1);
+    if (removed >= 0) {
+        printf("removed %ld inodes.\n", removed);
+    } else {
+        printf("remove failed!\n");
+    }
+    free(inodes);
+}
+
 void do_stat(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
     if (args != 2) {
-        printf("Usage: stat <inode>\n");
+        printf("Usage: stat <inode|path>\n");
         return;
     }
 
-    ssize_t inode_number = atoi(arg1);
+    ssize_t inode_number = inode_arg(fs, arg1, false);
     ssize_t bytes        = fs_stat(fs, inode_number);
     if (bytes >= 0) {
         printf("inode %ld has size %ld bytes.\n", inode_number, bytes);
@@ -175,48 +319,352 @@ void do_stat(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
 
 void do_copyout(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
     if (args != 3) {
-        printf("Usage: copyout <inode> <file>\n");
+        printf("Usage: copyout <inode|path> <file>\n");
         return;
     }
 
-    if (!copyout(fs, atoi(arg1), arg2)) {
+    ssize_t inode_number = inode_arg(fs, arg1, false);
+    if (inode_number < 0 || !copyout(fs, inode_number, arg2)) {
         printf("copyout failed!\n");
     }
 }
 
 void do_cat(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
     if (args != 2) {
-        printf("Usage: cat <inode>\n");
+        printf("Usage: cat <inode|path>\n");
         return;
     }
 
-    if (!copyout(fs, atoi(arg1), "/dev/stdout")) {
+    ssize_t inode_number = inode_arg(fs, arg1, false);
+    if (inode_number < 0 || !copyout(fs, inode_number, "/dev/stdout")) {
         printf("cat failed!\n");
     }
 }
 
 void do_copyin(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
     if (args != 3) {
-        printf("Usage: copyin <file> <inode>\n");
+        printf("Usage: copyin <file> <inode|path>\n");
         return;
     }
 
-    if (!copyin(fs, arg1, atoi(arg2))) {
+    ssize_t inode_number = inode_arg(fs, arg2, true);
+    if (inode_number < 0 || !copyin(fs, arg1, inode_number)) {
         printf("copyout failed!\n");
     }
 }
 
+void do_truncate(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 3) {
+        printf("Usage: truncate <inode> <size>\n");
+        return;
+    }
+
+    size_t inode_number = atoi(arg1);
+    if (fs_truncate(fs, inode_number, strtoul(arg2, NULL, 10))) {
+        printf("truncated inode %ld.\n", inode_number);
+    } else {
+        printf("truncate failed!\n");
+    }
+}
+
+void do_compress(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 3 || (!streq(arg2, "on") && !streq(arg2, "off"))) {
+        printf("Usage: compress <inode> <on|off>\n");
+        return;
+    }
+
+    size_t inode_number = atoi(arg1);
+    if (fs_set_compression(fs, inode_number, streq(arg2, "on"))) {
+        printf("compression %s for inode %ld.\n", arg2, inode_number);
+    } else {
+        printf("compress failed!\n");
+    }
+}
+
+void do_verify(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    char *end     = NULL;
+    long  threads = (args == 2) ? strtol(arg1, &end, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (args > 2 || (end != NULL && *end != '\0') || threads < 1) {
+        printf("Usage: verify [threads]\n");
+        return;
+    }
+
+    ssize_t bad = disk_verify(disk, threads);
+    if (bad < 0) {
+        printf("verify failed (checksums are enabled with -c)!\n");
+    } else {
+        printf("verified %lu blocks, %ld bad.\n", disk->blocks, bad);
+    }
+}
+
+void do_resync(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 2) {
+        printf("Usage: resync <replica>\n");
+        return;
+    }
+
+    ssize_t repaired = disk_resync(disk, strtoul(arg1, NULL, 10));
+    if (repaired < 0) {
+        printf("resync failed (mirror disk files with -m)!\n");
+    } else {
+        printf("resynced replica %s, %ld blocks repaired.\n", arg1, repaired);
+    }
+}
+
+void do_dedup(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 1) {
+        printf("Usage: dedup\n");
+        return;
+    }
+
+    DedupStats stats;
+    if (!fs_dedup_stats(fs, &stats)) {
+        printf("dedup failed (format with dedup)!\n");
+        return;
+    }
+
+    printf("%lu logical blocks, %lu physical blocks, %lu shared blocks\n",
+           stats.logical_blocks, stats.physical_blocks, stats.shared_blocks);
+    printf("dedup ratio %.2f\n",
+           stats.physical_blocks ? (double)stats.logical_blocks / stats.physical_blocks : 1.0);
+}
+
+void do_trim(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 1) {
+        printf("Usage: trim\n");
+        return;
+    }
+
+    ssize_t trimmed = fs_trim(fs);
+    if (trimmed < 0) {
+        printf("trim failed!\n");
+    } else {
+        printf("trimmed %ld blocks.\n", trimmed);
+    }
+}
+
+void do_df(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 1) {
+        printf("Usage: df\n");
+        return;
+    }
+
+    SpaceStats stats;
+    if (!fs_statfs(fs, &stats)) {
+        printf("df failed!\n");
+        return;
+    }
+
+    printf("%lu byte blocks: %lu total, %lu data, %lu used, %lu free (%.1f%%)\n",
+           stats.block_size, stats.total_blocks, stats.data_blocks, stats.data_blocks - stats.free_blocks,
+           stats.free_blocks, stats.data_blocks ? 100.0 * stats.free_blocks / stats.data_blocks : 0.0);
+    printf("largest free extent: %lu blocks\n", stats.largest_extent);
+    printf("inodes: %lu total, %lu used, %lu free\n",
+           stats.total_inodes, stats.total_inodes - stats.free_inodes, stats.free_inodes);
+}
+
+void do_inspect(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    InspectOptions options;
+    if (args < 2 || args > 3 || !fs_inspect_parse(args == 3 ? arg2 : NULL, &options)) {
+        printf("Usage: inspect <file|-> [threads=<n>,inodes=<first>-<last>,size=<min>-<max>,extents,binary]\n");
+        return;
+    }
+
+    if (options.threads == 0) {
+        options.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    FILE *stream = streq(arg1, "-") ? stdout : fopen(arg1, "w");
+    if (stream == NULL) {
+        printf("Unable to open %s: %s\n", arg1, strerror(errno));
+        return;
+    }
+
+    ssize_t reported = fs_inspect(disk, &options, stream);
+    if (stream != stdout) {
+        fclose(stream);
+    }
+
+    if (reported < 0) {
+        printf("inspect failed!\n");
+    } else if (stream != stdout) {
+        printf("inspected %ld inodes.\n", reported);
+    }
+}
+
+void do_mkdir(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 2) {
+        printf("Usage: mkdir <path>\n");
+        return;
+    }
+
+    char    name[FS_NAME_MAX + 1];
+    ssize_t parent = fs_resolve_parent(fs, arg1, name);
+    ssize_t inode_number = (parent >= 0) ? fs_mkdir(fs, parent, name) : -1;
+    if (inode_number >= 0) {
+        printf("created directory %s as inode %ld.\n", arg1, inode_number);
+    } else {
+        printf("mkdir failed!\n");
+    }
+}
+
+void do_ls(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args > 2) {
+        printf("Usage: ls [path]\n");
+        return;
+    }
+
+    ssize_t dir = fs_resolve(fs, (args == 2) ? arg1 : "/");
+    if (dir < 0) {
+        printf("ls failed!\n");
+        return;
+    }
+
+    DirEntry entry;
+    size_t   cookie = 0;
+    int      result;
+    while ((result = fs_readdir(fs, dir, &cookie, &entry)) > 0) {
+        ssize_t size = fs_stat(fs, entry.inode_number);
+        printf("%6u %10ld %s%s\n", entry.inode_number, size, entry.name,
+               (entry.type == DIR_TYPE_DIRECTORY) ? "/" : "");
+    }
+
+    if (result < 0) {
+        printf("ls failed!\n");
+    }
+}
+
+void do_link(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 3) {
+        printf("Usage: link <inode> <path>\n");
+        return;
+    }
+
+    char    name[FS_NAME_MAX + 1];
+    ssize_t parent = fs_resolve_parent(fs, arg2, name);
+    if (parent >= 0 && fs_link(fs, parent, name, atoi(arg1))) {
+        printf("linked inode %d as %s.\n", atoi(arg1), arg2);
+    } else {
+        printf("link failed!\n");
+    }
+}
+
+void do_unlink(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 2) {
+        printf("Usage: unlink <path>\n");
+        return;
+    }
+
+    char    name[FS_NAME_MAX + 1];
+    ssize_t parent = fs_resolve_parent(fs, arg1, name);
+    if (parent >= 0 && fs_unlink(fs, parent, name)) {
+        printf("unlinked %s.\n", arg1);
+    } else {
+        printf("unlink failed!\n");
+    }
+}
+
+void do_import(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args != 2 && args != 3) {
+        printf("Usage: import <hostdir> [manifest]\n");
+        return;
+    }
+
+    ssize_t root = fs_root(fs);
+    if (root < 0) {
+        printf("import failed!\n");
+        return;
+    }
+
+    ImportOptions options = {0};
+    if (args == 3 && (options.manifest = fopen(arg2, "w")) == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", arg2, strerror(errno));
+        return;
+    }
+
+    ImportStats stats;
+    bool imported = fs_import(fs, arg1, root, &options, &stats);
+    printf("imported %lu files, %lu directories, %lu bytes (%lu skipped, %lu errors).\n",
+           stats.files, stats.directories, stats.bytes, stats.skipped, stats.errors);
+    if (!imported) {
+        printf("import failed!\n");
+    }
+
+    if (options.manifest) {
+        fclose(options.manifest);
+    }
+}
+
+void do_stats(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args > 2 || (args == 2 && !streq(arg1, "reset"))) {
+        printf("Usage: stats [reset]\n");
+        return;
+    }
+
+    if (args == 2) {
+        fs_stats_reset(fs);
+        stats_reset(&disk->stats);
+        return;
+    }
+
+    Stats stats;
+    fs_stats(fs, &stats);
+    if (fs->disk == NULL) {
+        stats_merge(&stats, &disk->stats);
+    }
+    stats_print(&stats, stdout);
+    if (disk->model != NULL) {
+        printf("simulated disk time %.3f ms\n", disk->simulated / 1e6);
+    }
+}
+
+void do_metrics(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
+    if (args < 2) {
+        printf("Usage: metrics <file|off> [seconds]\n");
+        return;
+    }
+
+    if (streq(arg1, "off")) {
+        fs_stats_stop(fs);
+        return;
+    }
+
+    unsigned int interval = (args == 3) ? strtoul(arg2, NULL, 10) : 10;
+    if (!fs_stats_start(fs, arg1, interval)) {
+        printf("metrics failed!\n");
+        return;
+    }
+
+    printf("writing metrics to %s every %u seconds\n", arg1, interval);
+}
+
 void do_help(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
     printf("Commands are:\n");
-    printf("    format\n");
+    printf("    format  [compress] [dedup] [large] [fixed] [block=<bytes>] [inode=<bytes>] [group=<blocks>]\n");
     printf("    mount\n");
     printf("    debug\n");
-    printf("    create\n");
+    printf("    create  [count]\n");
     printf("    remove  <inode>\n");
-    printf("    cat     <inode>\n");
-    printf("    stat    <inode>\n");
-    printf("    copyin  <file> <inode>\n");
-    printf("    copyout <inode> <file>\n");
+    printf("    remove-range <first> <last>\n");
+    printf("    cat     <inode|path>\n");
+    printf("    stat    <inode|path>\n");
+    printf("    copyin  <file> <inode|path>\n");
+    printf("    copyout <inode|path> <file>\n");
+    printf("    mkdir   <path>\n");
+    printf("    ls      [path]\n");
+    printf("    link    <inode> <path>\n");
+    printf("    unlink  <path>\n");
+    printf("    import  <hostdir> [manifest]\n");
+    printf("    truncate <inode> <size>\n");
+    printf("    compress <inode> <on|off>\n");
+    printf("    verify  [threads]\n");
+    printf("    resync  <replica>\n");
+    printf("    dedup\n");
+    printf("    trim\n");
+    printf("    df\n");
+    printf("    inspect <file|-> [spec]\n");
+    printf("    stats   [reset]\n");
+    printf("    metrics <file|off> [seconds]\n");
     printf("    help\n");
     printf("    quit\n");
     printf("    exit\n");
@@ -225,55 +673,67 @@ void do_help(Disk *disk, FileSystem *fs, int args, char *arg1, char *arg2) {
 /* 实用函数 */
 
 bool copyin(FileSystem *fs, const char *path, size_t inode_number) {
-    FILE *stream = fopen(path, "r");
-    if (!stream) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
         fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
         return false;
     }
 
-    char buffer[4*BUFSIZ] = {0};
-    size_t offset = 0;
-    while (true) {
-        ssize_t result = fread(buffer, 1, sizeof(buffer), stream);
-        if (result <= 0) {
-            break;
-        }
-        ssize_t actual = fs_write(fs, inode_number, buffer, result, offset);
-        if (actual < 0) {
-            fprintf(stderr, "fs_write returned invalid result %ld\n", actual);
-            break;
-        }
-        offset += actual;
-        if (actual != result) {
-            fprintf(stderr, "fs_write only wrote %ld bytes, not %ld bytes\n", actual, result);
-            break;
-        }
+    ssize_t copied = fs_copyin(fs, inode_number, fd);
+    close(fd);
+    if (copied < 0) {
+        fprintf(stderr, "Unable to copy %s into inode %lu\n", path, inode_number);
+        return false;
     }
-    printf("%lu bytes copied\n", offset);
-    fclose(stream);
+
+    printf("%ld bytes copied\n", copied);
     return true;
 }
 
 bool copyout(FileSystem *fs, size_t inode_number, const char *path) {
-    FILE *stream = fopen(path, "w");
-    if (!stream) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
         fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
         return false;
     }
 
-    char buffer[4*BUFSIZ] = {0};
-    size_t offset = 0;
-    while (true) {
-        ssize_t result = fs_read(fs, inode_number, buffer, sizeof(buffer), offset);
-        if (result <= 0) {
-            break;
-        }
-        fwrite(buffer, 1, result, stream);
-        offset += result;
+    ssize_t copied = fs_copyout(fs, inode_number, fd);
+    close(fd);
+    if (copied < 0) {
+        fprintf(stderr, "Unable to copy inode %lu to %s\n", inode_number, path);
+        return false;
     }
-    printf("%lu bytes copied\n", offset);
-    fclose(stream);
+
+    printf("%ld bytes copied\n", copied);
     return true;
 }
 
+/**
+ * 将命令参数解析为inode编号：以"/"开头的参数按路径解析，否则是inode编号。
+ * create为true且路径不存在时创建新文件并链接到该路径。
+ **/
+ssize_t inode_arg(FileSystem *fs, const char *arg, bool create) {
+    if (arg[0] != '/') {
+        return atoi(arg);
+    }
+
+    ssize_t inode_number = fs_resolve(fs, arg);
+    if (inode_number >= 0 || !create) {
+        return inode_number;
+    }
+
+    char    name[FS_NAME_MAX + 1];
+    ssize_t parent = fs_resolve_parent(fs, arg, name);
+    if (parent < 0 || (inode_number = fs_create(fs)) < 0) {
+        return -1;
+    }
+
+    if (!fs_link(fs, parent, name, inode_number)) {
+        fs_remove(fs, inode_number);
+        return -1;
+    }
+
+    return inode_number;
+}
+
 /* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,181 @@
+/* unit_delta.c: Unit tests for SimpleFS incremental send and receive */
+
+#include "sfs/delta.h"
+#include "sfs/logging.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+
+/* Constants */
+
+#define SOURCE_PATH "unit_delta.source"
+#define TARGET_PATH "unit_delta.target"
+#define DELTA_PATH  "unit_delta.delta"
+#define BLOCKS      (200)
+
+/* Functions */
+
+void test_cleanup() {
+    unlink(SOURCE_PATH);
+    unlink(SOURCE_PATH ".gen");
+    unlink(TARGET_PATH);
+    unlink(DELTA_PATH);
+}
+
+bool fill_block(Disk *disk, size_t block, char value) {
+    char data[BLOCK_SIZE];
+    memset(data, value, BLOCK_SIZE);
+    data[0] = (char)block;
+    return disk_write(disk, block, data) == BLOCK_SIZE;
+}
+
+bool same_images(Disk *source, Disk *target) {
+    char a[BLOCK_SIZE], b[BLOCK_SIZE];
+    for (size_t block = 0; block < source->blocks; block++) {
+        if (disk_read(source, block, a) != BLOCK_SIZE || disk_read(target, block, b) != BLOCK_SIZE ||
+            memcmp(a, b, BLOCK_SIZE) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool send_delta(Disk *disk, uint32_t since, DeltaStats *stats) {
+    int fd = open(DELTA_PATH, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    assert(fd >= 0);
+    bool success = delta_send(disk, since, fd, stats);
+    close(fd);
+    return success;
+}
+
+bool receive_delta(Disk *disk, DeltaStats *stats) {
+    int fd = open(DELTA_PATH, O_RDONLY);
+    assert(fd >= 0);
+    bool success = delta_receive(disk, fd, stats);
+    close(fd);
+    return success;
+}
+
+int test_00_delta_roundtrip() {
+    DiskOptions options = {.track = true};
+    Disk *source = disk_open_with(SOURCE_PATH, BLOCKS, &options);
+    Disk *target = disk_open(TARGET_PATH, BLOCKS);
+    assert(source && target);
+
+    for (size_t block = 0; block < BLOCKS; block++) {
+        assert(fill_block(source, block, 'a'));
+    }
+
+    debug("Check full send");
+    DeltaStats sent, received;
+    assert(send_delta(source, 0, &sent));
+    assert(sent.since == 0 && sent.until == 1);
+    assert(sent.blocks == BLOCKS && sent.runs == (BLOCKS + DELTA_RUN_BLOCKS - 1) / DELTA_RUN_BLOCKS);
+    assert(receive_delta(target, &received));
+    assert(received.blocks == BLOCKS && received.until == 1 && received.bytes == sent.bytes);
+    assert(same_images(source, target));
+
+    debug("Check incremental send moves only changed blocks");
+    assert(fill_block(source, 5, 'b'));
+    assert(fill_block(source, 6, 'b'));
+    assert(fill_block(source, 150, 'c'));
+    assert(send_delta(source, sent.until, &sent));
+    assert(sent.since == 1 && sent.until == 2);
+    assert(sent.blocks == 3 && sent.runs == 2);
+    assert(sent.bytes == sizeof(DeltaHeader) + 3 * sizeof(DeltaRun) + 3 * BLOCK_SIZE);
+    assert(receive_delta(target, &received));
+    assert(received.blocks == 3 && received.runs == 2);
+    assert(same_images(source, target));
+
+    debug("Check empty and repeated sends");
+    assert(send_delta(source, sent.until, &sent));
+    assert(sent.blocks == 0 && sent.runs == 0);
+    assert(receive_delta(target, &received) && received.blocks == 0);
+    assert(fill_block(source, 7, 'd'));
+    assert(send_delta(source, 1, &sent));
+    assert(sent.blocks == 4 && sent.runs == 2);
+    assert(receive_delta(target, &received));
+    assert(same_images(source, target));
+
+    debug("Check send requires change tracking");
+    int fd = open(DELTA_PATH, O_WRONLY|O_TRUNC);
+    assert(fd >= 0);
+    assert(!delta_send(target, 0, fd, &sent));
+    close(fd);
+
+    disk_close(source);
+    disk_close(target);
+    return EXIT_SUCCESS;
+}
+
+int test_01_delta_corrupt() {
+    DiskOptions options = {.track = true};
+    Disk *source = disk_open_with(SOURCE_PATH, BLOCKS, &options);
+    Disk *target = disk_open(TARGET_PATH, BLOCKS);
+    assert(source && target);
+
+    assert(fill_block(source, 10, 'x'));
+    DeltaStats sent, received;
+    assert(send_delta(source, 0, &sent));
+    assert(sent.blocks == BLOCKS);
+
+    debug("Check corrupted runs are not applied");
+    int fd = open(DELTA_PATH, O_RDWR);
+    assert(fd >= 0);
+    off_t offset = sizeof(DeltaHeader) + sizeof(DeltaRun) + 10 * BLOCK_SIZE + 100;
+    assert(pwrite(fd, "!", 1, offset) == 1);
+    close(fd);
+    assert(!receive_delta(target, &received));
+    assert(received.blocks == 0);
+    char data[BLOCK_SIZE];
+    assert(disk_read(target, 10, data) == BLOCK_SIZE && data[100] == 0);
+
+    debug("Check truncated deltas are rejected");
+    assert(send_delta(source, 0, &sent));
+    assert(truncate(DELTA_PATH, sent.bytes - sizeof(DeltaRun)) == 0);
+    assert(!receive_delta(target, &received));
+    assert(received.blocks == BLOCKS);
+
+    debug("Check deltas for other disk sizes are rejected");
+    disk_close(target);
+    target = disk_open(TARGET_PATH, BLOCKS / 2);
+    assert(target);
+    assert(send_delta(source, 0, &sent));
+    assert(!receive_delta(target, &received));
+    assert(received.blocks == 0);
+
+    disk_close(source);
+    disk_close(target);
+    return EXIT_SUCCESS;
+}
+
+/* Main execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test delta_roundtrip\n");
+        fprintf(stderr, "    1. Test delta_corrupt\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    atexit(test_cleanup);
+
+    switch (number) {
+        case 0:  status = test_00_delta_roundtrip(); break;
+        case 1:  status = test_01_delta_corrupt(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,248 @@
+/* unit_dir.c: Unit tests for SimpleFS directories */
+
+#include "sfs/dir.h"
+#include "sfs/logging.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+
+/* Constants */
+
+#define DISK_PATH       "./../data/image.unit"
+#define DISK_BLOCKS     (2048)
+
+/* Functions */
+
+void test_cleanup() {
+    unlink(DISK_PATH);
+}
+
+Disk *test_format(FileSystem *fs) {
+    Disk *disk = disk_open(DISK_PATH, DISK_BLOCKS);
+    assert(disk);
+    assert(fs_format(fs, disk));
+    assert(fs_mount(fs, disk));
+    return disk;
+}
+
+int test_00_dir_mkdir() {
+    FileSystem fs = {0};
+    Disk *disk = test_format(&fs);
+
+    debug("Check namespace before root exists");
+    assert(fs_resolve(&fs, "/") == -1);
+
+    debug("Check creating directories");
+    ssize_t root = fs_root(&fs);
+    assert(root >= 0);
+    assert(fs_root(&fs) == root);
+    assert(fs_resolve(&fs, "/") == root);
+
+    ssize_t usr = fs_mkdir(&fs, root, "usr");
+    assert(usr >= 0);
+    assert(fs_mkdir(&fs, root, "usr") == -1);
+    ssize_t bin = fs_mkdir(&fs, usr, "bin");
+    assert(bin >= 0);
+
+    debug("Check invalid names");
+    assert(fs_mkdir(&fs, root, "") == -1);
+    assert(fs_mkdir(&fs, root, "..") == -1);
+    assert(fs_mkdir(&fs, root, "a/b") == -1);
+
+    debug("Check lookup");
+    assert(fs_lookup(&fs, root, "usr") == usr);
+    assert(fs_lookup(&fs, usr, "bin") == bin);
+    assert(fs_lookup(&fs, usr, "lib") == -1);
+    assert(fs_lookup(&fs, bin, "..") == usr);
+    assert(fs_lookup(&fs, root, "..") == root);
+    assert(fs_lookup(&fs, usr, ".") == usr);
+
+    debug("Check path resolution");
+    assert(fs_resolve(&fs, "/usr/bin") == bin);
+    assert(fs_resolve(&fs, "usr//bin/") == bin);
+    assert(fs_resolve(&fs, "/usr/bin/../../usr") == usr);
+    assert(fs_resolve(&fs, "/usr/lib") == -1);
+
+    char name[FS_NAME_MAX + 1];
+    assert(fs_resolve_parent(&fs, "/usr/bin/ls", name) == bin);
+    assert(strcmp(name, "ls") == 0);
+    assert(fs_resolve_parent(&fs, "/", name) == -1);
+
+    debug("Check directories are not plain files");
+    assert(fs_remove(&fs, usr) == false);
+    assert(fs_lookup(&fs, 12, "usr") == -1);
+
+    debug("Check remounting namespace");
+    fs_unmount(&fs);
+    assert(fs_mount(&fs, disk));
+    assert(fs_resolve(&fs, "/usr/bin") == bin);
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_01_dir_link() {
+    FileSystem fs = {0};
+    Disk *disk = test_format(&fs);
+
+    ssize_t root = fs_root(&fs);
+    ssize_t etc = fs_mkdir(&fs, root, "etc");
+    assert(etc >= 0);
+
+    debug("Check linking files");
+    ssize_t file = fs_create(&fs);
+    assert(file >= 0);
+    assert(fs_write(&fs, file, "hello", 5, 0) == 5);
+    assert(fs_link(&fs, etc, "motd", file));
+    assert(fs_link(&fs, root, "motd", file));
+    assert(fs_link(&fs, root, "motd", file) == false);
+    assert(fs_link(&fs, root, "etc2", etc) == false);
+    assert(fs_link(&fs, file, "x", file) == false);
+    assert(fs_resolve(&fs, "/etc/motd") == file);
+    assert(fs_resolve(&fs, "/motd") == file);
+    assert(fs_resolve(&fs, "/motd/x") == -1);
+
+    debug("Check unlinking files");
+    assert(fs_unlink(&fs, root, "motd"));
+    assert(fs_unlink(&fs, root, "motd") == false);
+    assert(fs_stat(&fs, file) == 5);
+
+    debug("Check unlinking non-empty directories");
+    assert(fs_unlink(&fs, root, "etc") == false);
+    assert(fs_unlink(&fs, etc, "motd"));
+    assert(fs_stat(&fs, file) == -1);
+    assert(fs_unlink(&fs, root, "etc"));
+    assert(fs_resolve(&fs, "/etc") == -1);
+    assert(fs_stat(&fs, etc) == -1);
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_02_dir_readdir() {
+    FileSystem fs = {0};
+    Disk *disk = test_format(&fs);
+
+    ssize_t root = fs_root(&fs);
+    ssize_t file = fs_create(&fs);
+    assert(file >= 0);
+
+    debug("Check empty directory");
+    DirEntry entry;
+    size_t cookie = 0;
+    assert(fs_readdir(&fs, root, &cookie, &entry) == 0);
+    assert(fs_readdir(&fs, file, &cookie, &entry) == -1);
+
+    debug("Check listing entries");
+    char name[FS_NAME_MAX + 1];
+    for (size_t i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "file-%zu", i);
+        assert(fs_link(&fs, root, name, file));
+    }
+    assert(fs_mkdir(&fs, root, "dir") >= 0);
+
+    bool seen[1000] = {0};
+    size_t entries = 0, directories = 0;
+    int result;
+    cookie = 0;
+    while ((result = fs_readdir(&fs, root, &cookie, &entry)) > 0) {
+        entries++;
+        if (entry.type == DIR_TYPE_DIRECTORY) {
+            assert(strcmp(entry.name, "dir") == 0);
+            directories++;
+            continue;
+        }
+
+        size_t i;
+        assert(sscanf(entry.name, "file-%zu", &i) == 1 && i < 1000);
+        assert(!seen[i]);
+        assert(entry.inode_number == file);
+        seen[i] = true;
+    }
+    assert(result == 0);
+    assert(entries == 1001);
+    assert(directories == 1);
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_03_dir_large() {
+    FileSystem fs = {0};
+    Disk *disk = test_format(&fs);
+
+    ssize_t root = fs_root(&fs);
+    ssize_t big = fs_mkdir(&fs, root, "big");
+    assert(big >= 0);
+
+    ssize_t files[4];
+    for (size_t i = 0; i < 4; i++) {
+        files[i] = fs_create(&fs);
+        assert(files[i] >= 0);
+    }
+
+    debug("Check inserting 100000 entries");
+    char name[FS_NAME_MAX + 1];
+    for (size_t i = 0; i < 100000; i++) {
+        snprintf(name, sizeof(name), "entry-%zu", i);
+        assert(fs_link(&fs, big, name, files[i % 4]));
+    }
+
+    debug("Check lookups read a constant number of blocks");
+    for (size_t i = 0; i < 100000; i += 997) {
+        snprintf(name, sizeof(name), "entry-%zu", i);
+        size_t reads = disk->reads;
+        assert(fs_lookup(&fs, big, name) == files[i % 4]);
+        assert(disk->reads - reads <= 6);
+    }
+    assert(fs_lookup(&fs, big, "entry-100000") == -1);
+
+    debug("Check removing entries");
+    for (size_t i = 0; i < 100000; i += 2) {
+        snprintf(name, sizeof(name), "entry-%zu", i);
+        assert(fs_unlink(&fs, big, name));
+    }
+    assert(fs_lookup(&fs, big, "entry-0") == -1);
+    assert(fs_lookup(&fs, big, "entry-1") == files[1]);
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+/* Main execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test dir_mkdir\n");
+        fprintf(stderr, "    1. Test dir_link\n");
+        fprintf(stderr, "    2. Test dir_readdir\n");
+        fprintf(stderr, "    3. Test dir_large\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    assert(atexit(test_cleanup) == EXIT_SUCCESS);
+
+    switch (number) {
+        case 0:  status = test_00_dir_mkdir(); break;
+        case 1:  status = test_01_dir_link(); break;
+        case 2:  status = test_02_dir_readdir(); break;
+        case 3:  status = test_03_dir_large(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -1,5 +1,6 @@
 /* unit_disk.c: Unit tests for SimpleFS disk emulator */
 
+#include "sfs/crc32c.h"
 #include "sfs/disk.h"
 #include "sfs/logging.h"
 
@@ -7,17 +8,27 @@
 #include <limits.h>
 #include <stdio.h>
 
+#include <fcntl.h>
 #include <unistd.h>
 
 /* Constants */
 
 #define DISK_PATH   "unit_disk.image"
 #define DISK_BLOCKS (4)
+#define COPY_PATH   "unit_disk.copy"
+#define TRACE_PATH  "unit_disk.trace"
+#define STRIPE_PATH "unit_disk.stripe"
 
 /* Functions */
 
 void test_cleanup() {
     unlink(DISK_PATH);
+    unlink(DISK_PATH ".crc");
+    unlink(DISK_PATH ".gen");
+    unlink(COPY_PATH);
+    unlink(TRACE_PATH);
+    unlink(STRIPE_PATH);
+    unlink(STRIPE_PATH ".crc");
 }
 
 int test_00_disk_open() {
@@ -106,6 +117,461 @@ int test_02_disk_write() {
     return EXIT_SUCCESS;
 }
 
+int test_03_disk_checksums() {
+    DiskOptions options = {.checksums = true};
+    Disk *disk = disk_open_with(DISK_PATH, DISK_BLOCKS, &options);
+    assert(disk);
+    assert(disk->checksums);
+
+    char data[BLOCK_SIZE];
+    for (size_t b = 0; b < DISK_BLOCKS; b++) {
+        debug("Check checksummed write block %lu", b);
+        memset(data, 'a' + b, BLOCK_SIZE);
+        assert(disk_write(disk, b, data) == BLOCK_SIZE);
+        assert(disk_read(disk, b, data) == BLOCK_SIZE);
+        assert(data[BLOCK_SIZE - 1] == 'a' + b);
+    }
+    assert(disk_verify(disk, 3) == 0);
+    disk_close(disk);
+
+    debug("Check corrupted block");
+    int fd = open(DISK_PATH, O_RDWR);
+    assert(fd >= 0);
+    assert(pwrite(fd, "X", 1, 2 * BLOCK_SIZE + 17) == 1);
+    close(fd);
+
+    disk = disk_open_with(DISK_PATH, DISK_BLOCKS, &options);
+    assert(disk);
+    assert(disk_read(disk, 1, data) == BLOCK_SIZE);
+    assert(disk_read(disk, 2, data) == DISK_FAILURE);
+    assert(disk->checksum_errors == 1);
+    assert(disk_verify(disk, 2) == 1);
+
+    debug("Check rewriting corrupted block");
+    memset(data, 'z', BLOCK_SIZE);
+    assert(disk_write(disk, 2, data) == BLOCK_SIZE);
+    assert(disk_read(disk, 2, data) == BLOCK_SIZE);
+    assert(disk_verify(disk, 8) == 0);
+    assert(disk_verify(disk, SIZE_MAX) == 0);
+
+    debug("Check verify without checksums");
+    disk_close(disk);
+    disk = disk_open(DISK_PATH, DISK_BLOCKS);
+    assert(disk);
+    assert(disk_verify(disk, 1) == -1);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_04_crc32c() {
+    debug("Check standard test vector");
+    assert(crc32c(0, "123456789", 9) == 0xe3069283);
+    assert(crc32c(0, "", 0) == 0);
+
+    debug("Check incremental computation");
+    char data[3 * BLOCK_SIZE + 5];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i * 131 + 7;
+    }
+    uint32_t whole = crc32c(0, data, sizeof(data));
+    uint32_t part  = crc32c(0, data, 1001);
+    assert(crc32c(part, data + 1001, sizeof(data) - 1001) == whole);
+
+    debug("Check against bitwise reference");
+    uint32_t crc = ~0U;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        crc ^= (unsigned char)data[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0x82f63b78 & -(crc & 1));
+        }
+    }
+    assert(~crc == whole);
+
+    return EXIT_SUCCESS;
+}
+
+int test_05_disk_copy() {
+    for (int checksums = 0; checksums < 2; checksums++) {
+        DiskOptions options = {.checksums = checksums};
+        Disk *disk = disk_open_with(DISK_PATH, DISK_BLOCKS, &options);
+        assert(disk);
+
+        int fd = open(COPY_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        assert(fd >= 0);
+
+        char data[BLOCK_SIZE];
+        for (size_t b = 0; b < 3; b++) {
+            memset(data, 'a' + b + checksums, BLOCK_SIZE);
+            assert(pwrite(fd, data, BLOCK_SIZE, b * BLOCK_SIZE) == BLOCK_SIZE);
+        }
+
+        debug("Check copying into disk (checksums %d)", checksums);
+        assert(disk_copy_in(disk, 1, 3, fd, 0) == 3);
+        assert(disk->writes == 3);
+        for (size_t b = 1; b < DISK_BLOCKS; b++) {
+            assert(disk_read(disk, b, data) == BLOCK_SIZE);
+            assert(data[0] == 'a' + (b - 1) + checksums && data[BLOCK_SIZE - 1] == data[0]);
+        }
+        assert(checksums == 0 || disk_verify(disk, 1) == 0);
+
+        debug("Check copying out of disk (checksums %d)", checksums);
+        assert(disk_copy_out(disk, 2, 2, fd, BLOCK_SIZE) == 2);
+        assert(pread(fd, data, BLOCK_SIZE, 2 * BLOCK_SIZE) == BLOCK_SIZE);
+        assert(data[0] == 'c' + checksums);
+
+        debug("Check invalid ranges (checksums %d)", checksums);
+        assert(disk_copy_in(disk, 2, 3, fd, 0) == DISK_FAILURE);
+        assert(disk_copy_out(disk, DISK_BLOCKS, 1, fd, 0) == DISK_FAILURE);
+        assert(disk_copy_in(disk, 0, 1, fd, 10 * BLOCK_SIZE) == DISK_FAILURE);
+
+        close(fd);
+        disk_close(disk);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int test_06_disk_trace() {
+    DiskOptions options = {.trace = TRACE_PATH};
+    Disk *disk = disk_open_with(DISK_PATH, DISK_BLOCKS, &options);
+    assert(disk);
+    assert(disk->trace);
+
+    char data[BLOCK_SIZE] = {0};
+    assert(disk_write(disk, 1, data) == BLOCK_SIZE);
+    assert(disk_read(disk, 1, data) == BLOCK_SIZE);
+    assert(disk_read(disk, DISK_BLOCKS, data) == DISK_FAILURE);
+    assert(disk_write(disk, 3, data) == BLOCK_SIZE);
+    disk_close(disk);
+
+    debug("Check trace header");
+    FILE *stream = fopen(TRACE_PATH, "r");
+    assert(stream);
+    TraceHeader header;
+    assert(trace_read_header(stream, &header));
+    assert(header.block_size == BLOCK_SIZE);
+    assert(header.blocks == DISK_BLOCKS);
+
+    debug("Check trace records");
+    uint8_t  operations[] = {TRACE_WRITE, TRACE_READ, TRACE_READ, TRACE_WRITE};
+    uint32_t blocks[]     = {1, 1, DISK_BLOCKS, 3};
+    uint8_t  status[]     = {0, 0, 1, 0};
+    uint64_t timestamp    = 0;
+    TraceRecord record;
+    for (size_t i = 0; i < 4; i++) {
+        assert(trace_read(stream, &record));
+        assert(record.operation == operations[i]);
+        assert(record.block == blocks[i]);
+        assert(record.status == status[i]);
+        assert(record.timestamp >= timestamp);
+        timestamp = record.timestamp;
+    }
+    assert(!trace_read(stream, &record));
+    fclose(stream);
+
+    debug("Check bad trace path");
+    options.trace = "/asdf/NOPE";
+    assert(disk_open_with(DISK_PATH, DISK_BLOCKS, &options) == NULL);
+
+    return EXIT_SUCCESS;
+}
+
+int test_07_disk_model() {
+    ModelOptions model;
+
+    debug("Check model_parse");
+    assert(model_parse("hdd", &model) && model.type == MODEL_HDD && model.parameter == 0 && !model.sleep);
+    assert(model_parse("ssd:4,sleep", &model) && model.type == MODEL_SSD && model.parameter == 4 && model.sleep);
+    assert(model_parse("constant:25", &model) && model.type == MODEL_CONSTANT_LATENCY && model.parameter == 25);
+    assert(model_parse("none", &model) && model.type == MODEL_NONE);
+    assert(!model_parse("tape", &model));
+    assert(!model_parse("hdd:7200,fast", &model));
+
+    char data[BLOCK_SIZE] = {0};
+
+    debug("Check constant model");
+    DiskOptions options = {.model = {.type = MODEL_CONSTANT_LATENCY, .parameter = 25}};
+    Disk *disk = disk_open_with(DISK_PATH, DISK_BLOCKS, &options);
+    assert(disk && disk->model);
+    for (size_t b = 0; b < DISK_BLOCKS; b++) {
+        assert(disk_write(disk, b, data) == BLOCK_SIZE);
+        assert(disk_read(disk, b, data) == BLOCK_SIZE);
+    }
+    assert(disk_read(disk, DISK_BLOCKS, data) == DISK_FAILURE);
+    assert(disk->simulated == 2 * DISK_BLOCKS * 25000);
+    assert(disk->stats.counters[STATS_DISK_READ].nanoseconds >= DISK_BLOCKS * 25000);
+    assert(disk->inflight == 0);
+    disk_close(disk);
+
+    debug("Check hdd model");
+    options.model = (ModelOptions){.type = MODEL_HDD};
+    disk = disk_open_with(DISK_PATH, 4096, &options);
+    assert(disk);
+    for (size_t b = 0; b < 64; b++) {
+        assert(disk_read(disk, b, data) == BLOCK_SIZE);
+    }
+    uint64_t sequential = disk->simulated;
+    for (size_t b = 0; b < 64; b++) {
+        assert(disk_read(disk, (b * 997) % 4096, data) == BLOCK_SIZE);
+    }
+    assert(disk->simulated - sequential > 10 * sequential);
+    disk_close(disk);
+
+    debug("Check ssd erase blocks");
+    options.model = (ModelOptions){.type = MODEL_SSD};
+    disk = disk_open_with(DISK_PATH, DISK_BLOCKS, &options);
+    assert(disk);
+    for (size_t i = 0; i < MODEL_SSD_ERASE_BLOCKS; i++) {
+        assert(disk_write(disk, i % DISK_BLOCKS, data) == BLOCK_SIZE);
+    }
+    assert(disk->simulated == MODEL_SSD_ERASE_BLOCKS * MODEL_SSD_WRITE);
+    assert(disk_write(disk, 0, data) == BLOCK_SIZE);
+    assert(disk->simulated == (MODEL_SSD_ERASE_BLOCKS + 1) * MODEL_SSD_WRITE + MODEL_SSD_ERASE);
+    disk_close(disk);
+
+    return EXIT_SUCCESS;
+}
+
+int test_08_disk_submit() {
+    for (int checksums = 0; checksums < 2; checksums++) {
+        DiskOptions options = {.checksums = checksums};
+        Disk *disk = disk_open_with(DISK_PATH, 64, &options);
+        assert(disk);
+
+        char        data[8][BLOCK_SIZE];
+        DiskRequest requests[8];
+
+        debug("Check batched writes (checksums %d)", checksums);
+        size_t blocks[] = {40, 3, 41, 2, 42, 1, 60, 43};
+        for (size_t i = 0; i < 8; i++) {
+            memset(data[i], 'a' + i, BLOCK_SIZE);
+            requests[i] = (DiskRequest){.block = blocks[i], .write = true, .data = data[i]};
+        }
+        assert(disk_submit(disk, requests, 8) == 8);
+        assert(disk->writes == 8);
+        for (size_t i = 0; i < 8; i++) {
+            assert(requests[i].result == BLOCK_SIZE);
+            char block[BLOCK_SIZE];
+            assert(disk_read(disk, blocks[i], block) == BLOCK_SIZE);
+            assert(block[0] == 'a' + (char)i && block[BLOCK_SIZE - 1] == block[0]);
+        }
+        assert(checksums == 0 || disk_verify(disk, 1) == 0);
+
+        debug("Check batched reads and same block ordering (checksums %d)", checksums);
+        memset(data[0], 'x', BLOCK_SIZE);
+        requests[0] = (DiskRequest){.block = 5,  .write = false, .data = data[1]};
+        requests[1] = (DiskRequest){.block = 5,  .write = true,  .data = data[0]};
+        requests[2] = (DiskRequest){.block = 5,  .write = false, .data = data[2]};
+        requests[3] = (DiskRequest){.block = 41, .write = false, .data = data[3]};
+        requests[4] = (DiskRequest){.block = 64, .write = false, .data = data[4]};
+        assert(disk_submit(disk, requests, 5) == 4);
+        assert(data[1][0] == 0);
+        assert(data[2][0] == 'x');
+        assert(data[3][0] == 'c');
+        assert(requests[4].result == DISK_FAILURE);
+
+        disk_close(disk);
+        test_cleanup();
+    }
+
+    debug("Check elevator ordering under the hdd model");
+    DiskOptions options = {.model = {.type = MODEL_HDD}};
+    char        data[BLOCK_SIZE] = {0};
+    DiskRequest requests[64];
+    uint64_t    simulated[2];
+    uint64_t    distance[2];
+    for (int batched = 0; batched < 2; batched++) {
+        Disk *disk = disk_open_with(DISK_PATH, 4096, &options);
+        assert(disk);
+        for (size_t i = 0; i < 64; i++) {
+            requests[i] = (DiskRequest){.block = (i * 997) % 4096, .data = data};
+        }
+        if (batched) {
+            assert(disk_submit(disk, requests, 64) == 64);
+        } else {
+            for (size_t i = 0; i < 64; i++) {
+                assert(disk_read(disk, requests[i].block, data) == BLOCK_SIZE);
+            }
+        }
+        simulated[batched] = disk->simulated;
+        distance[batched]  = disk->seek_distance;
+        disk_close(disk);
+    }
+    assert(distance[1] < 4096);
+    assert(distance[1] * 10 < distance[0]);
+    assert(simulated[1] < simulated[0]);
+
+    return EXIT_SUCCESS;
+}
+
+int test_09_disk_stripe() {
+    DiskOptions options = {.checksums = true, .stripe = 2};
+    Disk *disk = disk_open_list(DISK_PATH "," STRIPE_PATH, 10, &options);
+    assert(disk);
+    assert(disk->member_count == 2 && disk->stripe == 2 && disk->blocks == 10);
+    assert(disk->members[0]->blocks == 6 && disk->members[1]->blocks == 6);
+
+    debug("Check striped writes land on the right members");
+    char data[BLOCK_SIZE];
+    for (size_t b = 0; b < 10; b++) {
+        memset(data, 'a' + b, BLOCK_SIZE);
+        assert(disk_write(disk, b, data) == BLOCK_SIZE);
+    }
+    assert(disk_write(disk, 10, data) == DISK_FAILURE);
+    assert(disk->writes == 10);
+
+    for (size_t b = 0; b < 10; b++) {
+        size_t unit  = b / 2;
+        Disk  *member = disk->members[unit % 2];
+        assert(pread(member->fd, data, BLOCK_SIZE, (off_t)BLOCK_SIZE * ((unit / 2) * 2 + b % 2)) == BLOCK_SIZE);
+        assert(data[0] == 'a' + (char)b);
+    }
+
+    debug("Check batched reads across members");
+    char        blocks[11][BLOCK_SIZE];
+    DiskRequest requests[11];
+    for (size_t i = 0; i < 11; i++) {
+        requests[i] = (DiskRequest){.block = (i * 7) % 11, .write = false, .data = blocks[i]};
+    }
+    assert(disk_submit(disk, requests, 11) == 10);
+    for (size_t i = 0; i < 11; i++) {
+        if (requests[i].block == 10) {
+            assert(requests[i].result == DISK_FAILURE);
+        } else {
+            assert(requests[i].result == BLOCK_SIZE);
+            assert(blocks[i][0] == 'a' + (char)requests[i].block && blocks[i][BLOCK_SIZE - 1] == blocks[i][0]);
+        }
+    }
+    assert(disk->reads == 10);
+
+    debug("Check copying striped ranges");
+    int fd = open(COPY_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    assert(disk_copy_out(disk, 1, 8, fd, 0) == 8);
+    for (size_t b = 1; b < 9; b++) {
+        assert(pread(fd, data, BLOCK_SIZE, (off_t)BLOCK_SIZE * (b - 1)) == BLOCK_SIZE);
+        assert(data[0] == 'a' + (char)b);
+    }
+    assert(disk_copy_in(disk, 2, 8, fd, 0) == 8);
+    assert(disk_read(disk, 9, data) == BLOCK_SIZE && data[0] == 'i');
+    assert(disk_verify(disk, 2) == 0);
+    close(fd);
+
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_10_disk_mirror() {
+    DiskOptions options = {.checksums = true, .mirror = true};
+    Disk *disk = disk_open_list(DISK_PATH "," STRIPE_PATH, 8, &options);
+    assert(disk);
+    assert(disk->mirrored && disk->member_count == 2);
+    assert(disk->members[0]->blocks == 8 && disk->members[1]->blocks == 8);
+
+    debug("Check mirrored writes reach every replica");
+    char data[BLOCK_SIZE];
+    for (size_t b = 0; b < 8; b++) {
+        memset(data, 'a' + b, BLOCK_SIZE);
+        assert(disk_write(disk, b, data) == BLOCK_SIZE);
+    }
+    assert(disk->writes == 8);
+    assert(disk->members[0]->writes == 8 && disk->members[1]->writes == 8);
+
+    debug("Check reads are balanced across replicas");
+    for (size_t b = 0; b < 8; b++) {
+        assert(disk_read(disk, b, data) == BLOCK_SIZE && data[0] == 'a' + (char)b);
+    }
+    assert(disk->members[0]->reads == 4 && disk->members[1]->reads == 4);
+
+    char        blocks[8][BLOCK_SIZE];
+    DiskRequest requests[8];
+    for (size_t i = 0; i < 8; i++) {
+        requests[i] = (DiskRequest){.block = i, .data = blocks[i]};
+    }
+    assert(disk_submit(disk, requests, 8) == 8);
+    for (size_t i = 0; i < 8; i++) {
+        assert(blocks[i][0] == 'a' + (char)i);
+    }
+    assert(disk->members[0]->reads == 8 && disk->members[1]->reads == 8);
+
+    debug("Check failed reads are retried and repaired");
+    memset(data, 'z', BLOCK_SIZE);
+    assert(pwrite(disk->members[0]->fd, data, BLOCK_SIZE, 3 * BLOCK_SIZE) == BLOCK_SIZE);
+    assert(pwrite(disk->members[1]->fd, data, BLOCK_SIZE, 4 * BLOCK_SIZE) == BLOCK_SIZE);
+    assert(disk_submit(disk, requests, 8) == 8);
+    assert(blocks[3][0] == 'd' && blocks[4][0] == 'e');
+    for (size_t b = 0; b < 8; b++) {
+        assert(disk_read(disk, b, data) == BLOCK_SIZE && data[0] == 'a' + (char)b);
+    }
+    assert(disk_verify(disk, 1) == 0);
+
+    debug("Check stale replicas are skipped and resynced");
+    disk->members[1]->stale = true;
+    size_t reads = disk->members[1]->reads;
+    memset(data, 'y', BLOCK_SIZE);
+    assert(disk_write(disk, 6, data) == BLOCK_SIZE);
+    assert(disk_read(disk, 6, data) == BLOCK_SIZE && data[0] == 'y');
+    assert(disk->members[1]->reads == reads);
+    assert(disk_resync(disk, 0) == -1);
+    assert(disk_resync(disk, 1) == 1);
+    assert(!disk->members[1]->stale);
+    assert(disk_read(disk->members[1], 6, data) == BLOCK_SIZE && data[0] == 'y');
+    assert(disk_resync(disk, 1) == 0);
+
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_11_disk_track() {
+    debug("Check untracked images have no generations");
+    Disk *disk = disk_open(DISK_PATH, DISK_BLOCKS);
+    assert(disk && disk->generations == NULL);
+    assert(disk_checkpoint(disk) == DISK_FAILURE);
+    disk_close(disk);
+
+    debug("Check tracking starts with every block changed");
+    DiskOptions options = {.track = true};
+    disk = disk_open_with(DISK_PATH, DISK_BLOCKS, &options);
+    assert(disk && disk->generations);
+    assert(disk->generation == 1);
+    for (size_t b = 0; b < DISK_BLOCKS; b++) {
+        assert(disk->generations[b] == 1);
+    }
+    assert(disk_checkpoint(disk) == 1);
+    assert(disk->generation == 2);
+
+    debug("Check writes record the current generation");
+    char data[BLOCK_SIZE];
+    memset(data, 'g', BLOCK_SIZE);
+    assert(disk_write(disk, 2, data) == BLOCK_SIZE);
+    DiskRequest requests[2] = {{.block = 0, .write = true, .data = data}, {.block = 1, .write = true, .data = data}};
+    assert(disk_submit(disk, requests, 2) == 2);
+    assert(disk->generations[0] == 2 && disk->generations[1] == 2 && disk->generations[2] == 2);
+    assert(disk->generations[3] == 1);
+    assert(disk_checkpoint(disk) == 2);
+    assert(disk_discard(disk, 3, 1) == 1);
+    assert(disk->generations[3] == 3);
+    disk_close(disk);
+
+    debug("Check generations persist and tracking continues without the option");
+    disk = disk_open(DISK_PATH, DISK_BLOCKS);
+    assert(disk && disk->generations);
+    assert(disk->generation == 3);
+    assert(disk->generations[0] == 2 && disk->generations[3] == 3);
+    assert(disk_write(disk, 1, data) == BLOCK_SIZE);
+    assert(disk->generations[1] == 3);
+    disk_close(disk);
+
+    debug("Check resized images restart with every block changed");
+    disk = disk_open(DISK_PATH, DISK_BLOCKS * 2);
+    assert(disk && disk->generation == 4);
+    for (size_t b = 0; b < DISK_BLOCKS * 2; b++) {
+        assert(disk->generations[b] == 4);
+    }
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
 /* Main execution */
 
 int main(int argc, char *argv[]) {
@@ -115,6 +581,15 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "    0. Test disk_open\n");
         fprintf(stderr, "    1. Test disk_read\n");
         fprintf(stderr, "    2. Test disk_write\n");
+        fprintf(stderr, "    3. Test disk_checksums\n");
+        fprintf(stderr, "    4. Test crc32c\n");
+        fprintf(stderr, "    5. Test disk_copy\n");
+        fprintf(stderr, "    6. Test disk_trace\n");
+        fprintf(stderr, "    7. Test disk_model\n");
+        fprintf(stderr, "    8. Test disk_submit\n");
+        fprintf(stderr, "    9. Test disk_stripe\n");
+        fprintf(stderr, "    10. Test disk_mirror\n");
+        fprintf(stderr, "    11. Test disk_track\n");
         return EXIT_FAILURE;
     }
 
@@ -127,6 +602,15 @@ int main(int argc, char *argv[]) {
         case 0:  status = test_00_disk_open(); break;
         case 1:  status = test_01_disk_read(); break;
         case 2:  status = test_02_disk_write(); break;
+        case 3:  status = test_03_disk_checksums(); break;
+        case 4:  status = test_04_crc32c(); break;
+        case 5:  status = test_05_disk_copy(); break;
+        case 6:  status = test_06_disk_trace(); break;
+        case 7:  status = test_07_disk_model(); break;
+        case 8:  status = test_08_disk_submit(); break;
+        case 9:  status = test_09_disk_stripe(); break;
+        case 10: status = test_10_disk_mirror(); break;
+        case 11: status = test_11_disk_track(); break;
         default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
     }
 
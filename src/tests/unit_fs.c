@@ -4,15 +4,18 @@
 #include "sfs/logging.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
 
+#include <sys/stat.h>
 #include <unistd.h>
 
 /* Functions */
 
 void test_cleanup() {
     unlink("./../data/image.unit");
+    unlink("./../data/image.unit.crc");
 }
 
 int test_00_fs_mount() {
@@ -166,6 +169,1259 @@ int test_03_fs_stat() {
     return EXIT_SUCCESS;
 }
 
+int test_04_fs_truncate() {
+    assert(system("cp ./../data/image.20 ./../data/image.unit") == EXIT_SUCCESS);
+
+    Disk *disk = disk_open("./../data/image.unit", 20);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_mount(&fs, disk));
+
+    char original[27160];
+    assert(fs_read(&fs, 2, original, sizeof(original), 0) == sizeof(original));
+
+    debug("Check truncating invalid inode");
+    assert(fs_truncate(&fs, 0, 0) == false);
+
+    debug("Check shrinking inode 2");
+    assert(fs_truncate(&fs, 2, 5000));
+    assert(fs_stat(&fs, 2) == 5000);
+    assert(fs.free_blocks[4] == false);
+    assert(fs.free_blocks[5] == false);
+    assert(fs.free_blocks[6]);
+    assert(fs.free_blocks[7]);
+    assert(fs.free_blocks[8]);
+    assert(fs.free_blocks[9]);
+    assert(fs.free_blocks[13]);
+    assert(fs.free_blocks[14]);
+
+    Block block;
+    assert(disk_read(fs.disk, 1, block.data) != DISK_FAILURE);
+    assert(block.inodes[2].indirect == 0);
+    assert(block.inodes[2].direct[2] == 0);
+
+    char data[27160];
+    assert(fs_read(&fs, 2, data, sizeof(data), 0) == 5000);
+    assert(memcmp(data, original, 5000) == 0);
+
+    debug("Check extending inode 2");
+    assert(fs_truncate(&fs, 2, 10000));
+    assert(fs_stat(&fs, 2) == 10000);
+    assert(fs_read(&fs, 2, data, sizeof(data), 0) == 10000);
+    assert(memcmp(data, original, 5000) == 0);
+    for (size_t i = 5000; i < 10000; i++) {
+        assert(data[i] == 0);
+    }
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_05_fs_fallocate() {
+    assert(system("cp ./../data/image.200 ./../data/image.unit") == EXIT_SUCCESS);
+
+    Disk *disk = disk_open("./../data/image.unit", 200);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_mount(&fs, disk));
+
+    ssize_t inode_number = fs_create(&fs);
+    assert(inode_number >= 0);
+
+    debug("Check reserving more blocks than available");
+    assert(fs_fallocate(&fs, inode_number, 0, 1000 * BLOCK_SIZE) == false);
+    assert(fs_stat(&fs, inode_number) == 0);
+
+    debug("Check reserving a contiguous run");
+    assert(fs_fallocate(&fs, inode_number, 0, 20 * BLOCK_SIZE));
+    assert(fs_stat(&fs, inode_number) == 0);
+
+    Block block;
+    assert(disk_read(fs.disk, 1 + inode_number / INODES_PER_BLOCK, block.data) != DISK_FAILURE);
+    Inode *inode = &block.inodes[inode_number % INODES_PER_BLOCK];
+    for (size_t i = 1; i < POINTERS_PER_INODE; i++) {
+        assert(inode->direct[i] == inode->direct[0] + i);
+    }
+    assert(inode->indirect == inode->direct[0] + POINTERS_PER_INODE);
+
+    uint32_t first = inode->direct[0];
+    assert(disk_read(fs.disk, inode->indirect, block.data) != DISK_FAILURE);
+    for (size_t i = 0; i < 15; i++) {
+        assert(block.pointers[i] == first + POINTERS_PER_INODE + 1 + i);
+    }
+    assert(block.pointers[15] == 0);
+
+    debug("Check writing into reserved blocks");
+    char data[20 * BLOCK_SIZE];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i % 251;
+    }
+    assert(fs_write(&fs, inode_number, data, sizeof(data), 0) == sizeof(data));
+    assert(fs_stat(&fs, inode_number) == sizeof(data));
+
+    assert(disk_read(fs.disk, 1 + inode_number / INODES_PER_BLOCK, block.data) != DISK_FAILURE);
+    assert(block.inodes[inode_number % INODES_PER_BLOCK].direct[0] == first);
+
+    char copy[20 * BLOCK_SIZE];
+    assert(fs_read(&fs, inode_number, copy, sizeof(copy), 0) == sizeof(copy));
+    assert(memcmp(data, copy, sizeof(data)) == 0);
+
+    debug("Check removing reserved inode");
+    assert(fs_remove(&fs, inode_number));
+    for (size_t i = 0; i < 21; i++) {
+        assert(fs.free_blocks[first + i]);
+    }
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_06_fs_compression() {
+    Disk *disk = disk_open("./../data/image.unit", 200);
+    assert(disk);
+
+    FileSystem fs = {0};
+    FormatOptions options = {.compress = true};
+    assert(fs_format_with(&fs, disk, &options));
+    assert(fs_mount(&fs, disk));
+
+    debug("Check compressed inode");
+    ssize_t inode_number = fs_create(&fs);
+    assert(inode_number >= 0);
+
+    char data[40 * BLOCK_SIZE + 123];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = "2026-10-18 INFO request served\n"[i % 32];
+    }
+    assert(fs_write(&fs, inode_number, data, sizeof(data), 0) == sizeof(data));
+
+    Block block;
+    assert(disk_read(fs.disk, 1, block.data) != DISK_FAILURE);
+    assert(block.inodes[inode_number].flags & INODE_COMPRESSED);
+    assert(block.inodes[inode_number].direct[1] == 0);
+    assert(block.inodes[inode_number].direct[3] & COMPRESSED_MARK);
+
+    size_t used = 0;
+    for (size_t b = 0; b < fs.meta_data.blocks; b++) {
+        used += !fs.free_blocks[b];
+    }
+    assert(used < 1 + fs.meta_data.inode_blocks + 20);
+
+    debug("Check reading compressed inode");
+    char copy[sizeof(data)];
+    assert(fs_read(&fs, inode_number, copy, sizeof(copy), 0) == sizeof(copy));
+    assert(memcmp(data, copy, sizeof(data)) == 0);
+    assert(fs_read(&fs, inode_number, copy, 100, 3 * BLOCK_SIZE + 7) == 100);
+    assert(memcmp(data + 3 * BLOCK_SIZE + 7, copy, 100) == 0);
+
+    debug("Check overwriting compressed inode");
+    memset(data + 5000, 'x', 3000);
+    assert(fs_write(&fs, inode_number, data + 5000, 3000, 5000) == 3000);
+
+    debug("Check remounting compressed inode");
+    fs_unmount(&fs);
+    assert(fs_mount(&fs, disk));
+    assert(fs_read(&fs, inode_number, copy, sizeof(copy), 0) == sizeof(copy));
+    assert(memcmp(data, copy, sizeof(data)) == 0);
+
+    debug("Check truncating compressed inode");
+    assert(fs_truncate(&fs, inode_number, 10000));
+    assert(fs_truncate(&fs, inode_number, 30000));
+    assert(fs_read(&fs, inode_number, copy, sizeof(copy), 0) == 30000);
+    assert(memcmp(data, copy, 10000) == 0);
+    for (size_t i = 10000; i < 30000; i++) {
+        assert(copy[i] == 0);
+    }
+
+    debug("Check switching compression");
+    assert(fs_set_compression(&fs, inode_number, false) == false);
+    ssize_t plain = fs_create(&fs);
+    assert(plain >= 0);
+    assert(fs_set_compression(&fs, plain, false));
+    assert(fs_write(&fs, plain, data, 2 * BLOCK_SIZE, 0) == 2 * BLOCK_SIZE);
+    assert(disk_read(fs.disk, 1, block.data) != DISK_FAILURE);
+    assert(block.inodes[plain].flags == 0);
+    assert(block.inodes[plain].direct[1] != 0);
+
+    debug("Check removing compressed inode");
+    assert(fs_remove(&fs, inode_number));
+    assert(fs_remove(&fs, plain));
+    for (size_t b = 1 + fs.meta_data.inode_blocks; b < fs.meta_data.blocks; b++) {
+        assert(fs.free_blocks[b]);
+    }
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_07_fs_dedup() {
+    Disk *disk = disk_open("./../data/image.unit", 200);
+    assert(disk);
+
+    FileSystem fs = {0};
+    FormatOptions options = {.dedup = true};
+    assert(fs_format_with(&fs, disk, &options));
+    assert(fs_mount(&fs, disk));
+    assert(fs.meta_data.flags & FS_DEDUP);
+
+    debug("Check writing duplicate blocks");
+    char data[4 * BLOCK_SIZE];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = 'a' + (i / BLOCK_SIZE) % 2;
+    }
+
+    ssize_t first = fs_create(&fs);
+    ssize_t second = fs_create(&fs);
+    assert(first >= 0 && second >= 0);
+    assert(fs_write(&fs, first, data, sizeof(data), 0) == sizeof(data));
+    assert(fs_write(&fs, second, data, sizeof(data), 0) == sizeof(data));
+
+    DedupStats stats;
+    assert(fs_dedup_stats(&fs, &stats));
+    assert(stats.logical_blocks == 8);
+    assert(stats.physical_blocks == 2);
+    assert(stats.shared_blocks == 2);
+
+    debug("Check copy on write");
+    memset(data, 'z', 100);
+    assert(fs_write(&fs, first, data, 100, 0) == 100);
+
+    char copy[sizeof(data)];
+    assert(fs_read(&fs, first, copy, sizeof(copy), 0) == sizeof(copy));
+    assert(memcmp(data, copy, sizeof(data)) == 0);
+    assert(fs_read(&fs, second, copy, sizeof(copy), 0) == sizeof(copy));
+    assert(copy[0] == 'a' && copy[99] == 'a');
+    assert(fs_dedup_stats(&fs, &stats));
+    assert(stats.physical_blocks == 3);
+
+    debug("Check zero blocks");
+    char zero[BLOCK_SIZE] = {0};
+    assert(fs_write(&fs, second, zero, BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE);
+    assert(fs_dedup_stats(&fs, &stats));
+    assert(stats.logical_blocks == 7);
+
+    debug("Check remounting dedup index");
+    fs_unmount(&fs);
+    assert(fs_mount(&fs, disk));
+    ssize_t third = fs_create(&fs);
+    assert(third >= 0);
+    assert(fs_write(&fs, third, data, sizeof(data), 0) == sizeof(data));
+    assert(fs_dedup_stats(&fs, &stats));
+    assert(stats.physical_blocks == 3);
+    assert(stats.logical_blocks == 11);
+
+    debug("Check removing dedup inodes");
+    assert(fs_remove(&fs, first));
+    assert(fs_remove(&fs, second));
+    assert(fs_remove(&fs, third));
+    assert(fs_dedup_stats(&fs, &stats));
+    assert(stats.logical_blocks == 0 && stats.physical_blocks == 0);
+    for (size_t b = 1 + fs.meta_data.inode_blocks + fs.meta_data.dedup_blocks; b < fs.meta_data.blocks; b++) {
+        assert(fs.free_blocks[b]);
+    }
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_08_fs_copy() {
+    Disk *disk = disk_open("./../data/image.unit", 200);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_format(&fs, disk));
+    assert(fs_mount(&fs, disk));
+
+    char data[20 * BLOCK_SIZE + 321];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i * 7 + i / BLOCK_SIZE;
+    }
+
+    int fd = open("./../data/image.copy", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    assert(write(fd, data, sizeof(data)) == sizeof(data));
+
+    debug("Check copying host file into inode");
+    ssize_t inode_number = fs_create(&fs);
+    assert(inode_number >= 0);
+    assert(fs_write(&fs, inode_number, data, 20 * BLOCK_SIZE, 10 * BLOCK_SIZE) == 20 * BLOCK_SIZE);
+    assert(fs_copyin(&fs, inode_number, fd) == sizeof(data));
+    assert(fs_stat(&fs, inode_number) == sizeof(data));
+
+    char copy[sizeof(data)];
+    assert(fs_read(&fs, inode_number, copy, sizeof(copy), 0) == sizeof(copy));
+    assert(memcmp(data, copy, sizeof(data)) == 0);
+
+    debug("Check copying inode with holes to host file");
+    assert(fs_truncate(&fs, inode_number, 2 * BLOCK_SIZE));
+    assert(fs_truncate(&fs, inode_number, 6 * BLOCK_SIZE + 5));
+    assert(fs_write(&fs, inode_number, "tail", 4, 6 * BLOCK_SIZE));
+    assert(fs_copyout(&fs, inode_number, fd) == 6 * BLOCK_SIZE + 5);
+
+    assert(lseek(fd, 0, SEEK_END) == 6 * BLOCK_SIZE + 5);
+    assert(pread(fd, copy, 6 * BLOCK_SIZE + 5, 0) == 6 * BLOCK_SIZE + 5);
+    assert(memcmp(data, copy, 2 * BLOCK_SIZE) == 0);
+    for (size_t i = 2 * BLOCK_SIZE; i < 6 * BLOCK_SIZE; i++) {
+        assert(copy[i] == 0);
+    }
+    assert(memcmp(copy + 6 * BLOCK_SIZE, "tail", 5) == 0);
+
+    debug("Check copying compressed inode");
+    ssize_t packed = fs_create(&fs);
+    assert(packed >= 0);
+    assert(fs_set_compression(&fs, packed, true));
+    assert(lseek(fd, 0, SEEK_SET) == 0);
+    assert(fs_copyin(&fs, packed, fd) == 6 * BLOCK_SIZE + 5);
+    assert(fs_read(&fs, packed, copy, sizeof(copy), 0) == 6 * BLOCK_SIZE + 5);
+    assert(memcmp(copy + 6 * BLOCK_SIZE, "tail", 5) == 0);
+
+    close(fd);
+    unlink("./../data/image.copy");
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_09_fs_geometry() {
+    Disk *disk = disk_open("./../data/image.unit", 400);
+    assert(disk);
+
+    FileSystem    fs = {0};
+    FormatOptions options = {0};
+
+    debug("Check formatting with invalid geometry");
+    options.block_size = 6000;
+    assert(fs_format_with(&fs, disk, &options) == false);
+    options.block_size = 2 * FS_BLOCK_SIZE_MAX;
+    assert(fs_format_with(&fs, disk, &options) == false);
+    options.block_size = FS_BLOCK_SIZE_MAX;
+    options.inode_size = 48;
+    assert(fs_format_with(&fs, disk, &options) == false);
+    options.inode_size = 16;
+    assert(fs_format_with(&fs, disk, &options) == false);
+
+    debug("Check formatting with 64K blocks and 128 byte inodes");
+    options.inode_size = 128;
+    assert(fs_format_with(&fs, disk, &options));
+    assert(fs_mount(&fs, disk));
+    assert(fs.block_size == FS_BLOCK_SIZE_MAX && fs.sectors == FS_BLOCK_SIZE_MAX / BLOCK_SIZE);
+    assert(fs.meta_data.blocks == 400 / fs.sectors);
+    assert(fs.meta_data.inode_blocks == 0 && fs.meta_data.inodes == 0);
+    assert(fs.pointers_per_block == FS_BLOCK_SIZE_MAX / sizeof(uint32_t));
+
+    size_t size = 8 * FS_BLOCK_SIZE_MAX + 777;
+    char  *data = (char *)malloc(size);
+    char  *copy = (char *)malloc(size);
+    assert(data && copy);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = i * 13 + i / FS_BLOCK_SIZE_MAX;
+    }
+
+    debug("Check reading and writing through direct and indirect pointers");
+    ssize_t inode_number = fs_create(&fs);
+    ssize_t second       = fs_create(&fs);
+    assert(inode_number == 0 && second == 1);
+    assert(fs.meta_data.inode_blocks == 1);
+    assert(fs.meta_data.inodes == FS_BLOCK_SIZE_MAX / 128);
+    assert(fs_write(&fs, second, "second", 6, 0) == 6);
+    assert(fs_write(&fs, inode_number, data, size, 0) == (ssize_t)size);
+    assert(fs_stat(&fs, inode_number) == (ssize_t)size);
+
+    size_t reads = disk->reads;
+    assert(fs_read(&fs, inode_number, copy, size, 0) == (ssize_t)size);
+    assert(memcmp(data, copy, size) == 0);
+    assert(disk->reads > reads);
+    assert(fs_read(&fs, inode_number, copy, 100, 3 * FS_BLOCK_SIZE_MAX - 50) == 100);
+    assert(memcmp(data + 3 * FS_BLOCK_SIZE_MAX - 50, copy, 100) == 0);
+
+    debug("Check compressed files with large compression groups");
+    ssize_t packed = fs_create(&fs);
+    assert(packed >= 0 && fs_set_compression(&fs, packed, true));
+    memset(copy, 'z', size);
+    assert(fs_write(&fs, packed, copy, size, 0) == (ssize_t)size);
+    memset(copy, 0, size);
+    assert(fs_read(&fs, packed, copy, size, 0) == (ssize_t)size);
+    assert(copy[0] == 'z' && copy[size - 1] == 'z');
+
+    debug("Check remounting");
+    fs_unmount(&fs);
+    assert(fs_mount(&fs, disk));
+    assert(fs.block_size == FS_BLOCK_SIZE_MAX && fs.inode_size == 128);
+    assert(fs_read(&fs, inode_number, copy, size, 0) == (ssize_t)size);
+    assert(memcmp(data, copy, size) == 0);
+    assert(fs_read(&fs, second, copy, 6, 0) == 6 && memcmp(copy, "second", 6) == 0);
+    assert(fs.free_blocks[fs.meta_data.blocks - 1]);
+
+    debug("Check copying host file in and out");
+    int fd = open("./../data/image.copy", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    assert(fs_copyout(&fs, inode_number, fd) == (ssize_t)size);
+    assert(fs_remove(&fs, inode_number));
+    inode_number = fs_create(&fs);
+    assert(inode_number == 0);
+    assert(fs_copyin(&fs, inode_number, fd) == (ssize_t)size);
+    assert(fs_read(&fs, inode_number, copy, size, 0) == (ssize_t)size);
+    assert(memcmp(data, copy, size) == 0);
+    close(fd);
+    unlink("./../data/image.copy");
+    fs_unmount(&fs);
+
+    debug("Check deduplication with 16K blocks");
+    options = (FormatOptions){.dedup = true, .block_size = 4 * BLOCK_SIZE};
+    assert(fs_format_with(&fs, disk, &options));
+    assert(fs_mount(&fs, disk));
+    inode_number = fs_create(&fs);
+    memset(copy, 'd', 2 * fs.block_size);
+    assert(fs_write(&fs, inode_number, copy, 2 * fs.block_size, 0) == (ssize_t)(2 * fs.block_size));
+
+    DedupStats stats;
+    assert(fs_dedup_stats(&fs, &stats));
+    assert(stats.logical_blocks == 2 && stats.physical_blocks == 1);
+
+    free(data);
+    free(copy);
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_10_fs_large() {
+    Disk *disk = disk_open("./../data/image.unit", 3000);
+    assert(disk);
+
+    FileSystem    fs = {0};
+    FormatOptions options = {.large = true, .inode_size = 32};
+
+    debug("Check formatting large file systems");
+    assert(fs_format_with(&fs, disk, &options) == false);
+    options.inode_size = 0;
+    Disk huge = {.blocks = COMPRESSED_MARK};
+    assert(fs_format_with(&fs, &huge, &options) == false);
+    assert(fs_format_with(&fs, disk, &options));
+    assert(fs_mount(&fs, disk));
+    assert((fs.meta_data.flags & FS_LARGE) && fs.inode_size == FS_LARGE_INODE_SIZE);
+
+    char data[BLOCK_SIZE];
+    char copy[BLOCK_SIZE];
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        data[i] = i * 7 + 1;
+    }
+
+    debug("Check writing through double and triple indirect blocks");
+    size_t  pointers = BLOCK_SIZE / sizeof(uint32_t);
+    size_t  middle   = (POINTERS_PER_INODE + pointers + 10) * BLOCK_SIZE + 100;
+    size_t  far      = 5ull << 30;
+    ssize_t inode_number = fs_create(&fs);
+    assert(inode_number == 0);
+
+    size_t free_blocks = 0;
+    for (size_t block = 0; block < fs.meta_data.blocks; block++) {
+        free_blocks += fs.free_blocks[block];
+    }
+    assert(fs_write(&fs, inode_number, data, BLOCK_SIZE, middle) == BLOCK_SIZE);
+    assert(fs_write(&fs, inode_number, data, BLOCK_SIZE, far) == BLOCK_SIZE);
+    assert(fs_stat(&fs, inode_number) == (ssize_t)(far + BLOCK_SIZE));
+    assert((size_t)fs_stat(&fs, inode_number) > UINT32_MAX);
+
+    assert(fs_read(&fs, inode_number, copy, BLOCK_SIZE, far) == BLOCK_SIZE);
+    assert(memcmp(data, copy, BLOCK_SIZE) == 0);
+    assert(fs_read(&fs, inode_number, copy, BLOCK_SIZE, middle) == BLOCK_SIZE);
+    assert(memcmp(data, copy, BLOCK_SIZE) == 0);
+    assert(fs_read(&fs, inode_number, copy, BLOCK_SIZE, far - BLOCK_SIZE) == BLOCK_SIZE);
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        assert(copy[i] == 0);
+    }
+
+    debug("Check remounting large files");
+    fs_unmount(&fs);
+    assert(fs_mount(&fs, disk));
+    assert(fs_stat(&fs, inode_number) == (ssize_t)(far + BLOCK_SIZE));
+    assert(fs_read(&fs, inode_number, copy, BLOCK_SIZE, far) == BLOCK_SIZE);
+    assert(memcmp(data, copy, BLOCK_SIZE) == 0);
+
+    debug("Check truncating large files");
+    assert(fs_truncate(&fs, inode_number, middle + BLOCK_SIZE));
+    assert(fs_read(&fs, inode_number, copy, BLOCK_SIZE, middle) == BLOCK_SIZE);
+    assert(memcmp(data, copy, BLOCK_SIZE) == 0);
+    assert(fs_remove(&fs, inode_number));
+
+    size_t remaining = 0;
+    for (size_t block = 0; block < fs.meta_data.blocks; block++) {
+        remaining += fs.free_blocks[block];
+    }
+    assert(remaining == free_blocks);
+    fs_unmount(&fs);
+
+    debug("Check mounting rejects bad superblocks");
+    Block block;
+    assert(disk_read(disk, 0, block.data) == BLOCK_SIZE);
+    block.super.flags |= 1 << 7;
+    assert(disk_write(disk, 0, block.data) == BLOCK_SIZE);
+    assert(fs_mount(&fs, disk) == false);
+    block.super.flags &= ~(1 << 7);
+    block.super.inodes = block.super.inode_blocks * INODES_PER_BLOCK + 1;
+    assert(disk_write(disk, 0, block.data) == BLOCK_SIZE);
+    assert(fs_mount(&fs, disk) == false);
+    block.super.magic_number = 0;
+    assert(disk_write(disk, 0, block.data) == BLOCK_SIZE);
+    assert(fs_mount(&fs, disk) == false);
+
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_11_fs_groups() {
+    Disk *disk = disk_open("./../data/image.unit", 2000);
+    assert(disk);
+
+    FileSystem    fs = {0};
+    FormatOptions options = {.group_blocks = 256, .fixed_inodes = true};
+
+    debug("Check formatting with allocation groups");
+    assert(fs_format_with(&fs, disk, &options));
+    assert(fs_mount(&fs, disk));
+    assert(fs.meta_data.flags & FS_GROUPS);
+    assert(fs.meta_data.group_blocks == 256 && fs.meta_data.group_inode_blocks == 2);
+    assert(fs.group_count == 8 && fs.meta_data.inode_blocks == 16);
+    assert(fs.free_blocks[257] == false && fs.free_blocks[258] == false && fs.free_blocks[259]);
+    assert(fs.groups[7].end == fs.meta_data.blocks);
+
+    size_t free_blocks = 0;
+    for (size_t g = 0; g < fs.group_count; g++) {
+        free_blocks += fs.groups[g].free;
+    }
+    assert(free_blocks == fs.meta_data.blocks - 1 - fs.meta_data.inode_blocks);
+
+    debug("Check files are placed in the group of their inode");
+    char data[8 * BLOCK_SIZE];
+    memset(data, 'g', sizeof(data));
+    for (size_t i = 0; i <= 300; i++) {
+        assert(fs_create(&fs) == (ssize_t)i);
+    }
+    assert(fs_write(&fs, 300, data, sizeof(data), 0) == sizeof(data));
+    assert(fs_write(&fs, 0, data, BLOCK_SIZE, 0) == BLOCK_SIZE);
+    assert(fs.groups[1].free == 256 - 2 - 9);
+    assert(fs.groups[0].free == 256 - 2 - 1);
+
+    Block block;
+    assert(disk_read(disk, 257, block.data) == BLOCK_SIZE);
+    Inode *inode = &block.inodes[300 % INODES_PER_BLOCK];
+    assert(inode->valid && inode->direct[0] >= 259 && inode->direct[0] < 513);
+    assert(inode->indirect >= 259 && inode->indirect < 513);
+
+    debug("Check full groups spill into the next group");
+    assert(fs_write(&fs, 300, data, sizeof(data), 1000 * BLOCK_SIZE) == sizeof(data));
+    for (size_t offset = sizeof(data); offset < 1000 * BLOCK_SIZE; offset += sizeof(data)) {
+        if (fs.groups[1].free == 0) {
+            break;
+        }
+        assert(fs_write(&fs, 300, data, sizeof(data), offset) == sizeof(data));
+    }
+    assert(fs.groups[1].free == 0);
+    assert(fs_write(&fs, 0, data, sizeof(data), BLOCK_SIZE) == sizeof(data));
+    assert(fs_write(&fs, 300, data, sizeof(data), 1016 * BLOCK_SIZE) == sizeof(data));
+    assert(fs.groups[2].free < 256 - 2);
+
+    debug("Check remounting rebuilds the group counters");
+    size_t counters[8];
+    for (size_t g = 0; g < fs.group_count; g++) {
+        counters[g] = fs.groups[g].free;
+    }
+    fs_unmount(&fs);
+    assert(fs_mount(&fs, disk));
+    for (size_t g = 0; g < fs.group_count; g++) {
+        assert(fs.groups[g].free == counters[g]);
+    }
+
+    debug("Check removing files returns blocks to their groups");
+    assert(fs_remove(&fs, 300));
+    assert(fs_remove(&fs, 0));
+    size_t remaining = 0;
+    for (size_t g = 0; g < fs.group_count; g++) {
+        remaining += fs.groups[g].free;
+    }
+    assert(remaining == free_blocks);
+    fs_unmount(&fs);
+
+    debug("Check mounting rejects inconsistent groups");
+    assert(disk_read(disk, 0, block.data) == BLOCK_SIZE);
+    block.super.group_inode_blocks = 3;
+    assert(disk_write(disk, 0, block.data) == BLOCK_SIZE);
+    assert(fs_mount(&fs, disk) == false);
+
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_12_fs_inode_map() {
+    Disk *disk = disk_open("./../data/image.unit", 2000);
+    assert(disk);
+
+    FileSystem    fs = {0};
+    FormatOptions options = {.group_blocks = 256};
+
+    debug("Check formatting without an inode table");
+    assert(fs_format_with(&fs, disk, &options));
+    assert(fs_mount(&fs, disk));
+    assert(fs.meta_data.flags & FS_INODE_MAP);
+    assert(fs.meta_data.inode_blocks == 0 && fs.meta_data.inodes == 0 && fs.meta_data.inode_chunks == 0);
+    assert(fs.meta_data.chunk_blocks == 1 && fs.group_count == 8);
+    assert(fs.groups[0].free == 256 && fs.free_blocks[1]);
+
+    debug("Check growing the inode table on demand");
+    for (size_t i = 0; i < INODES_PER_BLOCK; i++) {
+        assert(fs_create(&fs) == (ssize_t)i);
+    }
+    assert(fs.meta_data.inode_chunks == 1 && fs.meta_data.inodes == INODES_PER_BLOCK);
+    assert(fs.meta_data.inode_map[0] == 1 && fs.free_blocks[1] == false);
+    assert(fs_create(&fs) == INODES_PER_BLOCK);
+    assert(fs.meta_data.inode_chunks == 2 && fs.meta_data.inode_blocks == 2);
+    assert(fs.meta_data.inode_map[1] == 257);
+    assert(fs.groups[0].free == 255 && fs.groups[1].free == 255);
+
+    debug("Check files are placed in the group of their inode chunk");
+    char data[BLOCK_SIZE];
+    memset(data, 'm', sizeof(data));
+    assert(fs_write(&fs, INODES_PER_BLOCK, data, sizeof(data), 0) == sizeof(data));
+    Block block;
+    assert(disk_read(disk, 257, block.data) == BLOCK_SIZE);
+    assert(block.inodes[0].valid && block.inodes[0].direct[0] > 257 && block.inodes[0].direct[0] < 513);
+
+    debug("Check mounting only reads the inode chunks in use");
+    fs_unmount(&fs);
+    size_t reads = disk->reads;
+    assert(fs_mount(&fs, disk));
+    assert(disk->reads - reads == 1 + 2);
+    assert(fs.meta_data.inode_chunks == 2 && fs.free_blocks[1] == false && fs.free_blocks[257] == false);
+    assert(fs.groups[1].free == 254);
+    assert(fs_stat(&fs, INODES_PER_BLOCK) == BLOCK_SIZE);
+    assert(fs_read(&fs, INODES_PER_BLOCK, data, sizeof(data), 0) == sizeof(data) && data[0] == 'm');
+    fs_unmount(&fs);
+
+    debug("Check mounting rejects bad inode maps");
+    assert(disk_read(disk, 0, block.data) == BLOCK_SIZE);
+    block.super.inode_map[1] = fs.meta_data.blocks;
+    assert(disk_write(disk, 0, block.data) == BLOCK_SIZE);
+    assert(fs_mount(&fs, disk) == false);
+    block.super.inode_map[1] = 257;
+    block.super.inode_blocks = 3;
+    assert(disk_write(disk, 0, block.data) == BLOCK_SIZE);
+    assert(fs_mount(&fs, disk) == false);
+
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_13_fs_view() {
+    Disk *disk = disk_open("./../data/image.unit", 400);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_format(&fs, disk));
+    assert(fs_mount(&fs, disk));
+
+    size_t size = 70 * BLOCK_SIZE + 100;
+    char  *data = (char *)malloc(size);
+    char  *copy = (char *)malloc(size);
+    assert(data && copy);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = i * 11 + i / BLOCK_SIZE;
+    }
+
+    ssize_t inode_number = fs_create(&fs);
+    assert(inode_number >= 0);
+    assert(fs_write(&fs, inode_number, data, size, 0) == (ssize_t)size);
+
+    debug("Check reading views of a file range");
+    FsView view;
+    assert(fs_read_view(&fs, inode_number, &view, 10 * BLOCK_SIZE, 100) == 10 * BLOCK_SIZE);
+    assert(view.count == 11 && view.length == 10 * BLOCK_SIZE);
+    assert(view.iov[0].iov_len == BLOCK_SIZE - 100 && view.iov[10].iov_len == 100);
+    size_t offset = 100;
+    for (size_t i = 0; i < view.count; i++) {
+        assert(memcmp(view.iov[i].iov_base, data + offset, view.iov[i].iov_len) == 0);
+        offset += view.iov[i].iov_len;
+    }
+
+    debug("Check views share pinned pages (only the inode is read)");
+    FsView shared;
+    size_t reads = disk->reads;
+    assert(fs_read_view(&fs, inode_number, &shared, BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE);
+    assert(disk->reads == reads + 1);
+    assert(shared.iov[0].iov_base == view.iov[1].iov_base && shared.pages[0]->refs == 2);
+    fs_release_view(&fs, &shared);
+    assert(view.pages[1]->refs == 1 && shared.count == 0);
+
+    debug("Check views are snapshots of the file");
+    assert(fs_write(&fs, inode_number, "changed", 7, BLOCK_SIZE) == 7);
+    assert(memcmp(view.iov[1].iov_base, data + BLOCK_SIZE, BLOCK_SIZE) == 0);
+    assert(fs_read_view(&fs, inode_number, &shared, 7, BLOCK_SIZE) == 7);
+    assert(shared.iov[0].iov_base != view.iov[1].iov_base && memcmp(shared.iov[0].iov_base, "changed", 7) == 0);
+    fs_release_view(&fs, &shared);
+    fs_release_view(&fs, &view);
+
+    debug("Check views are limited by the pages available");
+    assert(fs_read_view(&fs, inode_number, &view, size, 0) == FS_VIEW_PAGES * BLOCK_SIZE);
+    assert(view.count == FS_VIEW_PAGES);
+    assert(fs_read_view(&fs, inode_number, &shared, 100, size - 100) == -1);
+    fs_release_view(&fs, &view);
+    assert(fs_read_view(&fs, inode_number, &shared, 1000, size - 100) == 100);
+    assert(memcmp(shared.iov[0].iov_base, data + size - 100, 100) == 0);
+    fs_release_view(&fs, &shared);
+    assert(fs_read_view(&fs, inode_number, &shared, 100, size) == 0 && shared.count == 0);
+
+    debug("Check views of compressed files");
+    ssize_t packed = fs_create(&fs);
+    assert(packed >= 0 && fs_set_compression(&fs, packed, true));
+    memset(copy, 'p', 3 * BLOCK_SIZE);
+    assert(fs_write(&fs, packed, copy, 3 * BLOCK_SIZE, 0) == 3 * BLOCK_SIZE);
+    assert(fs_read_view(&fs, packed, &view, 2 * BLOCK_SIZE, BLOCK_SIZE / 2) == 2 * BLOCK_SIZE);
+    for (size_t i = 0; i < view.count; i++) {
+        assert(memcmp(view.iov[i].iov_base, copy, view.iov[i].iov_len) == 0);
+    }
+    fs_release_view(&fs, &view);
+
+    free(data);
+    free(copy);
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+void test_async_callback(FsRequest *request) {
+    size_t *completed = (size_t *)request->context;
+    (*completed)++;
+}
+
+void test_async_free(FsRequest *request) {
+    size_t *completed = (size_t *)request->context;
+    (*completed)++;
+    free(request);
+}
+
+int test_14_fs_async() {
+    Disk *disk = disk_open("./../data/image.unit", 400);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_format(&fs, disk));
+    assert(fs_mount(&fs, disk));
+
+    enum { FILES = 16, LENGTH = 3 * BLOCK_SIZE + 500 };
+    static char data[FILES][LENGTH];
+    static char copy[FILES][LENGTH];
+    for (size_t f = 0; f < FILES; f++) {
+        memset(data[f], 'a' + f, LENGTH);
+        assert(fs_create(&fs) == (ssize_t)f);
+        assert(fs_write(&fs, f, data[f], LENGTH, 0) == LENGTH);
+    }
+
+    debug("Check reading many files asynchronously");
+    FsRequest requests[FILES + 2];
+    memset(requests, 0, sizeof(requests));
+    for (size_t f = 0; f < FILES; f++) {
+        requests[f] = (FsRequest){.inode_number = f, .data = copy[f], .length = LENGTH, .offset = f};
+        assert(fs_read_async(&fs, &requests[f]));
+    }
+    requests[FILES]     = (FsRequest){.inode_number = 0, .data = copy[0], .length = 10, .offset = LENGTH};
+    requests[FILES + 1] = (FsRequest){.inode_number = 300, .data = copy[0], .length = 10};
+    assert(fs_read_async(&fs, &requests[FILES]));
+    assert(fs_read_async(&fs, &requests[FILES + 1]));
+
+    size_t    reaped = 0;
+    FsRequest *request;
+    while ((request = fs_async_reap(&fs, true)) != NULL) {
+        size_t f = request - requests;
+        if (f < FILES) {
+            assert(request->result == (ssize_t)(LENGTH - f));
+            assert(memcmp(copy[f], data[f], LENGTH - f) == 0);
+        } else {
+            assert(request->result == (f == FILES ? 0 : -1));
+        }
+        reaped++;
+    }
+    assert(reaped == FILES + 2);
+    assert(fs_async_reap(&fs, false) == NULL);
+
+    debug("Check asynchronous writes complete in order with callbacks");
+    size_t completed = 0;
+    memset(data[1], 'W', LENGTH);
+    requests[0] = (FsRequest){.inode_number = 1, .data = data[1], .length = LENGTH, .offset = 0,
+                              .callback = test_async_callback, .context = &completed};
+    requests[1] = (FsRequest){.inode_number = 1, .data = copy[1], .length = LENGTH, .offset = 0,
+                              .callback = test_async_callback, .context = &completed};
+    assert(fs_write_async(&fs, &requests[0]));
+    assert(fs_read_async(&fs, &requests[1]));
+    assert(fs_async_reap(&fs, true) == NULL);
+    assert(completed == 2);
+    assert(requests[0].result == LENGTH && requests[1].result == LENGTH);
+    assert(memcmp(copy[1], data[1], LENGTH) == 0);
+
+    Stats stats;
+    fs_stats(&fs, &stats);
+    assert(stats.counters[STATS_FS_READ_ASYNC].calls == FILES + 3);
+    assert(stats.counters[STATS_FS_WRITE_ASYNC].calls == 1);
+
+    debug("Check callbacks may free their requests");
+    completed = 0;
+    for (size_t f = 0; f < FILES; f++) {
+        FsRequest *owned = malloc(sizeof(FsRequest));
+        assert(owned);
+        *owned = (FsRequest){.inode_number = f, .data = copy[f], .length = LENGTH,
+                             .callback = test_async_free, .context = &completed};
+        assert(fs_read_async(&fs, owned));
+    }
+    assert(fs_async_reap(&fs, true) == NULL);
+    assert(completed == FILES);
+
+    debug("Check unmounting finishes queued requests");
+    completed = 0;
+    for (size_t f = 0; f < FILES; f++) {
+        requests[f] = (FsRequest){.inode_number = f, .data = copy[f], .length = LENGTH,
+                                  .callback = test_async_callback, .context = &completed};
+        assert(fs_read_async(&fs, &requests[f]));
+    }
+    fs_unmount(&fs);
+    assert(completed == FILES && fs.engine == NULL);
+    assert(memcmp(copy[FILES - 1], data[FILES - 1], LENGTH) == 0);
+
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_15_fs_batch() {
+    Disk *disk = disk_open("./../data/image.unit", 2000);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_format(&fs, disk));
+    assert(fs_mount(&fs, disk));
+
+    size_t free_blocks = 0;
+    for (size_t block = 0; block < fs.meta_data.blocks; block++) {
+        free_blocks += fs.free_blocks[block];
+    }
+
+    debug("Check creating inodes in batches");
+    size_t inodes[400];
+    size_t writes = disk->writes;
+    assert(fs_create_many(&fs, inodes, 300) == 300);
+    for (size_t i = 0; i < 300; i++) {
+        assert(inodes[i] == i);
+    }
+    assert(disk->writes - writes == 3 * 3);
+    assert(fs_create(&fs) == 300);
+
+    debug("Check removing inodes in batches");
+    char data[2 * BLOCK_SIZE] = {0};
+    for (size_t i = 0; i < 10; i++) {
+        assert(fs_write(&fs, i * 20, data, sizeof(data), 6 * BLOCK_SIZE) == sizeof(data));
+    }
+    for (size_t i = 0; i < 301; i++) {
+        inodes[i] = 300 - i;
+    }
+    inodes[301] = 7;
+    inodes[302] = 5000;
+    writes = disk->writes;
+    assert(fs_remove_many(&fs, inodes, 303) == 301);
+    assert(disk->writes - writes == 3);
+    assert(fs_stat(&fs, 0) < 0 && fs_stat(&fs, 300) < 0);
+
+    size_t remaining = 0;
+    for (size_t block = 0; block < fs.meta_data.blocks; block++) {
+        remaining += fs.free_blocks[block];
+    }
+    assert(remaining == free_blocks - 3);
+    assert(fs_remove_many(&fs, inodes, 303) == 0);
+
+    debug("Check batches reuse removed inodes");
+    assert(fs_create_many(&fs, inodes, 400) == 400);
+    assert(inodes[0] == 0 && inodes[399] == 399 && fs.meta_data.inode_chunks == 4);
+
+    debug("Check inodes that fail to free are left unchanged");
+    char block[7 * BLOCK_SIZE] = {1};
+    assert(fs_write(&fs, 1, block, sizeof(block), 0) == sizeof(block));
+    assert(fs_write(&fs, 2, block, BLOCK_SIZE, 0) == BLOCK_SIZE);
+    fs_unmount(&fs);
+
+    Block table;
+    assert(fs.inode_size == sizeof(Inode));
+    assert(disk_read(disk, fs.meta_data.inode_map[0], table.data) == BLOCK_SIZE);
+    Inode broken = table.inodes[1];
+    table.inodes[1].indirect = 5000;
+    assert(disk_write(disk, fs.meta_data.inode_map[0], table.data) == BLOCK_SIZE);
+    assert(fs_mount(&fs, disk));
+    assert(fs_remove_many(&fs, (size_t[]){1, 2}, 2) == 1);
+    for (size_t i = 0; i < POINTERS_PER_INODE; i++) {
+        assert(!fs.free_blocks[broken.direct[i]]);
+    }
+    assert(!fs_remove(&fs, 1) && !fs.free_blocks[broken.direct[0]]);
+    fs_unmount(&fs);
+
+    assert(disk_read(disk, fs.meta_data.inode_map[0], table.data) == BLOCK_SIZE);
+    assert(table.inodes[1].valid && table.inodes[1].direct[0] == broken.direct[0]);
+    assert(!table.inodes[2].valid);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_16_fs_discard() {
+    DiskOptions options = {.checksums = true, .discard = true};
+    Disk *disk = disk_open_with("./../data/image.unit", 2000, &options);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_format(&fs, disk));
+    assert(fs_mount(&fs, disk));
+    assert(fs.discards.blocks);
+
+    size_t free_blocks = 0;
+    for (size_t block = 0; block < fs.meta_data.blocks; block++) {
+        free_blocks += fs.free_blocks[block];
+    }
+
+    debug("Check removing a file punches holes for its blocks");
+    char data[64 * BLOCK_SIZE];
+    memset(data, 'x', sizeof(data));
+    ssize_t inode = fs_create(&fs);
+    assert(inode == 0);
+    size_t first = 0;
+    while (!fs.free_blocks[first]) {
+        first++;
+    }
+    assert(fs_write(&fs, inode, data, sizeof(data), 0) == sizeof(data));
+    assert(!fs.free_blocks[first]);
+
+    struct stat st;
+    assert(stat("./../data/image.unit", &st) == 0);
+    blkcnt_t allocated = st.st_blocks;
+
+    assert(fs_remove(&fs, inode));
+    assert(fs.discards.count == 0);
+    assert(disk->discards == 64 + 1);
+    assert(stat("./../data/image.unit", &st) == 0);
+    assert(st.st_blocks <= allocated - 64 * BLOCK_SIZE / 512);
+
+    size_t remaining = 0;
+    for (size_t block = 0; block < fs.meta_data.blocks; block++) {
+        remaining += fs.free_blocks[block];
+    }
+    assert(remaining == free_blocks - 1);
+
+    debug("Check discarded blocks read back as zeros");
+    char block[BLOCK_SIZE];
+    assert(disk_read(disk, first, block) == BLOCK_SIZE);
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        assert(block[i] == 0);
+    }
+    assert(disk_verify(disk, 2) == 0);
+
+    debug("Check truncating punches holes for the freed tail");
+    inode = fs_create(&fs);
+    assert(fs_write(&fs, inode, data, sizeof(data), 0) == sizeof(data));
+    size_t discards = disk->discards;
+    assert(fs_truncate(&fs, inode, 16 * BLOCK_SIZE));
+    assert(disk->discards - discards == 64 - 16);
+    assert(fs_read(&fs, inode, block, BLOCK_SIZE, 15 * BLOCK_SIZE) == BLOCK_SIZE && block[0] == 'x');
+    assert(fs_remove(&fs, inode));
+
+    fs_unmount(&fs);
+    disk_close(disk);
+
+    debug("Check trimming free blocks of an existing image");
+    disk = disk_open("./../data/image.unit", 2000);
+    assert(disk && !disk->discard);
+    assert(fs_mount(&fs, disk));
+    assert(fs.discards.blocks == NULL);
+
+    inode = fs_create(&fs);
+    assert(fs_write(&fs, inode, data, sizeof(data), 0) == sizeof(data));
+    assert(fs_remove(&fs, inode));
+    assert(disk->discards == 0);
+    assert(stat("./../data/image.unit", &st) == 0);
+    allocated = st.st_blocks;
+
+    ssize_t trimmed = fs_trim(&fs);
+    assert(trimmed == (ssize_t)free_blocks - 1);
+    assert(disk->discards == (size_t)trimmed);
+    assert(stat("./../data/image.unit", &st) == 0);
+    assert(st.st_blocks <= allocated - 64 * BLOCK_SIZE / 512);
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+size_t count_free(FileSystem *fs, size_t *largest) {
+    size_t free_blocks = 0;
+    *largest = 0;
+    for (size_t g = 0; g < fs->group_count; g++) {
+        size_t run = 0;
+        for (size_t block = fs->groups[g].data; block < fs->groups[g].end; block++) {
+            run = fs->free_blocks[block] ? run + 1 : 0;
+            free_blocks += fs->free_blocks[block];
+            *largest = run > *largest ? run : *largest;
+        }
+    }
+    return free_blocks;
+}
+
+int test_17_fs_statfs() {
+    Disk *disk = disk_open("./../data/image.unit", 2000);
+    assert(disk);
+
+    FormatOptions options = {.group_blocks = 500};
+    FileSystem fs = {0};
+    SpaceStats stats;
+    size_t largest;
+    assert(!fs_statfs(&fs, &stats));
+    assert(fs_format_with(&fs, disk, &options));
+    assert(fs_mount(&fs, disk));
+
+    debug("Check counts of a fresh file system");
+    assert(fs_statfs(&fs, &stats));
+    assert(stats.block_size == BLOCK_SIZE && stats.total_blocks == 2000);
+    assert(stats.free_blocks == count_free(&fs, &largest) && stats.data_blocks == stats.free_blocks);
+    assert(stats.largest_extent == largest);
+    assert(stats.total_inodes == 0 && stats.free_inodes == 0);
+
+    debug("Check counts follow creates, writes and removes");
+    size_t inodes[200];
+    assert(fs_create_many(&fs, inodes, 200) == 200);
+    char data[8 * BLOCK_SIZE] = {0};
+    data[0] = 1;
+    for (size_t i = 0; i < 20; i++) {
+        assert(fs_write(&fs, inodes[i * 10], data, sizeof(data), 0) == sizeof(data));
+    }
+    assert(fs_remove(&fs, inodes[50]));
+    assert(fs_remove_many(&fs, inodes + 100, 20) == 20);
+    assert(fs_truncate(&fs, inodes[0], BLOCK_SIZE));
+    assert(fs_statfs(&fs, &stats));
+    assert(stats.total_inodes == 256 && stats.free_inodes == 256 - 200 + 21);
+    assert(stats.free_blocks == count_free(&fs, &largest));
+    assert(stats.largest_extent == largest);
+    assert(stats.data_blocks - stats.free_blocks == 2 + 16 * 9 + 1);
+
+    debug("Check counts are saved at unmount");
+    size_t free_blocks = stats.free_blocks;
+    fs_unmount(&fs);
+    Block block;
+    assert(disk_read(disk, 0, block.data) == BLOCK_SIZE);
+    assert(block.super.free_block_count == free_blocks && block.super.free_inode_count == 77);
+    assert(fs_mount(&fs, disk));
+    assert(fs_statfs(&fs, &stats));
+    assert(stats.free_blocks == free_blocks && stats.free_inodes == 77);
+    fs_unmount(&fs);
+    disk_close(disk);
+
+    debug("Check unmodified file systems are left untouched");
+    disk = disk_open("./../data/image.5", 5);
+    assert(disk);
+    Block before, after;
+    assert(disk_read(disk, 0, before.data) == BLOCK_SIZE);
+    assert(fs_mount(&fs, disk));
+    assert(fs_statfs(&fs, &stats));
+    assert(stats.free_blocks == 2 && stats.largest_extent == 2);
+    fs_unmount(&fs);
+    assert(disk_read(disk, 0, after.data) == BLOCK_SIZE);
+    assert(memcmp(before.data, after.data, BLOCK_SIZE) == 0);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int compare_lines(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+size_t read_lines(FILE *stream, char *lines[], size_t capacity) {
+    char   line[BUFSIZ];
+    size_t count = 0;
+    rewind(stream);
+    while (fgets(line, sizeof(line), stream) && count < capacity) {
+        lines[count++] = strdup(line);
+    }
+    qsort(lines, count, sizeof(char *), compare_lines);
+    return count;
+}
+
+int test_18_fs_inspect() {
+    Disk *disk = disk_open("./../data/image.unit", 2000);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_format(&fs, disk));
+    assert(fs_mount(&fs, disk));
+
+    size_t inodes[40];
+    assert(fs_create_many(&fs, inodes, 40) == 40);
+    char data[12 * BLOCK_SIZE];
+    memset(data, 1, sizeof(data));
+    assert(fs_write(&fs, inodes[1], data, 3 * BLOCK_SIZE, 0) == 3 * BLOCK_SIZE);
+    assert(fs_write(&fs, inodes[2], data, sizeof(data), 0) == sizeof(data));
+    assert(fs_write(&fs, inodes[3], data, BLOCK_SIZE, 0) == BLOCK_SIZE);
+    assert(fs_write(&fs, inodes[1], data, BLOCK_SIZE, 3 * BLOCK_SIZE) == BLOCK_SIZE);
+    fs_unmount(&fs);
+
+    InspectOptions options;
+    assert(!fs_inspect_parse("threads=2,bogus", &options));
+    assert(!fs_inspect_parse("size=abc", &options));
+    assert(fs_inspect_parse("threads=4,inodes=2-9,size=4096-,extents,binary", &options));
+    assert(options.threads == 4 && options.first_inode == 2 && options.end_inode == 10);
+    assert(options.min_size == 4096 && options.end_size == 0 && options.extents && options.binary);
+    assert(fs_inspect_parse("inodes=3", &options) && options.first_inode == 3 && options.end_inode == 4);
+
+    debug("Check JSON records of every inode");
+    FILE *stream = tmpfile();
+    assert(stream);
+    assert(fs_inspect_parse("extents", &options));
+    assert(fs_inspect(disk, &options, stream) == 40);
+    char  *lines[64];
+    size_t count = read_lines(stream, lines, 64);
+    assert(count == 40);
+    for (size_t i = 0; i < count; i++) {
+        size_t inode, size, blocks, indirect, extents, start, length, mapped = 0;
+        int    offset;
+        assert(sscanf(lines[i], "{\"inode\":%zu,\"size\":%zu,", &inode, &size) == 2);
+        char *field = strstr(lines[i], "\"blocks\":");
+        assert(field && sscanf(field, "\"blocks\":%zu,\"indirect_blocks\":%zu,\"extents\":%zu,",
+                               &blocks, &indirect, &extents) == 3);
+        assert(blocks == (size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        assert(indirect == (blocks > POINTERS_PER_INODE));
+        assert(extents >= (blocks > 0) && extents <= blocks);
+        field = strstr(lines[i], "\"map\":[");
+        assert(field);
+        field += 7;
+        while (sscanf(field, "%*[[,]%zu,%zu]%n", &start, &length, &offset) == 2) {
+            mapped += length;
+            field  += offset;
+        }
+        assert(mapped == blocks && strcmp(field, "]}\n") == 0);
+        if (inode == inodes[1]) {
+            assert(size == 4 * BLOCK_SIZE && extents == 2 && strstr(lines[i], "\"fragmentation\":0.3333"));
+        }
+        if (inode == inodes[2]) {
+            assert(size == sizeof(data) && indirect == 1);
+        }
+    }
+
+    debug("Check records do not depend on the number of threads");
+    FILE *parallel = tmpfile();
+    assert(parallel);
+    assert(fs_inspect_parse("threads=4,extents", &options));
+    assert(fs_inspect(disk, &options, parallel) == 40);
+    char *others[64];
+    assert(read_lines(parallel, others, 64) == count);
+    for (size_t i = 0; i < count; i++) {
+        assert(strcmp(lines[i], others[i]) == 0);
+        free(lines[i]);
+        free(others[i]);
+    }
+    fclose(parallel);
+    fclose(stream);
+
+    debug("Check size and inode filters in binary records");
+    stream = tmpfile();
+    assert(stream);
+    assert(fs_inspect_parse("binary,size=1-16384,inodes=0-3", &options));
+    assert(fs_inspect(disk, &options, stream) == 2);
+    rewind(stream);
+    InspectHeader header;
+    assert(fread(&header, sizeof(header), 1, stream) == 1);
+    assert(header.magic == INSPECT_MAGIC && header.version == INSPECT_VERSION && header.block_size == BLOCK_SIZE);
+    InspectRecord record;
+    for (size_t i = 0; i < 2; i++) {
+        assert(fread(&record, sizeof(record), 1, stream) == 1);
+        assert(record.inode == inodes[1] || record.inode == inodes[3]);
+        assert(record.listed == 0 && record.size > 0 && record.size <= 16384);
+    }
+    assert(fread(&record, 1, 1, stream) == 0);
+    fclose(stream);
+
+    debug("Check unformatted disks are rejected");
+    Disk *blank = disk_open("./../data/image.blank", 10);
+    assert(blank);
+    assert(fs_inspect(blank, NULL, stdout) == -1);
+    disk_close(blank);
+    unlink("./../data/image.blank");
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+int test_19_fs_inspect_threads() {
+    Disk *disk = disk_open("./../data/image.unit", 65536);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_format(&fs, disk));
+    assert(fs_mount(&fs, disk));
+
+    size_t *inodes = malloc(20000 * sizeof(size_t));
+    assert(inodes);
+    assert(fs_create_many(&fs, inodes, 20000) == 20000);
+    char   data[7 * BLOCK_SIZE];
+    size_t indirect = 0;
+    memset(data, 1, sizeof(data));
+    for (size_t i = 0; i < 20000; i += 50) {
+        size_t length = (i / 50 % 7 + 1) * BLOCK_SIZE;
+        assert(fs_write(&fs, inodes[i], data, length, 0) == (ssize_t)length);
+        indirect += length > POINTERS_PER_INODE * BLOCK_SIZE;
+    }
+    free(inodes);
+    fs_unmount(&fs);
+
+    debug("Check overlapping threads report every inode and count every read");
+    InspectOptions options = {.threads = 1, .extents = true};
+    FILE  *stream = tmpfile();
+    assert(stream);
+    size_t reads  = disk->reads;
+    assert(fs_inspect(disk, &options, stream) == 20000);
+    size_t serial = disk->reads - reads;
+    assert(serial == 1 + fs.meta_data.inode_blocks + indirect);
+
+    char **lines = malloc(20000 * sizeof(char *));
+    assert(lines);
+    assert(read_lines(stream, lines, 20000) == 20000);
+    fclose(stream);
+
+    for (size_t threads = 2; threads <= 16; threads *= 2) {
+        options.threads = threads;
+        stream = tmpfile();
+        assert(stream);
+        reads = disk->reads;
+        assert(fs_inspect(disk, &options, stream) == 20000);
+        assert(disk->reads - reads == serial);
+
+        char **others = malloc(20000 * sizeof(char *));
+        assert(others);
+        assert(read_lines(stream, others, 20000) == 20000);
+        for (size_t i = 0; i < 20000; i++) {
+            assert(strcmp(lines[i], others[i]) == 0);
+            free(others[i]);
+        }
+        free(others);
+        fclose(stream);
+    }
+
+    options.threads = SIZE_MAX;
+    stream = tmpfile();
+    assert(stream);
+    assert(fs_inspect(disk, &options, stream) == 20000);
+    fclose(stream);
+
+    for (size_t i = 0; i < 20000; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
 /* Main execution */
 
 int main(int argc, char *argv[]) {
@@ -176,6 +1432,22 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "    1. Test fs_create\n");
         fprintf(stderr, "    2. Test fs_remove\n");
         fprintf(stderr, "    3. Test fs_stat\n");
+        fprintf(stderr, "    4. Test fs_truncate\n");
+        fprintf(stderr, "    5. Test fs_fallocate\n");
+        fprintf(stderr, "    6. Test fs_compression\n");
+        fprintf(stderr, "    7. Test fs_dedup\n");
+        fprintf(stderr, "    8. Test fs_copy\n");
+        fprintf(stderr, "    9. Test fs_geometry\n");
+        fprintf(stderr, "    10. Test fs_large\n");
+        fprintf(stderr, "    11. Test fs_groups\n");
+        fprintf(stderr, "    12. Test fs_inode_map\n");
+        fprintf(stderr, "    13. Test fs_view\n");
+        fprintf(stderr, "    14. Test fs_async\n");
+        fprintf(stderr, "    15. Test fs_batch\n");
+        fprintf(stderr, "    16. Test fs_discard\n");
+        fprintf(stderr, "    17. Test fs_statfs\n");
+        fprintf(stderr, "    18. Test fs_inspect\n");
+        fprintf(stderr, "    19. Test fs_inspect_threads\n");
         return EXIT_FAILURE;
     }
 
@@ -189,6 +1461,22 @@ int main(int argc, char *argv[]) {
         case 1:  status = test_01_fs_create(); break;
         case 2:  status = test_02_fs_remove(); break;
         case 3:  status = test_03_fs_stat(); break;
+        case 4:  status = test_04_fs_truncate(); break;
+        case 5:  status = test_05_fs_fallocate(); break;
+        case 6:  status = test_06_fs_compression(); break;
+        case 7:  status = test_07_fs_dedup(); break;
+        case 8:  status = test_08_fs_copy(); break;
+        case 9:  status = test_09_fs_geometry(); break;
+        case 10: status = test_10_fs_large(); break;
+        case 11: status = test_11_fs_groups(); break;
+        case 12: status = test_12_fs_inode_map(); break;
+        case 13: status = test_13_fs_view(); break;
+        case 14: status = test_14_fs_async(); break;
+        case 15: status = test_15_fs_batch(); break;
+        case 16: status = test_16_fs_discard(); break;
+        case 17: status = test_17_fs_statfs(); break;
+        case 18: status = test_18_fs_inspect(); break;
+        case 19: status = test_19_fs_inspect_threads(); break;
         default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
     }
 
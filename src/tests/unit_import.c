@@ -0,0 +1,156 @@
+/* unit_import.c: Unit tests for SimpleFS bulk import */
+
+#include "sfs/dir.h"
+#include "sfs/import.h"
+#include "sfs/logging.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Constants */
+
+#define DISK_PATH       "./../data/image.unit"
+#define DISK_BLOCKS     (1024)
+#define HOST_PATH       "./../data/import.unit"
+
+/* Functions */
+
+void test_cleanup() {
+    unlink(DISK_PATH);
+    system("rm -rf " HOST_PATH);
+}
+
+void test_host_file(const char *path, size_t size, char seed) {
+    FILE *stream = fopen(path, "w");
+    assert(stream);
+    for (size_t i = 0; i < size; i++) {
+        fputc(seed + i % 23, stream);
+    }
+    fclose(stream);
+}
+
+void test_host_tree() {
+    assert(mkdir(HOST_PATH, 0755) == 0);
+    assert(mkdir(HOST_PATH "/logs", 0755) == 0);
+    assert(mkdir(HOST_PATH "/logs/old", 0755) == 0);
+    assert(mkdir(HOST_PATH "/empty", 0755) == 0);
+
+    char path[BUFSIZ];
+    for (size_t i = 0; i < 50; i++) {
+        snprintf(path, sizeof(path), HOST_PATH "/logs/%zu.log", i);
+        test_host_file(path, i * 1000, 'a' + i % 10);
+    }
+    test_host_file(HOST_PATH "/logs/old/big", 3 * IMPORT_CHUNK_SIZE / 2, 'A');
+    test_host_file(HOST_PATH "/empty.txt", 0, 'x');
+    assert(symlink("logs", HOST_PATH "/link") == 0);
+}
+
+bool test_same(FileSystem *fs, const char *image_path, const char *host_path) {
+    ssize_t inode_number = fs_resolve(fs, image_path);
+    if (inode_number < 0) {
+        return false;
+    }
+
+    FILE *stream = fopen(host_path, "r");
+    assert(stream);
+
+    char expected[BUFSIZ], actual[BUFSIZ];
+    size_t offset = 0, length;
+    bool same = true;
+    while ((length = fread(expected, 1, sizeof(expected), stream)) > 0) {
+        if (fs_read(fs, inode_number, actual, length, offset) != (ssize_t)length ||
+            memcmp(expected, actual, length) != 0) {
+            same = false;
+            break;
+        }
+        offset += length;
+    }
+    fclose(stream);
+
+    return same && fs_stat(fs, inode_number) == (ssize_t)offset;
+}
+
+int test_00_import_tree() {
+    test_host_tree();
+
+    Disk *disk = disk_open(DISK_PATH, DISK_BLOCKS);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_format(&fs, disk));
+    assert(fs_mount(&fs, disk));
+
+    debug("Check importing host tree");
+    char manifest[BUFSIZ * 4] = {0};
+    ImportOptions options = {.threads = 4};
+    options.manifest = fmemopen(manifest, sizeof(manifest), "w");
+    assert(options.manifest);
+
+    ImportStats stats;
+    ssize_t root = fs_root(&fs);
+    assert(fs_import(&fs, HOST_PATH, root, &options, &stats));
+    fclose(options.manifest);
+
+    assert(stats.files == 52);
+    assert(stats.directories == 3);
+    assert(stats.skipped == 1);
+    assert(stats.errors == 0);
+
+    debug("Check imported contents");
+    char image_path[BUFSIZ], host_path[BUFSIZ];
+    for (size_t i = 0; i < 50; i++) {
+        snprintf(image_path, sizeof(image_path), "/logs/%zu.log", i);
+        snprintf(host_path, sizeof(host_path), HOST_PATH "/logs/%zu.log", i);
+        assert(test_same(&fs, image_path, host_path));
+    }
+    assert(test_same(&fs, "/logs/old/big", HOST_PATH "/logs/old/big"));
+    assert(test_same(&fs, "/empty.txt", HOST_PATH "/empty.txt"));
+    assert(fs_resolve(&fs, "/empty") >= 0);
+    assert(fs_resolve(&fs, "/link") == -1);
+
+    debug("Check manifest");
+    char line[BUFSIZ];
+    snprintf(line, sizeof(line), "%zd\tlogs/old/big\n", fs_resolve(&fs, "/logs/old/big"));
+    assert(strstr(manifest, line) != NULL);
+    snprintf(line, sizeof(line), "%zd\tlogs/\n", fs_resolve(&fs, "/logs"));
+    assert(strstr(manifest, line) != NULL);
+
+    debug("Check importing over existing files");
+    assert(fs_import(&fs, HOST_PATH "/logs/0.log", root, NULL, &stats));
+    assert(fs_import(&fs, HOST_PATH "/logs/0.log", root, NULL, &stats) == false);
+    assert(stats.errors == 1);
+    assert(fs_import(&fs, HOST_PATH "/missing", root, NULL, &stats) == false);
+
+    fs_unmount(&fs);
+    disk_close(disk);
+    return EXIT_SUCCESS;
+}
+
+/* Main execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test import_tree\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    assert(atexit(test_cleanup) == EXIT_SUCCESS);
+
+    switch (number) {
+        case 0:  status = test_00_import_tree(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,112 @@
+/* unit_lz.c: Unit tests for SimpleFS LZ codec */
+
+#include "sfs/lz.h"
+#include "sfs/logging.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+/* Constants */
+
+#define DATA_SIZE   (1<<14)
+
+/* Functions */
+
+int test_00_lz_roundtrip() {
+    char data[DATA_SIZE], packed[DATA_SIZE], unpacked[DATA_SIZE];
+
+    debug("Check compressible data");
+    for (size_t i = 0; i < DATA_SIZE; i++) {
+        data[i] = "INFO request served\n"[i % 20];
+    }
+    size_t packed_size = lz_compress(data, DATA_SIZE, packed, DATA_SIZE);
+    assert(packed_size > 0);
+    assert(packed_size < DATA_SIZE / 16);
+    assert(lz_decompress(packed, packed_size, unpacked, DATA_SIZE) == DATA_SIZE);
+    assert(memcmp(data, unpacked, DATA_SIZE) == 0);
+
+    debug("Check zero data");
+    memset(data, 0, DATA_SIZE);
+    packed_size = lz_compress(data, DATA_SIZE, packed, DATA_SIZE);
+    assert(packed_size > 0);
+    assert(packed_size < 128);
+    assert(lz_decompress(packed, packed_size, unpacked, DATA_SIZE) == DATA_SIZE);
+    assert(memcmp(data, unpacked, DATA_SIZE) == 0);
+
+    debug("Check short data");
+    packed_size = lz_compress("abc", 3, packed, DATA_SIZE);
+    assert(packed_size == 4);
+    assert(lz_decompress(packed, packed_size, unpacked, DATA_SIZE) == 3);
+    assert(memcmp(unpacked, "abc", 3) == 0);
+
+    return EXIT_SUCCESS;
+}
+
+int test_01_lz_incompressible() {
+    char data[DATA_SIZE], packed[2*DATA_SIZE], unpacked[DATA_SIZE];
+
+    srand(30341);
+    for (size_t i = 0; i < DATA_SIZE; i++) {
+        data[i] = rand();
+    }
+
+    debug("Check output larger than capacity");
+    assert(lz_compress(data, DATA_SIZE, packed, DATA_SIZE / 2) == 0);
+
+    debug("Check random data roundtrip");
+    size_t packed_size = lz_compress(data, DATA_SIZE, packed, sizeof(packed));
+    assert(packed_size > DATA_SIZE);
+    assert(lz_decompress(packed, packed_size, unpacked, DATA_SIZE) == DATA_SIZE);
+    assert(memcmp(data, unpacked, DATA_SIZE) == 0);
+
+    return EXIT_SUCCESS;
+}
+
+int test_02_lz_corrupt() {
+    char data[DATA_SIZE], packed[DATA_SIZE], unpacked[DATA_SIZE];
+
+    for (size_t i = 0; i < DATA_SIZE; i++) {
+        data[i] = i % 7;
+    }
+    size_t packed_size = lz_compress(data, DATA_SIZE, packed, DATA_SIZE);
+    assert(packed_size > 0);
+
+    debug("Check output buffer too small");
+    assert(lz_decompress(packed, packed_size, unpacked, DATA_SIZE - 1) == -1);
+
+    debug("Check truncated input");
+    assert(lz_decompress(packed, 2, unpacked, DATA_SIZE) == -1);
+
+    debug("Check bad offset");
+    char bad[] = {0x10, 'a', 0x10, 0x00};
+    assert(lz_decompress(bad, sizeof(bad), unpacked, DATA_SIZE) == -1);
+
+    return EXIT_SUCCESS;
+}
+
+/* Main execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test lz roundtrip\n");
+        fprintf(stderr, "    1. Test lz incompressible\n");
+        fprintf(stderr, "    2. Test lz corrupt\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_lz_roundtrip(); break;
+        case 1:  status = test_01_lz_incompressible(); break;
+        case 2:  status = test_02_lz_corrupt(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,141 @@
+/* unit_stats.c: Unit tests for SimpleFS statistics */
+
+#include "sfs/dir.h"
+#include "sfs/fs.h"
+#include "sfs/logging.h"
+#include "sfs/stats.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+
+/* Constants */
+
+#define DISK_PATH       "./../data/image.unit"
+#define DISK_BLOCKS     (256)
+#define METRICS_PATH    "./../data/metrics.unit"
+
+/* Functions */
+
+int test_00_stats_record() {
+    Stats stats;
+    stats_reset(&stats);
+
+    debug("Check counters");
+    uint64_t start = stats_now();
+    stats_record(&stats, STATS_FS_READ, start, true, 4096);
+    stats_record(&stats, STATS_FS_READ, start, true, 100);
+    stats_record(&stats, STATS_FS_READ, start, false, 4096);
+    assert(stats.counters[STATS_FS_READ].calls == 3);
+    assert(stats.counters[STATS_FS_READ].errors == 1);
+    assert(stats.counters[STATS_FS_READ].bytes == 4196);
+    assert(stats.counters[STATS_FS_WRITE].calls == 0);
+
+    debug("Check histogram buckets");
+    uint64_t total = 0;
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        total += stats.counters[STATS_FS_READ].histogram[i];
+    }
+    assert(total == 3);
+
+    debug("Check percentiles");
+    StatsCounter counter = {0};
+    counter.histogram[10] = 99;                 /* [512, 1024)纳秒 */
+    counter.histogram[20] = 1;                  /* [2^19, 2^20)纳秒 */
+    assert(stats_percentile(&counter, 50) == 1024);
+    assert(stats_percentile(&counter, 99) == (1 << 20));
+    assert(stats_percentile(&counter, 99.9) == (1 << 20));
+
+    debug("Check merge");
+    Stats merged;
+    stats_reset(&merged);
+    stats_merge(&merged, &stats);
+    stats_merge(&merged, &stats);
+    assert(merged.counters[STATS_FS_READ].calls == 6);
+    assert(strcmp(stats_name(STATS_DISK_READ), "disk_read") == 0);
+
+    return EXIT_SUCCESS;
+}
+
+int test_01_stats_filesystem() {
+    Disk *disk = disk_open(DISK_PATH, DISK_BLOCKS);
+    assert(disk);
+
+    FileSystem fs = {0};
+    assert(fs_format(&fs, disk));
+    assert(fs_mount(&fs, disk));
+
+    debug("Check entry points and disk counters");
+    char data[BLOCK_SIZE] = {0};
+    ssize_t inode_number = fs_create(&fs);
+    assert(inode_number >= 0);
+    assert(fs_write(&fs, inode_number, data, sizeof(data), 0) == sizeof(data));
+    assert(fs_read(&fs, inode_number, data, sizeof(data), 0) == sizeof(data));
+    assert(fs_stat(&fs, 1000) < 0);
+    assert(fs_mkdir(&fs, fs_root(&fs), "dir") >= 0);
+
+    Stats stats;
+    fs_stats(&fs, &stats);
+    assert(stats.counters[STATS_FS_FORMAT].calls == 1);
+    assert(stats.counters[STATS_FS_MOUNT].calls == 1);
+    assert(stats.counters[STATS_FS_WRITE].bytes == BLOCK_SIZE);
+    assert(stats.counters[STATS_FS_READ].bytes == BLOCK_SIZE);
+    assert(stats.counters[STATS_FS_STAT].errors == 1);
+    assert(stats.counters[STATS_FS_MKDIR].calls == 1);
+    assert(stats.counters[STATS_DISK_READ].calls == disk->reads);
+    assert(stats.counters[STATS_DISK_WRITE].calls == disk->writes);
+
+    debug("Check periodic metrics");
+    unlink(METRICS_PATH);
+    assert(fs_stats_start(&fs, METRICS_PATH, 1));
+    assert(access(METRICS_PATH, R_OK) == 0);
+    fs_unmount(&fs);
+    assert(fs.dumper == NULL);
+
+    FILE *stream = fopen(METRICS_PATH, "r");
+    assert(stream);
+    char line[BUFSIZ];
+    bool found = false;
+    while (fgets(line, sizeof(line), stream)) {
+        found |= strcmp(line, "sfs_calls_total{op=\"fs_mkdir\"} 1\n") == 0;
+    }
+    fclose(stream);
+    assert(found);
+
+    debug("Check reset");
+    fs_stats_reset(&fs);
+    fs_stats(&fs, &stats);
+    assert(stats.counters[STATS_FS_READ].calls == 0);
+
+    disk_close(disk);
+    unlink(DISK_PATH);
+    unlink(METRICS_PATH);
+    return EXIT_SUCCESS;
+}
+
+/* Main execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0. Test stats record\n");
+        fprintf(stderr, "    1. Test stats filesystem\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_stats_record(); break;
+        case 1:  status = test_01_stats_filesystem(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,575 @@
+/* sfs_bench.c: SimpleFS 基准测试 */
+
+#include "sfs/disk.h"
+#include "sfs/fs.h"
+#include "sfs/utils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+/*  宏定义 */
+
+#define streq(a, b)	(strcmp((a), (b)) == 0)
+
+/* 常量 */
+
+#define BENCH_IMAGE         "sfs_bench.image"   /* 默认的磁盘映像 */
+#define BENCH_BLOCKS        (4096)              /* 默认的磁盘块数 */
+#define BENCH_OPS           (1000)              /* 每个负载默认的操作数 */
+#define BENCH_CHUNK         (16 * BLOCK_SIZE)   /* 顺序读写每次操作的字节数 */
+#define BENCH_SMALL_MAX     (4 * BLOCK_SIZE)    /* 小文件的最大大小 */
+
+/* 结构 */
+
+typedef struct Bench Bench;
+struct Bench {
+    Disk        *disk;                          /* 测试使用的磁盘 */
+    FileSystem   fs;                            /* 测试使用的文件系统 */
+    DiskOptions  disk_options;                  /* 磁盘选项 */
+    FormatOptions options;                      /* 格式化选项 */
+    size_t       blocks;                        /* 磁盘块数 */
+    size_t       ops;                           /* 每个负载的操作数 */
+    ssize_t      file;                          /* 读负载使用的数据文件（-1表示还没有） */
+    size_t       file_size;                     /* 数据文件的大小 */
+    char        *buffer;                        /* 读写缓冲区 */
+};
+
+typedef struct Result Result;
+struct Result {
+    const char  *name;                          /* 负载名称 */
+    size_t       ops;                           /* 完成的操作数 */
+    size_t       bytes;                         /* 读写的字节数 */
+    double       seconds;                       /* 所有操作的总耗时 */
+    double      *latencies;                     /* 每个操作的延迟（秒） */
+    size_t       capacity;                      /* latencies的容量 */
+    size_t       reads;                         /* 磁盘读取次数 */
+    size_t       writes;                        /* 磁盘写入次数 */
+};
+
+typedef bool (*Workload)(Bench *bench, Result *result);
+
+typedef struct WorkloadEntry WorkloadEntry;
+struct WorkloadEntry {
+    const char  *name;                          /* 负载名称（-w的参数） */
+    Workload     run;                           /* 负载函数 */
+};
+
+/* 负载函数原型 */
+
+bool bench_format(Bench *bench, Result *result);
+bool bench_mount(Bench *bench, Result *result);
+bool bench_seq_write(Bench *bench, Result *result);
+bool bench_seq_read(Bench *bench, Result *result);
+bool bench_rand_write(Bench *bench, Result *result);
+bool bench_rand_read(Bench *bench, Result *result);
+bool bench_create(Bench *bench, Result *result);
+bool bench_remove(Bench *bench, Result *result);
+bool bench_small_files(Bench *bench, Result *result);
+
+/* 实用函数原型 */
+
+double  bench_now(void);
+void    bench_begin(Bench *bench, Result *result);
+void    bench_record(Result *result, double start, size_t bytes);
+void    bench_end(Bench *bench, Result *result);
+bool    bench_prepare_file(Bench *bench);
+double  bench_percentile(Result *result, double percentile);
+int     bench_compare(const void *a, const void *b);
+void    bench_report_text(Result *results, size_t count);
+void    bench_report_json(Bench *bench, Result *results, size_t count);
+
+/* 负载表 */
+
+WorkloadEntry WORKLOADS[] = {
+    {"format",      bench_format},
+    {"mount",       bench_mount},
+    {"seq-write",   bench_seq_write},
+    {"seq-read",    bench_seq_read},
+    {"rand-write",  bench_rand_write},
+    {"rand-read",   bench_rand_read},
+    {"create",      bench_create},
+    {"remove",      bench_remove},
+    {"small-files", bench_small_files},
+};
+
+#define WORKLOAD_COUNT  (sizeof(WORKLOADS) / sizeof(WORKLOADS[0]))
+
+/* 主程序 */
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "    -i <image>      Disk image to use, or comma separated images to stripe (default %s, removed afterwards)\n", BENCH_IMAGE);
+    fprintf(stderr, "    -S <blocks>     Stripe unit for several images (default %d)\n", DISK_STRIPE_DEFAULT);
+    fprintf(stderr, "    -M              Mirror several images instead of striping them\n");
+    fprintf(stderr, "    -b <blocks>     Number of blocks in the image (default %d)\n", BENCH_BLOCKS);
+    fprintf(stderr, "    -n <ops>        Operations per workload (default %d)\n", BENCH_OPS);
+    fprintf(stderr, "    -w <list>       Comma separated workloads (default all)\n");
+    fprintf(stderr, "    -s <seed>       Random seed\n");
+    fprintf(stderr, "    -t <trace>      Record block I/O to a trace file\n");
+    fprintf(stderr, "    -l <model>      Latency model: none, constant[:us], hdd[:rpm], ssd[:channels] [,sleep]\n");
+    fprintf(stderr, "    -c              Enable block checksums\n");
+    fprintf(stderr, "    -z              Format with compression\n");
+    fprintf(stderr, "    -d              Format with deduplication\n");
+    fprintf(stderr, "    -B <bytes>      File system block size (default %d, up to %d)\n", BLOCK_SIZE, FS_BLOCK_SIZE_MAX);
+    fprintf(stderr, "    -j              Report as JSON\n");
+    fprintf(stderr, "Workloads:");
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+        fprintf(stderr, " %s", WORKLOADS[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *image    = BENCH_IMAGE;
+    const char *selected = NULL;
+    bool        json     = false;
+    bool        keep     = false;
+    Bench       bench    = {.ops = BENCH_OPS, .file = -1, .blocks = BENCH_BLOCKS};
+    int         option;
+
+    srand(time(NULL));
+
+    while ((option = getopt(argc, argv, "i:b:n:w:s:t:l:czdB:S:Mjh")) != -1) {
+        switch (option) {
+            case 'i': image = optarg; keep = true; break;
+            case 'b': bench.blocks = strtoul(optarg, NULL, 10); break;
+            case 'n': bench.ops = strtoul(optarg, NULL, 10); break;
+            case 'w': selected = optarg; break;
+            case 's': srand(strtoul(optarg, NULL, 10)); break;
+            case 't': bench.disk_options.trace = optarg; break;
+            case 'l':
+                if (!model_parse(optarg, &bench.disk_options.model)) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'c': bench.disk_options.checksums = true; break;
+            case 'z': bench.options.compress = true; break;
+            case 'd': bench.options.dedup = true; break;
+            case 'B': bench.options.block_size = strtoul(optarg, NULL, 10); break;
+            case 'S': bench.disk_options.stripe = strtoul(optarg, NULL, 10); break;
+            case 'M': bench.disk_options.mirror = true; break;
+            case 'j': json = true; break;
+            default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc || bench.blocks < 16 || bench.ops == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench.disk   = disk_open_list(image, bench.blocks, &bench.disk_options);
+    bench.buffer = (char *)malloc(max(BENCH_CHUNK, BENCH_SMALL_MAX));
+    if (bench.disk == NULL || bench.buffer == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", image, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < max(BENCH_CHUNK, BENCH_SMALL_MAX); i++) {
+        bench.buffer[i] = rand();
+    }
+
+    if (!fs_format_with(&bench.fs, bench.disk, &bench.options) || !fs_mount(&bench.fs, bench.disk)) {
+        fprintf(stderr, "Unable to format %s\n", image);
+        return EXIT_FAILURE;
+    }
+
+    Result results[WORKLOAD_COUNT] = {{0}};
+    size_t count  = 0;
+    int    status = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+        if (selected != NULL) {
+            const char *match  = strstr(selected, WORKLOADS[i].name);
+            size_t      length = strlen(WORKLOADS[i].name);
+            while (match && ((match != selected && match[-1] != ',') || (match[length] != 0 && match[length] != ','))) {
+                match = strstr(match + 1, WORKLOADS[i].name);
+            }
+            if (match == NULL) {
+                continue;
+            }
+        }
+
+        Result *result = &results[count++];
+        result->name = WORKLOADS[i].name;
+        if (!WORKLOADS[i].run(&bench, result)) {
+            fprintf(stderr, "Workload %s failed\n", result->name);
+            status = EXIT_FAILURE;
+        }
+    }
+
+    /* disk_close会向标准输出打印读写次数：关闭期间把标准输出转到标准错误，保证结果可以直接解析 */
+    fs_unmount(&bench.fs);
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    disk_close(bench.disk);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    free(bench.buffer);
+
+    if (json) {
+        bench_report_json(&bench, results, count);
+    } else {
+        bench_report_text(results, count);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        free(results[i].latencies);
+    }
+    if (!keep) {
+        unlink(image);
+        char checksum_path[BUFSIZ];
+        snprintf(checksum_path, sizeof(checksum_path), "%s.crc", image);
+        unlink(checksum_path);
+    }
+
+    return status;
+}
+
+/* 负载函数 */
+
+/**
+ * 格式化整个磁盘（每次格式化后重新挂载，负载结束后数据文件失效）。
+ **/
+bool bench_format(Bench *bench, Result *result) {
+    size_t ops = max(bench->ops / 100, 1);
+
+    fs_unmount(&bench->fs);
+    bench_begin(bench, result);
+    for (size_t i = 0; i < ops; i++) {
+        double start = bench_now();
+        if (!fs_format_with(&bench->fs, bench->disk, &bench->options)) {
+            return false;
+        }
+        bench_record(result, start, 0);
+    }
+    bench_end(bench, result);
+
+    bench->file = -1;
+    return fs_mount(&bench->fs, bench->disk);
+}
+
+/**
+ * 重复卸载并挂载文件系统。
+ **/
+bool bench_mount(Bench *bench, Result *result) {
+    bench_begin(bench, result);
+    for (size_t i = 0; i < bench->ops; i++) {
+        fs_unmount(&bench->fs);
+        double start = bench_now();
+        if (!fs_mount(&bench->fs, bench->disk)) {
+            return false;
+        }
+        bench_record(result, start, 0);
+    }
+    bench_end(bench, result);
+    return true;
+}
+
+/**
+ * 以BENCH_CHUNK为单位顺序写入数据文件，写满后从头覆盖。
+ **/
+bool bench_seq_write(Bench *bench, Result *result) {
+    if (!bench_prepare_file(bench)) {
+        return false;
+    }
+
+    bench_begin(bench, result);
+    for (size_t i = 0, offset = 0; i < bench->ops; i++) {
+        if (offset + BENCH_CHUNK > bench->file_size) {
+            offset = 0;
+        }
+
+        double start = bench_now();
+        if (fs_write(&bench->fs, bench->file, bench->buffer, BENCH_CHUNK, offset) != BENCH_CHUNK) {
+            return false;
+        }
+        bench_record(result, start, BENCH_CHUNK);
+        offset += BENCH_CHUNK;
+    }
+    bench_end(bench, result);
+    return true;
+}
+
+/**
+ * 以BENCH_CHUNK为单位顺序读取数据文件，读完后从头开始。
+ **/
+bool bench_seq_read(Bench *bench, Result *result) {
+    if (!bench_prepare_file(bench)) {
+        return false;
+    }
+
+    bench_begin(bench, result);
+    for (size_t i = 0, offset = 0; i < bench->ops; i++) {
+        if (offset + BENCH_CHUNK > bench->file_size) {
+            offset = 0;
+        }
+
+        double start = bench_now();
+        if (fs_read(&bench->fs, bench->file, bench->buffer, BENCH_CHUNK, offset) != BENCH_CHUNK) {
+            return false;
+        }
+        bench_record(result, start, BENCH_CHUNK);
+        offset += BENCH_CHUNK;
+    }
+    bench_end(bench, result);
+    return true;
+}
+
+/**
+ * 在数据文件中随机写入对齐的4K块。
+ **/
+bool bench_rand_write(Bench *bench, Result *result) {
+    if (!bench_prepare_file(bench)) {
+        return false;
+    }
+
+    bench_begin(bench, result);
+    for (size_t i = 0; i < bench->ops; i++) {
+        size_t offset = (rand() % (bench->file_size / BLOCK_SIZE)) * BLOCK_SIZE;
+        double start  = bench_now();
+        if (fs_write(&bench->fs, bench->file, bench->buffer, BLOCK_SIZE, offset) != BLOCK_SIZE) {
+            return false;
+        }
+        bench_record(result, start, BLOCK_SIZE);
+    }
+    bench_end(bench, result);
+    return true;
+}
+
+/**
+ * 在数据文件中随机读取对齐的4K块。
+ **/
+bool bench_rand_read(Bench *bench, Result *result) {
+    if (!bench_prepare_file(bench)) {
+        return false;
+    }
+
+    bench_begin(bench, result);
+    for (size_t i = 0; i < bench->ops; i++) {
+        size_t offset = (rand() % (bench->file_size / BLOCK_SIZE)) * BLOCK_SIZE;
+        double start  = bench_now();
+        if (fs_read(&bench->fs, bench->file, bench->buffer, BLOCK_SIZE, offset) != BLOCK_SIZE) {
+            return false;
+        }
+        bench_record(result, start, BLOCK_SIZE);
+    }
+    bench_end(bench, result);
+    return true;
+}
+
+/**
+ * 连续创建空文件（创建的文件留给remove负载删除）。
+ **/
+bool bench_create(Bench *bench, Result *result) {
+    bench_begin(bench, result);
+    for (size_t i = 0; i < bench->ops; i++) {
+        double start = bench_now();
+        if (fs_create(&bench->fs) < 0) {
+            break;
+        }
+        bench_record(result, start, 0);
+    }
+    bench_end(bench, result);
+    return result->ops > 0;
+}
+
+/**
+ * 删除除数据文件以外的所有文件（没有时先创建），每删除一个文件计一次操作。
+ **/
+bool bench_remove(Bench *bench, Result *result) {
+    size_t created = 0;
+    for (size_t i = 0; i < bench->fs.meta_data.inodes && created < bench->ops; i++) {
+        if (fs_stat(&bench->fs, i) < 0 && fs_create(&bench->fs) < 0) {
+            break;
+        }
+        created++;
+    }
+
+    bench_begin(bench, result);
+    for (size_t i = 0; i < bench->fs.meta_data.inodes && result->ops < bench->ops; i++) {
+        if ((ssize_t)i == bench->file || fs_stat(&bench->fs, i) < 0) {
+            continue;
+        }
+
+        double start = bench_now();
+        if (!fs_remove(&bench->fs, i)) {
+            return false;
+        }
+        bench_record(result, start, 0);
+    }
+    bench_end(bench, result);
+    return result->ops > 0;
+}
+
+/**
+ * 小文件负载：每个操作创建一个1到4块大小的文件、写入、读回并删除。
+ **/
+bool bench_small_files(Bench *bench, Result *result) {
+    bench_begin(bench, result);
+    for (size_t i = 0; i < bench->ops; i++) {
+        size_t  size  = 1 + rand() % BENCH_SMALL_MAX;
+        double  start = bench_now();
+        ssize_t inode_number = fs_create(&bench->fs);
+        if (inode_number < 0 ||
+            fs_write(&bench->fs, inode_number, bench->buffer, size, 0) != (ssize_t)size ||
+            fs_read(&bench->fs, inode_number, bench->buffer, size, 0) != (ssize_t)size ||
+            !fs_remove(&bench->fs, inode_number)) {
+            return false;
+        }
+        bench_record(result, start, 2 * size);
+    }
+    bench_end(bench, result);
+    return true;
+}
+
+/* 实用函数 */
+
+/**
+ * 返回统计时钟的当前时间（秒），包括延迟模型模拟的耗时。
+ **/
+double bench_now(void) {
+    return stats_now() / 1e9;
+}
+
+/**
+ * 开始一个负载：分配延迟数组并记录磁盘计数器的初始值（结束时相减）。
+ **/
+void bench_begin(Bench *bench, Result *result) {
+    result->capacity  = bench->ops;
+    result->latencies = (double *)calloc(result->capacity, sizeof(double));
+    result->reads     = bench->disk->reads;
+    result->writes    = bench->disk->writes;
+}
+
+/**
+ * 记录一个完成的操作。
+ **/
+void bench_record(Result *result, double start, size_t bytes) {
+    double latency = bench_now() - start;
+
+    if (result->latencies && result->ops < result->capacity) {
+        result->latencies[result->ops] = latency;
+    }
+    result->ops++;
+    result->bytes   += bytes;
+    result->seconds += latency;
+}
+
+/**
+ * 结束一个负载：计算磁盘读写次数并对延迟排序以便计算百分位数。
+ **/
+void bench_end(Bench *bench, Result *result) {
+    result->reads  = bench->disk->reads - result->reads;
+    result->writes = bench->disk->writes - result->writes;
+    if (result->latencies) {
+        qsort(result->latencies, min(result->ops, result->capacity), sizeof(double), bench_compare);
+    }
+}
+
+/**
+ * 需要时创建并写满数据文件（不计入任何负载）：大小为单个文件的最大容量与磁盘一半中较小的一个。
+ **/
+bool bench_prepare_file(Bench *bench) {
+    if (bench->file >= 0) {
+        return true;
+    }
+
+    size_t capacity = (POINTERS_PER_INODE + bench->fs.pointers_per_block) * bench->fs.block_size;
+    size_t size     = min(capacity, bench->fs.meta_data.blocks / 2 * bench->fs.block_size);
+    size = size / BENCH_CHUNK * BENCH_CHUNK;
+    if (size == 0) {
+        return false;
+    }
+
+    bench->file = fs_create(&bench->fs);
+    if (bench->file < 0 || !fs_fallocate(&bench->fs, bench->file, 0, size)) {
+        return false;
+    }
+
+    for (size_t offset = 0; offset < size; offset += BENCH_CHUNK) {
+        if (fs_write(&bench->fs, bench->file, bench->buffer, BENCH_CHUNK, offset) != BENCH_CHUNK) {
+            return false;
+        }
+    }
+
+    bench->file_size = size;
+    return true;
+}
+
+/**
+ * 返回延迟的百分位数（秒）。
+ **/
+double bench_percentile(Result *result, double percentile) {
+    size_t count = min(result->ops, result->capacity);
+    if (count == 0 || result->latencies == NULL) {
+        return 0;
+    }
+
+    size_t index = (size_t)(percentile / 100.0 * count);
+    return result->latencies[min(index, count - 1)];
+}
+
+int bench_compare(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * 以表格形式输出结果（延迟单位为微秒）。
+ **/
+void bench_report_text(Result *results, size_t count) {
+    printf("%-12s %8s %12s %10s %10s %10s %10s %9s %9s\n",
+           "workload", "ops", "ops/s", "MB/s", "p50(us)", "p99(us)", "p999(us)", "reads/op", "writes/op");
+
+    for (size_t i = 0; i < count; i++) {
+        Result *r   = &results[i];
+        double  ops = max(r->ops, 1);
+        printf("%-12s %8zu %12.1f %10.2f %10.1f %10.1f %10.1f %9.2f %9.2f\n",
+               r->name, r->ops,
+               r->seconds > 0 ? r->ops / r->seconds : 0,
+               r->seconds > 0 ? r->bytes / r->seconds / (1<<20) : 0,
+               bench_percentile(r, 50) * 1e6, bench_percentile(r, 99) * 1e6, bench_percentile(r, 99.9) * 1e6,
+               r->reads / ops, r->writes / ops);
+    }
+}
+
+/**
+ * 以JSON形式输出结果（延迟单位为微秒）。
+ **/
+void bench_report_json(Bench *bench, Result *results, size_t count) {
+    printf("{\n");
+    printf("  \"blocks\": %zu,\n", bench->blocks);
+    printf("  \"block_size\": %zu,\n", bench->options.block_size ? bench->options.block_size : BLOCK_SIZE);
+    printf("  \"checksums\": %s,\n", bench->disk_options.checksums ? "true" : "false");
+    printf("  \"model\": \"%s\",\n", (const char *[]){"none", "constant", "hdd", "ssd"}[bench->disk_options.model.type]);
+    printf("  \"compress\": %s,\n", bench->options.compress ? "true" : "false");
+    printf("  \"dedup\": %s,\n", bench->options.dedup ? "true" : "false");
+    printf("  \"results\": [\n");
+
+    for (size_t i = 0; i < count; i++) {
+        Result *r   = &results[i];
+        double  ops = max(r->ops, 1);
+        printf("    {\"workload\": \"%s\", \"ops\": %zu, \"bytes\": %zu, \"seconds\": %.6f, "
+               "\"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f, "
+               "\"p50_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, "
+               "\"reads_per_op\": %.3f, \"writes_per_op\": %.3f}%s\n",
+               r->name, r->ops, r->bytes, r->seconds,
+               r->seconds > 0 ? r->ops / r->seconds : 0,
+               r->seconds > 0 ? r->bytes / r->seconds / (1<<20) : 0,
+               bench_percentile(r, 50) * 1e6, bench_percentile(r, 99) * 1e6, bench_percentile(r, 99.9) * 1e6,
+               r->reads / ops, r->writes / ops, (i + 1 < count) ? "," : "");
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
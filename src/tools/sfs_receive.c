@@ -0,0 +1,66 @@
+/* sfs_receive.c: 把增量应用到映像 */
+
+#include "sfs/delta.h"
+#include "sfs/disk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+
+/* 主程序 */
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <image> <blocks> <delta>\n", program);
+    fprintf(stderr, "    -c              Enable block checksums\n");
+    fprintf(stderr, "Applies a delta written by sfs_send (\"-\" reads it from standard input).\n");
+}
+
+int main(int argc, char *argv[]) {
+    DiskOptions options = {0};
+    int         option;
+
+    while ((option = getopt(argc, argv, "ch")) != -1) {
+        switch (option) {
+            case 'c': options.checksums = true; break;
+            default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 3) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *path = argv[optind + 2];
+    int         fd   = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    Disk *disk = disk_open_with(argv[optind], strtoul(argv[optind + 1], NULL, 10), &options);
+    if (disk == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", argv[optind], strerror(errno));
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    DeltaStats stats;
+    bool       success = delta_receive(disk, fd, &stats);
+    close(fd);
+
+    if (success) {
+        printf("received %zu blocks in %zu runs (%zu bytes), checkpoint %u to %u\n",
+               stats.blocks, stats.runs, stats.bytes, stats.since, stats.until);
+    } else {
+        fprintf(stderr, "receive failed after %zu blocks!\n", stats.blocks);
+    }
+
+    disk_close(disk);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
@@ -0,0 +1,145 @@
+/* sfs_replay.c: 重放块I/O跟踪 */
+
+#include "sfs/disk.h"
+#include "sfs/stats.h"
+#include "sfs/trace.h"
+#include "sfs/utils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+/* 结构 */
+
+typedef struct Replay Replay;
+struct Replay {
+    size_t      records;                        /* 跟踪中的记录数 */
+    size_t      replayed;                       /* 重放的记录数 */
+    size_t      skipped;                        /* 块编号超出磁盘而跳过的记录数 */
+    size_t      errors;                         /* 重放时失败的操作数 */
+    size_t      traced_errors;                  /* 记录时就失败的操作数 */
+    uint64_t    traced_latency;                 /* 记录时所有操作的总耗时（纳秒） */
+    uint64_t    max_lag;                        /* 按原速重放时最多落后于计划的时间（纳秒） */
+};
+
+/* 主程序 */
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <trace> <image>\n", program);
+    fprintf(stderr, "    -b <blocks>     Number of blocks in the image (default from trace)\n");
+    fprintf(stderr, "    -m              Replay at maximum speed instead of original timing\n");
+    fprintf(stderr, "    -x <factor>     Speed up original timing by factor (default 1)\n");
+    fprintf(stderr, "    -l <model>      Latency model: none, constant[:us], hdd[:rpm], ssd[:channels] [,sleep]\n");
+    fprintf(stderr, "    -c              Enable block checksums\n");
+    fprintf(stderr, "Writes store a deterministic pattern: replay against a scratch copy of the image.\n");
+}
+
+int main(int argc, char *argv[]) {
+    DiskOptions options = {0};
+    size_t      blocks  = 0;
+    double      factor  = 1;
+    bool        maximum = false;
+    int         option;
+
+    while ((option = getopt(argc, argv, "b:mx:l:ch")) != -1) {
+        switch (option) {
+            case 'b': blocks = strtoul(optarg, NULL, 10); break;
+            case 'm': maximum = true; break;
+            case 'x': factor = strtod(optarg, NULL); break;
+            case 'c': options.checksums = true; break;
+            case 'l':
+                if (!model_parse(optarg, &options.model)) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 2 || factor <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *stream = fopen(argv[optind], "r");
+    if (stream == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", argv[optind], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    TraceHeader header;
+    if (!trace_read_header(stream, &header) || header.block_size != BLOCK_SIZE) {
+        fprintf(stderr, "%s is not a block I/O trace for %d byte blocks\n", argv[optind], BLOCK_SIZE);
+        fclose(stream);
+        return EXIT_FAILURE;
+    }
+
+    Disk *disk = disk_open_with(argv[optind + 1], blocks ? blocks : header.blocks, &options);
+    if (disk == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", argv[optind + 1], strerror(errno));
+        fclose(stream);
+        return EXIT_FAILURE;
+    }
+
+    Replay      replay = {0};
+    TraceRecord record;
+    char        data[BLOCK_SIZE];
+    uint64_t    start  = stats_now();
+
+    while (trace_read(stream, &record)) {
+        replay.records++;
+        replay.traced_latency += record.latency;
+        replay.traced_errors  += record.status != 0;
+
+        if (record.block >= disk->blocks) {
+            replay.skipped++;
+            continue;
+        }
+
+        if (!maximum) {
+            uint64_t target = start + (uint64_t)(record.timestamp / factor);
+            uint64_t now    = stats_now();
+            if (now < target) {
+                uint64_t        wait  = target - now;
+                struct timespec delay = {.tv_sec = wait / 1000000000ull, .tv_nsec = wait % 1000000000ull};
+                nanosleep(&delay, NULL);
+            } else {
+                replay.max_lag = max(replay.max_lag, now - target);
+            }
+        }
+
+        ssize_t result;
+        if (record.operation == TRACE_WRITE) {
+            memset(data, (uint8_t)record.block, BLOCK_SIZE);
+            result = disk_write(disk, record.block, data);
+        } else {
+            result = disk_read(disk, record.block, data);
+        }
+
+        replay.replayed++;
+        replay.errors += result == DISK_FAILURE;
+    }
+
+    double elapsed = (stats_now() - start) / 1e9;
+
+    printf("%zu records, %zu replayed, %zu skipped, %zu errors (%zu in trace)\n",
+           replay.records, replay.replayed, replay.skipped, replay.errors, replay.traced_errors);
+    printf("%.3f seconds, %.1f ops/s, max lag %.3f ms\n",
+           elapsed, elapsed > 0 ? replay.replayed / elapsed : 0, replay.max_lag / 1e6);
+
+    const StatsCounter *reads  = &disk->stats.counters[STATS_DISK_READ];
+    const StatsCounter *writes = &disk->stats.counters[STATS_DISK_WRITE];
+    printf("I/O time %.3f ms in trace, %.3f ms in replay\n",
+           replay.traced_latency / 1e6, (reads->nanoseconds + writes->nanoseconds) / 1e6);
+    stats_print(&disk->stats, stdout);
+
+    fclose(stream);
+    disk_close(disk);
+    return replay.errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */
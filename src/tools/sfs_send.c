@@ -0,0 +1,67 @@
+/* sfs_send.c: 发送映像自某个检查点以来的变化 */
+
+#include "sfs/delta.h"
+#include "sfs/disk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+
+/* 主程序 */
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <image> <blocks> <since> <delta>\n", program);
+    fprintf(stderr, "    -c              Enable block checksums\n");
+    fprintf(stderr, "Writes the blocks changed since checkpoint <since> (0 for the whole image) to <delta>\n");
+    fprintf(stderr, "and prints the new checkpoint to pass as <since> next time.\n");
+}
+
+int main(int argc, char *argv[]) {
+    DiskOptions options = {.track = true};
+    int         option;
+
+    while ((option = getopt(argc, argv, "ch")) != -1) {
+        switch (option) {
+            case 'c': options.checksums = true; break;
+            default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 4) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Disk *disk = disk_open_with(argv[optind], strtoul(argv[optind + 1], NULL, 10), &options);
+    if (disk == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", argv[optind], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    int fd = open(argv[optind + 3], O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s: %s\n", argv[optind + 3], strerror(errno));
+        disk_close(disk);
+        return EXIT_FAILURE;
+    }
+
+    DeltaStats stats;
+    bool       success = delta_send(disk, strtoul(argv[optind + 2], NULL, 10), fd, &stats);
+    success = close(fd) == 0 && success;
+
+    if (success) {
+        printf("sent %zu blocks in %zu runs (%zu bytes) since checkpoint %u\n",
+               stats.blocks, stats.runs, stats.bytes, stats.since);
+        printf("checkpoint %u\n", stats.until);
+    } else {
+        fprintf(stderr, "send failed!\n");
+    }
+
+    disk_close(disk);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set expandtab sts=4 sw=4 ts=8 ft=c: */